@@ -0,0 +1,722 @@
+#define _GNU_SOURCE // For opendir(), stat() and POSIX file I/O
+#include "corpus_pipeline.h"
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/***************************/
+/*   CONSTANT DEFINITIONS  */
+/***************************/
+
+#define PATH_SEPARATOR ','            // Separates paths in a corpus spec
+#define INITIAL_FILE_CAPACITY 16      // First allocation of a file list
+#define MIN_SPAN_CAPACITY 256         // Smallest span array for a file
+#define BYTES_PER_SPAN_GUESS 8        // Initial span array size per file byte
+#define DEFAULT_IO_DEPTH 4            // Reads in flight per reader
+#define NANOS_PER_SECOND 1e9
+#define READ_ERROR "Error: could not read corpus file "
+#define ALLOCATION_ERROR "Allocation failure: Failed to allocate memory\n"
+
+/***************************/
+/*   STRUCTURE DEFINITIONS */
+/***************************/
+
+/**
+ * Progress of one file through the pipeline.
+ */
+typedef enum SlotState {
+    SLOT_FREE,        // Not in use
+    SLOT_READING,     // A reader is loading the file
+    SLOT_READ,        // Loaded, waiting for a tokenizer
+    SLOT_TOKENIZING,  // A tokenizer is scanning it
+    SLOT_READY        // Tokenized (or failed), waiting for the consumer
+} SlotState;
+
+/**
+ * Slot structure.
+ * One file in flight. File i always uses slot i % window.
+ */
+typedef struct Slot {
+    SlotState state;    // Pipeline stage of the file
+    int file_index;     // Index in the file list
+    char *text;         // File contents
+    size_t length;      // Bytes in text
+    TokenSpan *spans;   // Tokens of text
+    size_t span_count;  // Number of spans
+    bool failed;        // Reading or tokenizing failed
+} Slot;
+
+/**
+ * Pipeline structure.
+ * State shared by the reader, tokenizer and consumer threads, guarded by
+ * one mutex. Work items are whole files, so the lock is taken a handful
+ * of times per file and never contended in the steady state.
+ */
+typedef struct Pipeline {
+    const CorpusFiles *files;   // Files to read
+    Slot *slots;                // window slots
+    int window;                 // Number of slots
+    int next_to_read;           // Next file a reader may claim
+    int next_to_consume;        // Next file the consumer waits for
+    bool stop;                  // Consumer finished early or failed
+    ReadBackend backend;        // Backend requested for the readers
+    int io_depth;               // Reads in flight per reader
+    PipelineStats stats;        // Read figures, summed over readers
+    pthread_mutex_t lock;       // Guards everything above
+    pthread_cond_t changed;     // Broadcast on every state change
+} Pipeline;
+
+/***************************/
+/*   FILE LISTS            */
+/***************************/
+
+/**
+ * Copy length bytes of a string into a new NUL-terminated string.
+ *
+ * @return New string, or NULL on allocation failure
+ */
+static char *copy_string(const char *source, size_t length)
+{
+    char *copy = malloc(length + 1);
+    if (copy != NULL)
+    {
+        memcpy(copy, source, length);
+        copy[length] = '\0';
+    }
+    return copy;
+}
+
+/**
+ * Append a path to a file list, taking ownership of it.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int append_file(CorpusFiles *files, int *capacity, char *path)
+{
+    if (path == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+    if (files->count == *capacity)
+    {
+        int new_capacity = *capacity ? *capacity * 2 : INITIAL_FILE_CAPACITY;
+        char **paths = realloc(files->paths, new_capacity * sizeof(char *));
+        if (paths == NULL)
+        {
+            free(path);
+            return EXIT_FAILURE;
+        }
+        files->paths = paths;
+        *capacity = new_capacity;
+    }
+    files->paths[files->count++] = path;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * qsort comparator ordering paths by name.
+ */
+static int compare_paths(const void *first, const void *second)
+{
+    return strcmp(*(char *const *)first, *(char *const *)second);
+}
+
+/**
+ * Append the regular files of a directory, in name order.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+static int append_directory(CorpusFiles *files, int *capacity,
+                            const char *directory)
+{
+    DIR *dir = opendir(directory);
+    if (dir == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    int first = files->count;
+    size_t dir_length = strlen(directory);
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+        {
+            continue;  // ".", ".." and hidden files
+        }
+
+        size_t name_length = strlen(entry->d_name);
+        char *path = malloc(dir_length + name_length + 2);
+        if (path == NULL)
+        {
+            closedir(dir);
+            return EXIT_FAILURE;
+        }
+        memcpy(path, directory, dir_length);
+        path[dir_length] = '/';
+        memcpy(path + dir_length + 1, entry->d_name, name_length + 1);
+
+        struct stat info;
+        if (stat(path, &info) != 0 || !S_ISREG(info.st_mode))
+        {
+            free(path);
+            continue;
+        }
+        if (append_file(files, capacity, path) == EXIT_FAILURE)
+        {
+            closedir(dir);
+            return EXIT_FAILURE;
+        }
+    }
+    closedir(dir);
+
+    qsort(files->paths + first, files->count - first, sizeof(char *),
+          compare_paths);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Expand a corpus specification into a list of files.
+ *
+ * @param spec Comma-separated files and directories
+ * @param files List to fill
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE otherwise
+ */
+int list_corpus_files(const char *spec, CorpusFiles *files)
+{
+    files->paths = NULL;
+    files->count = 0;
+    int capacity = 0;
+
+    while (*spec)
+    {
+        const char *end = strchr(spec, PATH_SEPARATOR);
+        size_t length = end ? (size_t)(end - spec) : strlen(spec);
+        char *path = copy_string(spec, length);
+        struct stat info;
+        int result = EXIT_FAILURE;
+
+        if (path != NULL && length > 0 && stat(path, &info) == 0)
+        {
+            if (S_ISDIR(info.st_mode))
+            {
+                result = append_directory(files, &capacity, path);
+                free(path);
+            }
+            else
+            {
+                result = append_file(files, &capacity, path);
+            }
+        }
+        else
+        {
+            free(path);
+        }
+
+        if (result == EXIT_FAILURE)
+        {
+            free_corpus_files(files);
+            return EXIT_FAILURE;
+        }
+        spec += length + (end ? 1 : 0);
+    }
+
+    if (files->count == 0)
+    {
+        free_corpus_files(files);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Free the paths of a file list.
+ *
+ * @param files List to empty
+ */
+void free_corpus_files(CorpusFiles *files)
+{
+    for (int i = 0; i < files->count; i++)
+    {
+        free(files->paths[i]);
+    }
+    free(files->paths);
+    files->paths = NULL;
+    files->count = 0;
+}
+
+/***************************/
+/*   PIPELINE STAGES       */
+/***************************/
+
+/**
+ * Current monotonic time in seconds.
+ *
+ * @return Seconds since an arbitrary fixed point
+ */
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / NANOS_PER_SECOND;
+}
+
+/**
+ * Load a whole file into memory.
+ *
+ * The file is cut into PIPELINE_READ_CHUNK pieces and up to depth of them
+ * are kept in flight on the queue, so the device always has work queued
+ * while earlier pieces complete. A short read is resubmitted for its
+ * remainder; a read at end of file (the file shrank) ends the text there.
+ *
+ * @param path File to read
+ * @param queue Reader's read queue
+ * @param depth Most reads to keep in flight
+ * @param slot Slot receiving text and length
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+static int read_whole_file(const char *path, ReadQueue *queue, int depth,
+                           Slot *slot)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return EXIT_FAILURE;
+    }
+
+    size_t size = (size_t)info.st_size;
+    char *text = malloc(size + 1);
+    off_t *offsets = malloc(depth * sizeof(off_t));  // Pending read per tag
+    size_t *remaining = malloc(depth * sizeof(size_t));
+    int *free_tags = malloc(depth * sizeof(int));
+    bool failed = text == NULL || offsets == NULL || remaining == NULL
+                  || free_tags == NULL;
+    size_t next = 0;         // Next byte not yet requested
+    size_t end = size;       // Bytes actually present
+    int in_flight = 0;
+    int free_count = 0;
+    for (int tag = depth - 1; !failed && tag >= 0; tag--)
+    {
+        free_tags[free_count++] = tag;
+    }
+
+    while (!failed && (next < end || in_flight > 0))
+    {
+        // Keep the queue full
+        while (next < end && free_count > 0)
+        {
+            int tag = free_tags[--free_count];
+            size_t length = end - next < PIPELINE_READ_CHUNK
+                            ? end - next : PIPELINE_READ_CHUNK;
+            offsets[tag] = (off_t)next;
+            remaining[tag] = length;
+            if (read_queue_submit(queue, fd, text + next, length, (off_t)next,
+                                  tag) == EXIT_FAILURE)
+            {
+                free_tags[free_count++] = tag;
+                failed = true;
+                break;
+            }
+            next += length;
+            in_flight++;
+        }
+        if (in_flight == 0)
+        {
+            break;
+        }
+
+        int tag;
+        ssize_t result;
+        if (read_queue_wait(queue, &tag, &result) == EXIT_FAILURE)
+        {
+            failed = true;
+            break;
+        }
+        in_flight--;
+
+        if (result < 0)
+        {
+            failed = true;
+        }
+        else if (result == 0 || (size_t)result == remaining[tag])
+        {
+            if (result == 0 && (size_t)offsets[tag] < end)
+            {
+                end = (size_t)offsets[tag];  // File shrank since fstat()
+            }
+            free_tags[free_count++] = tag;
+        }
+        else
+        {
+            // Short read - ask for the rest of the piece
+            offsets[tag] += result;
+            remaining[tag] -= (size_t)result;
+            if (read_queue_submit(queue, fd, text + offsets[tag], remaining[tag],
+                                  offsets[tag], tag) == EXIT_FAILURE)
+            {
+                failed = true;
+            }
+            else
+            {
+                in_flight++;
+            }
+        }
+    }
+
+    // Drain reads still in flight after an error before freeing the buffer
+    int tag;
+    ssize_t result;
+    while (in_flight > 0 && read_queue_wait(queue, &tag, &result) == EXIT_SUCCESS)
+    {
+        in_flight--;
+    }
+
+    close(fd);
+    free(offsets);
+    free(remaining);
+    free(free_tags);
+    if (failed)
+    {
+        if (in_flight == 0)
+        {
+            free(text);  // Otherwise a lost read may still write into it
+        }
+        return EXIT_FAILURE;
+    }
+    slot->text = text;
+    slot->length = end;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Find all token spans of a loaded file.
+ *
+ * @param slot Slot holding the text; receives spans and span_count
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int tokenize_file(Slot *slot)
+{
+    size_t capacity = slot->length / BYTES_PER_SPAN_GUESS + MIN_SPAN_CAPACITY;
+    size_t count = 0;
+    size_t base = 0;
+    TokenSpan *spans = malloc(capacity * sizeof(TokenSpan));
+    if (spans == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    while (base < slot->length)
+    {
+        if (count == capacity)
+        {
+            TokenSpan *grown = realloc(spans, 2 * capacity * sizeof(TokenSpan));
+            if (grown == NULL)
+            {
+                free(spans);
+                return EXIT_FAILURE;
+            }
+            spans = grown;
+            capacity *= 2;
+        }
+
+        size_t resume = 0;
+        size_t found = find_token_spans(slot->text + base, slot->length - base,
+                                        spans + count, capacity - count,
+                                        &resume);
+        for (size_t i = count; i < count + found; i++)
+        {
+            spans[i].offset += base;
+        }
+        count += found;
+        base += resume;
+    }
+
+    slot->spans = spans;
+    slot->span_count = count;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Reader thread: claim the next file inside the window and load it.
+ *
+ * @param arg Pipeline
+ * @return NULL
+ */
+static void *reader_thread(void *arg)
+{
+    Pipeline *pipeline = arg;
+    int count = pipeline->files->count;
+    ReadQueue *queue = create_read_queue(pipeline->io_depth, pipeline->backend);
+
+    pthread_mutex_lock(&pipeline->lock);
+    if (queue != NULL)
+    {
+        pipeline->stats.backend = read_queue_backend(queue);
+    }
+    while (!pipeline->stop && pipeline->next_to_read < count)
+    {
+        if (pipeline->next_to_read >= pipeline->next_to_consume + pipeline->window)
+        {
+            pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+            continue;
+        }
+
+        int index = pipeline->next_to_read++;
+        Slot *slot = &pipeline->slots[index % pipeline->window];
+        slot->state = SLOT_READING;
+        slot->file_index = index;
+        slot->failed = false;
+        pthread_mutex_unlock(&pipeline->lock);
+
+        double start = now_seconds();
+        bool failed = queue == NULL
+                      || read_whole_file(pipeline->files->paths[index], queue,
+                                         pipeline->io_depth, slot)
+                         == EXIT_FAILURE;
+        double elapsed = now_seconds() - start;
+
+        pthread_mutex_lock(&pipeline->lock);
+        if (!failed)
+        {
+            pipeline->stats.bytes_read += slot->length;
+            pipeline->stats.files_read++;
+            pipeline->stats.read_seconds += elapsed;
+        }
+        slot->failed = failed;
+        slot->state = failed ? SLOT_READY : SLOT_READ;
+        pthread_cond_broadcast(&pipeline->changed);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    free_read_queue(&queue);
+    return NULL;
+}
+
+/**
+ * Find a loaded file waiting for a tokenizer.
+ *
+ * @param pipeline Pipeline (lock held)
+ * @param pending Set to true if some file may still become READ
+ * @return Slot to tokenize, or NULL
+ */
+static Slot *find_read_slot(Pipeline *pipeline, bool *pending)
+{
+    *pending = pipeline->next_to_read < pipeline->files->count;
+    for (int i = 0; i < pipeline->window; i++)
+    {
+        Slot *slot = &pipeline->slots[i];
+        if (slot->state == SLOT_READ)
+        {
+            return slot;
+        }
+        if (slot->state == SLOT_READING)
+        {
+            *pending = true;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Tokenizer thread: turn loaded files into token spans.
+ *
+ * @param arg Pipeline
+ * @return NULL
+ */
+static void *tokenizer_thread(void *arg)
+{
+    Pipeline *pipeline = arg;
+
+    pthread_mutex_lock(&pipeline->lock);
+    while (!pipeline->stop)
+    {
+        bool pending = false;
+        Slot *slot = find_read_slot(pipeline, &pending);
+        if (slot == NULL)
+        {
+            if (!pending)
+            {
+                break;  // Every file has been read and claimed
+            }
+            pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+            continue;
+        }
+
+        slot->state = SLOT_TOKENIZING;
+        pthread_mutex_unlock(&pipeline->lock);
+
+        bool failed = tokenize_file(slot) == EXIT_FAILURE;
+
+        pthread_mutex_lock(&pipeline->lock);
+        slot->failed = failed;
+        slot->state = SLOT_READY;
+        pthread_cond_broadcast(&pipeline->changed);
+    }
+    pthread_mutex_unlock(&pipeline->lock);
+    return NULL;
+}
+
+/**
+ * Release a slot's buffers.
+ *
+ * @param slot Slot to empty
+ */
+static void clear_slot(Slot *slot)
+{
+    free(slot->text);
+    free(slot->spans);
+    slot->text = NULL;
+    slot->spans = NULL;
+    slot->length = 0;
+    slot->span_count = 0;
+    slot->state = SLOT_FREE;
+}
+
+/**
+ * Consume every file in list order on the calling thread.
+ *
+ * @param pipeline Running pipeline
+ * @param consumer Token consumer
+ * @param context Consumer context
+ * @return EXIT_SUCCESS, or EXIT_FAILURE on error
+ */
+static int consume_files(Pipeline *pipeline, span_consumer_t consumer,
+                         void *context)
+{
+    for (int index = 0; index < pipeline->files->count; index++)
+    {
+        Slot *slot = &pipeline->slots[index % pipeline->window];
+
+        pthread_mutex_lock(&pipeline->lock);
+        while (slot->state != SLOT_READY || slot->file_index != index)
+        {
+            pthread_cond_wait(&pipeline->changed, &pipeline->lock);
+        }
+        pthread_mutex_unlock(&pipeline->lock);
+
+        int result = EXIT_FAILURE;
+        if (slot->failed)
+        {
+            fprintf(stdout, "%s%s\n", READ_ERROR, pipeline->files->paths[index]);
+        }
+        else
+        {
+            result = consumer(context, slot->text, slot->length, slot->spans,
+                              slot->span_count);
+        }
+
+        pthread_mutex_lock(&pipeline->lock);
+        clear_slot(slot);
+        pipeline->next_to_consume++;
+        pthread_cond_broadcast(&pipeline->changed);
+        pthread_mutex_unlock(&pipeline->lock);
+
+        if (result != EXIT_SUCCESS)
+        {
+            return result == PIPELINE_STOP ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/***************************/
+/*   PIPELINE              */
+/***************************/
+
+/**
+ * Read and tokenize a list of files in parallel, consuming them in order.
+ *
+ * @param files Files to read
+ * @param config Thread counts
+ * @param consumer Called once per file on the calling thread
+ * @param context Passed through to consumer
+ * @param stats Receives read throughput figures (may be NULL)
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int run_corpus_pipeline(const CorpusFiles *files, const PipelineConfig *config,
+                        span_consumer_t consumer, void *context,
+                        PipelineStats *stats)
+{
+    double start = now_seconds();
+    int readers = config->readers > 0 ? config->readers : 1;
+    int tokenizers = config->tokenizers > 0 ? config->tokenizers : 1;
+    int threads_wanted = readers + tokenizers;
+
+    Pipeline pipeline;
+    pipeline.files = files;
+    pipeline.window = config->window > 0 ? config->window : threads_wanted + 1;
+    pipeline.next_to_read = 0;
+    pipeline.next_to_consume = 0;
+    pipeline.stop = false;
+    pipeline.backend = config->backend;
+    pipeline.io_depth = config->io_depth > 0 ? config->io_depth
+                                             : DEFAULT_IO_DEPTH;
+    memset(&pipeline.stats, 0, sizeof(PipelineStats));
+    pipeline.stats.backend = config->backend;
+    pipeline.slots = calloc(pipeline.window, sizeof(Slot));
+    pthread_t *threads = malloc(threads_wanted * sizeof(pthread_t));
+    if (pipeline.slots == NULL || threads == NULL)
+    {
+        free(pipeline.slots);
+        free(threads);
+        fprintf(stdout, ALLOCATION_ERROR);
+        return EXIT_FAILURE;
+    }
+    pthread_mutex_init(&pipeline.lock, NULL);
+    pthread_cond_init(&pipeline.changed, NULL);
+
+    int started = 0;
+    int result = EXIT_SUCCESS;
+    for (int i = 0; i < threads_wanted; i++)
+    {
+        void *(*body)(void *) = i < readers ? reader_thread : tokenizer_thread;
+        if (pthread_create(&threads[i], NULL, body, &pipeline) != 0)
+        {
+            result = EXIT_FAILURE;
+            break;
+        }
+        started++;
+    }
+
+    // Consume only if every stage has at least one thread running
+    if (result == EXIT_SUCCESS)
+    {
+        result = consume_files(&pipeline, consumer, context);
+    }
+
+    pthread_mutex_lock(&pipeline.lock);
+    pipeline.stop = true;
+    pthread_cond_broadcast(&pipeline.changed);
+    pthread_mutex_unlock(&pipeline.lock);
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Files loaded but never consumed after an early stop
+    for (int i = 0; i < pipeline.window; i++)
+    {
+        clear_slot(&pipeline.slots[i]);
+    }
+    pipeline.stats.wall_seconds = now_seconds() - start;
+    if (stats != NULL)
+    {
+        *stats = pipeline.stats;
+    }
+    pthread_cond_destroy(&pipeline.changed);
+    pthread_mutex_destroy(&pipeline.lock);
+    free(pipeline.slots);
+    free(threads);
+    return result;
+}
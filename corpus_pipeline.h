@@ -0,0 +1,100 @@
+#ifndef _CORPUS_PIPELINE_H_
+#define _CORPUS_PIPELINE_H_
+#include <stdlib.h> // For size_t
+#include "tokenizer.h"
+#include "read_queue.h"
+
+/**
+ * Extra return value of a span_consumer_t: stop reading, without error.
+ */
+#define PIPELINE_STOP 2
+
+#define PIPELINE_READ_CHUNK (1 << 20)  // Bytes per read request (1 MiB)
+
+/**
+ * CorpusFiles structure.
+ * Ordered list of the files making up a corpus.
+ */
+typedef struct CorpusFiles {
+    char **paths;  // File paths, in reading order
+    int count;     // Number of paths
+} CorpusFiles;
+
+/**
+ * PipelineConfig structure.
+ * Thread counts of run_corpus_pipeline().
+ */
+typedef struct PipelineConfig {
+    int readers;     // Threads reading files into memory
+    int tokenizers;  // Threads turning file contents into token spans
+    int window;      // Most files in memory at once (0 = readers + tokenizers + 1)
+    ReadBackend backend;  // How readers issue their reads
+    int io_depth;    // Reads each reader keeps in flight (0 = default)
+} PipelineConfig;
+
+/**
+ * PipelineStats structure.
+ * Read throughput measured by run_corpus_pipeline().
+ */
+typedef struct PipelineStats {
+    size_t bytes_read;     // Bytes loaded from all files
+    int files_read;        // Files loaded
+    double read_seconds;   // Time readers spent loading, summed over readers
+    double wall_seconds;   // Time from start to the last file consumed
+    ReadBackend backend;   // Backend the readers ended up using
+} PipelineStats;
+
+// Function pointer type receiving every token of one file, in order
+typedef int (*span_consumer_t)(void *context, const char *text,
+                               size_t length, const TokenSpan *spans,
+                               size_t count);
+
+/**
+ * Expand a corpus specification into a list of files.
+ *
+ * The specification is a comma-separated list of paths. A file is taken
+ * as is; a directory contributes its regular files (not recursing, skipping
+ * names starting with '.') in name order, so shard files dated
+ * YYYY-MM-DD are read chronologically.
+ *
+ * @param spec Corpus specification
+ * @param files List to fill
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if a path cannot be used,
+ *         no file was found, or allocation failed
+ */
+int list_corpus_files(const char *spec, CorpusFiles *files);
+
+/**
+ * Free the paths of a file list.
+ *
+ * @param files List to empty
+ */
+void free_corpus_files(CorpusFiles *files);
+
+/**
+ * Read and tokenize a list of files in parallel, consuming them in order.
+ *
+ * Reader threads load whole files, each keeping io_depth reads of
+ * PIPELINE_READ_CHUNK bytes in flight through a ReadQueue (io_uring where
+ * available, a pread thread pool otherwise). Tokenizer threads find their
+ * token spans (with hashes and terminal flags) and the calling thread
+ * passes each tokenized file to consumer, strictly in list order, so
+ * results do not depend on thread timing. At most window files are held
+ * in memory; readers wait for the consumer to catch up before starting
+ * further files.
+ *
+ * @param files Files to read
+ * @param config Thread counts and I/O settings
+ * @param consumer Called once per file on the calling thread; returns
+ *        EXIT_SUCCESS to continue, PIPELINE_STOP to stop early or
+ *        EXIT_FAILURE to abort
+ * @param context Passed through to consumer
+ * @param stats Receives read throughput figures (may be NULL)
+ * @return EXIT_SUCCESS if all files (or all until PIPELINE_STOP) were
+ *         consumed, EXIT_FAILURE on read, allocation or consumer error
+ */
+int run_corpus_pipeline(const CorpusFiles *files, const PipelineConfig *config,
+                        span_consumer_t consumer, void *context,
+                        PipelineStats *stats);
+
+#endif //_CORPUS_PIPELINE_H_
@@ -0,0 +1,161 @@
+#include "count_min_sketch.h"
+#include <math.h> // For ceil(), log()
+
+/***************************/
+/*   CONSTANT DEFINITIONS  */
+/***************************/
+
+#define EULER 2.718281828459045      // Width factor from the CMS error bound
+#define SEED_BASE 0x9E3779B97F4A7C15ULL // Golden-ratio increment for row seeds
+
+/**
+ * Mix a key with a row seed into a well-distributed hash (splitmix64 finalizer).
+ *
+ * @param key Key to hash
+ * @param seed Row seed
+ * @return 64-bit hash
+ */
+static uint64_t mix_hash(uint64_t key, uint64_t seed)
+{
+    uint64_t z = key + seed;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Create a count-min sketch with width ceil(e / epsilon) and
+ * depth ceil(ln(1 / delta)).
+ *
+ * @param epsilon Relative overestimate bound
+ * @param delta Failure probability
+ * @return Pointer to the new sketch, or NULL on failure
+ */
+CountMinSketch *create_count_min_sketch(double epsilon, double delta)
+{
+    if (epsilon <= 0 || epsilon >= 1 || delta <= 0 || delta >= 1)
+    {
+        return NULL;  // Bounds outside (0, 1)
+    }
+
+    CountMinSketch *sketch = malloc(sizeof(CountMinSketch));
+    if (sketch == NULL)
+    {
+        return NULL;
+    }
+
+    sketch->width = (int)ceil(EULER / epsilon);
+    sketch->depth = (int)ceil(log(1 / delta));
+    sketch->total = 0;
+    sketch->counters = calloc((size_t)sketch->width * sketch->depth,
+                              sizeof(unsigned int));
+    sketch->seeds = malloc(sketch->depth * sizeof(uint64_t));
+    if (sketch->counters == NULL || sketch->seeds == NULL)
+    {
+        free_count_min_sketch(&sketch);
+        return NULL;
+    }
+
+    // Independent-looking seeds for every row
+    for (int row = 0; row < sketch->depth; row++)
+    {
+        sketch->seeds[row] = (uint64_t)(row + 1) * SEED_BASE;
+    }
+
+    return sketch;
+}
+
+/**
+ * Find the counter of key in the given row.
+ *
+ * @param sketch Sketch to index
+ * @param row Row number
+ * @param key Key to locate
+ * @return Pointer to the counter
+ */
+static unsigned int *counter_of(const CountMinSketch *sketch, int row,
+                                uint64_t key)
+{
+    size_t column = mix_hash(key, sketch->seeds[row]) % sketch->width;
+    return &sketch->counters[(size_t)row * sketch->width + column];
+}
+
+/**
+ * Conservatively increment key and return its new estimate.
+ *
+ * @param sketch Sketch to update
+ * @param key Key to count
+ * @return New estimate of key's count
+ */
+unsigned int count_min_sketch_add(CountMinSketch *sketch, uint64_t key)
+{
+    unsigned int estimate = count_min_sketch_estimate(sketch, key) + 1;
+
+    // Raise only the counters that fall below the new estimate
+    for (int row = 0; row < sketch->depth; row++)
+    {
+        unsigned int *counter = counter_of(sketch, row, key);
+        if (*counter < estimate)
+        {
+            *counter = estimate;
+        }
+    }
+
+    sketch->total++;
+    return estimate;
+}
+
+/**
+ * Estimate the count of key as the minimum over all rows.
+ *
+ * @param sketch Sketch to query
+ * @param key Key to look up
+ * @return Estimated count
+ */
+unsigned int count_min_sketch_estimate(const CountMinSketch *sketch,
+                                       uint64_t key)
+{
+    unsigned int estimate = *counter_of(sketch, 0, key);
+
+    for (int row = 1; row < sketch->depth; row++)
+    {
+        unsigned int counter = *counter_of(sketch, row, key);
+        if (counter < estimate)
+        {
+            estimate = counter;
+        }
+    }
+
+    return estimate;
+}
+
+/**
+ * Bytes used by the sketch.
+ *
+ * @param sketch Sketch to measure
+ * @return Size in bytes
+ */
+size_t count_min_sketch_memory_usage(const CountMinSketch *sketch)
+{
+    return sizeof(CountMinSketch) +
+           (size_t)sketch->width * sketch->depth * sizeof(unsigned int) +
+           sketch->depth * sizeof(uint64_t);
+}
+
+/**
+ * Free the sketch's arrays and the sketch itself.
+ *
+ * @param sketch_ptr Pointer to the sketch pointer
+ */
+void free_count_min_sketch(CountMinSketch **sketch_ptr)
+{
+    if (sketch_ptr == NULL || *sketch_ptr == NULL)
+    {
+        return;
+    }
+
+    free((*sketch_ptr)->counters);
+    free((*sketch_ptr)->seeds);
+    free(*sketch_ptr);
+    *sketch_ptr = NULL;
+}
@@ -0,0 +1,68 @@
+#ifndef _COUNT_MIN_SKETCH_H_
+#define _COUNT_MIN_SKETCH_H_
+#include <stdlib.h> // For malloc()
+#include <stdint.h> // For uint64_t
+
+/**
+ * CountMinSketch structure.
+ * A fixed-size table of depth rows by width counters. Every key increments
+ * one counter per row; its count is estimated as the smallest of those
+ * counters, which never underestimates and overestimates by at most
+ * epsilon * total with probability at least 1 - delta.
+ */
+typedef struct CountMinSketch {
+    unsigned int *counters;    // depth * width counters, row after row
+    uint64_t *seeds;           // One hash seed per row
+    int width;                 // Counters per row, ceil(e / epsilon)
+    int depth;                 // Number of rows, ceil(ln(1 / delta))
+    unsigned long total;       // Sum of all increments
+} CountMinSketch;
+
+/**
+ * Create a count-min sketch sized for the given error bounds.
+ *
+ * @param epsilon Relative overestimate bound (0 < epsilon < 1)
+ * @param delta Probability of exceeding the bound (0 < delta < 1)
+ * @return Pointer to the new sketch, or NULL on invalid bounds or allocation failure
+ */
+CountMinSketch *create_count_min_sketch(double epsilon, double delta);
+
+/**
+ * Increment the count of key by one and return its new estimate.
+ *
+ * Uses conservative update: only the counters currently holding the
+ * minimum are raised, which tightens estimates without breaking the
+ * never-underestimate guarantee.
+ *
+ * @param sketch Sketch to update
+ * @param key Key to count
+ * @return Estimated count of key after the increment
+ */
+unsigned int count_min_sketch_add(CountMinSketch *sketch, uint64_t key);
+
+/**
+ * Estimate the count of key.
+ *
+ * @param sketch Sketch to query
+ * @param key Key to look up
+ * @return Estimated count (never less than the true count)
+ */
+unsigned int count_min_sketch_estimate(const CountMinSketch *sketch,
+                                       uint64_t key);
+
+/**
+ * Bytes used by the sketch, including its struct.
+ *
+ * @param sketch Sketch to measure
+ * @return Size in bytes
+ */
+size_t count_min_sketch_memory_usage(const CountMinSketch *sketch);
+
+/**
+ * Free a count-min sketch and set the pointer to NULL.
+ *
+ * @param sketch_ptr Pointer to the sketch pointer
+ */
+void free_count_min_sketch(CountMinSketch **sketch_ptr);
+
+#endif //_COUNT_MIN_SKETCH_H_
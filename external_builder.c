@@ -0,0 +1,459 @@
+#define _POSIX_C_SOURCE 200809L // For getpid() and access()
+#include "external_builder.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/***************************/
+/*   CONSTANT DEFINITIONS  */
+/***************************/
+
+#define PENDING_BUDGET_SHARE 8     // Pending pairs take 1/8 of the budget
+#define RUN_BUDGET_SHARE 4         // In-memory runs spill beyond 1/4 of it
+#define PENDING_PAIR_BYTES (2 * sizeof(unsigned long long)) // Pair and sort copy
+#define SPILL_BUFFER_BYTES (1024 * 1024)  // stdio buffer of a run being spilled
+#define RUN_BUFFER_BYTES (256 * 1024)     // Smallest read buffer of a merged run
+#define MAX_MERGE_WAY 256          // Most run files open in one merge
+#define RUN_PATH_EXTRA 64          // Room for the name of a file in the directory
+#define FLAG 1                     // Constant true value for infinite loops
+
+/***************************/
+/*   STRUCTURE DEFINITIONS */
+/***************************/
+
+/**
+ * RunReader structure.
+ * A run file being merged, positioned on its current record.
+ */
+typedef struct RunReader {
+    FILE *file;              // Run file
+    char *buffer;            // stdio buffer of file
+    unsigned long long key;  // Key of the current record
+    unsigned int count;      // Count of the current record
+} RunReader;
+
+// Receives the merged records in ascending key order
+typedef int (*record_sink_t)(void *context, unsigned long long key,
+                             unsigned int count);
+
+/***************************/
+/*   HELPER FUNCTIONS      */
+/***************************/
+
+/**
+ * Name of a run (or scratch) file in the builder's directory.
+ *
+ * The process id keeps builders of different processes sharing a
+ * directory apart.
+ *
+ * @param builder Builder owning the file
+ * @param kind "run" or "values"
+ * @param number Number of the run
+ * @return Newly allocated path, or NULL on allocation error
+ */
+static char *builder_file_path(const ExternalBuilder *builder,
+                               const char *kind, int number)
+{
+    size_t size = strlen(builder->directory) + RUN_PATH_EXTRA;
+    char *path = malloc(size);
+    if (path == NULL)
+    {
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        return NULL;
+    }
+    snprintf(path, size, "%s/markov-%s-%ld-%d", builder->directory, kind,
+             (long)getpid(), number);
+    return path;
+}
+
+/**
+ * Open a run file with a buffer of its own.
+ *
+ * @param builder Builder owning the file
+ * @param number Number of the run
+ * @param mode "wb" or "rb"
+ * @param buffer_bytes Size of the stdio buffer
+ * @param buffer Receives the buffer, to free after fclose()
+ * @return The open file, or NULL on I/O or allocation error
+ */
+static FILE *open_run_file(const ExternalBuilder *builder, int number,
+                           const char *mode, size_t buffer_bytes,
+                           char **buffer)
+{
+    char *path = builder_file_path(builder, "run", number);
+    FILE *file = (path != NULL) ? fopen(path, mode) : NULL;
+    free(path);
+    *buffer = (file != NULL) ? malloc(buffer_bytes) : NULL;
+    if (*buffer == NULL ||
+        setvbuf(file, *buffer, _IOFBF, buffer_bytes) != 0)
+    {
+        if (file != NULL)
+        {
+            fclose(file);
+        }
+        free(*buffer);
+        *buffer = NULL;
+        return NULL;
+    }
+    return file;
+}
+
+/**
+ * Delete a run file.
+ *
+ * @param builder Builder owning the file
+ * @param number Number of the run
+ */
+static void remove_run_file(const ExternalBuilder *builder, int number)
+{
+    char *path = builder_file_path(builder, "run", number);
+    if (path != NULL)
+    {
+        remove(path);
+        free(path);
+    }
+}
+
+/**
+ * Append one record to a run file.
+ *
+ * @param context The run file (FILE *)
+ * @param key Transition key
+ * @param count Observations of the transition
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on I/O error
+ */
+static int write_record(void *context, unsigned long long key,
+                        unsigned int count)
+{
+    FILE *file = context;
+    return (fwrite(&key, sizeof(key), 1, file) == 1 &&
+            fwrite(&count, sizeof(count), 1, file) == 1)
+           ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Move a run reader to its next record.
+ *
+ * @param reader Reader to advance
+ * @return true if a record was read, false at the end of the file or on
+ *         error (tell them apart with ferror())
+ */
+static bool read_record(RunReader *reader)
+{
+    return fread(&reader->key, sizeof(reader->key), 1, reader->file) == 1 &&
+           fread(&reader->count, sizeof(reader->count), 1, reader->file) == 1;
+}
+
+/**
+ * Pass a matrix entry on to a MatrixStream.
+ *
+ * @param context The stream (MatrixStream *)
+ * @param key Transition key
+ * @param count Observations of the transition
+ * @return As matrix_stream_add()
+ */
+static int stream_record(void *context, unsigned long long key,
+                         unsigned int count)
+{
+    return matrix_stream_add(context, (uint32_t)(key >> PAIR_ID_BITS),
+                             (uint32_t)(key & PAIR_ID_MASK), count);
+}
+
+/**
+ * Restore the heap order below a position of a heap of run readers.
+ *
+ * @param heap Readers, smallest current key first
+ * @param size Readers in the heap
+ * @param index Position whose reader may be too large
+ */
+static void sift_down(RunReader **heap, int size, int index)
+{
+    while (FLAG)
+    {
+        int smallest = index;
+        int left = 2 * index + 1;
+        int right = left + 1;
+        if (left < size && heap[left]->key < heap[smallest]->key)
+        {
+            smallest = left;
+        }
+        if (right < size && heap[right]->key < heap[smallest]->key)
+        {
+            smallest = right;
+        }
+        if (smallest == index)
+        {
+            return;
+        }
+        RunReader *swap = heap[index];
+        heap[index] = heap[smallest];
+        heap[smallest] = swap;
+        index = smallest;
+    }
+}
+
+/**
+ * Merge consecutive run files into one ordered stream of records.
+ *
+ * Records with equal keys in several runs are emitted once with their
+ * counts added. The run files are removed afterwards.
+ *
+ * @param builder Builder owning the runs
+ * @param first Number of the first run to merge
+ * @param count Number of runs to merge
+ * @param buffer_bytes Read buffer of every run
+ * @param sink Receives the merged records
+ * @param context Passed to sink
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on I/O, allocation or sink
+ *         error
+ */
+static int merge_run_files(const ExternalBuilder *builder, int first,
+                           int count, size_t buffer_bytes, record_sink_t sink,
+                           void *context)
+{
+    RunReader *readers = calloc(count > 0 ? count : 1, sizeof(RunReader));
+    RunReader **heap = calloc(count > 0 ? count : 1, sizeof(RunReader *));
+    int result = (readers != NULL && heap != NULL) ? EXIT_SUCCESS :
+                 EXIT_FAILURE;
+    int size = 0;
+    for (int i = 0; i < count && result == EXIT_SUCCESS; i++)
+    {
+        RunReader *reader = &readers[i];
+        reader->file = open_run_file(builder, first + i, "rb", buffer_bytes,
+                                     &reader->buffer);
+        if (reader->file == NULL || (!read_record(reader) &&
+                                     ferror(reader->file)))
+        {
+            result = EXIT_FAILURE;
+        }
+        else if (!feof(reader->file))
+        {
+            heap[size++] = reader;
+        }
+    }
+    for (int i = size / 2 - 1; i >= 0; i--)
+    {
+        sift_down(heap, size, i);
+    }
+
+    while (result == EXIT_SUCCESS && size > 0)
+    {
+        unsigned long long key = heap[0]->key;
+        unsigned int total = 0;
+        while (size > 0 && heap[0]->key == key)
+        {
+            total += heap[0]->count;
+            if (!read_record(heap[0]))
+            {
+                if (ferror(heap[0]->file))
+                {
+                    result = EXIT_FAILURE;
+                }
+                heap[0] = heap[--size];  // This run is used up
+            }
+            sift_down(heap, size, 0);
+        }
+        if (result == EXIT_SUCCESS)
+        {
+            result = sink(context, key, total);
+        }
+    }
+
+    for (int i = 0; readers != NULL && i < count; i++)
+    {
+        if (readers[i].file != NULL)
+        {
+            fclose(readers[i].file);
+        }
+        free(readers[i].buffer);
+        remove_run_file(builder, first + i);
+    }
+    free(readers);
+    free(heap);
+    return result;
+}
+
+/**
+ * Write everything the pair builder holds to a new run file.
+ *
+ * @param builder Builder to spill
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on I/O or allocation error
+ */
+static int spill_runs(ExternalBuilder *builder)
+{
+    PairRun run;
+    if (pair_builder_take_run(&builder->pairs, &run) == EXIT_FAILURE)
+    {
+        return EXIT_FAILURE;
+    }
+    if (run.length == 0)
+    {
+        return EXIT_SUCCESS;
+    }
+
+    char *buffer;
+    FILE *file = open_run_file(builder, builder->run_count, "wb",
+                               SPILL_BUFFER_BYTES, &buffer);
+    int result = (file != NULL) ? EXIT_SUCCESS : EXIT_FAILURE;
+    builder->run_count += (file != NULL);
+    for (size_t i = 0; i < run.length && result == EXIT_SUCCESS; i++)
+    {
+        result = write_record(file, run.keys[i], run.counts[i]);
+    }
+    if (file != NULL && fclose(file) != 0)
+    {
+        result = EXIT_FAILURE;
+    }
+    free(buffer);
+    builder->spilled += run.length;
+    free_pair_run(&run);
+    return result;
+}
+
+/***************************/
+/*   FUNCTION DEFINITIONS  */
+/***************************/
+
+int create_external_builder(ExternalBuilder *builder, const char *directory,
+                            const char *snapshot_path, size_t memory_budget)
+{
+    builder->directory = NULL;
+    builder->snapshot = NULL;
+    builder->memory_budget = memory_budget;
+    builder->run_budget = memory_budget / RUN_BUDGET_SHARE;
+    builder->first_run = 0;
+    builder->run_count = 0;
+    builder->spilled = 0;
+    if (memory_budget < MIN_EXTERNAL_BUDGET)
+    {
+        return EXIT_FAILURE;
+    }
+
+    // Both paths are only written after the whole corpus is read
+    struct stat info;
+    if (stat(directory, &info) != 0 || !S_ISDIR(info.st_mode) ||
+        access(directory, W_OK | X_OK) != 0 ||
+        (builder->snapshot = fopen(snapshot_path, "wb")) == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    builder->directory = malloc(strlen(directory) + 1);
+    if (builder->directory == NULL)
+    {
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        fclose(builder->snapshot);
+        builder->snapshot = NULL;
+        return EXIT_FAILURE;
+    }
+    strcpy(builder->directory, directory);
+
+    size_t capacity = memory_budget / PENDING_BUDGET_SHARE / PENDING_PAIR_BYTES;
+    if (create_pair_builder(&builder->pairs, capacity) == EXIT_FAILURE)
+    {
+        free(builder->directory);
+        builder->directory = NULL;
+        fclose(builder->snapshot);
+        builder->snapshot = NULL;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int external_builder_add(ExternalBuilder *builder, int from_id, int to_id)
+{
+    PairBuilder *pairs = &builder->pairs;
+    bool sorts = (pairs->pending_count == pairs->capacity);
+    if (pair_builder_add(pairs, from_id, to_id) == EXIT_FAILURE)
+    {
+        return EXIT_FAILURE;
+    }
+
+    // Runs only grow when the pending pairs are sorted
+    if (sorts && pair_builder_memory_usage(pairs) -
+                 pairs->capacity * PENDING_PAIR_BYTES > builder->run_budget)
+    {
+        return spill_runs(builder);
+    }
+    return EXIT_SUCCESS;
+}
+
+int write_external_snapshot(ExternalBuilder *builder,
+                            MarkovChain *markov_chain,
+                            format_func_t format_func)
+{
+    if (spill_runs(builder) == EXIT_FAILURE)
+    {
+        return EXIT_FAILURE;
+    }
+    free_pair_builder(&builder->pairs);
+
+    // Every run needs a read buffer (and a pass its output) in the budget
+    int way = (int)(builder->memory_budget / RUN_BUFFER_BYTES) - 1;
+    way = (way < MAX_MERGE_WAY) ? way : MAX_MERGE_WAY;
+    size_t buffer_bytes = builder->memory_budget / (way + 1);
+    while (builder->run_count - builder->first_run > way)
+    {
+        char *buffer;
+        FILE *file = open_run_file(builder, builder->run_count, "wb",
+                                   buffer_bytes, &buffer);
+        if (file == NULL)
+        {
+            return EXIT_FAILURE;
+        }
+        builder->run_count++;
+        int merged = merge_run_files(builder, builder->first_run, way,
+                                     buffer_bytes, write_record, file);
+        builder->first_run += way;
+        if (fclose(file) != 0 || merged == EXIT_FAILURE)
+        {
+            free(buffer);
+            return EXIT_FAILURE;
+        }
+        free(buffer);
+    }
+
+    // The stream takes over the snapshot file, whether it opens or not
+    char *scratch_path = builder_file_path(builder, "values", 0);
+    MatrixStream *stream = (scratch_path != NULL)
+                           ? open_matrix_stream(markov_chain, builder->snapshot,
+                                                scratch_path, format_func)
+                           : NULL;
+    if (scratch_path != NULL)
+    {
+        builder->snapshot = NULL;
+    }
+    free(scratch_path);
+    if (stream == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+    int merged = merge_run_files(builder, builder->first_run,
+                                 builder->run_count - builder->first_run,
+                                 buffer_bytes, stream_record, stream);
+    builder->first_run = builder->run_count;
+    int closed = close_matrix_stream(&stream);
+    return (merged == EXIT_FAILURE || closed == EXIT_FAILURE) ? EXIT_FAILURE :
+           EXIT_SUCCESS;
+}
+
+void free_external_builder(ExternalBuilder *builder)
+{
+    if (builder->directory == NULL)
+    {
+        return;
+    }
+    for (int number = builder->first_run; number < builder->run_count;
+         number++)
+    {
+        remove_run_file(builder, number);
+    }
+    if (builder->snapshot != NULL)
+    {
+        fclose(builder->snapshot);
+        builder->snapshot = NULL;
+    }
+    free_pair_builder(&builder->pairs);
+    free(builder->directory);
+    builder->directory = NULL;
+}
@@ -0,0 +1,89 @@
+#ifndef _EXTERNAL_BUILDER_H_
+#define _EXTERNAL_BUILDER_H_
+#include "pair_builder.h"
+#include "matrix_export.h"
+
+/**
+ * Smallest memory budget an external builder accepts, in bytes.
+ */
+#define MIN_EXTERNAL_BUDGET (4 * 1024 * 1024)
+
+/**
+ * ExternalBuilder structure.
+ * Out-of-core construction of a chain's transitions, for corpora whose
+ * transitions do not fit in memory. Pairs are collected in a PairBuilder
+ * whose buffers and runs take at most half of the memory budget; when the
+ * runs outgrow their share they are merged and written to a run file of
+ * sorted (state id, successor id, count) records. write_external_snapshot()
+ * then k-way merges the run files and streams the result straight into a
+ * matrix file (see matrix_export.h), which open_matrix_file() maps back.
+ *
+ * Only the transitions are kept out of memory: the states themselves are
+ * still nodes of the chain's database.
+ *
+ * The run directory is checked and the snapshot file opened when the
+ * builder is created, so a bad path fails before the corpus is read.
+ */
+typedef struct ExternalBuilder {
+    PairBuilder pairs;            // Transitions not spilled yet
+    char *directory;              // Directory the run files are written to
+    FILE *snapshot;               // Snapshot file, open until it is written
+    size_t memory_budget;         // Bytes for buffers and in-memory runs
+    size_t run_budget;            // Bytes of runs that trigger a spill
+    int first_run;                // Number of the oldest run file left
+    int run_count;                // Run files created so far
+    unsigned long long spilled;   // Records written to run files in total
+} ExternalBuilder;
+
+/**
+ * Set up an empty builder.
+ *
+ * @param builder Builder to set up
+ * @param directory Existing, writable directory for the run files
+ * @param snapshot_path Snapshot file to create or truncate now and write
+ *        in write_external_snapshot()
+ * @param memory_budget Bytes of memory to use, at least MIN_EXTERNAL_BUDGET
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on a budget that is too
+ *         small, a missing or read-only directory, a snapshot that cannot
+ *         be created or allocation error
+ */
+int create_external_builder(ExternalBuilder *builder, const char *directory,
+                            const char *snapshot_path, size_t memory_budget);
+
+/**
+ * Record one observed transition, spilling runs to disk as needed.
+ *
+ * @param builder Builder to add to
+ * @param from_id Id of the state the transition leaves
+ * @param to_id Id of the state it enters
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on I/O or allocation error
+ */
+int external_builder_add(ExternalBuilder *builder, int from_id, int to_id);
+
+/**
+ * Write every recorded transition to a matrix file of counts.
+ *
+ * The remaining pairs are spilled, the pair buffers are freed and the run
+ * files are merged, at most as many at a time as the budget has room for
+ * read buffers; earlier passes write their output as new run files. The
+ * last pass feeds a MatrixStream, so the snapshot is written front to
+ * back without the chain ever being held in memory. The run files are
+ * removed as they are consumed.
+ *
+ * @param builder Builder holding the transitions (empty afterwards)
+ * @param markov_chain Chain whose database holds the states
+ * @param format_func Writes a state's label, or NULL for no labels
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on I/O or allocation error
+ */
+int write_external_snapshot(ExternalBuilder *builder,
+                            MarkovChain *markov_chain,
+                            format_func_t format_func);
+
+/**
+ * Free a builder and remove any run files it left behind.
+ *
+ * @param builder Builder to empty
+ */
+void free_external_builder(ExternalBuilder *builder);
+
+#endif //_EXTERNAL_BUILDER_H_
@@ -0,0 +1,964 @@
+#define _GNU_SOURCE // For accept4(), epoll and eventfd
+#include "generation_server.h"
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/***************************/
+/*   CONSTANT DEFINITIONS  */
+/***************************/
+
+#define FLAG 1                         // Constant true value for infinite loops
+#define LISTEN_BACKLOG 128             // Pending connections the kernel may queue
+#define MAX_EVENTS 64                  // epoll events handled per wakeup
+#define MAX_REQUEST_LINE 128           // Longest accepted request line
+#define INITIAL_RESPONSE_CAPACITY 4096 // First allocation of a response buffer
+#define VERB_LENGTH 8                  // Buffer size for the request verb
+#define SOCKET_ERROR "Error: could not listen on the server socket\n"
+#define NO_START_ERROR "Error: chain has no state to start a sequence from\n"
+#define BAD_REQUEST_RESPONSE "ERR bad request\n"
+#define TOO_LONG_RESPONSE "ERR request line too long\n"
+#define NO_MEMORY_RESPONSE "ERR out of memory\n"
+
+/***************************/
+/*   STRUCTURE DEFINITIONS */
+/***************************/
+
+/**
+ * Connection structure.
+ * State of one client connection, owned by the event loop thread.
+ */
+typedef struct Connection {
+    int fd;                    // Socket, -1 once closed
+    char input[MAX_REQUEST_LINE];  // Bytes received but not yet parsed
+    int input_len;             // Number of bytes in input
+    char *output;              // Bytes queued for sending
+    size_t output_len;         // Number of bytes in output
+    size_t output_capacity;    // Bytes allocated for output
+    size_t output_sent;        // Bytes of output already sent
+    unsigned int events;       // epoll events currently registered
+    bool busy;                 // A request is queued or being generated
+    bool eof;                  // Peer finished sending; close once answered
+    bool closing;              // Closed; free once no job refers to it
+    struct Connection *prev;   // Previous connection in the server's list
+    struct Connection *next;   // Next connection in the server's list
+} Connection;
+
+/**
+ * Job structure.
+ * One parsed request travelling from the event loop to a worker and back.
+ */
+typedef struct Job {
+    Connection *connection;    // Connection that sent the request
+    int count;                 // Number of sequences to generate
+    unsigned long long seed;   // Seed of the request's random state
+    int max_length;            // Maximum states per sequence
+    char *response;            // Generated response, NULL on allocation failure
+    size_t response_len;       // Length of response
+    struct Job *next;          // Next job in the queue
+} Job;
+
+/**
+ * JobQueue structure.
+ * FIFO of jobs linked through Job::next.
+ */
+typedef struct JobQueue {
+    Job *head;  // Oldest job
+    Job *tail;  // Newest job
+} JobQueue;
+
+/**
+ * Server structure.
+ * Everything shared between the event loop and the workers.
+ */
+typedef struct Server {
+    MarkovChain *markov_chain;   // Chain to generate from (read only)
+    const ServerConfig *config;  // Server settings
+    StartIndex starts;           // Non-terminal states with successors
+    int listen_fd;               // Listening socket
+    int epoll_fd;                // Event loop
+    int event_fd;                // Workers signal finished jobs here
+    pthread_t *threads;          // Worker threads
+    int thread_count;            // Number of started workers
+    pthread_mutex_t lock;        // Protects pending, done and stopping
+    pthread_cond_t work_ready;   // Signalled when pending gains jobs
+    JobQueue pending;            // Jobs waiting for a worker
+    JobQueue done;               // Jobs waiting to be sent
+    bool stopping;               // Workers should exit
+    Connection *connections;     // All live connections
+} Server;
+
+// Set by the signal handler to end the event loop
+static volatile sig_atomic_t stop_requested = 0;
+
+/***************************/
+/*   FUNCTION DEFINITIONS  */
+/***************************/
+
+/**
+ * Signal handler for SIGINT/SIGTERM.
+ *
+ * @param signal_number Ignored
+ */
+static void request_stop(int signal_number)
+{
+    (void)signal_number;
+    stop_requested = 1;
+}
+
+/**
+ * Append a job list to the end of a queue.
+ *
+ * @param queue Queue to append to
+ * @param first First job of a NULL-terminated list
+ */
+static void enqueue_jobs(JobQueue *queue, Job *first)
+{
+    Job *last = first;
+    while (last->next != NULL)
+    {
+        last = last->next;
+    }
+
+    if (queue->tail == NULL)
+    {
+        queue->head = first;
+    }
+    else
+    {
+        queue->tail->next = first;
+    }
+    queue->tail = last;
+}
+
+/**
+ * Free every job in a NULL-terminated list.
+ *
+ * @param job First job of the list
+ */
+static void free_jobs(Job *job)
+{
+    while (job != NULL)
+    {
+        Job *next = job->next;
+        free(job->response);
+        free(job);
+        job = next;
+    }
+}
+
+/**
+ * Collect every state a sequence may start from.
+ *
+ * @param server Server to fill
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+static int collect_starts(Server *server)
+{
+    if (build_start_index(server->markov_chain, &server->starts) ==
+        EXIT_FAILURE)
+    {
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        return EXIT_FAILURE;
+    }
+
+    if (server->starts.count == 0)
+    {
+        fprintf(stdout, NO_START_ERROR);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Make sure a buffer has room for extra more bytes.
+ *
+ * @param buffer Buffer pointer, reallocated in place
+ * @param length Bytes in use
+ * @param capacity Bytes allocated, updated in place
+ * @param extra Bytes about to be appended
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int reserve(char **buffer, size_t length, size_t *capacity, size_t extra)
+{
+    if (length + extra <= *capacity)
+    {
+        return EXIT_SUCCESS;
+    }
+
+    size_t new_capacity = (*capacity == 0) ? INITIAL_RESPONSE_CAPACITY : *capacity;
+    while (new_capacity < length + extra)
+    {
+        new_capacity *= 2;
+    }
+
+    char *grown = realloc(*buffer, new_capacity);
+    if (grown == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+    *buffer = grown;
+    *capacity = new_capacity;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Append the text of one state to a response.
+ *
+ * @param server Server (for the format function)
+ * @param job Job whose response to extend
+ * @param capacity Bytes allocated for the response
+ * @param data State data to format
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+static int append_state(Server *server, Job *job, size_t *capacity, void *data)
+{
+    size_t room = *capacity - job->response_len;
+    int needed = server->config->format_func(data, job->response + job->response_len,
+                                             room);
+    if (needed < 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    // Did not fit: grow and format again
+    if ((size_t)needed >= room)
+    {
+        if (reserve(&job->response, job->response_len, capacity,
+                    (size_t)needed + 1) == EXIT_FAILURE)
+        {
+            return EXIT_FAILURE;
+        }
+        server->config->format_func(data, job->response + job->response_len,
+                                    *capacity - job->response_len);
+    }
+
+    job->response_len += needed;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Generate the full response of a job.
+ *
+ * On allocation failure the response is left NULL and the event loop
+ * answers with NO_MEMORY_RESPONSE instead.
+ *
+ * Sequences are generated LOCKSTEP_WALKS at a time with
+ * generate_sequences_batch(), so the memory latency of one walk overlaps
+ * with the others.
+ *
+ * @param server Server to generate from
+ * @param job Job to answer
+ * @param sequences Scratch array of LOCKSTEP_WALKS * config->max_length
+ *        node pointers
+ */
+static void generate_response(Server *server, Job *job, MarkovNode **sequences)
+{
+    MarkovChain *markov_chain = server->markov_chain;
+    size_t capacity = 0;
+    random_state_t state;
+
+    seed_random_state(&state, job->seed);
+    job->response = NULL;
+    job->response_len = 0;
+
+    if (sequences == NULL ||
+        reserve(&job->response, 0, &capacity, INITIAL_RESPONSE_CAPACITY) ==
+        EXIT_FAILURE)
+    {
+        return;
+    }
+    job->response_len = snprintf(job->response, capacity, "OK %d\n", job->count);
+
+    for (int done = 0; done < job->count; done += LOCKSTEP_WALKS)
+    {
+        MarkovNode *firsts[LOCKSTEP_WALKS];
+        int lengths[LOCKSTEP_WALKS];
+        int group = (job->count - done < LOCKSTEP_WALKS) ? job->count - done
+                                                         : LOCKSTEP_WALKS;
+
+        sample_start_nodes(&server->starts, group, firsts, &state);
+        generate_sequences_batch(markov_chain, firsts, group, job->max_length,
+                                 sequences, lengths, &state);
+
+        for (int i = 0; i < group; i++)
+        {
+            MarkovNode **sequence = sequences + (size_t)i * job->max_length;
+            for (int j = 0; j < lengths[i]; j++)
+            {
+                if (append_state(server, job, &capacity, sequence[j]->data) ==
+                    EXIT_FAILURE ||
+                    reserve(&job->response, job->response_len, &capacity, 1) ==
+                    EXIT_FAILURE)
+                {
+                    free(job->response);
+                    job->response = NULL;
+                    return;
+                }
+                job->response[job->response_len++] =
+                        (j + 1 < lengths[i]) ? ' ' : '\n';
+            }
+        }
+    }
+}
+
+/**
+ * Worker thread: take batches of pending jobs, generate, hand them back.
+ *
+ * @param arg The Server
+ * @return NULL
+ */
+static void *worker_main(void *arg)
+{
+    Server *server = arg;
+    MarkovNode **sequences = malloc((size_t)LOCKSTEP_WALKS *
+                                    server->config->max_length *
+                                    sizeof(MarkovNode *));
+    const unsigned long long one = 1;
+
+    pthread_mutex_lock(&server->lock);
+    while (FLAG)
+    {
+        while (server->pending.head == NULL && !server->stopping)
+        {
+            pthread_cond_wait(&server->work_ready, &server->lock);
+        }
+        if (server->stopping)
+        {
+            break;
+        }
+
+        // Take up to max_batch jobs in one go
+        Job *batch = server->pending.head;
+        Job *last = batch;
+        for (int taken = 1; taken < server->config->max_batch &&
+                            last->next != NULL; taken++)
+        {
+            last = last->next;
+        }
+        server->pending.head = last->next;
+        if (server->pending.head == NULL)
+        {
+            server->pending.tail = NULL;
+        }
+        last->next = NULL;
+        pthread_mutex_unlock(&server->lock);
+
+        for (Job *job = batch; job != NULL; job = job->next)
+        {
+            generate_response(server, job, sequences);
+        }
+
+        pthread_mutex_lock(&server->lock);
+        enqueue_jobs(&server->done, batch);
+        pthread_mutex_unlock(&server->lock);
+
+        // Wake the event loop; a failed write only delays delivery
+        if (write(server->event_fd, &one, sizeof(one)) < 0)
+        {
+            perror("eventfd");
+        }
+        pthread_mutex_lock(&server->lock);
+    }
+    pthread_mutex_unlock(&server->lock);
+
+    free(sequences);
+    return NULL;
+}
+
+/**
+ * Register the epoll events a connection currently needs.
+ *
+ * Reading pauses while the input buffer is full (a request is still being
+ * generated) and writing is watched only while output is pending.
+ *
+ * @param server Server
+ * @param connection Connection to update
+ */
+static void update_interest(Server *server, Connection *connection)
+{
+    if (connection->fd < 0)
+    {
+        return;
+    }
+
+    unsigned int events = 0;
+    if (!connection->eof && connection->input_len < MAX_REQUEST_LINE)
+    {
+        events |= EPOLLIN;
+    }
+    if (connection->output_sent < connection->output_len)
+    {
+        events |= EPOLLOUT;
+    }
+
+    if (events != connection->events)
+    {
+        struct epoll_event event = {.events = events, .data.ptr = connection};
+        epoll_ctl(server->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+        connection->events = events;
+    }
+}
+
+/**
+ * Close a connection's socket. The Connection itself is freed later, once
+ * no job refers to it (see reap_connections()).
+ *
+ * @param server Server
+ * @param connection Connection to close
+ */
+static void close_connection(Server *server, Connection *connection)
+{
+    if (connection->fd < 0)
+    {
+        return;
+    }
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    connection->fd = -1;
+    connection->closing = true;
+}
+
+/**
+ * Unlink and free a connection.
+ *
+ * @param server Server
+ * @param connection Connection to free
+ */
+static void free_connection(Server *server, Connection *connection)
+{
+    if (connection->prev != NULL)
+    {
+        connection->prev->next = connection->next;
+    }
+    else
+    {
+        server->connections = connection->next;
+    }
+    if (connection->next != NULL)
+    {
+        connection->next->prev = connection->prev;
+    }
+
+    if (connection->fd >= 0)
+    {
+        close(connection->fd);
+    }
+    free(connection->output);
+    free(connection);
+}
+
+/**
+ * Free every closed connection that no job refers to any more.
+ *
+ * @param server Server
+ */
+static void reap_connections(Server *server)
+{
+    Connection *connection = server->connections;
+    while (connection != NULL)
+    {
+        Connection *next = connection->next;
+        if (connection->closing && !connection->busy)
+        {
+            free_connection(server, connection);
+        }
+        connection = next;
+    }
+}
+
+/**
+ * Close a connection whose peer stopped sending once it has been answered.
+ *
+ * @param server Server
+ * @param connection Connection to check
+ */
+static void close_if_finished(Server *server, Connection *connection)
+{
+    if (connection->eof && !connection->busy &&
+        connection->output_len == 0 && connection->input_len == 0)
+    {
+        close_connection(server, connection);
+    }
+}
+
+/**
+ * Send as much queued output as the socket accepts.
+ *
+ * @param server Server
+ * @param connection Connection to flush
+ */
+static void flush_output(Server *server, Connection *connection)
+{
+    while (connection->fd >= 0 && connection->output_sent < connection->output_len)
+    {
+        ssize_t sent = send(connection->fd,
+                            connection->output + connection->output_sent,
+                            connection->output_len - connection->output_sent,
+                            MSG_NOSIGNAL);
+        if (sent < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                close_connection(server, connection);
+            }
+            break;
+        }
+        connection->output_sent += sent;
+    }
+
+    if (connection->output_sent == connection->output_len)
+    {
+        connection->output_sent = 0;
+        connection->output_len = 0;
+        close_if_finished(server, connection);
+    }
+    update_interest(server, connection);
+}
+
+/**
+ * Queue bytes for sending and try to send them right away.
+ *
+ * @param server Server
+ * @param connection Connection to answer
+ * @param text Bytes to send
+ * @param length Number of bytes
+ */
+static void queue_output(Server *server, Connection *connection,
+                         const char *text, size_t length)
+{
+    if (connection->fd < 0)
+    {
+        return;
+    }
+    if (reserve(&connection->output, connection->output_len,
+                &connection->output_capacity, length) == EXIT_FAILURE)
+    {
+        close_connection(server, connection);
+        return;
+    }
+    memcpy(connection->output + connection->output_len, text, length);
+    connection->output_len += length;
+    flush_output(server, connection);
+}
+
+/**
+ * Parse one request line into a job.
+ *
+ * The line must hold exactly the four fields; trailing text is rejected.
+ *
+ * @param server Server (for the limits)
+ * @param line NUL-terminated request line without the newline
+ * @param job Job to fill
+ * @return EXIT_SUCCESS if the request is valid, EXIT_FAILURE otherwise
+ */
+static int parse_request(Server *server, const char *line, Job *job)
+{
+    char verb[VERB_LENGTH];
+    int end = 0;
+    if (sscanf(line, "%7s %d %llu %d %n", verb, &job->count, &job->seed,
+               &job->max_length, &end) != 4 ||
+        line[end] != '\0' || strcmp(verb, SERVER_REQUEST_VERB) != 0)
+    {
+        return EXIT_FAILURE;
+    }
+    if (job->count < 0 || job->count > server->config->max_count ||
+        job->max_length < 1 || job->max_length > server->config->max_length)
+    {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Turn buffered request lines into jobs, one at a time per connection.
+ *
+ * Invalid lines are answered immediately, and a final line the peer ended
+ * with EOF is handled like any other. The first valid line is queued
+ * for the workers and parsing pauses until its response has been queued,
+ * which keeps responses in request order.
+ *
+ * @param server Server
+ * @param connection Connection with buffered input
+ */
+static void dispatch_requests(Server *server, Connection *connection)
+{
+    while (connection->fd >= 0 && !connection->busy)
+    {
+        char *newline = memchr(connection->input, '\n', connection->input_len);
+        if (newline == NULL && connection->eof && connection->input_len > 0 &&
+            connection->input_len < MAX_REQUEST_LINE)
+        {
+            // The peer ended its last request with EOF instead of a newline
+            newline = connection->input + connection->input_len;
+            connection->input_len++;
+        }
+        if (newline == NULL)
+        {
+            if (connection->input_len == MAX_REQUEST_LINE)
+            {
+                queue_output(server, connection, TOO_LONG_RESPONSE,
+                             strlen(TOO_LONG_RESPONSE));
+                close_connection(server, connection);
+            }
+            break;
+        }
+
+        // Cut the line out of the input buffer
+        *newline = '\0';
+        if (newline > connection->input && newline[-1] == '\r')
+        {
+            newline[-1] = '\0';
+        }
+        char line[MAX_REQUEST_LINE];
+        strcpy(line, connection->input);
+        int consumed = (int)(newline - connection->input) + 1;
+        memmove(connection->input, connection->input + consumed,
+                connection->input_len - consumed);
+        connection->input_len -= consumed;
+
+        Job *job = calloc(1, sizeof(Job));
+        if (job == NULL)
+        {
+            queue_output(server, connection, NO_MEMORY_RESPONSE,
+                         strlen(NO_MEMORY_RESPONSE));
+            continue;
+        }
+        if (parse_request(server, line, job) == EXIT_FAILURE)
+        {
+            free(job);
+            queue_output(server, connection, BAD_REQUEST_RESPONSE,
+                         strlen(BAD_REQUEST_RESPONSE));
+            continue;
+        }
+
+        job->connection = connection;
+        connection->busy = true;
+        pthread_mutex_lock(&server->lock);
+        enqueue_jobs(&server->pending, job);
+        pthread_cond_signal(&server->work_ready);
+        pthread_mutex_unlock(&server->lock);
+    }
+    close_if_finished(server, connection);
+    update_interest(server, connection);
+}
+
+/**
+ * Accept every pending connection on the listening socket.
+ *
+ * @param server Server
+ */
+static void accept_connections(Server *server)
+{
+    while (FLAG)
+    {
+        int fd = accept4(server->listen_fd, NULL, NULL,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            break;  // EAGAIN: no more pending connections
+        }
+
+        Connection *connection = calloc(1, sizeof(Connection));
+        if (connection == NULL)
+        {
+            close(fd);
+            continue;
+        }
+        connection->fd = fd;
+        connection->events = EPOLLIN;
+        connection->next = server->connections;
+        if (server->connections != NULL)
+        {
+            server->connections->prev = connection;
+        }
+        server->connections = connection;
+
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = connection};
+        if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0)
+        {
+            close_connection(server, connection);
+        }
+    }
+}
+
+/**
+ * Read whatever a connection has sent and dispatch complete requests.
+ *
+ * @param server Server
+ * @param connection Readable connection
+ */
+static void read_requests(Server *server, Connection *connection)
+{
+    while (connection->fd >= 0 && connection->input_len < MAX_REQUEST_LINE)
+    {
+        ssize_t received = recv(connection->fd,
+                                connection->input + connection->input_len,
+                                MAX_REQUEST_LINE - connection->input_len, 0);
+        if (received == 0)
+        {
+            connection->eof = true;  // Answer what was sent, then close
+            break;
+        }
+        if (received < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                close_connection(server, connection);
+                return;
+            }
+            break;
+        }
+        connection->input_len += received;
+    }
+
+    dispatch_requests(server, connection);
+}
+
+/**
+ * Send the responses of every finished job.
+ *
+ * @param server Server
+ */
+static void deliver_responses(Server *server)
+{
+    unsigned long long finished;
+    if (read(server->event_fd, &finished, sizeof(finished)) < 0)
+    {
+        return;  // Spurious wakeup
+    }
+
+    pthread_mutex_lock(&server->lock);
+    Job *job = server->done.head;
+    server->done.head = NULL;
+    server->done.tail = NULL;
+    pthread_mutex_unlock(&server->lock);
+
+    while (job != NULL)
+    {
+        Job *next = job->next;
+        Connection *connection = job->connection;
+        connection->busy = false;
+
+        if (job->response != NULL)
+        {
+            queue_output(server, connection, job->response, job->response_len);
+        }
+        else
+        {
+            queue_output(server, connection, NO_MEMORY_RESPONSE,
+                         strlen(NO_MEMORY_RESPONSE));
+        }
+        dispatch_requests(server, connection);
+
+        free(job->response);
+        free(job);
+        job = next;
+    }
+}
+
+/**
+ * Create, bind and listen on the Unix domain socket.
+ *
+ * @param path Filesystem path of the socket
+ * @return Listening socket, or -1 on error
+ */
+static int listen_on(const char *path)
+{
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path))
+    {
+        return -1;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+
+    unlink(path);  // Remove a stale socket from a previous run
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0 ||
+        listen(fd, LISTEN_BACKLOG) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Open the sockets, epoll instance and eventfd, and start the workers.
+ *
+ * @param server Server to set up
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+static int start_server(Server *server)
+{
+    server->listen_fd = listen_on(server->config->socket_path);
+    server->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    server->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (server->listen_fd < 0 || server->epoll_fd < 0 || server->event_fd < 0)
+    {
+        fprintf(stdout, SOCKET_ERROR);
+        return EXIT_FAILURE;
+    }
+
+    // The listening socket is tagged NULL, the eventfd with the server
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->listen_fd, &event);
+    event.data.ptr = server;
+    epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, server->event_fd, &event);
+
+    server->threads = malloc(server->config->workers * sizeof(pthread_t));
+    if (server->threads == NULL)
+    {
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < server->config->workers; i++)
+    {
+        if (pthread_create(&server->threads[i], NULL, worker_main, server) != 0)
+        {
+            return EXIT_FAILURE;
+        }
+        server->thread_count++;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Stop the workers and release every resource of the server.
+ *
+ * @param server Server to tear down
+ */
+static void stop_server(Server *server)
+{
+    pthread_mutex_lock(&server->lock);
+    server->stopping = true;
+    pthread_cond_broadcast(&server->work_ready);
+    pthread_mutex_unlock(&server->lock);
+
+    for (int i = 0; i < server->thread_count; i++)
+    {
+        pthread_join(server->threads[i], NULL);
+    }
+
+    free_jobs(server->pending.head);
+    free_jobs(server->done.head);
+    while (server->connections != NULL)
+    {
+        free_connection(server, server->connections);
+    }
+
+    if (server->listen_fd >= 0)
+    {
+        close(server->listen_fd);
+        unlink(server->config->socket_path);
+    }
+    if (server->epoll_fd >= 0)
+    {
+        close(server->epoll_fd);
+    }
+    if (server->event_fd >= 0)
+    {
+        close(server->event_fd);
+    }
+    pthread_mutex_destroy(&server->lock);
+    pthread_cond_destroy(&server->work_ready);
+    free(server->threads);
+    free_start_index(&server->starts);
+}
+
+/**
+ * Run the event loop until SIGINT or SIGTERM.
+ *
+ * @param markov_chain Trained chain to generate from
+ * @param config Server settings
+ * @return EXIT_SUCCESS after a clean shutdown, EXIT_FAILURE on setup error
+ */
+int run_generation_server(MarkovChain *markov_chain, const ServerConfig *config)
+{
+    Server server;
+    memset(&server, 0, sizeof(server));
+    server.markov_chain = markov_chain;
+    server.config = config;
+    server.listen_fd = -1;
+    server.epoll_fd = -1;
+    server.event_fd = -1;
+    pthread_mutex_init(&server.lock, NULL);
+    pthread_cond_init(&server.work_ready, NULL);
+
+    // No SA_RESTART, so a signal interrupts epoll_wait()
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = request_stop;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    if (collect_starts(&server) == EXIT_FAILURE ||
+        start_server(&server) == EXIT_FAILURE)
+    {
+        stop_server(&server);
+        return EXIT_FAILURE;
+    }
+
+    struct epoll_event events[MAX_EVENTS];
+    while (!stop_requested)
+    {
+        int ready = epoll_wait(server.epoll_fd, events, MAX_EVENTS, -1);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;  // Signal: the loop condition decides
+            }
+            break;
+        }
+
+        for (int i = 0; i < ready; i++)
+        {
+            void *tag = events[i].data.ptr;
+            if (tag == NULL)
+            {
+                accept_connections(&server);
+            }
+            else if (tag == &server)
+            {
+                deliver_responses(&server);
+            }
+            else
+            {
+                Connection *connection = tag;
+                if (events[i].events & (EPOLLERR | EPOLLHUP))
+                {
+                    close_connection(&server, connection);
+                    continue;
+                }
+                if (events[i].events & EPOLLOUT)
+                {
+                    flush_output(&server, connection);
+                }
+                if (events[i].events & EPOLLIN)
+                {
+                    read_requests(&server, connection);
+                }
+            }
+        }
+
+        // Connections closed during this round are freed only now
+        reap_connections(&server);
+    }
+
+    stop_server(&server);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,54 @@
+#ifndef _GENERATION_SERVER_H_
+#define _GENERATION_SERVER_H_
+
+#include "markov_chain.h"
+
+/**
+ * Line protocol spoken over the Unix domain socket.
+ *
+ * Request (one per line, nothing else on it; the last line may end at
+ * EOF instead of a newline):
+ *     GEN <count> <seed> <max_length>\n
+ *
+ * Response:
+ *     OK <count>\n
+ *     <state> <state> ... <state>\n      (count lines, one per sequence)
+ * or
+ *     ERR <reason>\n
+ *
+ * Every sequence starts at a random non-terminal state and follows the
+ * same rules as generate_random_sequence(). Equal seeds give equal
+ * responses. A connection may send its next request as soon as it has
+ * written the previous one; responses come back in order.
+ */
+#define SERVER_REQUEST_VERB "GEN"
+
+/**
+ * ServerConfig structure.
+ * Settings for run_generation_server().
+ */
+typedef struct ServerConfig {
+    const char *socket_path;    // Filesystem path of the listening socket
+    int workers;                // Generation threads in the pool
+    int max_batch;              // Requests a worker takes from the queue at once
+    int max_count;              // Largest <count> accepted per request
+    int max_length;             // Largest <max_length> accepted per request
+    format_func_t format_func;  // Writes one state's text into a buffer
+} ServerConfig;
+
+/**
+ * Serve generation requests until SIGINT or SIGTERM.
+ *
+ * The chain must be fully trained (and ideally frozen) before the call and
+ * is only read while serving. One epoll event loop accepts connections and
+ * parses requests; a pool of worker threads takes queued requests in
+ * batches, generates with per-request random states and hands the
+ * responses back to the event loop through an eventfd.
+ *
+ * @param markov_chain Trained chain to generate from
+ * @param config Server settings
+ * @return EXIT_SUCCESS after a clean shutdown, EXIT_FAILURE on setup error
+ */
+int run_generation_server(MarkovChain *markov_chain, const ServerConfig *config);
+
+#endif //_GENERATION_SERVER_H_
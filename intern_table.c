@@ -0,0 +1,192 @@
+#include "intern_table.h"
+#include "tokenizer.h"
+#include <string.h> // For memcmp(), memset(), strlen()
+
+/***************************/
+/*   CONSTANT DEFINITIONS  */
+/***************************/
+
+#define INITIAL_INTERN_CAPACITY 1024  // Slots of a new table (power of two)
+#define MAX_LOAD_NUMERATOR 3          // Grow beyond 3/4 occupancy
+#define MAX_LOAD_DENOMINATOR 4
+
+/***************************/
+/*   HELPER FUNCTIONS      */
+/***************************/
+
+/**
+ * Put an entry into the first free slot of its probe sequence.
+ *
+ * @param entries Slot array
+ * @param capacity Number of slots (power of two)
+ * @param entry Entry to place
+ */
+static void place_entry(InternEntry *entries, size_t capacity,
+                        InternEntry entry)
+{
+    size_t mask = capacity - 1;
+    size_t slot = entry.hash & mask;
+    while (entries[slot].node != NULL)
+    {
+        slot = (slot + 1) & mask;
+    }
+    entries[slot] = entry;
+}
+
+/**
+ * Double the number of slots and re-place every entry.
+ *
+ * @param table Table to grow
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int grow_intern_table(InternTable *table)
+{
+    size_t capacity = table->capacity * 2;
+    InternEntry *entries = calloc(capacity, sizeof(InternEntry));
+    if (entries == NULL)
+    {
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        if (table->entries[i].node != NULL)
+        {
+            place_entry(entries, capacity, table->entries[i]);
+        }
+    }
+    free(table->entries);
+    table->entries = entries;
+    table->capacity = capacity;
+    return EXIT_SUCCESS;
+}
+
+/***************************/
+/*   INTERN TABLE          */
+/***************************/
+
+/**
+ * Create an empty intern table.
+ *
+ * @return Pointer to the new table, or NULL on allocation failure
+ */
+InternTable *create_intern_table(void)
+{
+    InternTable *table = malloc(sizeof(InternTable));
+    if (table == NULL)
+    {
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        return NULL;
+    }
+
+    table->entries = calloc(INITIAL_INTERN_CAPACITY, sizeof(InternEntry));
+    if (table->entries == NULL)
+    {
+        free(table);
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        return NULL;
+    }
+    table->capacity = INITIAL_INTERN_CAPACITY;
+    table->size = 0;
+    return table;
+}
+
+/**
+ * Find the node holding a word.
+ *
+ * Hash and length are compared first, so the word bytes are only read
+ * again (by memcmp) for a probable match.
+ *
+ * @param table Table to search
+ * @param word Word bytes
+ * @param length Length of the word
+ * @param hash hash_token() of the word
+ * @return Matching node, or NULL if the word is not interned
+ */
+MarkovNode *intern_table_find(const InternTable *table, const char *word,
+                              size_t length, unsigned long hash)
+{
+    size_t mask = table->capacity - 1;
+    size_t slot = hash & mask;
+
+    while (table->entries[slot].node != NULL)
+    {
+        const InternEntry *entry = &table->entries[slot];
+        if (entry->hash == hash && entry->length == length
+            && memcmp(entry->node->data, word, length) == 0)
+        {
+            return entry->node;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+/**
+ * Intern a node whose word is known not to be in the table yet.
+ *
+ * @param table Table to update
+ * @param node Database node holding the word
+ * @param length Length of the word
+ * @param hash hash_token() of the word
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+int intern_table_insert(InternTable *table, MarkovNode *node, size_t length,
+                        unsigned long hash)
+{
+    if ((table->size + 1) * MAX_LOAD_DENOMINATOR
+        > table->capacity * MAX_LOAD_NUMERATOR)
+    {
+        if (grow_intern_table(table) == EXIT_FAILURE)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    InternEntry entry = {hash, length, node};
+    place_entry(table->entries, table->capacity, entry);
+    table->size++;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Re-intern every node of a chain of NUL-terminated strings.
+ *
+ * @param table Table to refill
+ * @param markov_chain Chain whose database to index
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+int intern_table_rebuild(InternTable *table, MarkovChain *markov_chain)
+{
+    memset(table->entries, 0, table->capacity * sizeof(InternEntry));
+    table->size = 0;
+
+    for (Node *node = markov_chain->database->first; node; node = node->next)
+    {
+        const char *word = node->data->data;
+        size_t length = strlen(word);
+        if (intern_table_insert(table, node->data, length,
+                                hash_token(word, length)) == EXIT_FAILURE)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Free an intern table.
+ *
+ * @param table_ptr Pointer to the table pointer, set to NULL
+ */
+void free_intern_table(InternTable **table_ptr)
+{
+    if (table_ptr == NULL || *table_ptr == NULL)
+    {
+        return;
+    }
+    free((*table_ptr)->entries);
+    free(*table_ptr);
+    *table_ptr = NULL;
+}
@@ -0,0 +1,76 @@
+#ifndef _INTERN_TABLE_H_
+#define _INTERN_TABLE_H_
+#include "markov_chain.h"
+
+/**
+ * InternEntry structure.
+ * One word of the chain's database, keyed by its hash and length.
+ */
+typedef struct InternEntry {
+    unsigned long hash;   // hash_token() of the word
+    size_t length;        // Length of the word in bytes
+    MarkovNode *node;     // Database node holding the word, NULL if empty
+} InternEntry;
+
+/**
+ * InternTable structure.
+ * Open-addressing hash table from word bytes to the MarkovNode holding
+ * them. Lets the string ingest path find a word's node in O(1) with one
+ * memcmp, instead of get_node_from_database()'s comp_func scan of the
+ * whole database. Entries point into the chain, so the table must be
+ * rebuilt after anything that removes database nodes (pruning).
+ */
+typedef struct InternTable {
+    InternEntry *entries;  // capacity slots, linear probing
+    size_t capacity;       // Number of slots (power of two)
+    size_t size;           // Number of occupied slots
+} InternTable;
+
+/**
+ * Create an empty intern table.
+ *
+ * @return Pointer to the new table, or NULL on allocation failure
+ */
+InternTable *create_intern_table(void);
+
+/**
+ * Find the node holding a word.
+ *
+ * @param table Table to search
+ * @param word Word bytes (need not be NUL-terminated)
+ * @param length Length of the word
+ * @param hash hash_token() of the word
+ * @return Matching node, or NULL if the word is not interned
+ */
+MarkovNode *intern_table_find(const InternTable *table, const char *word,
+                              size_t length, unsigned long hash);
+
+/**
+ * Intern a node whose word is known not to be in the table yet.
+ *
+ * @param table Table to update (grows as needed)
+ * @param node Database node holding the word
+ * @param length Length of the word
+ * @param hash hash_token() of the word
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+int intern_table_insert(InternTable *table, MarkovNode *node, size_t length,
+                        unsigned long hash);
+
+/**
+ * Re-intern every node of a chain of NUL-terminated strings.
+ *
+ * @param table Table to refill
+ * @param markov_chain Chain whose database to index
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+int intern_table_rebuild(InternTable *table, MarkovChain *markov_chain);
+
+/**
+ * Free an intern table (the nodes it points to are not touched).
+ *
+ * @param table_ptr Pointer to the table pointer, set to NULL
+ */
+void free_intern_table(InternTable **table_ptr);
+
+#endif //_INTERN_TABLE_H_
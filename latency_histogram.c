@@ -0,0 +1,146 @@
+#include "latency_histogram.h"
+#include <string.h> // For memset()
+
+/***************************/
+/*   CONSTANT DEFINITIONS  */
+/***************************/
+
+#define SUB_BUCKETS (1ULL << HISTOGRAM_SUB_BITS)        // Exact range
+#define HALF_SUB_BUCKETS (1ULL << (HISTOGRAM_SUB_BITS - 1))  // Buckets per octave
+
+/**
+ * Bucket index of a value.
+ *
+ * Values below SUB_BUCKETS map to themselves. Larger values are shifted
+ * right by e until they fit in [SUB_BUCKETS / 2, SUB_BUCKETS), and every
+ * e owns HALF_SUB_BUCKETS consecutive buckets.
+ *
+ * @param value Value to place
+ * @return Bucket index
+ */
+static int bucket_of(unsigned long long value)
+{
+    if (value < SUB_BUCKETS)
+    {
+        return (int)value;
+    }
+
+    int shift = 0;
+    while ((value >> shift) >= SUB_BUCKETS)
+    {
+        shift++;
+    }
+    return (int)(shift * HALF_SUB_BUCKETS + (value >> shift));
+}
+
+/**
+ * Smallest value that falls in a bucket.
+ *
+ * @param bucket Bucket index
+ * @return Lower bound of the bucket
+ */
+static unsigned long long bucket_floor(int bucket)
+{
+    if ((unsigned long long)bucket < SUB_BUCKETS)
+    {
+        return (unsigned long long)bucket;
+    }
+
+    int shift = (int)(bucket / HALF_SUB_BUCKETS) - 1;
+    unsigned long long sub = bucket - shift * HALF_SUB_BUCKETS;
+    return sub << shift;
+}
+
+/**
+ * Empty a histogram.
+ *
+ * @param histogram Histogram to reset
+ */
+void histogram_reset(LatencyHistogram *histogram)
+{
+    memset(histogram, 0, sizeof(LatencyHistogram));
+}
+
+/**
+ * Record one value.
+ *
+ * @param histogram Histogram to update
+ * @param value Value to record
+ */
+void histogram_record(LatencyHistogram *histogram, unsigned long long value)
+{
+    histogram->counts[bucket_of(value)]++;
+    if (histogram->total == 0 || value < histogram->min)
+    {
+        histogram->min = value;
+    }
+    if (value > histogram->max)
+    {
+        histogram->max = value;
+    }
+    histogram->total++;
+    histogram->sum += (double)value;
+}
+
+/**
+ * Add every value of one histogram to another.
+ *
+ * @param into Histogram to add to
+ * @param from Histogram to add
+ */
+void histogram_merge(LatencyHistogram *into, const LatencyHistogram *from)
+{
+    if (from->total == 0)
+    {
+        return;
+    }
+
+    for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+    {
+        into->counts[bucket] += from->counts[bucket];
+    }
+    if (into->total == 0 || from->min < into->min)
+    {
+        into->min = from->min;
+    }
+    if (from->max > into->max)
+    {
+        into->max = from->max;
+    }
+    into->total += from->total;
+    into->sum += from->sum;
+}
+
+/**
+ * Value at the given percentile.
+ *
+ * @param histogram Histogram to query
+ * @param percentile Percentile in [0, 100]
+ * @return Lower bound of the bucket holding that percentile
+ */
+unsigned long long histogram_percentile(const LatencyHistogram *histogram,
+                                        double percentile)
+{
+    if (histogram->total == 0)
+    {
+        return 0;
+    }
+
+    // Rank of the wanted value, 1-based
+    long rank = (long)(percentile / 100.0 * histogram->total + 0.5);
+    if (rank < 1)
+    {
+        rank = 1;
+    }
+
+    long seen = 0;
+    for (int bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+    {
+        seen += histogram->counts[bucket];
+        if (seen >= rank)
+        {
+            return bucket_floor(bucket);
+        }
+    }
+    return histogram->max;
+}
@@ -0,0 +1,56 @@
+#ifndef _LATENCY_HISTOGRAM_H_
+#define _LATENCY_HISTOGRAM_H_
+#include <stdlib.h> // For size_t
+
+#define HISTOGRAM_SUB_BITS 7  // 2^6 buckets per power of two (< 1.6% error)
+#define HISTOGRAM_BUCKETS ((66 - HISTOGRAM_SUB_BITS) << (HISTOGRAM_SUB_BITS - 1))
+
+/**
+ * LatencyHistogram structure.
+ * HDR-style log-linear histogram: values below 2^HISTOGRAM_SUB_BITS are
+ * counted exactly, larger values in buckets whose width is at most 1/64 of
+ * the value, so any 64-bit value is recorded in O(1) with bounded relative
+ * error.
+ */
+typedef struct LatencyHistogram {
+    long counts[HISTOGRAM_BUCKETS];  // Number of values per bucket
+    long total;                      // Number of values recorded
+    unsigned long long min;          // Smallest value recorded
+    unsigned long long max;          // Largest value recorded
+    double sum;                      // Sum of all values (for the mean)
+} LatencyHistogram;
+
+/**
+ * Empty a histogram.
+ *
+ * @param histogram Histogram to reset
+ */
+void histogram_reset(LatencyHistogram *histogram);
+
+/**
+ * Record one value.
+ *
+ * @param histogram Histogram to update
+ * @param value Value to record (e.g. nanoseconds)
+ */
+void histogram_record(LatencyHistogram *histogram, unsigned long long value);
+
+/**
+ * Add every value of one histogram to another.
+ *
+ * @param into Histogram to add to
+ * @param from Histogram to add
+ */
+void histogram_merge(LatencyHistogram *into, const LatencyHistogram *from);
+
+/**
+ * Value at the given percentile.
+ *
+ * @param histogram Histogram to query
+ * @param percentile Percentile in [0, 100]
+ * @return Lower bound of the bucket holding that percentile (0 if empty)
+ */
+unsigned long long histogram_percentile(const LatencyHistogram *histogram,
+                                        double percentile);
+
+#endif //_LATENCY_HISTOGRAM_H_
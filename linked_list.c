@@ -42,4 +42,46 @@ int add(LinkedList *link_list, void *data)
     // Increment the size counter
     link_list->size++;
     return 0;  // Success
+}
+
+/**
+ * Unlink the node following prev from the linked list.
+ *
+ * This function performs the following steps:
+ * 1. Finds the node to remove (the first node if prev is NULL)
+ * 2. Bridges the list over it
+ * 3. Updates the last pointer if the removed node was the tail
+ * 4. Decrements the list size
+ *
+ * @param link_list Pointer to the LinkedList to remove from
+ * @param prev Node preceding the one to remove, or NULL for the first node
+ * @return The unlinked node, or NULL if there is nothing to remove
+ */
+Node *remove_next(LinkedList *link_list, Node *prev)
+{
+    Node *removed = (prev == NULL) ? link_list->first : prev->next;
+    if (removed == NULL)
+    {
+        return NULL;  // Nothing follows prev
+    }
+
+    // Bridge over the removed node
+    if (prev == NULL)
+    {
+        link_list->first = removed->next;
+    }
+    else
+    {
+        prev->next = removed->next;
+    }
+
+    // Removing the tail moves the last pointer back to prev
+    if (link_list->last == removed)
+    {
+        link_list->last = prev;
+    }
+
+    removed->next = NULL;
+    link_list->size--;
+    return removed;
 }
\ No newline at end of file
@@ -34,4 +34,16 @@ typedef struct LinkedList {
  */
 int add(LinkedList *link_list, void *data);
 
+/**
+ * Unlink the node that follows prev in the given linked list.
+ *
+ * The unlinked node is returned to the caller, who owns it (and its data)
+ * from then on. The list's first, last and size fields are updated.
+ *
+ * @param link_list Link list to remove from
+ * @param prev Node preceding the one to remove, or NULL to remove the first
+ * @return The unlinked node, or NULL if there is no node to remove
+ */
+Node *remove_next(LinkedList *link_list, Node *prev);
+
 #endif //_LINKEDLIST_H_
\ No newline at end of file
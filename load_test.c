@@ -0,0 +1,480 @@
+#define _GNU_SOURCE // For clock_gettime()
+#include "generation_server.h"
+#include "latency_histogram.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/***************************/
+/*   CONSTANT DEFINITIONS  */
+/***************************/
+
+#define MIN_ARGS 4                     // Program, socket path, seconds, concurrency
+#define MAX_ARGS 5                     // Optional request mix
+#define MAX_MIX 16                     // Most request kinds in one mix
+#define MIX_FIELDS 3                   // count:max_length:weight
+#define DEFAULT_MIX "1:20:8,10:20:2"   // Mostly single sequences, some batches
+#define MAX_REQUEST_LINE 128           // Longest request line we send
+#define INITIAL_RESPONSE_CAPACITY 4096 // First allocation of a response buffer
+#define NANOS_PER_SECOND 1000000000ULL
+#define NANOS_PER_MICRO 1000.0
+#define BASE 10
+#define USAGE_ERROR "Usage: load_test <socket path> <seconds per level> " \
+                    "<max concurrency> [count:max_length:weight,...]\n"
+#define MIX_ERROR "Error: bad request mix\n"
+#define CONNECT_ERROR "Error: could not connect to the server socket\n"
+#define ALLOCATION_ERROR "Allocation failure: Failed to allocate memory\n"
+
+/***************************/
+/*   STRUCTURE DEFINITIONS */
+/***************************/
+
+/**
+ * RequestKind structure.
+ * One entry of the request mix, picked with probability weight / total.
+ */
+typedef struct RequestKind {
+    int count;       // Sequences per request
+    int max_length;  // Longest sequence per request
+    int weight;      // Relative frequency in the mix
+} RequestKind;
+
+/**
+ * RequestMix structure.
+ */
+typedef struct RequestMix {
+    RequestKind kinds[MAX_MIX];  // Request kinds
+    int size;                    // Number of kinds in use
+    int total_weight;            // Sum of all weights
+} RequestMix;
+
+/**
+ * Client structure.
+ * One simulated client: a connection kept busy with back-to-back requests
+ * until the deadline, recording every round trip into its own histogram.
+ */
+typedef struct Client {
+    const char *socket_path;         // Server socket
+    const RequestMix *mix;           // Requests to send
+    unsigned long long deadline;     // Monotonic time to stop at (ns)
+    unsigned long long rng;          // xorshift state for mix and seeds
+    LatencyHistogram histogram;      // Round-trip latencies (ns)
+    long errors;                     // ERR responses and broken connections
+    long sequences;                  // Sequences received
+} Client;
+
+/***************************/
+/*   HELPER FUNCTIONS      */
+/***************************/
+
+/**
+ * Current monotonic time.
+ *
+ * @return Nanoseconds since an arbitrary fixed point
+ */
+static unsigned long long now_nanos(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * NANOS_PER_SECOND
+           + (unsigned long long)ts.tv_nsec;
+}
+
+/**
+ * Advance a client's xorshift64* generator.
+ *
+ * @param state Generator state (never 0)
+ * @return Next pseudo-random value
+ */
+static unsigned long long next_random(unsigned long long *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+/**
+ * Parse a request mix of the form "count:max_length:weight,...".
+ *
+ * @param text Mix description
+ * @param mix Mix to fill
+ * @return true on success, false if the text is malformed
+ */
+static bool parse_mix(const char *text, RequestMix *mix)
+{
+    mix->size = 0;
+    mix->total_weight = 0;
+    while (*text)
+    {
+        RequestKind kind;
+        int consumed = 0;
+        if (mix->size == MAX_MIX
+            || sscanf(text, "%d:%d:%d%n", &kind.count, &kind.max_length,
+                      &kind.weight, &consumed) != MIX_FIELDS
+            || kind.count <= 0 || kind.max_length <= 0 || kind.weight <= 0)
+        {
+            return false;
+        }
+        mix->kinds[mix->size++] = kind;
+        mix->total_weight += kind.weight;
+        text += consumed;
+        if (*text == ',')
+        {
+            text++;
+        }
+        else if (*text)
+        {
+            return false;
+        }
+    }
+    return mix->size > 0;
+}
+
+/**
+ * Pick a request kind according to the mix weights.
+ *
+ * @param client Client whose generator to use
+ * @return Chosen kind
+ */
+static const RequestKind *pick_kind(Client *client)
+{
+    int target = (int)(next_random(&client->rng)
+                       % (unsigned long long)client->mix->total_weight);
+    for (int i = 0; i < client->mix->size; i++)
+    {
+        target -= client->mix->kinds[i].weight;
+        if (target < 0)
+        {
+            return &client->mix->kinds[i];
+        }
+    }
+    return &client->mix->kinds[client->mix->size - 1];
+}
+
+/**
+ * Connect to the server's Unix domain socket.
+ *
+ * @param socket_path Filesystem path of the socket
+ * @return Connected socket, or -1 on failure
+ */
+static int connect_to_server(const char *socket_path)
+{
+    struct sockaddr_un address;
+    if (strlen(socket_path) >= sizeof(address.sun_path))
+    {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Write a whole buffer to a socket.
+ *
+ * @return true on success, false if the connection broke
+ */
+static bool write_all(int fd, const char *buffer, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = write(fd, buffer, length);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (written <= 0)
+        {
+            return false;
+        }
+        buffer += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+/**
+ * Read one complete response: the status line plus, for "OK n", n lines.
+ *
+ * @param fd Connected socket
+ * @param buffer Receive buffer (grown as needed)
+ * @param capacity Size of the receive buffer
+ * @param sequences Set to n for an OK response
+ * @return 1 for OK, 0 for ERR, -1 if the connection broke
+ */
+static int read_response(int fd, char **buffer, size_t *capacity,
+                         int *sequences)
+{
+    size_t length = 0;
+    size_t scanned = 0;
+    long lines_needed = -1;  // Unknown until the status line is complete
+    long lines_seen = 0;
+    int status = -1;
+
+    while (lines_needed < 0 || lines_seen < lines_needed)
+    {
+        if (length == *capacity)
+        {
+            char *grown = realloc(*buffer, *capacity * 2);
+            if (grown == NULL)
+            {
+                return -1;
+            }
+            *buffer = grown;
+            *capacity *= 2;
+        }
+        ssize_t received = read(fd, *buffer + length, *capacity - length);
+        if (received < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (received <= 0)
+        {
+            return -1;
+        }
+        length += (size_t)received;
+
+        for (; scanned < length; scanned++)
+        {
+            if ((*buffer)[scanned] != '\n')
+            {
+                continue;
+            }
+            lines_seen++;
+            if (lines_needed < 0)
+            {
+                // Status line complete: "OK n" or "ERR reason"
+                if (sscanf(*buffer, "OK %d", sequences) == 1)
+                {
+                    status = 1;
+                    lines_needed = 1 + *sequences;
+                }
+                else
+                {
+                    status = 0;
+                    lines_needed = 1;
+                }
+            }
+        }
+    }
+    return status;
+}
+
+/**
+ * Body of one client thread: send requests back to back until the deadline.
+ *
+ * @param arg Client to run
+ * @return NULL
+ */
+static void *run_client(void *arg)
+{
+    Client *client = arg;
+    size_t capacity = INITIAL_RESPONSE_CAPACITY;
+    char *response = malloc(capacity);
+    int fd = connect_to_server(client->socket_path);
+    if (response == NULL || fd < 0)
+    {
+        client->errors++;
+        free(response);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return NULL;
+    }
+
+    char request[MAX_REQUEST_LINE];
+    while (now_nanos() < client->deadline)
+    {
+        const RequestKind *kind = pick_kind(client);
+        int length = snprintf(request, sizeof(request), "%s %d %llu %d\n",
+                              SERVER_REQUEST_VERB, kind->count,
+                              next_random(&client->rng), kind->max_length);
+
+        int sequences = 0;
+        unsigned long long start = now_nanos();
+        if (!write_all(fd, request, (size_t)length))
+        {
+            client->errors++;
+            break;
+        }
+        int status = read_response(fd, &response, &capacity, &sequences);
+        unsigned long long end = now_nanos();
+        if (status < 0)
+        {
+            client->errors++;
+            break;
+        }
+        if (status == 0)
+        {
+            client->errors++;
+            continue;
+        }
+        histogram_record(&client->histogram, end - start);
+        client->sequences += sequences;
+    }
+
+    close(fd);
+    free(response);
+    return NULL;
+}
+
+/**
+ * Run one concurrency level and print its row of the report.
+ *
+ * @param socket_path Server socket
+ * @param mix Requests to send
+ * @param concurrency Number of simultaneous clients
+ * @param seconds Duration of the level
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if no client could run
+ */
+static int run_level(const char *socket_path, const RequestMix *mix,
+                     int concurrency, int seconds)
+{
+    Client *clients = malloc(concurrency * sizeof(Client));
+    pthread_t *threads = malloc(concurrency * sizeof(pthread_t));
+    LatencyHistogram *total = malloc(sizeof(LatencyHistogram));
+    if (clients == NULL || threads == NULL || total == NULL)
+    {
+        free(clients);
+        free(threads);
+        free(total);
+        fprintf(stdout, ALLOCATION_ERROR);
+        return EXIT_FAILURE;
+    }
+
+    unsigned long long start = now_nanos();
+    unsigned long long deadline = start + seconds * NANOS_PER_SECOND;
+    int started = 0;
+    for (int i = 0; i < concurrency; i++)
+    {
+        clients[i].socket_path = socket_path;
+        clients[i].mix = mix;
+        clients[i].deadline = deadline;
+        clients[i].rng = ((unsigned long long)concurrency << 32) + i + 1;
+        clients[i].errors = 0;
+        clients[i].sequences = 0;
+        histogram_reset(&clients[i].histogram);
+        if (pthread_create(&threads[i], NULL, run_client, &clients[i]) != 0)
+        {
+            break;
+        }
+        started++;
+    }
+
+    histogram_reset(total);
+    long errors = 0;
+    long sequences = 0;
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(threads[i], NULL);
+        histogram_merge(total, &clients[i].histogram);
+        errors += clients[i].errors;
+        sequences += clients[i].sequences;
+    }
+    double elapsed = (double)(now_nanos() - start) / NANOS_PER_SECOND;
+
+    fprintf(stdout, "%11d %9ld %10.0f %10.0f %9.1f %9.1f %9.1f %9.1f %9.1f %7ld\n",
+            concurrency, total->total, total->total / elapsed,
+            sequences / elapsed,
+            histogram_percentile(total, 50.0) / NANOS_PER_MICRO,
+            histogram_percentile(total, 90.0) / NANOS_PER_MICRO,
+            histogram_percentile(total, 99.0) / NANOS_PER_MICRO,
+            histogram_percentile(total, 99.9) / NANOS_PER_MICRO,
+            total->max / NANOS_PER_MICRO, errors);
+    fflush(stdout);
+
+    int result = (started == 0 || total->total == 0) ? EXIT_FAILURE
+                                                      : EXIT_SUCCESS;
+    free(clients);
+    free(threads);
+    free(total);
+    return result;
+}
+
+/***************************/
+/*   MAIN FUNCTION         */
+/***************************/
+
+/**
+ * Load-test a running generation server (tweets_generator --serve=PATH).
+ *
+ * Runs the request mix at concurrency 1, 2, 4, ... up to the given maximum,
+ * each level for the given number of seconds, and prints one line per level
+ * with throughput and latency percentiles (microseconds).
+ *
+ * @param argc Number of arguments
+ * @param argv Arguments: socket path, seconds per level, max concurrency,
+ *             optional request mix "count:max_length:weight,..."
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+int main(int argc, char *argv[])
+{
+    if (argc < MIN_ARGS || argc > MAX_ARGS)
+    {
+        fprintf(stdout, USAGE_ERROR);
+        return EXIT_FAILURE;
+    }
+
+    const char *socket_path = argv[1];
+    int seconds = (int)strtol(argv[2], NULL, BASE);
+    int max_concurrency = (int)strtol(argv[3], NULL, BASE);
+    if (seconds <= 0 || max_concurrency <= 0)
+    {
+        fprintf(stdout, USAGE_ERROR);
+        return EXIT_FAILURE;
+    }
+
+    RequestMix mix;
+    if (!parse_mix(argc == MAX_ARGS ? argv[4] : DEFAULT_MIX, &mix))
+    {
+        fprintf(stdout, MIX_ERROR);
+        return EXIT_FAILURE;
+    }
+
+    int probe = connect_to_server(socket_path);
+    if (probe < 0)
+    {
+        fprintf(stdout, CONNECT_ERROR);
+        return EXIT_FAILURE;
+    }
+    close(probe);
+
+    fprintf(stdout, "%11s %9s %10s %10s %9s %9s %9s %9s %9s %7s\n",
+            "concurrency", "requests", "req/s", "seq/s", "p50(us)",
+            "p90(us)", "p99(us)", "p99.9(us)", "max(us)", "errors");
+    for (int concurrency = 1; ; concurrency *= 2)
+    {
+        if (concurrency > max_concurrency)
+        {
+            concurrency = max_concurrency;
+        }
+        if (run_level(socket_path, &mix, concurrency, seconds) == EXIT_FAILURE)
+        {
+            return EXIT_FAILURE;
+        }
+        if (concurrency == max_concurrency)
+        {
+            break;
+        }
+    }
+    return EXIT_SUCCESS;
+}
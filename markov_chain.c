@@ -1,5 +1,11 @@
+#define _DEFAULT_SOURCE // For MAP_ANONYMOUS, MAP_HUGETLB and madvise()
 #include "markov_chain.h"
 #include <string.h>
+#include <limits.h> // For INT_MAX
+#include <time.h>   // For clock()
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 
 /***************************/
 /*   CONSTANT DEFINITIONS  */
@@ -9,6 +15,56 @@
 #define FLAG 1           // Constant true value for infinite loop
 #define WHICH_WORD 0     // Initial accumulator for frequency selection
 #define LEN_OF_TWEET 1   // Initial sequence length counter
+#define DECAY_MAX_SHIFT 20          // Observation weight exponent that triggers renormalization
+#define DECAY_RENORMALIZE_BITS 10   // Counts are divided by 2^bits when renormalizing
+#define DECAY_COUNT_LIMIT (INT_MAX / 2)  // all_following above this triggers renormalization
+#define INITIAL_LOG_CAPACITY 1024   // First allocation of a window epoch log
+#define FANOUT_BUCKETS 24           // Power-of-two buckets in the fan-out histogram
+#define MAX_PHASES 16               // Distinct phases timed by markov_stats_phase()
+#define HUGE_PAGE_SIZE (2UL << 20)  // Size of an x86-64 / arm64 huge page
+#define SUCCESSOR_HASH_MULTIPLIER 2654435761u  // 2^32 / golden ratio
+#define SUCCESSOR_MAX_LOAD_NUMERATOR 1         // Successor tables stay half empty
+#define SUCCESSOR_MAX_LOAD_DENOMINATOR 2
+#define INITIAL_SUCCESSOR_INDEX 64             // First size of the table pointer array
+
+#if defined(__GNUC__)
+#define PREFETCH(address) __builtin_prefetch(address)
+#else
+#define PREFETCH(address) ((void)(address))
+#endif
+
+/***************************/
+/*   HOT-PATH COUNTERS     */
+/***************************/
+
+#ifdef MARKOV_STATS
+/**
+ * Counters updated on the hot paths when compiled with -DMARKOV_STATS.
+ */
+typedef struct MarkovStats {
+    long lookups;             // get_node_from_database() calls
+    long lookup_probes;       // Database nodes visited by those lookups
+    long comp_calls;          // comp_func invocations
+    long frequency_reallocs;  // Frequency list reallocations
+    long which_node_calls;    // Successor selections
+    long which_node_scanned;  // Frequency entries scanned by those selections
+    long first_node_calls;    // get_first_random_node() calls
+    long first_node_retries;  // Rejected candidates in get_first_random_node()
+    const char *phase_names[MAX_PHASES];  // Names of the timed phases
+    clock_t phase_ticks[MAX_PHASES];      // CPU time spent per phase
+    int phase_count;          // Number of distinct phases seen
+    int current_phase;        // Phase being timed, -1 before the first
+    clock_t phase_start;      // When the current phase started
+} MarkovStats;
+
+static MarkovStats markov_stats = {.current_phase = -1};
+
+#define STAT_INC(counter) (markov_stats.counter++)
+#define STAT_ADD(counter, amount) (markov_stats.counter += (amount))
+#else
+#define STAT_INC(counter) ((void)0)
+#define STAT_ADD(counter, amount) ((void)0)
+#endif
 
 /**
  * Get a random number between 0 and max_number [0, max_number).
@@ -21,6 +77,39 @@ int get_random_number(int max_number)
     return rand() % max_number;
 }
 
+/**
+ * Seed a caller-owned random state (splitmix64 of the seed, never zero).
+ *
+ * @param state State to initialize
+ * @param seed Seed value
+ */
+void seed_random_state(random_state_t *state, unsigned long long seed)
+{
+    unsigned long long z = seed + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    z ^= z >> 31;
+    *state = (z != 0) ? z : 1;
+}
+
+/**
+ * Get a random number in [0, max_number) from a caller-owned state
+ * (xorshift64*), so several threads can sample without sharing rand().
+ *
+ * @param max_number Upper bound (exclusive)
+ * @param state Generator state, advanced in place
+ * @return Random number in range [0, max_number)
+ */
+int get_random_number_r(int max_number, random_state_t *state)
+{
+    unsigned long long x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return (int)(((x * 0x2545F4914F6CDD1DULL) >> 33) % (unsigned)max_number);
+}
+
 /**
  * Search for a node in the database that contains the specified data.
  *
@@ -34,10 +123,14 @@ int get_random_number(int max_number)
 Node* get_node_from_database(MarkovChain *markov_chain, void *data_ptr)
 {
     Node *traveller = markov_chain->database->first;
+    STAT_INC(lookups);
 
     // Traverse the linked list
     while (traveller)
     {
+        STAT_INC(lookup_probes);
+        STAT_INC(comp_calls);
+
         // Compare current node's data with the search data
         if (markov_chain->comp_func(traveller->data->data, data_ptr) == 0)
         {
@@ -64,6 +157,12 @@ Node* get_node_from_database(MarkovChain *markov_chain, void *data_ptr)
  */
 Node* add_to_database(MarkovChain *markov_chain, void *data_ptr)
 {
+    // A frozen chain's packed layout has no room for new states
+    if (markov_chain->layout != NULL)
+    {
+        return NULL;
+    }
+
     // Allocate memory for new MarkovNode
     MarkovNode *new_markov_node = (MarkovNode*)malloc(sizeof(MarkovNode));
     if (new_markov_node == NULL)
@@ -82,6 +181,8 @@ Node* add_to_database(MarkovChain *markov_chain, void *data_ptr)
     // Initialize the node's frequency tracking
     new_markov_node->frequency_list = NULL;
     new_markov_node->following_count = 0;
+    new_markov_node->all_following = 0;
+    new_markov_node->id = markov_chain->database->size;
 
     // Add the new node to the database linked list
     int addNode = add(markov_chain->database, new_markov_node);
@@ -93,17 +194,333 @@ Node* add_to_database(MarkovChain *markov_chain, void *data_ptr)
     return markov_chain->database->last;  // Return pointer to newly added node
 }
 
+/***************************/
+/*   SUCCESSOR TABLES      */
+/***************************/
+
+/**
+ * Slot at which the probe sequence of a successor id starts.
+ *
+ * Ids are dense, so the multiplication spreads neighbouring ids over the
+ * table and the shift folds the well-mixed high bits into the low ones.
+ *
+ * @param id Successor id
+ * @param slot_count Number of slots (power of two)
+ * @return First slot to probe
+ */
+static int successor_slot(int id, int slot_count)
+{
+    unsigned int hash = (unsigned int)id * SUCCESSOR_HASH_MULTIPLIER;
+    return (int)((hash ^ (hash >> 16)) & (unsigned int)(slot_count - 1));
+}
+
+/**
+ * Find the slot holding a successor id.
+ *
+ * @param table Table to search
+ * @param id Successor id
+ * @return The slot, or NULL if the id is not in the table
+ */
+static SuccessorSlot *find_successor_slot(const SuccessorTable *table, int id)
+{
+    int mask = table->slot_count - 1;
+    int slot = successor_slot(id, table->slot_count);
+
+    while (table->slots[slot].id != EMPTY_SUCCESSOR_SLOT)
+    {
+        if (table->slots[slot].id == id)
+        {
+            return &table->slots[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+/**
+ * Put a successor id into the first free slot of its probe sequence.
+ *
+ * @param table Table with room for one more id
+ * @param id Successor id (not in the table yet)
+ * @param position Index of its entry in the frequency list
+ */
+static void place_successor(SuccessorTable *table, int id, int position)
+{
+    int mask = table->slot_count - 1;
+    int slot = successor_slot(id, table->slot_count);
+
+    while (table->slots[slot].id != EMPTY_SUCCESSOR_SLOT)
+    {
+        slot = (slot + 1) & mask;
+    }
+    table->slots[slot] = (SuccessorSlot) {id, position};
+}
+
+/**
+ * Re-create the slots of a table from a node's frequency list.
+ *
+ * Sized so that the list can grow to twice its length before the table
+ * passes its maximum load.
+ *
+ * @param table Table to fill
+ * @param node Node whose frequency list to index
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error (the
+ *         table keeps its old slots)
+ */
+static int rebuild_successor_slots(SuccessorTable *table, MarkovNode *node)
+{
+    int slot_count = 1;
+    while (slot_count * SUCCESSOR_MAX_LOAD_NUMERATOR <
+           2 * node->following_count * SUCCESSOR_MAX_LOAD_DENOMINATOR)
+    {
+        slot_count *= 2;
+    }
+
+    SuccessorSlot *slots = malloc(slot_count * sizeof(SuccessorSlot));
+    if (slots == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+    for (int slot = 0; slot < slot_count; slot++)
+    {
+        slots[slot].id = EMPTY_SUCCESSOR_SLOT;
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->slot_count = slot_count;
+    for (int i = 0; i < node->following_count; i++)
+    {
+        place_successor(table, node->frequency_list[i].markov_node->id, i);
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Successor table of a node, if it has one.
+ *
+ * @param markov_chain Chain the node belongs to
+ * @param node Node to look up
+ * @return The node's table, or NULL
+ */
+static SuccessorTable *get_successor_table(MarkovChain *markov_chain,
+                                           MarkovNode *node)
+{
+    SuccessorIndex *successors = markov_chain->successors;
+    if (successors == NULL || node->id >= successors->count)
+    {
+        return NULL;
+    }
+    return successors->tables[node->id];
+}
+
+/**
+ * Make room in the chain's successor index for a node id.
+ *
+ * @param markov_chain Chain whose index to grow (created if missing)
+ * @param id Node id that needs a table pointer
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int reserve_successor_index(MarkovChain *markov_chain, int id)
+{
+    SuccessorIndex *successors = markov_chain->successors;
+    if (successors == NULL)
+    {
+        successors = calloc(1, sizeof(SuccessorIndex));
+        if (successors == NULL)
+        {
+            return EXIT_FAILURE;
+        }
+        markov_chain->successors = successors;
+    }
+    if (id < successors->count)
+    {
+        return EXIT_SUCCESS;
+    }
+
+    int count = (successors->count == 0) ? INITIAL_SUCCESSOR_INDEX :
+                successors->count;
+    while (count <= id)
+    {
+        count *= 2;
+    }
+    SuccessorTable **tables = realloc(successors->tables,
+                                      count * sizeof(SuccessorTable *));
+    if (tables == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+    memset(tables + successors->count, 0,
+           (count - successors->count) * sizeof(SuccessorTable *));
+    successors->tables = tables;
+    successors->count = count;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Successor table of a high fan-out node, building it on first use.
+ *
+ * Nodes at or below SUCCESSOR_TABLE_THRESHOLD successors have no table;
+ * scanning their short list is as fast as hashing. A table that cannot be
+ * allocated is simply not built, and the list is scanned instead.
+ *
+ * @param markov_chain Chain the node belongs to
+ * @param node Node being trained
+ * @return The node's table, or NULL to scan the list
+ */
+static SuccessorTable *index_successors(MarkovChain *markov_chain,
+                                        MarkovNode *node)
+{
+    if (node->following_count <= SUCCESSOR_TABLE_THRESHOLD)
+    {
+        return NULL;
+    }
+    SuccessorTable *table = get_successor_table(markov_chain, node);
+    if (table != NULL ||
+        reserve_successor_index(markov_chain, node->id) == EXIT_FAILURE)
+    {
+        return table;
+    }
+
+    table = calloc(1, sizeof(SuccessorTable));
+    if (table == NULL || rebuild_successor_slots(table, node) == EXIT_FAILURE)
+    {
+        free(table);
+        return NULL;
+    }
+    table->list_capacity = node->following_count;
+    markov_chain->successors->tables[node->id] = table;
+    return table;
+}
+
+/**
+ * Record where an entry is after it moved within its frequency list.
+ *
+ * @param table Table of the list, or NULL
+ * @param list Frequency list
+ * @param position Current index of the entry that moved
+ */
+static void move_successor(SuccessorTable *table, MarkovNodeFrequency *list,
+                           int position)
+{
+    if (table != NULL)
+    {
+        find_successor_slot(table, list[position].markov_node->id)->position =
+                position;
+    }
+}
+
+/**
+ * Drop the successor table of a node whose entries moved wholesale.
+ *
+ * It is rebuilt from the list the next time the node is trained.
+ *
+ * @param markov_chain Chain the node belongs to
+ * @param node Node whose table to free
+ */
+static void drop_successor_table(MarkovChain *markov_chain, MarkovNode *node)
+{
+    SuccessorTable *table = get_successor_table(markov_chain, node);
+    if (table != NULL)
+    {
+        free(table->slots);
+        free(table);
+        markov_chain->successors->tables[node->id] = NULL;
+    }
+}
+
+/**
+ * Free every successor table of a chain and shrink the lists they indexed
+ * back to their exact length.
+ *
+ * Called before pruning and renormalization, which reorder and renumber
+ * entries, and at freeze, after which nothing is added.
+ *
+ * @param markov_chain Chain whose index to free
+ */
+static void free_successor_index(MarkovChain *markov_chain)
+{
+    SuccessorIndex *successors = markov_chain->successors;
+    if (successors == NULL)
+    {
+        return;
+    }
+
+    for (Node *traveller = markov_chain->database->first; traveller;
+         traveller = traveller->next)
+    {
+        MarkovNode *node = traveller->data;
+        SuccessorTable *table = get_successor_table(markov_chain, node);
+        if (table == NULL)
+        {
+            continue;
+        }
+
+        // Shrinking cannot lose data; keep the old block if realloc refuses
+        if (table->list_capacity > node->following_count &&
+            node->following_count > 0)
+        {
+            MarkovNodeFrequency *shrunk = (MarkovNodeFrequency *)realloc(
+                    node->frequency_list,
+                    node->following_count * sizeof(MarkovNodeFrequency));
+            if (shrunk != NULL)
+            {
+                node->frequency_list = shrunk;
+            }
+        }
+        free(table->slots);
+        free(table);
+    }
+    free(successors->tables);
+    free(successors);
+    markov_chain->successors = NULL;
+}
+
+/**
+ * Bytes used by the successor tables and the spare room of indexed lists.
+ *
+ * @param markov_chain Chain to measure
+ * @return Number of bytes
+ */
+static size_t successor_index_memory_usage(MarkovChain *markov_chain)
+{
+    SuccessorIndex *successors = markov_chain->successors;
+    if (successors == NULL)
+    {
+        return 0;
+    }
+
+    size_t bytes = sizeof(SuccessorIndex) +
+                   successors->count * sizeof(SuccessorTable *);
+    for (Node *traveller = markov_chain->database->first; traveller;
+         traveller = traveller->next)
+    {
+        SuccessorTable *table = get_successor_table(markov_chain,
+                                                    traveller->data);
+        if (table != NULL)
+        {
+            bytes += sizeof(SuccessorTable) +
+                     table->slot_count * sizeof(SuccessorSlot) +
+                     (table->list_capacity - traveller->data->following_count) *
+                     sizeof(MarkovNodeFrequency);
+        }
+    }
+    return bytes;
+}
+
 /**
  * Initialize a new frequency list for a MarkovNode.
  *
  * Creates the first entry in the frequency list, recording a transition
- * from first_node to second_node with an initial frequency of 1.
+ * from first_node to second_node with an initial frequency of weight.
  *
  * @param first_node Source node to initialize frequency list for
  * @param second_node Destination node to add to frequency list
+ * @param weight Weight of one observation (1 unless counts decay)
  * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
  */
-int new_frequency_list(MarkovNode *first_node, MarkovNode *second_node)
+int new_frequency_list(MarkovNode *first_node, MarkovNode *second_node,
+                       int weight)
 {
     // Allocate memory for the first frequency list entry
     first_node->frequency_list = (MarkovNodeFrequency*)
@@ -116,48 +533,192 @@ int new_frequency_list(MarkovNode *first_node, MarkovNode *second_node)
 
     // Initialize the first frequency entry
     first_node->frequency_list[0].markov_node = second_node;
-    first_node->frequency_list[0].frequency = 1;
+    first_node->frequency_list[0].frequency = weight;
     first_node->following_count = 1;
     first_node->frequency_list->num_of_nodes = 1;
-    first_node->all_following = 1;
+    first_node->all_following = weight;
 
     return EXIT_SUCCESS;
 }
 
+/**
+ * Swap the transition data of two frequency list entries.
+ *
+ * Only the successor pointer and its frequency are exchanged, so the
+ * num_of_nodes bookkeeping stored in entry 0 stays where it is.
+ *
+ * @param first First entry
+ * @param second Second entry
+ */
+static void swap_frequency_entries(MarkovNodeFrequency *first,
+                                   MarkovNodeFrequency *second)
+{
+    MarkovNode *node = first->markov_node;
+    int frequency = first->frequency;
+
+    first->markov_node = second->markov_node;
+    first->frequency = second->frequency;
+    second->markov_node = node;
+    second->frequency = frequency;
+}
+
+#ifdef ADAPTIVE_FREQUENCY_ORDER
+/**
+ * Move an entry whose frequency was just incremented toward the front.
+ *
+ * Counts only grow during training, so bubbling the changed entry past
+ * the run of smaller counts in front of it keeps the whole list sorted in
+ * descending order at all times.
+ *
+ * @param node Node owning the frequency list
+ * @param table Successor table of the node, or NULL
+ * @param index Index of the entry that was incremented
+ */
+static void promote_frequency_entry(MarkovNode *node, SuccessorTable *table,
+                                    int index)
+{
+    MarkovNodeFrequency *list = node->frequency_list;
+    int start = index;
+
+    while (index > 0 && list[index - 1].frequency < list[index].frequency)
+    {
+        swap_frequency_entries(&list[index - 1], &list[index]);
+        move_successor(table, list, index);
+        index--;
+    }
+    if (index != start)
+    {
+        move_successor(table, list, index);
+    }
+}
+#endif
+
 /**
  * Increment the frequency of an existing transition.
  *
- * Searches the frequency list of first_node for second_node.
- * If found, increments its frequency counter.
+ * Searches the frequency list of first_node for second_node: through the
+ * node's successor table past SUCCESSOR_TABLE_THRESHOLD successors, by a
+ * scan of the list below it. If found, increases its frequency counter by
+ * weight.
  *
  * @param first_node Source node
  * @param second_node Destination node to search for
- * @param markov_chain Pointer to MarkovChain (for comparison function)
+ * @param markov_chain Pointer to MarkovChain holding the successor tables
+ * @param weight Weight of one observation (1 unless counts decay)
  * @return EXIT_SUCCESS if node found and updated, EXIT_FAILURE if not found
  */
 int add_num_of_frequency(MarkovNode *first_node, MarkovNode *second_node,
-                         MarkovChain *markov_chain)
+                         MarkovChain *markov_chain, int weight)
+{
+    SuccessorTable *table = index_successors(markov_chain, first_node);
+    int found = -1;
+
+    if (table != NULL)
+    {
+        SuccessorSlot *slot = find_successor_slot(table, second_node->id);
+        found = (slot == NULL) ? -1 : slot->position;
+    }
+    else
+    {
+        // Every state has exactly one node in the database, so pointer
+        // equality is enough
+        for (int i = 0; i < first_node->following_count; i++)
+        {
+            if (first_node->frequency_list[i].markov_node == second_node)
+            {
+                found = i;
+                break;
+            }
+        }
+    }
+
+    if (found < 0)
+    {
+        return EXIT_FAILURE;  // Node not found in frequency list
+    }
+
+    // Found it - increment frequency counters
+    first_node->frequency_list[found].frequency += weight;
+    first_node->all_following += weight;
+#ifdef ADAPTIVE_FREQUENCY_ORDER
+    promote_frequency_entry(first_node, table, found);
+#endif
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Record a transition in approximate counting mode.
+ *
+ * The transition's count is incremented in the sketch and its new
+ * estimate becomes the candidate's frequency. A successor not yet in the
+ * list is added while there is room, otherwise it replaces the candidate
+ * with the lowest estimate if its own estimate is higher.
+ *
+ * @param first_node Source node
+ * @param second_node Destination node
+ * @param approximate Approximate counting state
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int add_approximate_transition(MarkovNode *first_node,
+                                      MarkovNode *second_node,
+                                      ApproximateCounts *approximate)
 {
-    // Search through existing frequency list entries
+    uint64_t key = ((uint64_t)first_node->id << 32) ^
+                   (uint64_t)second_node->id;
+    int estimate = (int)count_min_sketch_add(approximate->sketch, key);
+    int lowest = 0;
+
+    // Nodes are unique in the database, so compare pointers
     for (int i = 0; i < first_node->following_count; i++)
     {
-        // Check if this entry matches the second_node
-        if ((markov_chain->comp_func(
-                first_node->frequency_list[i].markov_node->data,
-                second_node->data)) == 0)
+        MarkovNodeFrequency *freq = &first_node->frequency_list[i];
+        if (freq->markov_node == second_node)
         {
-            // Found it - increment frequency counters
-            first_node->frequency_list[i].frequency++;
-            first_node->all_following++;
+            first_node->all_following += estimate - freq->frequency;
+            freq->frequency = estimate;
             return EXIT_SUCCESS;
         }
+        if (freq->frequency < first_node->frequency_list[lowest].frequency)
+        {
+            lowest = i;
+        }
+    }
+
+    if (first_node->following_count < approximate->heavy_hitters)
+    {
+        STAT_INC(frequency_reallocs);
+        MarkovNodeFrequency *new_list = (MarkovNodeFrequency *)realloc(
+                first_node->frequency_list,
+                (first_node->following_count + 1) * sizeof(MarkovNodeFrequency));
+        if (new_list == NULL)
+        {
+            fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+            return EXIT_FAILURE;
+        }
+
+        new_list[first_node->following_count].markov_node = second_node;
+        new_list[first_node->following_count].frequency = estimate;
+        first_node->frequency_list = new_list;
+        first_node->following_count++;
+        first_node->all_following += estimate;
+        new_list[0].num_of_nodes = first_node->following_count;
+        return EXIT_SUCCESS;
+    }
+
+    // List is full - evict the weakest candidate if the newcomer beats it
+    MarkovNodeFrequency *weakest = &first_node->frequency_list[lowest];
+    if (estimate > weakest->frequency)
+    {
+        first_node->all_following += estimate - weakest->frequency;
+        weakest->markov_node = second_node;
+        weakest->frequency = estimate;
     }
 
-    return EXIT_FAILURE;  // Node not found in frequency list
+    return EXIT_SUCCESS;
 }
 
 /**
- * Add a node to the frequency list or update its frequency.
+ * Record a transition with exact counts.
  *
  * This function handles recording a transition from first_node to second_node.
  * It either:
@@ -168,15 +729,17 @@ int add_num_of_frequency(MarkovNode *first_node, MarkovNode *second_node,
  * @param first_node Source node
  * @param second_node Destination node
  * @param markov_chain Pointer to MarkovChain
+ * @param weight Weight of one observation (1 unless counts decay)
  * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
  */
-int add_node_to_frequency_list(MarkovNode *first_node, MarkovNode *second_node,
-                               MarkovChain *markov_chain)
+static int add_exact_transition(MarkovNode *first_node, MarkovNode *second_node,
+                                MarkovChain *markov_chain, int weight)
 {
     // Case 1: No frequency list exists yet
     if (first_node->frequency_list == NULL)
     {
-        int make_new_frequency_list = new_frequency_list(first_node, second_node);
+        int make_new_frequency_list = new_frequency_list(first_node, second_node,
+                                                         weight);
         if (make_new_frequency_list == EXIT_FAILURE)
         {
             return EXIT_FAILURE;
@@ -185,8 +748,8 @@ int add_node_to_frequency_list(MarkovNode *first_node, MarkovNode *second_node,
     else
     {
         // Case 2: Frequency list exists - try to update existing entry
-        int add_num_to_frequency_list =
-                add_num_of_frequency(first_node, second_node, markov_chain);
+        int add_num_to_frequency_list = add_num_of_frequency(
+                first_node, second_node, markov_chain, weight);
 
         if (add_num_to_frequency_list == EXIT_SUCCESS)
         {
@@ -196,153 +759,1975 @@ int add_node_to_frequency_list(MarkovNode *first_node, MarkovNode *second_node,
         // Case 3: Node not in list - need to add new entry
         first_node->frequency_list->num_of_nodes++;
 
-        // Reallocate the frequency list to make room for new entry
-        MarkovNodeFrequency *new_list = (MarkovNodeFrequency*)realloc(
-                first_node->frequency_list,
-                (first_node->following_count + 1) * sizeof(MarkovNodeFrequency));
-
-        if (new_list == NULL)
+        // Reallocate the frequency list to make room for new entry; an
+        // indexed list doubles, a short one grows by exactly one entry
+        SuccessorTable *table = get_successor_table(markov_chain, first_node);
+        int count = first_node->following_count;
+        if (table == NULL || count == table->list_capacity)
         {
-            fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
-            return EXIT_FAILURE;  // Memory reallocation failed
+            int capacity = (table == NULL) ? count + 1 : count * 2;
+            STAT_INC(frequency_reallocs);
+            MarkovNodeFrequency *new_list = (MarkovNodeFrequency*)realloc(
+                    first_node->frequency_list,
+                    capacity * sizeof(MarkovNodeFrequency));
+
+            if (new_list == NULL)
+            {
+                first_node->frequency_list->num_of_nodes--;
+                fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+                return EXIT_FAILURE;  // Memory reallocation failed
+            }
+            first_node->frequency_list = new_list;
+            if (table != NULL)
+            {
+                table->list_capacity = capacity;
+            }
         }
 
         // Add the new node to the frequency list
-        new_list[first_node->following_count].markov_node = second_node;
-        new_list[first_node->following_count].frequency = 1;
+        MarkovNodeFrequency *list = first_node->frequency_list;
+        list[count].markov_node = second_node;
+        list[count].frequency = weight;
         first_node->following_count++;
-        first_node->all_following++;
-        first_node->frequency_list = new_list;
-    }
-
+        first_node->all_following += weight;
+        if (table != NULL)
+        {
+            // A table that cannot grow is dropped and rebuilt later
+            if (first_node->following_count * SUCCESSOR_MAX_LOAD_DENOMINATOR <=
+                table->slot_count * SUCCESSOR_MAX_LOAD_NUMERATOR)
+            {
+                place_successor(table, second_node->id, count);
+            }
+            else if (rebuild_successor_slots(table, first_node) ==
+                     EXIT_FAILURE)
+            {
+                drop_successor_table(markov_chain, first_node);
+                table = NULL;
+            }
+        }
+#ifdef ADAPTIVE_FREQUENCY_ORDER
+        promote_frequency_entry(first_node, table, count);
+#endif
+    }
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Divide every count in the chain by 2^bits.
+ *
+ * This is the only sweep over all nodes that decay needs, and it runs once
+ * every DECAY_MAX_SHIFT - DECAY_RENORMALIZE_BITS half-lives (or when a
+ * count nears overflow). The weight of new observations drops by the same
+ * factor, so at most weight_shift bits are shifted: old and new counts keep
+ * their relative weights. Transitions whose count drops to zero are
+ * removed, and all_following is recomputed from the surviving entries.
+ *
+ * @param markov_chain Pointer to MarkovChain
+ * @param bits Number of bits to shift every count right by, at most
+ * @return Number of bits actually shifted (0 when weight_shift is 0)
+ */
+static int renormalize_counts(MarkovChain *markov_chain, int bits)
+{
+    DecayState *decay = markov_chain->decay;
+    Node *traveller = markov_chain->database->first;
+
+    bits = (bits < decay->weight_shift) ? bits : decay->weight_shift;
+    if (bits == 0)
+    {
+        return 0;
+    }
+
+    // Surviving entries move up over the dropped ones
+    free_successor_index(markov_chain);
+
+    while (traveller)
+    {
+        MarkovNode *node = traveller->data;
+        int kept = 0;
+        int total = 0;
+
+        for (int i = 0; i < node->following_count; i++)
+        {
+            int frequency = node->frequency_list[i].frequency >> bits;
+            if (frequency > 0)
+            {
+                node->frequency_list[kept].markov_node =
+                        node->frequency_list[i].markov_node;
+                node->frequency_list[kept].frequency = frequency;
+                total += frequency;
+                kept++;
+            }
+        }
+
+        node->following_count = kept;
+        node->all_following = total;
+        if (kept == 0 && node->frequency_list != NULL)
+        {
+            free(node->frequency_list);
+            node->frequency_list = NULL;
+        }
+        else if (kept > 0)
+        {
+            node->frequency_list[0].num_of_nodes = kept;
+        }
+        traveller = traveller->next;
+    }
+
+    // Logged weights shrink with the counts they will be subtracted from
+    for (int slot = 0; slot < decay->config.window; slot++)
+    {
+        EpochLog *log = &decay->window_log[slot];
+        for (int i = 0; i < log->count; i++)
+        {
+            log->records[i].weight >>= bits;
+        }
+    }
+
+    decay->weight_shift -= bits;
+    return bits;
+}
+
+/**
+ * Subtract an expired observation from a transition.
+ *
+ * The count never drops below zero (renormalization rounds counts down).
+ * An entry reaching zero is removed; otherwise it is moved back past any
+ * larger counts so a sorted list stays sorted.
+ *
+ * @param markov_chain Pointer to MarkovChain holding the successor tables
+ * @param from Source node
+ * @param to Destination node
+ * @param weight Weight to subtract
+ */
+static void subtract_transition(MarkovChain *markov_chain, MarkovNode *from,
+                                MarkovNode *to, int weight)
+{
+    MarkovNodeFrequency *list = from->frequency_list;
+    SuccessorTable *table = get_successor_table(markov_chain, from);
+    int i = 0;
+
+    if (table != NULL)
+    {
+        SuccessorSlot *slot = find_successor_slot(table, to->id);
+        i = (slot == NULL) ? from->following_count : slot->position;
+    }
+    while (i < from->following_count && list[i].markov_node != to)
+    {
+        i++;
+    }
+    if (i == from->following_count)
+    {
+        return;
+    }
+
+    int removed = (weight < list[i].frequency) ? weight : list[i].frequency;
+    list[i].frequency -= removed;
+    from->all_following -= removed;
+
+    if (list[i].frequency > 0)
+    {
+        int start = i;
+        while (i + 1 < from->following_count &&
+               list[i + 1].frequency > list[i].frequency)
+        {
+            swap_frequency_entries(&list[i], &list[i + 1]);
+            move_successor(table, list, i);
+            i++;
+        }
+        if (i != start)
+        {
+            move_successor(table, list, i);
+        }
+        return;
+    }
+
+    // Drop the emptied entry, keeping the order of the others; the entries
+    // behind it all move, so the table goes too
+    drop_successor_table(markov_chain, from);
+    memmove(&list[i], &list[i + 1],
+            (from->following_count - i - 1) * sizeof(MarkovNodeFrequency));
+    from->following_count--;
+    if (from->following_count == 0)
+    {
+        free(list);
+        from->frequency_list = NULL;
+    }
+    else
+    {
+        list[0].num_of_nodes = from->following_count;
+    }
+}
+
+/**
+ * Remember a transition in the current epoch's window log.
+ *
+ * @param decay Decay state
+ * @param from Source node
+ * @param to Destination node
+ * @param weight Weight that was added
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int log_transition(DecayState *decay, MarkovNode *from, MarkovNode *to,
+                          int weight)
+{
+    EpochLog *log = &decay->window_log[decay->epoch % decay->config.window];
+
+    if (log->count == log->capacity)
+    {
+        int capacity = (log->capacity == 0) ? INITIAL_LOG_CAPACITY :
+                       log->capacity * 2;
+        TransitionRecord *records = (TransitionRecord *)realloc(
+                log->records, capacity * sizeof(TransitionRecord));
+        if (records == NULL)
+        {
+            fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+            return EXIT_FAILURE;
+        }
+        log->records = records;
+        log->capacity = capacity;
+    }
+
+    log->records[log->count++] = (TransitionRecord) {from, to, weight};
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Drop the window log records of transitions from or to evicted states.
+ *
+ * Their transitions are gone with the states, and the records would
+ * otherwise point at freed nodes when they expire.
+ *
+ * @param decay Decay state, or NULL
+ * @param evict Eviction marks indexed by node id
+ */
+static void forget_evicted_records(DecayState *decay, const char *evict)
+{
+    if (decay == NULL)
+    {
+        return;
+    }
+    for (int slot = 0; slot < decay->config.window; slot++)
+    {
+        EpochLog *log = &decay->window_log[slot];
+        int kept = 0;
+        for (int i = 0; i < log->count; i++)
+        {
+            if (!evict[log->records[i].from->id] &&
+                !evict[log->records[i].to->id])
+            {
+                log->records[kept++] = log->records[i];
+            }
+        }
+        log->count = kept;
+    }
+}
+
+/**
+ * Drop the window log records of transitions that pruning removed.
+ *
+ * A removed transition may be observed again and start a fresh entry; its
+ * old records would then subtract their weight from that entry when their
+ * epoch expires. Records are grouped by source so every surviving list is
+ * scanned once.
+ *
+ * @param markov_chain Pointer to MarkovChain (ids dense after eviction)
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int forget_pruned_records(MarkovChain *markov_chain)
+{
+    DecayState *decay = markov_chain->decay;
+    if (decay == NULL || decay->config.window == 0)
+    {
+        return EXIT_SUCCESS;
+    }
+
+    int size = markov_chain->database->size;
+    long total = 0;
+    for (int slot = 0; slot < decay->config.window; slot++)
+    {
+        total += decay->window_log[slot].count;
+    }
+    if (total == 0)
+    {
+        return EXIT_SUCCESS;
+    }
+
+    long *starts = (long *)calloc(size + 1, sizeof(long));
+    long *cursor = (long *)malloc(size * sizeof(long));
+    int *marks = (int *)malloc(size * sizeof(int));
+    TransitionRecord **grouped = (TransitionRecord **)malloc(
+            total * sizeof(TransitionRecord *));
+    if (starts == NULL || cursor == NULL || marks == NULL || grouped == NULL)
+    {
+        free(starts);
+        free(cursor);
+        free(marks);
+        free(grouped);
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        return EXIT_FAILURE;
+    }
+
+    // Bucket the records by source id
+    for (int slot = 0; slot < decay->config.window; slot++)
+    {
+        EpochLog *log = &decay->window_log[slot];
+        for (int i = 0; i < log->count; i++)
+        {
+            starts[log->records[i].from->id + 1]++;
+        }
+    }
+    for (int id = 0; id < size; id++)
+    {
+        starts[id + 1] += starts[id];
+        cursor[id] = starts[id];
+        marks[id] = -1;
+    }
+    for (int slot = 0; slot < decay->config.window; slot++)
+    {
+        EpochLog *log = &decay->window_log[slot];
+        for (int i = 0; i < log->count; i++)
+        {
+            grouped[cursor[log->records[i].from->id]++] = &log->records[i];
+        }
+    }
+
+    // Zero the weight of every record whose transition is gone
+    for (int id = 0; id < size; id++)
+    {
+        if (starts[id] == starts[id + 1])
+        {
+            continue;
+        }
+        MarkovNode *from = grouped[starts[id]]->from;
+        for (int i = 0; i < from->following_count; i++)
+        {
+            marks[from->frequency_list[i].markov_node->id] = id;
+        }
+        for (long r = starts[id]; r < starts[id + 1]; r++)
+        {
+            if (marks[grouped[r]->to->id] != id)
+            {
+                grouped[r]->weight = 0;
+            }
+        }
+    }
+
+    for (int slot = 0; slot < decay->config.window; slot++)
+    {
+        EpochLog *log = &decay->window_log[slot];
+        int kept = 0;
+        for (int i = 0; i < log->count; i++)
+        {
+            if (log->records[i].weight != 0)
+            {
+                log->records[kept++] = log->records[i];
+            }
+        }
+        log->count = kept;
+    }
+
+    free(starts);
+    free(cursor);
+    free(marks);
+    free(grouped);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Record a transition with time-decayed counts.
+ *
+ * Instead of shrinking every old count each epoch, new observations weigh
+ * 2^weight_shift, which doubles every half-life; relative to new data, old
+ * counts decay without being touched.
+ *
+ * @param first_node Source node
+ * @param second_node Destination node
+ * @param markov_chain Pointer to MarkovChain
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int add_decayed_transition(MarkovNode *first_node,
+                                  MarkovNode *second_node,
+                                  MarkovChain *markov_chain)
+{
+    DecayState *decay = markov_chain->decay;
+
+    // Keep the source's total away from int overflow; once new observations
+    // weigh 1 there is nothing left to divide, and the count saturates
+    if (first_node->all_following > DECAY_COUNT_LIMIT -
+                                    (1 << decay->weight_shift))
+    {
+        renormalize_counts(markov_chain, DECAY_RENORMALIZE_BITS);
+        if (first_node->all_following > DECAY_COUNT_LIMIT -
+                                        (1 << decay->weight_shift))
+        {
+            return EXIT_SUCCESS;
+        }
+    }
+
+    int weight = 1 << decay->weight_shift;
+    if (add_exact_transition(first_node, second_node, markov_chain,
+                             weight) == EXIT_FAILURE)
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (decay->config.window > 0)
+    {
+        return log_transition(decay, first_node, second_node, weight);
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Add a node to the frequency list or update its frequency.
+ *
+ * Dispatches to approximate, decayed or plain exact counting depending
+ * on how the chain was configured.
+ *
+ * @param first_node Source node
+ * @param second_node Destination node
+ * @param markov_chain Pointer to MarkovChain
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+int add_node_to_frequency_list(MarkovNode *first_node, MarkovNode *second_node,
+                               MarkovChain *markov_chain)
+{
+    // Packed frequency lists cannot grow
+    if (markov_chain->layout != NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    // Approximate mode keeps its own bounded candidate list
+    if (markov_chain->approximate != NULL)
+    {
+        return add_approximate_transition(first_node, second_node,
+                                          markov_chain->approximate);
+    }
+
+    if (markov_chain->decay != NULL)
+    {
+        return add_decayed_transition(first_node, second_node, markov_chain);
+    }
+
+    return add_exact_transition(first_node, second_node, markov_chain, 1);
+}
+
+/**
+ * Add a transition observed weight times at once.
+ *
+ * @param first_node Pointer to the source MarkovNode
+ * @param second_node Pointer to the destination MarkovNode
+ * @param markov_chain Pointer to the MarkovChain
+ * @param weight Number of observations (positive)
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on a non-positive weight,
+ *         a frozen, approximate or decaying chain, or allocation error
+ */
+int add_weighted_transition(MarkovNode *first_node, MarkovNode *second_node,
+                            MarkovChain *markov_chain, int weight)
+{
+    if (weight <= 0 || markov_chain->layout != NULL ||
+        markov_chain->approximate != NULL || markov_chain->decay != NULL)
+    {
+        return EXIT_FAILURE;
+    }
+    return add_exact_transition(first_node, second_node, markov_chain, weight);
+}
+
+/**
+ * Enable time-decayed and/or sliding-window counts on an exact chain.
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @param config Half-life and window length in epochs
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on invalid config or allocation error
+ */
+int enable_decay(MarkovChain *markov_chain, const DecayConfig *config)
+{
+    if (markov_chain->approximate != NULL || config->half_life < 0 ||
+        config->window < 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    DecayState *decay = malloc(sizeof(DecayState));
+    if (decay == NULL)
+    {
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        return EXIT_FAILURE;
+    }
+    decay->config = *config;
+    decay->epoch = 0;
+    decay->weight_shift = 0;
+    decay->window_log = NULL;
+
+    if (config->window > 0)
+    {
+        decay->window_log = (EpochLog *)calloc(config->window, sizeof(EpochLog));
+        if (decay->window_log == NULL)
+        {
+            free(decay);
+            fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+            return EXIT_FAILURE;
+        }
+    }
+
+    markov_chain->decay = decay;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Close the current epoch and start the next one.
+ *
+ * Expires the oldest window epoch by subtracting its logged transitions,
+ * and raises the weight of future observations every half-life.
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ */
+void advance_epoch(MarkovChain *markov_chain)
+{
+    DecayState *decay = markov_chain->decay;
+    if (decay == NULL)
+    {
+        return;
+    }
+
+    decay->epoch++;
+
+    // The slot about to be reused holds the epoch leaving the window
+    if (decay->config.window > 0)
+    {
+        EpochLog *log = &decay->window_log[decay->epoch % decay->config.window];
+        for (int i = 0; i < log->count; i++)
+        {
+            subtract_transition(markov_chain, log->records[i].from,
+                                log->records[i].to, log->records[i].weight);
+        }
+        log->count = 0;
+    }
+
+    if (decay->config.half_life > 0 &&
+        decay->epoch % decay->config.half_life == 0)
+    {
+        decay->weight_shift++;
+        if (decay->weight_shift >= DECAY_MAX_SHIFT)
+        {
+            renormalize_counts(markov_chain, DECAY_RENORMALIZE_BITS);
+        }
+    }
+}
+
+/**
+ * Get a random non-terminal starting node from the database.
+ *
+ * Randomly selects nodes from the database until finding one that
+ * is not a terminal state (as determined by the is_last function).
+ * This ensures sequences don't start with a terminal state.
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @return Pointer to a randomly selected non-terminal MarkovNode
+ */
+MarkovNode* get_first_random_node(MarkovChain *markov_chain)
+{
+    Node *node_to_return = markov_chain->database->first;
+    STAT_INC(first_node_calls);
+
+    // Keep selecting random nodes until we find a non-terminal one
+    while (FLAG)
+    {
+        // Get random index in range [0, database size)
+        int num = get_random_number(markov_chain->database->size);
+        int traveller = TRAVELLER;
+
+        // Traverse to the randomly selected node
+        while (traveller != num)
+        {
+            node_to_return = node_to_return->next;
+            traveller++;
+        }
+
+        void *one_word = node_to_return->data->data;
+
+        // Check if this node is a terminal state (or has no successors left)
+        if (!(markov_chain->is_last(one_word)) &&
+            node_to_return->data->all_following > 0)
+        {
+            break;  // Found a non-terminal node
+        }
+
+        // Reset to start of list for next iteration
+        STAT_INC(first_node_retries);
+        node_to_return = markov_chain->database->first;
+    }
+
+    return node_to_return->data;
+}
+
+/**
+ * Check whether get_first_random_node() has any state to return.
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @return true if some state is not a last state and has a successor
+ */
+bool has_start_node(MarkovChain *markov_chain)
+{
+    for (Node *node = markov_chain->database->first; node; node = node->next)
+    {
+        if (!markov_chain->is_last(node->data->data) &&
+            node->data->all_following > 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Select which node to transition to based on cumulative frequency.
+ *
+ * Uses a random number to probabilistically select the next state
+ * based on transition frequencies. Higher frequency transitions have
+ * a higher probability of being selected.
+ *
+ * @param first_node Current node
+ * @param random_num Random number in range [0, total_frequency)
+ * @return Pointer to the selected MarkovNodeFrequency
+ */
+MarkovNodeFrequency* which_node(MarkovNode *first_node, int random_num)
+{
+    int which_word = WHICH_WORD;
+    STAT_INC(which_node_calls);
+
+    // Iterate through frequency list, accumulating frequencies
+    for (int i = 0; i < first_node->following_count; ++i)
+    {
+        MarkovNodeFrequency *freq = &(first_node->frequency_list[i]);
+        which_word = which_word + freq->frequency;
+
+        // If cumulative frequency exceeds random number, select this node
+        if (which_word > random_num)
+        {
+            STAT_ADD(which_node_scanned, i + 1);
+            return freq;
+        }
+    }
+
+    // Fallback to first node (shouldn't normally reach here)
+    MarkovNodeFrequency *freq = &(first_node->frequency_list[0]);
+    return freq;
+}
+
+/**
+ * Get the next random node based on frequency distribution.
+ *
+ * Randomly selects the next state to transition to, with the probability
+ * of each state proportional to its frequency in the current node's
+ * frequency list.
+ *
+ * @param cur_markov_node Current MarkovNode
+ * @return Pointer to the next randomly selected MarkovNode
+ */
+MarkovNode* get_next_random_node(MarkovNode *cur_markov_node)
+{
+    // Get random number in range [0, total_transitions)
+    int random_num = get_random_number(cur_markov_node->all_following);
+
+    // Select node based on cumulative frequency distribution
+    MarkovNodeFrequency *freq_node = which_node(cur_markov_node, random_num);
+
+    return freq_node->markov_node;
+}
+
+/**
+ * Get the next random node using a caller-owned random state.
+ *
+ * @param cur_markov_node Current MarkovNode
+ * @param state Generator state
+ * @return Pointer to the next randomly selected MarkovNode
+ */
+MarkovNode* get_next_random_node_r(MarkovNode *cur_markov_node,
+                                   random_state_t *state)
+{
+    int random_num = get_random_number_r(cur_markov_node->all_following, state);
+    return which_node(cur_markov_node, random_num)->markov_node;
+}
+
+/**
+ * Generate a random sequence into an array instead of printing it.
+ *
+ * Follows the same stopping rules as generate_random_sequence(); out[0]
+ * is first_node itself.
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @param first_node Starting node
+ * @param max_length Maximum number of states, including first_node
+ * @param out Array of at least max_length node pointers
+ * @param state Generator state
+ * @return Number of states written to out
+ */
+int generate_sequence_r(MarkovChain *markov_chain, MarkovNode *first_node,
+                        int max_length, MarkovNode **out,
+                        random_state_t *state)
+{
+    int length = 0;
+    out[length++] = first_node;
+
+    while ((!markov_chain->is_last(first_node->data)) &&
+           first_node->all_following > 0 && length < max_length)
+    {
+        first_node = get_next_random_node_r(first_node, state);
+        out[length++] = first_node;
+    }
+
+    return length;
+}
+
+/**
+ * Collect every state a sequence may start from.
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @param index Index to fill
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+int build_start_index(MarkovChain *markov_chain, StartIndex *index)
+{
+    index->count = 0;
+    index->nodes = malloc((markov_chain->database->size + 1) *
+                          sizeof(MarkovNode *));
+    if (index->nodes == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    for (Node *traveller = markov_chain->database->first; traveller;
+         traveller = traveller->next)
+    {
+        MarkovNode *node = traveller->data;
+        if (!markov_chain->is_last(node->data) && node->all_following > 0)
+        {
+            index->nodes[index->count++] = node;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Free the array of a start index.
+ *
+ * @param index Index to empty
+ */
+void free_start_index(StartIndex *index)
+{
+    free(index->nodes);
+    index->nodes = NULL;
+    index->count = 0;
+}
+
+/**
+ * Draw count start states uniformly from a start index.
+ *
+ * @param index Non-empty start index
+ * @param count Number of states to draw
+ * @param out Array with room for count node pointers
+ * @param state Generator state
+ */
+void sample_start_nodes(const StartIndex *index, int count, MarkovNode **out,
+                        random_state_t *state)
+{
+    for (int i = 0; i < count; i++)
+    {
+        out[i] = index->nodes[get_random_number_r(index->count, state)];
+        PREFETCH(out[i]);
+    }
+}
+
+/**
+ * Advance up to LOCKSTEP_WALKS walks together until all of them stop.
+ *
+ * Every step makes two passes over the walks still running. The first
+ * prefetches the frequency list and data of each walk's current node
+ * (whose MarkovNode was prefetched one step earlier); the second samples
+ * the successors, by which time those lines have had a whole pass to
+ * arrive, and prefetches the chosen nodes for the next step.
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @param firsts Start node of each walk
+ * @param count Number of walks, at most LOCKSTEP_WALKS
+ * @param max_length Maximum number of states per walk
+ * @param out Output rows of max_length node pointers
+ * @param lengths Receives the length of each walk
+ * @param state Generator state
+ */
+static void advance_lockstep(MarkovChain *markov_chain, MarkovNode **firsts,
+                             int count, int max_length, MarkovNode **out,
+                             int *lengths, random_state_t *state)
+{
+    MarkovNode *current[LOCKSTEP_WALKS];
+    int running[LOCKSTEP_WALKS];
+    int running_count = count;
+
+    for (int i = 0; i < count; i++)
+    {
+        current[i] = firsts[i];
+        out[(size_t)i * max_length] = firsts[i];
+        lengths[i] = 1;
+        running[i] = i;
+    }
+
+    while (running_count > 0)
+    {
+        for (int r = 0; r < running_count; r++)
+        {
+            MarkovNode *node = current[running[r]];
+            PREFETCH(node->frequency_list);
+            PREFETCH(node->data);
+        }
+
+        int still_running = 0;
+        for (int r = 0; r < running_count; r++)
+        {
+            int walk = running[r];
+            MarkovNode *node = current[walk];
+            if (markov_chain->is_last(node->data) ||
+                node->all_following <= 0 || lengths[walk] >= max_length)
+            {
+                continue;  // Same stopping rules as generate_sequence_r()
+            }
+
+            node = get_next_random_node_r(node, state);
+            PREFETCH(node);
+            current[walk] = node;
+            out[(size_t)walk * max_length + lengths[walk]++] = node;
+            running[still_running++] = walk;
+        }
+        running_count = still_running;
+    }
+}
+
+/**
+ * Generate several random sequences in lockstep groups.
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @param firsts Start node of each walk
+ * @param count Number of walks
+ * @param max_length Maximum number of states per walk
+ * @param out Array of count * max_length node pointers
+ * @param lengths Receives the number of states of each walk
+ * @param state Generator state
+ */
+void generate_sequences_batch(MarkovChain *markov_chain, MarkovNode **firsts,
+                              int count, int max_length, MarkovNode **out,
+                              int *lengths, random_state_t *state)
+{
+    for (int done = 0; done < count; done += LOCKSTEP_WALKS)
+    {
+        int group = (count - done < LOCKSTEP_WALKS) ? count - done
+                                                    : LOCKSTEP_WALKS;
+        advance_lockstep(markov_chain, firsts + done, group, max_length,
+                         out + (size_t)done * max_length, lengths + done,
+                         state);
+    }
+}
+
+/**
+ * Generate and print a random sequence from the Markov chain.
+ *
+ * Starting from first_node, generates a sequence by repeatedly selecting
+ * the next state based on transition frequencies. Continues until either:
+ * - A terminal state is reached (as determined by is_last)
+ * - A state without successors is reached
+ * - The maximum length is reached
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @param first_node Starting node for sequence generation
+ * @param max_length Maximum number of states to generate
+ */
+void generate_random_sequence(MarkovChain *markov_chain, MarkovNode *first_node,
+                              int max_length)
+{
+    int len_of_tweet = LEN_OF_TWEET;
+
+    // Continue until terminal state, dead end or max length reached
+    while ((!markov_chain->is_last(first_node->data)) &&
+           first_node->all_following > 0 && len_of_tweet < max_length)
+    {
+        // Select next node based on frequency distribution
+        first_node = get_next_random_node(first_node);
+
+        // Print the selected node's data
+        markov_chain->print_func(first_node->data);
+
+        len_of_tweet++;
+    }
+}
+
+/**
+ * Weight of a state used to rank eviction and layout candidates.
+ */
+typedef struct StateWeight {
+    long weight;  // Transition mass touching the state
+    int id;       // Node id
+} StateWeight;
+
+/**
+ * qsort comparator ordering StateWeights by ascending weight, then id.
+ *
+ * @param first Pointer to the first StateWeight
+ * @param second Pointer to the second StateWeight
+ * @return Negative, zero or positive like strcmp
+ */
+static int compare_state_weight_asc(const void *first, const void *second)
+{
+    const StateWeight *a = (const StateWeight *)first;
+    const StateWeight *b = (const StateWeight *)second;
+    if (a->weight != b->weight)
+    {
+        return (a->weight > b->weight) - (a->weight < b->weight);
+    }
+    return (a->id > b->id) - (a->id < b->id);
+}
+
+/**
+ * qsort comparator ordering frequency entries by descending frequency.
+ *
+ * @param first Pointer to the first MarkovNodeFrequency
+ * @param second Pointer to the second MarkovNodeFrequency
+ * @return Negative if first is more frequent, positive if less, 0 if equal
+ */
+static int compare_frequency_desc(const void *first, const void *second)
+{
+    const MarkovNodeFrequency *a = (const MarkovNodeFrequency *)first;
+    const MarkovNodeFrequency *b = (const MarkovNodeFrequency *)second;
+    return (b->frequency > a->frequency) - (b->frequency < a->frequency);
+}
+
+/**
+ * Sort a single node's frequency list by descending frequency.
+ *
+ * @param node Node whose frequency list to sort
+ */
+static void sort_frequency_list(MarkovNode *node)
+{
+    if (node->following_count > 1)
+    {
+        qsort(node->frequency_list, node->following_count,
+              sizeof(MarkovNodeFrequency), compare_frequency_desc);
+
+        // Entry 0 carries the list size; restore it after the shuffle
+        node->frequency_list[0].num_of_nodes = node->following_count;
+    }
+}
+
+/**
+ * Order the states hot-first for the packed layout.
+ *
+ * States are ranked by incoming transition mass, which is how often
+ * training walks arrived there. A breadth-first search is started from
+ * each not yet placed state in that order, visiting successors in their
+ * (already descending) frequency order, so a hot state is followed by the
+ * states a walk most likely moves to next.
+ *
+ * @param by_id States indexed by id
+ * @param size Number of states
+ * @param order Receives the ids in layout order
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int hot_first_order(MarkovNode **by_id, int size, int *order)
+{
+    StateWeight *weights = (StateWeight *)calloc(size, sizeof(StateWeight));
+    char *placed = (char *)calloc(size, sizeof(char));
+    if (weights == NULL || placed == NULL)
+    {
+        free(weights);
+        free(placed);
+        return EXIT_FAILURE;
+    }
+
+    for (int id = 0; id < size; id++)
+    {
+        weights[id].id = id;
+    }
+    for (int id = 0; id < size; id++)
+    {
+        MarkovNode *node = by_id[id];
+        for (int i = 0; i < node->following_count; i++)
+        {
+            weights[node->frequency_list[i].markov_node->id].weight +=
+                    node->frequency_list[i].frequency;
+        }
+    }
+    qsort(weights, size, sizeof(StateWeight), compare_state_weight_asc);
+
+    // order doubles as the BFS queue: [head, tail) is still to expand
+    int head = 0;
+    int tail = 0;
+    for (int rank = size - 1; rank >= 0; rank--)
+    {
+        if (placed[weights[rank].id])
+        {
+            continue;
+        }
+        placed[weights[rank].id] = 1;
+        order[tail++] = weights[rank].id;
+
+        while (head < tail)
+        {
+            MarkovNode *node = by_id[order[head++]];
+            for (int i = 0; i < node->following_count; i++)
+            {
+                int next = node->frequency_list[i].markov_node->id;
+                if (!placed[next])
+                {
+                    placed[next] = 1;
+                    order[tail++] = next;
+                }
+            }
+        }
+    }
+
+    free(weights);
+    free(placed);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Name of a page backing, for reports.
+ *
+ * @param backing Page backing
+ * @return Static string
+ */
+const char *page_backing_name(PageBacking backing)
+{
+    switch (backing)
+    {
+        case PAGE_BACKING_HUGETLB:
+            return "hugetlb";
+        case PAGE_BACKING_TRANSPARENT:
+            return "transparent huge";
+        case PAGE_BACKING_MALLOC:
+            return "heap";
+        default:
+            return "auto";
+    }
+}
+
+/**
+ * Allocate the packed storage of a frozen chain.
+ *
+ * Tries the requested kind of memory, then each kind after it in the
+ * PageBacking list. Mappings are rounded up to whole huge pages.
+ *
+ * @param layout Layout whose storage, storage_bytes and backing to set
+ * @param bytes Bytes needed
+ * @param backing Preferred kind of memory
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int allocate_layout_storage(NodeLayout *layout, size_t bytes,
+                                   PageBacking backing)
+{
+    if (backing == PAGE_BACKING_AUTO)
+    {
+        backing = (bytes >= HUGE_PAGE_SIZE) ? PAGE_BACKING_HUGETLB
+                                            : PAGE_BACKING_MALLOC;
+    }
+
+#ifdef __linux__
+    size_t mapped = (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    if (backing == PAGE_BACKING_HUGETLB)
+    {
+        // Only succeeds if the administrator reserved enough huge pages
+        void *pages = mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (pages != MAP_FAILED)
+        {
+            layout->storage = pages;
+            layout->storage_bytes = mapped;
+            layout->backing = PAGE_BACKING_HUGETLB;
+            return EXIT_SUCCESS;
+        }
+        backing = PAGE_BACKING_TRANSPARENT;
+    }
+    if (backing == PAGE_BACKING_TRANSPARENT)
+    {
+        // Over-map by one page so the block can start on a 2 MiB boundary
+        void *pages = mmap(NULL, mapped + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (pages != MAP_FAILED)
+        {
+            char *start = pages;
+            size_t head = (HUGE_PAGE_SIZE - (size_t)start % HUGE_PAGE_SIZE) %
+                          HUGE_PAGE_SIZE;
+            if (head > 0)
+            {
+                munmap(start, head);
+            }
+            munmap(start + head + mapped, HUGE_PAGE_SIZE - head);
+
+            // A refusal only costs the speed-up, the mapping is still usable
+            madvise(start + head, mapped, MADV_HUGEPAGE);
+            layout->storage = start + head;
+            layout->storage_bytes = mapped;
+            layout->backing = PAGE_BACKING_TRANSPARENT;
+            return EXIT_SUCCESS;
+        }
+    }
+#endif
+
+    layout->storage = malloc(bytes);
+    layout->storage_bytes = bytes;
+    layout->backing = PAGE_BACKING_MALLOC;
+    return (layout->storage != NULL) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Release the packed storage of a frozen chain.
+ *
+ * @param layout Layout whose storage to release
+ */
+static void free_layout_storage(NodeLayout *layout)
+{
+#ifdef __linux__
+    if (layout->backing != PAGE_BACKING_MALLOC)
+    {
+        munmap(layout->storage, layout->storage_bytes);
+        layout->storage = NULL;
+        return;
+    }
+#endif
+    free(layout->storage);
+    layout->storage = NULL;
+}
+
+/**
+ * Copy every node and frequency list into two contiguous arrays.
+ *
+ * Nodes are placed in hot_first_order() and renumbered to their position;
+ * their frequency lists follow each other in the same order. The database
+ * keeps its list order (only the pointers change), so sampling with a
+ * given seed is unaffected. Leaves the chain as it was if any allocation
+ * fails.
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @param backing Preferred kind of memory for the arrays
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int pack_nodes(MarkovChain *markov_chain, PageBacking backing)
+{
+    int size = markov_chain->database->size;
+    long frequency_count = 0;
+    NodeLayout *layout = (NodeLayout *)malloc(sizeof(NodeLayout));
+    MarkovNode **by_id = (MarkovNode **)malloc(size * sizeof(MarkovNode *));
+    int *order = (int *)malloc(size * sizeof(int));
+    int *position = (int *)malloc(size * sizeof(int));
+    if (layout == NULL || by_id == NULL || order == NULL || position == NULL)
+    {
+        free(layout);
+        free(by_id);
+        free(order);
+        free(position);
+        return EXIT_FAILURE;
+    }
+
+    for (Node *traveller = markov_chain->database->first; traveller;
+         traveller = traveller->next)
+    {
+        by_id[traveller->data->id] = traveller->data;
+        frequency_count += traveller->data->following_count;
+    }
+
+    // Both arrays share one block; entries follow the nodes
+    size_t node_bytes = size * sizeof(MarkovNode);
+    size_t entry_offset = (node_bytes + sizeof(MarkovNodeFrequency) - 1) /
+                          sizeof(MarkovNodeFrequency);
+    layout->node_count = size;
+    layout->frequency_count = frequency_count;
+    if (hot_first_order(by_id, size, order) == EXIT_FAILURE ||
+        allocate_layout_storage(layout, (entry_offset + frequency_count) *
+                                        sizeof(MarkovNodeFrequency),
+                                backing) == EXIT_FAILURE)
+    {
+        free(layout);
+        free(by_id);
+        free(order);
+        free(position);
+        return EXIT_FAILURE;
+    }
+
+    layout->nodes = (MarkovNode *)layout->storage;
+    layout->frequencies = (MarkovNodeFrequency *)layout->storage + entry_offset;
+    for (int i = 0; i < size; i++)
+    {
+        position[order[i]] = i;
+    }
+
+    // Copy in layout order, redirecting successors to their new copies
+    MarkovNodeFrequency *next_list = layout->frequencies;
+    for (int i = 0; i < size; i++)
+    {
+        MarkovNode *old_node = by_id[order[i]];
+        MarkovNode *new_node = &layout->nodes[i];
+        *new_node = *old_node;
+        new_node->id = i;
+        new_node->frequency_list = NULL;
+        if (old_node->following_count > 0)
+        {
+            new_node->frequency_list = next_list;
+            for (int j = 0; j < old_node->following_count; j++)
+            {
+                next_list[j] = old_node->frequency_list[j];
+                next_list[j].markov_node = &layout->nodes[
+                        position[old_node->frequency_list[j].markov_node->id]];
+            }
+            next_list += old_node->following_count;
+        }
+    }
+
+    for (Node *traveller = markov_chain->database->first; traveller;
+         traveller = traveller->next)
+    {
+        MarkovNode *old_node = traveller->data;
+        traveller->data = &layout->nodes[position[old_node->id]];
+        free(old_node->frequency_list);
+        free(old_node);
+    }
+
+    markov_chain->layout = layout;
+    free(by_id);
+    free(order);
+    free(position);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Freeze the markov chain, packing it on huge pages when it is large.
+ *
+ * @param markov_chain Pointer to the MarkovChain to freeze
+ */
+void freeze_markov_chain(MarkovChain *markov_chain)
+{
+    freeze_markov_chain_backed(markov_chain, PAGE_BACKING_AUTO);
+}
+
+/**
+ * Sort every frequency list by descending frequency, then pack the nodes.
+ *
+ * which_node() stops at the first entry whose cumulative frequency
+ * exceeds the random number, so putting the most common successors first
+ * shortens the expected scan without changing any probabilities. Packing
+ * then puts the hottest states and their successor arrays next to each
+ * other, so a walk touches far fewer cache lines and pages.
+ *
+ * @param markov_chain Pointer to the MarkovChain to freeze
+ * @param backing Preferred kind of memory for the packed arrays
+ */
+void freeze_markov_chain_backed(MarkovChain *markov_chain, PageBacking backing)
+{
+    if (markov_chain->layout != NULL)
+    {
+        return;  // Already frozen
+    }
+
+    // Nothing is added to a frozen chain, and sorting moves every entry
+    free_successor_index(markov_chain);
+    Node *traveller = markov_chain->database->first;
+
+    while (traveller)
+    {
+        sort_frequency_list(traveller->data);
+        traveller = traveller->next;
+    }
+
+    // Without memory for the packed copy the chain stays as it is
+    pack_nodes(markov_chain, backing);
+}
+
+/**
+ * Enable sketch-backed approximate counting on an empty chain.
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @param config Error bounds and capacities
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+int enable_approximate_counts(MarkovChain *markov_chain,
+                              const ApproximateConfig *config)
+{
+    if (config->heavy_hitters <= 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    ApproximateCounts *approximate = malloc(sizeof(ApproximateCounts));
+    if (approximate == NULL)
+    {
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        return EXIT_FAILURE;
+    }
+
+    approximate->sketch = create_count_min_sketch(config->epsilon,
+                                                  config->delta);
+    if (approximate->sketch == NULL)
+    {
+        free(approximate);
+        return EXIT_FAILURE;
+    }
+    approximate->heavy_hitters = config->heavy_hitters;
+    approximate->max_states = config->max_states;
+
+    markov_chain->approximate = approximate;
     return EXIT_SUCCESS;
 }
 
 /**
- * Get a random non-terminal starting node from the database.
+ * Check whether the database has reached its approximate-mode state cap.
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @return true if no new state may be added, false otherwise
+ */
+bool is_database_full(MarkovChain *markov_chain)
+{
+    ApproximateCounts *approximate = markov_chain->approximate;
+    return approximate != NULL && approximate->max_states > 0 &&
+           markov_chain->database->size >= approximate->max_states;
+}
+
+/**
+ * Bytes used by the chain's own structures (state data excluded).
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @return Number of bytes allocated for the chain structure
+ */
+size_t markov_chain_memory_usage(MarkovChain *markov_chain)
+{
+    size_t bytes = sizeof(MarkovChain) + sizeof(LinkedList);
+    Node *traveller = markov_chain->database->first;
+
+    while (traveller)
+    {
+        bytes += sizeof(Node) + sizeof(MarkovNode) +
+                 traveller->data->following_count * sizeof(MarkovNodeFrequency);
+        traveller = traveller->next;
+    }
+
+    if (markov_chain->layout != NULL)
+    {
+        bytes += sizeof(NodeLayout);
+    }
+
+    if (markov_chain->approximate != NULL)
+    {
+        bytes += sizeof(ApproximateCounts) +
+                 count_min_sketch_memory_usage(markov_chain->approximate->sketch);
+    }
+
+    if (markov_chain->decay != NULL)
+    {
+        DecayState *decay = markov_chain->decay;
+        bytes += sizeof(DecayState) + decay->config.window * sizeof(EpochLog);
+        for (int slot = 0; slot < decay->config.window; slot++)
+        {
+            bytes += decay->window_log[slot].capacity * sizeof(TransitionRecord);
+        }
+    }
+
+    return bytes + successor_index_memory_usage(markov_chain);
+}
+
+/**
+ * Give a frequency list's dropped tail back to the allocator.
+ *
+ * Called after following_count was lowered; an emptied list is freed.
+ *
+ * @param node Node whose frequency list to shrink to following_count
+ */
+static void shrink_frequency_list(MarkovNode *node)
+{
+    int keep = node->following_count;
+    if (keep == 0)
+    {
+        free(node->frequency_list);
+        node->frequency_list = NULL;
+        return;
+    }
+
+    // Shrinking cannot lose data; keep the old block if realloc refuses
+    MarkovNodeFrequency *shrunk = (MarkovNodeFrequency *)realloc(
+            node->frequency_list, keep * sizeof(MarkovNodeFrequency));
+    if (shrunk != NULL)
+    {
+        node->frequency_list = shrunk;
+    }
+    node->frequency_list[0].num_of_nodes = keep;
+}
+
+/**
+ * Shrink a sorted frequency list to its first keep entries.
+ *
+ * The frequencies of the dropped entries are subtracted from the node's
+ * all_following and recorded in the report.
+ *
+ * @param node Node whose frequency list to truncate
+ * @param keep Number of leading entries to keep
+ * @param report Report to account the removed transitions in
+ */
+static void truncate_frequency_list(MarkovNode *node, int keep,
+                                    PruneReport *report)
+{
+    if (keep >= node->following_count)
+    {
+        return;
+    }
+
+    long mass = 0;
+    for (int i = keep; i < node->following_count; i++)
+    {
+        mass += node->frequency_list[i].frequency;
+    }
+
+    report->transitions_removed += node->following_count - keep;
+    report->mass_removed += mass;
+    node->all_following -= (int)mass;
+    node->following_count = keep;
+    shrink_frequency_list(node);
+}
+
+/**
+ * Apply the per-state top_k and min_count policies.
  *
- * Randomly selects nodes from the database until finding one that
- * is not a terminal state (as determined by the is_last function).
- * This ensures sequences don't start with a terminal state.
+ * @param markov_chain Pointer to the MarkovChain
+ * @param config Pruning policy
+ * @param report Report to account the removed transitions in
+ */
+static void prune_per_state(MarkovChain *markov_chain, const PruneConfig *config,
+                            PruneReport *report)
+{
+    Node *traveller = markov_chain->database->first;
+
+    while (traveller)
+    {
+        MarkovNode *node = traveller->data;
+        int keep = node->following_count;
+
+        sort_frequency_list(node);
+
+        if (config->top_k > 0 && keep > config->top_k)
+        {
+            keep = config->top_k;
+        }
+
+        // Always keep the most frequent successor
+        while (keep > 1 && node->frequency_list[keep - 1].frequency <
+                           config->min_count)
+        {
+            keep--;
+        }
+
+        truncate_frequency_list(node, keep, report);
+        traveller = traveller->next;
+    }
+}
+
+/**
+ * qsort comparator for ints in ascending order.
+ *
+ * @param first Pointer to the first int
+ * @param second Pointer to the second int
+ * @return Negative, zero or positive like strcmp
+ */
+static int compare_int_asc(const void *first, const void *second)
+{
+    int a = *(const int *)first;
+    int b = *(const int *)second;
+    return (a > b) - (a < b);
+}
+
+/**
+ * Drop the globally lowest-count transitions until the chain fits the budget.
+ *
+ * Only entries past the first of each (sorted) list are candidates. The
+ * cut-off frequency is found by sorting the candidate frequencies; entries
+ * below it are all dropped and entries equal to it are dropped until the
+ * quota is met.
  *
  * @param markov_chain Pointer to the MarkovChain
- * @return Pointer to a randomly selected non-terminal MarkovNode
+ * @param budget Memory budget in bytes
+ * @param report Report to account the removed transitions in
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
  */
-MarkovNode* get_first_random_node(MarkovChain *markov_chain)
+static int prune_transitions_to_budget(MarkovChain *markov_chain, size_t budget,
+                                       PruneReport *report)
 {
-    Node *node_to_return = markov_chain->database->first;
+    size_t usage = markov_chain_memory_usage(markov_chain);
+    if (usage <= budget)
+    {
+        return EXIT_SUCCESS;
+    }
 
-    // Keep selecting random nodes until we find a non-terminal one
-    while (FLAG)
+    long needed = (long)((usage - budget + sizeof(MarkovNodeFrequency) - 1) /
+                         sizeof(MarkovNodeFrequency));
+    long removable = 0;
+    Node *traveller;
+
+    for (traveller = markov_chain->database->first; traveller;
+         traveller = traveller->next)
     {
-        // Get random index in range [0, database size)
-        int num = get_random_number(markov_chain->database->size);
-        int traveller = TRAVELLER;
+        if (traveller->data->following_count > 1)
+        {
+            removable += traveller->data->following_count - 1;
+        }
+    }
+    if (removable == 0)
+    {
+        return EXIT_SUCCESS;
+    }
+    if (needed > removable)
+    {
+        needed = removable;
+    }
 
-        // Traverse to the randomly selected node
-        while (traveller != num)
+    // Collect candidate frequencies and find the cut-off
+    int *frequencies = (int *)malloc(removable * sizeof(int));
+    if (frequencies == NULL)
+    {
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        return EXIT_FAILURE;
+    }
+    long filled = 0;
+    for (traveller = markov_chain->database->first; traveller;
+         traveller = traveller->next)
+    {
+        MarkovNode *node = traveller->data;
+        for (int i = 1; i < node->following_count; i++)
         {
-            node_to_return = node_to_return->next;
-            traveller++;
+            frequencies[filled++] = node->frequency_list[i].frequency;
         }
+    }
+    qsort(frequencies, removable, sizeof(int), compare_int_asc);
 
-        void *one_word = node_to_return->data->data;
+    int threshold = frequencies[needed - 1];
+    long at_threshold = 0;  // How many entries equal to threshold to drop
+    for (long i = needed - 1; i >= 0 && frequencies[i] == threshold; i--)
+    {
+        at_threshold++;
+    }
+    free(frequencies);
+
+    // Lists are sorted, so the dropped entries form a suffix of each list
+    for (traveller = markov_chain->database->first; traveller;
+         traveller = traveller->next)
+    {
+        MarkovNode *node = traveller->data;
+        int keep = node->following_count;
 
-        // Check if this node is a terminal state
-        if (!(markov_chain->is_last(one_word)))
+        while (keep > 1 && node->frequency_list[keep - 1].frequency < threshold)
         {
-            break;  // Found a non-terminal node
+            keep--;
+        }
+        while (keep > 1 && at_threshold > 0 &&
+               node->frequency_list[keep - 1].frequency == threshold)
+        {
+            keep--;
+            at_threshold--;
         }
+        truncate_frequency_list(node, keep, report);
+    }
 
-        // Reset to start of list for next iteration
-        node_to_return = markov_chain->database->first;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Unlink and free every node marked for eviction, then renumber ids.
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @param evict Eviction marks indexed by node id
+ * @param report Report to account the removed states in
+ */
+static void remove_evicted_states(MarkovChain *markov_chain, const char *evict,
+                                  PruneReport *report)
+{
+    LinkedList *database = markov_chain->database;
+    Node *prev = NULL;
+    Node *traveller = database->first;
+
+    forget_evicted_records(markov_chain->decay, evict);
+
+    while (traveller)
+    {
+        MarkovNode *node = traveller->data;
+        if (!evict[node->id])
+        {
+            prev = traveller;
+            traveller = traveller->next;
+            continue;
+        }
+
+        // The evicted state's own transitions go with it
+        truncate_frequency_list(node, 0, report);
+        report->states_removed++;
+
+        Node *removed = remove_next(database, prev);
+        markov_chain->free_data(node->data);
+        free(node);
+        free(removed);
+        traveller = (prev == NULL) ? database->first : prev->next;
     }
 
-    return node_to_return->data;
+    // Keep ids dense after eviction
+    int id = 0;
+    for (traveller = database->first; traveller; traveller = traveller->next)
+    {
+        traveller->data->id = id++;
+    }
 }
 
 /**
- * Select which node to transition to based on cumulative frequency.
+ * Evict the lowest-count states until the chain fits the budget.
  *
- * Uses a random number to probabilistically select the next state
- * based on transition frequencies. Higher frequency transitions have
- * a higher probability of being selected.
+ * A state is never evicted while it is the only successor of another
+ * state. References to evicted states are removed from all frequency
+ * lists; if that would leave a surviving state without successors, its
+ * most frequent successor is spared instead.
  *
- * @param first_node Current node
- * @param random_num Random number in range [0, total_frequency)
- * @return Pointer to the selected MarkovNodeFrequency
+ * @param markov_chain Pointer to the MarkovChain
+ * @param budget Memory budget in bytes
+ * @param report Report to account the removed states in
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
  */
-MarkovNodeFrequency* which_node(MarkovNode *first_node, int random_num)
+static int prune_states_to_budget(MarkovChain *markov_chain, size_t budget,
+                                  PruneReport *report)
 {
-    int which_word = WHICH_WORD;
+    size_t usage = markov_chain_memory_usage(markov_chain);
+    if (usage <= budget)
+    {
+        return EXIT_SUCCESS;
+    }
 
-    // Iterate through frequency list, accumulating frequencies
-    for (int i = 0; i < first_node->following_count; ++i)
+    int size = markov_chain->database->size;
+    MarkovNode **by_id = (MarkovNode **)malloc(size * sizeof(MarkovNode *));
+    StateWeight *weights = (StateWeight *)calloc(size, sizeof(StateWeight));
+    char *pinned = (char *)calloc(size, sizeof(char));
+    char *evict = (char *)calloc(size, sizeof(char));
+    if (by_id == NULL || weights == NULL || pinned == NULL || evict == NULL)
     {
-        MarkovNodeFrequency *freq = &(first_node->frequency_list[i]);
-        which_word = which_word + freq->frequency;
+        free(by_id);
+        free(weights);
+        free(pinned);
+        free(evict);
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        return EXIT_FAILURE;
+    }
 
-        // If cumulative frequency exceeds random number, select this node
-        if (which_word > random_num)
+    // Weigh every state by the transition mass touching it
+    Node *traveller;
+    for (traveller = markov_chain->database->first; traveller;
+         traveller = traveller->next)
+    {
+        MarkovNode *node = traveller->data;
+        by_id[node->id] = node;
+        weights[node->id].id = node->id;
+        weights[node->id].weight += node->all_following;
+
+        for (int i = 0; i < node->following_count; i++)
         {
-            return freq;
+            weights[node->frequency_list[i].markov_node->id].weight +=
+                    node->frequency_list[i].frequency;
+        }
+        if (node->following_count == 1)
+        {
+            pinned[node->frequency_list[0].markov_node->id] = 1;
         }
     }
+    qsort(weights, size, sizeof(StateWeight), compare_state_weight_asc);
 
-    // Fallback to first node (shouldn't normally reach here)
-    MarkovNodeFrequency *freq = &(first_node->frequency_list[0]);
-    return freq;
+    // Mark the lightest unpinned states until enough bytes are freed
+    size_t excess = usage - budget;
+    size_t freed = 0;
+    for (int i = 0; i < size && freed < excess; i++)
+    {
+        MarkovNode *node = by_id[weights[i].id];
+        if (pinned[node->id])
+        {
+            continue;
+        }
+        evict[node->id] = 1;
+        freed += sizeof(Node) + sizeof(MarkovNode) +
+                 node->following_count * sizeof(MarkovNodeFrequency);
+    }
+
+    // Spare the top successor of any survivor that would lose all of them
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (traveller = markov_chain->database->first; traveller;
+             traveller = traveller->next)
+        {
+            MarkovNode *node = traveller->data;
+            if (evict[node->id] || node->following_count == 0)
+            {
+                continue;
+            }
+
+            bool all_evicted = true;
+            for (int i = 0; i < node->following_count && all_evicted; i++)
+            {
+                all_evicted = evict[node->frequency_list[i].markov_node->id];
+            }
+            if (all_evicted)
+            {
+                evict[node->frequency_list[0].markov_node->id] = 0;
+                changed = true;
+            }
+        }
+    }
+
+    // Remove references to evicted states from the survivors
+    for (traveller = markov_chain->database->first; traveller;
+         traveller = traveller->next)
+    {
+        MarkovNode *node = traveller->data;
+        if (evict[node->id])
+        {
+            continue;
+        }
+
+        int kept = 0;
+        for (int i = 0; i < node->following_count; i++)
+        {
+            MarkovNodeFrequency entry = node->frequency_list[i];
+            if (evict[entry.markov_node->id])
+            {
+                report->transitions_removed++;
+                report->mass_removed += entry.frequency;
+                node->all_following -= entry.frequency;
+                continue;
+            }
+            node->frequency_list[kept].markov_node = entry.markov_node;
+            node->frequency_list[kept].frequency = entry.frequency;
+            kept++;
+        }
+        if (kept < node->following_count)
+        {
+            node->following_count = kept;
+            shrink_frequency_list(node);
+        }
+    }
+
+    remove_evicted_states(markov_chain, evict, report);
+
+    free(by_id);
+    free(weights);
+    free(pinned);
+    free(evict);
+    return EXIT_SUCCESS;
 }
 
 /**
- * Get the next random node based on frequency distribution.
+ * Prune rare transitions and states from the Markov chain.
  *
- * Randomly selects the next state to transition to, with the probability
- * of each state proportional to its frequency in the current node's
- * frequency list.
+ * Applies top_k and min_count per state, then enforces the memory budget
+ * first by dropping transitions and then by evicting states.
  *
- * @param cur_markov_node Current MarkovNode
- * @return Pointer to the next randomly selected MarkovNode
+ * @param markov_chain Pointer to the MarkovChain to prune
+ * @param config Pruning policy
+ * @param report Filled with what was removed (may be NULL)
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
  */
-MarkovNode* get_next_random_node(MarkovNode *cur_markov_node)
+int prune_markov_chain(MarkovChain *markov_chain, const PruneConfig *config,
+                       PruneReport *report)
 {
-    // Get random number in range [0, total_transitions)
-    int random_num = get_random_number(cur_markov_node->all_following);
+    PruneReport local_report;
+    if (report == NULL)
+    {
+        report = &local_report;
+    }
+    *report = (PruneReport) {0, 0, 0, 0, 0};
+    report->bytes_before = markov_chain_memory_usage(markov_chain);
+    if (markov_chain->layout != NULL)
+    {
+        return EXIT_FAILURE;  // Packed nodes cannot be freed one by one
+    }
 
-    // Select node based on cumulative frequency distribution
-    MarkovNodeFrequency *freq_node = which_node(cur_markov_node, random_num);
+    // Pruning sorts and truncates lists and renumbers states
+    free_successor_index(markov_chain);
+    prune_per_state(markov_chain, config, report);
 
-    return freq_node->markov_node;
+    if (config->memory_budget > 0)
+    {
+        if (prune_transitions_to_budget(markov_chain, config->memory_budget,
+                                        report) == EXIT_FAILURE ||
+            prune_states_to_budget(markov_chain, config->memory_budget,
+                                   report) == EXIT_FAILURE)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (report->transitions_removed > 0 &&
+        forget_pruned_records(markov_chain) == EXIT_FAILURE)
+    {
+        return EXIT_FAILURE;
+    }
+
+    report->bytes_after = markov_chain_memory_usage(markov_chain);
+    return EXIT_SUCCESS;
 }
 
+#ifdef MARKOV_STATS
 /**
- * Generate and print a random sequence from the Markov chain.
+ * Start timing a new phase, closing the current one.
  *
- * Starting from first_node, generates a sequence by repeatedly selecting
- * the next state based on transition frequencies. Continues until either:
- * - A terminal state is reached (as determined by is_last)
- * - The maximum length is reached
+ * Repeated phase names accumulate into the same slot.
+ *
+ * @param name Phase name (must outlive the program's stats dump)
+ */
+void markov_stats_phase(const char *name)
+{
+    clock_t now = clock();
+
+    if (markov_stats.current_phase >= 0)
+    {
+        markov_stats.phase_ticks[markov_stats.current_phase] +=
+                now - markov_stats.phase_start;
+    }
+
+    int phase = 0;
+    while (phase < markov_stats.phase_count &&
+           strcmp(markov_stats.phase_names[phase], name) != 0)
+    {
+        phase++;
+    }
+    if (phase == markov_stats.phase_count && phase < MAX_PHASES)
+    {
+        markov_stats.phase_names[phase] = name;
+        markov_stats.phase_ticks[phase] = 0;
+        markov_stats.phase_count++;
+    }
+
+    markov_stats.current_phase = (phase < MAX_PHASES) ? phase : -1;
+    markov_stats.phase_start = now;
+}
+
+/**
+ * Print the hot-path counters and per-phase timings.
+ *
+ * @param out Stream to print to
+ */
+static void print_hot_path_counters(FILE *out)
+{
+    // Close the running phase so its time is included
+    if (markov_stats.current_phase >= 0)
+    {
+        markov_stats_phase(markov_stats.phase_names[markov_stats.current_phase]);
+    }
+
+    fprintf(out, "Database lookups: %ld (%.2f probes/lookup)\n",
+            markov_stats.lookups, markov_stats.lookups ?
+            (double)markov_stats.lookup_probes / markov_stats.lookups : 0.0);
+    fprintf(out, "comp_func calls: %ld\n", markov_stats.comp_calls);
+    fprintf(out, "Frequency list reallocs: %ld\n",
+            markov_stats.frequency_reallocs);
+    fprintf(out, "which_node calls: %ld (%.2f entries scanned/call)\n",
+            markov_stats.which_node_calls, markov_stats.which_node_calls ?
+            (double)markov_stats.which_node_scanned /
+            markov_stats.which_node_calls : 0.0);
+    fprintf(out, "get_first_random_node calls: %ld (%ld retries)\n",
+            markov_stats.first_node_calls, markov_stats.first_node_retries);
+
+    for (int phase = 0; phase < markov_stats.phase_count; phase++)
+    {
+        fprintf(out, "Phase %s: %.3f s\n", markov_stats.phase_names[phase],
+                (double)markov_stats.phase_ticks[phase] / CLOCKS_PER_SEC);
+    }
+}
+#endif
+
+/**
+ * Dump structural statistics (and hot-path counters if compiled in).
  *
  * @param markov_chain Pointer to the MarkovChain
- * @param first_node Starting node for sequence generation
- * @param max_length Maximum number of states to generate
+ * @param out Stream to print to
  */
-void generate_random_sequence(MarkovChain *markov_chain, MarkovNode *first_node,
-                              int max_length)
+void markov_chain_stats(MarkovChain *markov_chain, FILE *out)
 {
-    int len_of_tweet = LEN_OF_TWEET;
+    long fanout[FANOUT_BUCKETS] = {0};
+    long entries = 0;
+    long transitions = 0;
+    int max_fanout = 0;
+    Node *traveller;
 
-    // Continue until terminal state or max length reached
-    while ((!markov_chain->is_last(first_node->data)) && len_of_tweet < max_length)
+    for (traveller = markov_chain->database->first; traveller;
+         traveller = traveller->next)
     {
-        // Select next node based on frequency distribution
-        first_node = get_next_random_node(first_node);
+        MarkovNode *node = traveller->data;
+        int bucket = 0;
 
-        // Print the selected node's data
-        markov_chain->print_func(first_node->data);
+        // Bucket b > 0 holds fan-outs in [2^(b-1), 2^b)
+        while (bucket < FANOUT_BUCKETS - 1 && (1L << bucket) <= node->following_count)
+        {
+            bucket++;
+        }
+        fanout[bucket]++;
+        entries += node->following_count;
+        transitions += node->all_following;
+        if (node->following_count > max_fanout)
+        {
+            max_fanout = node->following_count;
+        }
+    }
 
-        len_of_tweet++;
+    long states = markov_chain->database->size;
+    fprintf(out, "Vocabulary size: %ld states\n", states);
+    fprintf(out, "Transitions: %ld distinct, %ld observed, max fan-out %d\n",
+            entries, transitions, max_fanout);
+
+    fprintf(out, "Fan-out histogram:\n");
+    fprintf(out, "  %8d       : %ld\n", 0, fanout[0]);
+    for (int bucket = 1; bucket < FANOUT_BUCKETS; bucket++)
+    {
+        if (fanout[bucket] > 0)
+        {
+            fprintf(out, "  %8ld-%-6ld: %ld\n", 1L << (bucket - 1),
+                    (1L << bucket) - 1, fanout[bucket]);
+        }
+    }
+
+    fprintf(out, "Bytes: %zu list nodes, %zu markov nodes, %zu frequency "
+                 "entries",
+            states * sizeof(Node), states * sizeof(MarkovNode),
+            entries * sizeof(MarkovNodeFrequency));
+    if (markov_chain->approximate != NULL)
+    {
+        fprintf(out, ", %zu sketch", count_min_sketch_memory_usage(
+                markov_chain->approximate->sketch));
+    }
+    if (markov_chain->decay != NULL)
+    {
+        size_t log_bytes = 0;
+        for (int slot = 0; slot < markov_chain->decay->config.window; slot++)
+        {
+            log_bytes += markov_chain->decay->window_log[slot].capacity *
+                         sizeof(TransitionRecord);
+        }
+        fprintf(out, ", %zu window logs", log_bytes);
     }
+    if (markov_chain->successors != NULL)
+    {
+        fprintf(out, ", %zu successor tables",
+                successor_index_memory_usage(markov_chain));
+    }
+    fprintf(out, " (%zu total)\n", markov_chain_memory_usage(markov_chain));
+    if (markov_chain->layout != NULL)
+    {
+        fprintf(out, "Packed layout: %zu bytes on %s pages\n",
+                markov_chain->layout->storage_bytes,
+                page_backing_name(markov_chain->layout->backing));
+    }
+
+#ifdef MARKOV_STATS
+    print_hot_path_counters(out);
+#else
+    fprintf(out, "Hot-path counters disabled (build with -DMARKOV_STATS)\n");
+#endif
 }
 
 /**
@@ -369,6 +2754,26 @@ void free_markov_chain(MarkovChain **ptr_chain)
 
     MarkovChain *chain = *ptr_chain;
 
+    // Free the approximate counting state, if any
+    if (chain->approximate != NULL)
+    {
+        free_count_min_sketch(&chain->approximate->sketch);
+        free(chain->approximate);
+        chain->approximate = NULL;
+    }
+
+    // Free the decay state and its window logs, if any
+    if (chain->decay != NULL)
+    {
+        for (int slot = 0; slot < chain->decay->config.window; slot++)
+        {
+            free(chain->decay->window_log[slot].records);
+        }
+        free(chain->decay->window_log);
+        free(chain->decay);
+        chain->decay = NULL;
+    }
+
     // If database is NULL, just free the chain itself
     if (chain->database == NULL)
     {
@@ -377,6 +2782,7 @@ void free_markov_chain(MarkovChain **ptr_chain)
         return;
     }
 
+    free_successor_index(chain);
     Node *traveller = chain->database->first;
 
     // Traverse through all nodes in the database
@@ -393,16 +2799,14 @@ void free_markov_chain(MarkovChain **ptr_chain)
                 our_node->data = NULL;
             }
 
-            // Free the frequency list
-            if (our_node->frequency_list)
+            // Packed nodes and lists are freed below, all at once
+            if (chain->layout == NULL)
             {
                 free(our_node->frequency_list);
                 our_node->frequency_list = NULL;
+                free(our_node);
+                our_node = NULL;
             }
-
-            // Free the MarkovNode itself
-            free(our_node);
-            our_node = NULL;
         }
 
         // Move to next node and free current
@@ -413,6 +2817,12 @@ void free_markov_chain(MarkovChain **ptr_chain)
     }
 
     // Free remaining structures
+    if (chain->layout != NULL)
+    {
+        free_layout_storage(chain->layout);
+        free(chain->layout);
+        chain->layout = NULL;
+    }
     free(traveller);
     traveller = NULL;
     free(chain->database);
@@ -2,10 +2,20 @@
 #define _MARKOV_CHAIN_H
 
 #include "linked_list.h"
+#include "count_min_sketch.h"
 #include <stdio.h>  // For printf(), sscanf()
 #include <stdlib.h> // For exit(), malloc()
 #include <stdbool.h> // for bool
 
+// Walks generate_sequences_batch() advances together
+#define LOCKSTEP_WALKS 32
+
+// Fan-out past which exact training indexes a node's successors by id
+#define SUCCESSOR_TABLE_THRESHOLD 32
+
+// Id of an unused SuccessorTable slot
+#define EMPTY_SUCCESSOR_SLOT -1
+
 // Error message for memory allocation failures
 #define ALLOCATION_ERROR_MASSAGE \
 "Allocation failure: Failed to allocate new memory\n"
@@ -29,6 +39,12 @@ typedef void *(*copy_func_t)(void *data);
 // Function pointer type for checking if data represents a last state
 typedef bool (*is_last_t)(void *data);
 
+// Function pointer type for formatting data into a buffer (snprintf-like)
+typedef int (*format_func_t)(void *data, char *buffer, size_t size);
+
+// Caller-owned random generator state for the thread-safe *_r functions
+typedef unsigned long long random_state_t;
+
 /***************************/
 /*        STRUCTS          */
 /***************************/
@@ -43,6 +59,7 @@ typedef struct MarkovNode {
     struct MarkovNodeFrequency *frequency_list;  // Array of possible next states with frequencies
     int all_following;                       // Total count of all transitions from this node
     int following_count;                     // Number of distinct states that can follow this one
+    int id;                                  // Dense index of this node in the database
 } MarkovNode;
 
 /**
@@ -57,6 +74,132 @@ typedef struct MarkovNodeFrequency {
     int num_of_nodes;                // Total number of nodes in frequency list
 } MarkovNodeFrequency;
 
+/**
+ * ApproximateConfig structure.
+ * Parameters for sketch-backed approximate counting.
+ */
+typedef struct ApproximateConfig {
+    double epsilon;     // Count overestimate bound, as a fraction of all transitions
+    double delta;       // Probability that a count exceeds the bound
+    int heavy_hitters;  // Candidate successors kept per state
+    int max_states;     // Maximum number of states (0 = unlimited)
+} ApproximateConfig;
+
+/**
+ * ApproximateCounts structure.
+ * State of approximate counting: transition counts live in a count-min
+ * sketch keyed by (state id, successor id), and every frequency_list holds
+ * at most heavy_hitters candidates whose frequencies are sketch estimates.
+ */
+typedef struct ApproximateCounts {
+    CountMinSketch *sketch;  // Transition counts
+    int heavy_hitters;       // Capacity of every frequency list
+    int max_states;          // Cap on database size (0 = unlimited)
+} ApproximateCounts;
+
+/**
+ * DecayConfig structure.
+ * Time-decay and sliding-window parameters, both measured in epochs
+ * (see advance_epoch()). A zero field disables that mechanism.
+ */
+typedef struct DecayConfig {
+    int half_life;  // Epochs after which an observation counts half as much
+    int window;     // Number of most recent epochs whose observations count
+} DecayConfig;
+
+/**
+ * TransitionRecord structure.
+ * One observation logged for sliding-window expiry.
+ */
+typedef struct TransitionRecord {
+    struct MarkovNode *from;  // Source state
+    struct MarkovNode *to;    // Successor state
+    int weight;               // Weight that was added to the transition
+} TransitionRecord;
+
+/**
+ * EpochLog structure.
+ * Growable array of the observations made during one epoch.
+ */
+typedef struct EpochLog {
+    TransitionRecord *records;  // Logged observations
+    int count;                  // Number of records in use
+    int capacity;               // Number of records allocated
+} EpochLog;
+
+/**
+ * DecayState structure.
+ * Lazy decay: rather than shrinking old counts, every new observation
+ * weighs 2^weight_shift and the shift grows by one each half-life. Counts
+ * are rescaled in a single sweep only when the shift or a total gets large.
+ */
+typedef struct DecayState {
+    DecayConfig config;   // Half-life and window length
+    long epoch;           // Current epoch number
+    int weight_shift;     // log2 of the weight of a new observation
+    EpochLog *window_log; // Ring of config.window epoch logs (NULL if no window)
+} DecayState;
+
+/**
+ * Kind of memory backing the packed storage of a frozen chain.
+ * A kind that is unavailable falls back to the next one in this list.
+ */
+typedef enum PageBacking {
+    PAGE_BACKING_AUTO,         // Huge pages for storage of 2 MiB or more, else malloc
+    PAGE_BACKING_HUGETLB,      // Explicit 2 MiB pages (MAP_HUGETLB)
+    PAGE_BACKING_TRANSPARENT,  // Anonymous mapping with madvise(MADV_HUGEPAGE)
+    PAGE_BACKING_MALLOC        // Ordinary heap memory
+} PageBacking;
+
+/**
+ * NodeLayout structure.
+ * Storage of a frozen chain: all nodes in one array, hottest first, and all
+ * frequency lists back to back in the same order, both in a single block.
+ */
+typedef struct NodeLayout {
+    MarkovNode *nodes;                 // Every node, indexed by id
+    MarkovNodeFrequency *frequencies;  // Every frequency list, in node order
+    int node_count;                    // Number of nodes
+    long frequency_count;              // Number of frequency entries
+    void *storage;                     // Block holding both arrays
+    size_t storage_bytes;              // Bytes allocated or mapped for storage
+    PageBacking backing;               // How storage was obtained
+} NodeLayout;
+
+/**
+ * SuccessorSlot structure.
+ * One slot of a SuccessorTable.
+ */
+typedef struct SuccessorSlot {
+    int id;        // Successor node id, or EMPTY_SUCCESSOR_SLOT
+    int position;  // Index of the successor's entry in the frequency list
+} SuccessorSlot;
+
+/**
+ * SuccessorTable structure.
+ * Open-addressing index of one high fan-out frequency list, from successor
+ * id to entry position, so a new observation finds its entry without
+ * scanning the list. The list itself stays one contiguous array (it is
+ * what sampling reads) and grows geometrically while indexed.
+ */
+typedef struct SuccessorTable {
+    SuccessorSlot *slots;  // capacity slots, linear probing
+    int slot_count;        // Number of slots (power of two)
+    int list_capacity;     // Entries allocated for the frequency list
+} SuccessorTable;
+
+/**
+ * SuccessorIndex structure.
+ * Successor tables of the nodes whose fan-out passed
+ * SUCCESSOR_TABLE_THRESHOLD while training with exact counts. Tables are
+ * built lazily, dropped by anything that reorders or renumbers entries
+ * wholesale (pruning, renormalization) and discarded at freeze.
+ */
+typedef struct SuccessorIndex {
+    SuccessorTable **tables;  // Table per node id, NULL for low fan-out nodes
+    int count;                // Number of entries in tables
+} SuccessorIndex;
+
 /**
  * MarkovChain structure.
  * Represents the entire Markov chain model.
@@ -86,8 +229,53 @@ typedef struct MarkovChain {
     // Function pointer to check if a state is terminal (last in sequence)
     // Returns: true if it's the last state, false otherwise
     is_last_t is_last;
+
+    // Sketch-backed approximate counting, or NULL for exact counts
+    ApproximateCounts *approximate;
+
+    // Time-decayed / sliding-window counting, or NULL for plain counts
+    DecayState *decay;
+
+    // Packed node storage once frozen, or NULL while training
+    NodeLayout *layout;
+
+    // Successor tables of high fan-out nodes, or NULL if there are none
+    SuccessorIndex *successors;
 } MarkovChain;
 
+/**
+ * StartIndex structure.
+ * Every state get_first_random_node() may return, gathered once so that
+ * start states are drawn with a single random index instead of a walk
+ * down the database.
+ */
+typedef struct StartIndex {
+    MarkovNode **nodes;  // Non-terminal states with at least one successor
+    int count;           // Number of entries in nodes
+} StartIndex;
+
+/**
+ * PruneConfig structure.
+ * Pruning policy for prune_markov_chain(). A zero field disables that policy.
+ */
+typedef struct PruneConfig {
+    int min_count;         // Drop transitions observed fewer than this many times
+    int top_k;             // Keep at most this many successors per state
+    size_t memory_budget;  // Evict lowest-count transitions/states above this many bytes
+} PruneConfig;
+
+/**
+ * PruneReport structure.
+ * Describes what a call to prune_markov_chain() removed.
+ */
+typedef struct PruneReport {
+    long transitions_removed;  // Frequency entries dropped
+    long states_removed;       // MarkovNodes evicted from the database
+    long mass_removed;         // Sum of frequencies of the dropped transitions
+    size_t bytes_before;       // markov_chain_memory_usage() before pruning
+    size_t bytes_after;        // markov_chain_memory_usage() after pruning
+} PruneReport;
+
 /***************************/
 /*    FUNCTION PROTOTYPES  */
 /***************************/
@@ -96,14 +284,22 @@ typedef struct MarkovChain {
  * Get one random state from the given markov_chain's database.
  *
  * Randomly selects a state from the database that is not a terminal state
- * (i.e., not a "last state" in a sequence). This is typically used to
- * start generating a random sequence.
+ * (i.e., not a "last state" in a sequence) and has at least one successor.
+ * This is typically used to start generating a random sequence.
  *
  * @param markov_chain Pointer to the MarkovChain
  * @return Pointer to a randomly selected MarkovNode that is not a last state
  */
 MarkovNode* get_first_random_node(MarkovChain *markov_chain);
 
+/**
+ * Check whether get_first_random_node() has any state to return.
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @return true if some state is not a last state and has a successor
+ */
+bool has_start_node(MarkovChain *markov_chain);
+
 /**
  * Choose randomly the next state based on occurrence frequency.
  *
@@ -116,13 +312,122 @@ MarkovNode* get_first_random_node(MarkovChain *markov_chain);
  */
 MarkovNode* get_next_random_node(MarkovNode *cur_markov_node);
 
+/**
+ * Seed a caller-owned random generator state.
+ *
+ * @param state State to initialize
+ * @param seed Seed value; equal seeds give equal streams
+ */
+void seed_random_state(random_state_t *state, unsigned long long seed);
+
+/**
+ * Get a random number in [0, max_number) from a caller-owned state.
+ *
+ * Unlike rand(), independent states can be used from different threads.
+ *
+ * @param max_number Upper bound (exclusive)
+ * @param state Generator state, advanced in place
+ * @return Random number in range [0, max_number)
+ */
+int get_random_number_r(int max_number, random_state_t *state);
+
+/**
+ * Thread-safe get_next_random_node() using a caller-owned random state.
+ *
+ * The chain must not be modified concurrently.
+ *
+ * @param cur_markov_node Current MarkovNode to choose successor from
+ * @param state Generator state
+ * @return Pointer to the randomly chosen next MarkovNode
+ */
+MarkovNode* get_next_random_node_r(MarkovNode *cur_markov_node,
+                                   random_state_t *state);
+
+/**
+ * Generate a random sequence into an array instead of printing it.
+ *
+ * Uses the same stopping rules as generate_random_sequence() and a
+ * caller-owned random state, so it can run on several threads at once
+ * over a chain that is no longer being trained.
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @param first_node Starting node, stored as out[0]
+ * @param max_length Maximum number of states, including first_node
+ * @param out Array with room for max_length node pointers
+ * @param state Generator state
+ * @return Number of states written to out
+ */
+int generate_sequence_r(MarkovChain *markov_chain, MarkovNode *first_node,
+                        int max_length, MarkovNode **out,
+                        random_state_t *state);
+
+/**
+ * Collect every state a sequence may start from.
+ *
+ * The index holds node pointers, so rebuild it after the chain changes.
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @param index Index to fill; count is 0 if no state can start a sequence
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+int build_start_index(MarkovChain *markov_chain, StartIndex *index);
+
+/**
+ * Free the array of a start index.
+ *
+ * @param index Index to empty
+ */
+void free_start_index(StartIndex *index);
+
+/**
+ * Draw count start states uniformly from a start index.
+ *
+ * Gives the same distribution as get_first_random_node(), without
+ * rejection or database traversal.
+ *
+ * @param index Non-empty start index
+ * @param count Number of states to draw
+ * @param out Array with room for count node pointers
+ * @param state Generator state
+ */
+void sample_start_nodes(const StartIndex *index, int count, MarkovNode **out,
+                        random_state_t *state);
+
+/**
+ * Generate several random sequences in lockstep.
+ *
+ * Equivalent to calling generate_sequence_r() once per start node, but the
+ * walks advance together one state at a time: while one walk samples its
+ * successor, the nodes, frequency lists and data the other walks need next
+ * are already being prefetched. On chains larger than the cache this hides
+ * most of the memory latency that a single walk pays on every step.
+ *
+ * Walks are advanced in groups of up to LOCKSTEP_WALKS and random numbers
+ * are drawn walk by walk within each step, so the result differs from
+ * separate generate_sequence_r() calls but is reproducible for a given
+ * state.
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @param firsts Start node of each walk
+ * @param count Number of walks
+ * @param max_length Maximum number of states per walk, including its start
+ * @param out Array of count * max_length node pointers; walk i is written
+ *        to out[i * max_length] onwards
+ * @param lengths Receives the number of states of each walk
+ * @param state Generator state
+ */
+void generate_sequences_batch(MarkovChain *markov_chain, MarkovNode **firsts,
+                              int count, int max_length, MarkovNode **out,
+                              int *lengths, random_state_t *state);
+
 /**
  * Generate and print a random sequence from the markov chain.
  *
  * Starting from the given node (or a random starting node if NULL),
  * generates a sequence of states by repeatedly selecting the next state
  * based on transition frequencies. The sequence continues until either:
- * - A terminal state is reached, or
+ * - A terminal state is reached,
+ * - A state without successors is reached (e.g. after pruning or expiry), or
  * - The maximum length is reached
  *
  * The sequence must have at least 2 states.
@@ -134,6 +439,184 @@ MarkovNode* get_next_random_node(MarkovNode *cur_markov_node);
 void generate_random_sequence(MarkovChain *markov_chain, MarkovNode *first_node,
                               int max_length);
 
+/**
+ * Freeze the markov chain once training is complete.
+ *
+ * Re-sorts the frequency list of every node by descending frequency so
+ * that sampling finds the common successors within the first few entries.
+ * The sampling distribution is unchanged; only the scan order differs.
+ *
+ * Compiling with -DADAPTIVE_FREQUENCY_ORDER keeps the lists sorted during
+ * training instead, in which case freezing is cheap (already sorted).
+ *
+ * Then moves every node into one array and every frequency list into
+ * another (see NodeLayout), ordered hot-first: states are ranked by how
+ * often transitions arrive at them and laid out breadth-first from the
+ * hottest, so walks stay within a small, contiguous part of memory. Node
+ * ids are renumbered to the new order; the database keeps its order, so
+ * get_first_random_node() is unaffected. If the packed copy cannot be
+ * allocated the nodes stay where they are.
+ *
+ * A frozen chain is read only: adding states or transitions and pruning
+ * fail. MarkovNode pointers taken before freezing are invalidated.
+ *
+ * The packed storage uses PAGE_BACKING_AUTO, so large chains sit on 2 MiB
+ * pages where the system provides them and random walks miss the TLB far
+ * less often.
+ *
+ * @param markov_chain Pointer to the MarkovChain to freeze
+ */
+void freeze_markov_chain(MarkovChain *markov_chain);
+
+/**
+ * Freeze the markov chain with a chosen backing for its packed storage.
+ *
+ * Same as freeze_markov_chain(); the storage comes from backing, or from
+ * the next available kind if that fails. The kind actually used is left in
+ * markov_chain->layout->backing.
+ *
+ * @param markov_chain Pointer to the MarkovChain to freeze
+ * @param backing Preferred kind of memory
+ */
+void freeze_markov_chain_backed(MarkovChain *markov_chain, PageBacking backing);
+
+/**
+ * Name of a page backing, for reports.
+ *
+ * @param backing Page backing
+ * @return Static string such as "hugetlb"
+ */
+const char *page_backing_name(PageBacking backing);
+
+/**
+ * Switch the markov chain to approximate, fixed-memory counting.
+ *
+ * Must be called before any transition is added. Afterwards
+ * add_node_to_frequency_list() counts transitions in a count-min sketch and
+ * keeps only the heavy_hitters successors with the highest estimates in
+ * each frequency_list; get_next_random_node() samples among those. The
+ * memory used for counts is fixed regardless of stream length, and
+ * capping max_states bounds the database as well (see is_database_full()).
+ *
+ * Sketch keys are node ids, so do not evict states with
+ * prune_markov_chain() while still training in this mode.
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @param config Error bounds and capacities
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on invalid config or allocation error
+ */
+int enable_approximate_counts(MarkovChain *markov_chain,
+                              const ApproximateConfig *config);
+
+/**
+ * Make transition counts decay over time and/or expire after a window.
+ *
+ * Time is measured in epochs advanced by advance_epoch(). With a half-life
+ * H, an observation made H epochs ago weighs half as much as a new one;
+ * this is done lazily by growing the weight of new observations, so no
+ * per-node work is needed when an epoch ends. With a window W, every
+ * observation is logged and subtracted again W epochs later.
+ *
+ * Under both mechanisms all_following always equals the sum of the node's
+ * frequencies, and transitions whose count reaches zero are removed.
+ * Cannot be combined with approximate counting. Transitions and states
+ * removed by prune_markov_chain() take their logged observations with
+ * them, so a window may be combined with a memory budget.
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @param config Half-life and window length in epochs
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on invalid config or allocation error
+ */
+int enable_decay(MarkovChain *markov_chain, const DecayConfig *config);
+
+/**
+ * End the current epoch.
+ *
+ * Expires the observations that leave the sliding window and advances the
+ * decay clock. Does nothing if decay is not enabled.
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ */
+void advance_epoch(MarkovChain *markov_chain);
+
+/**
+ * Check whether the database has reached its state cap.
+ *
+ * Only approximate counting with max_states set imposes a cap.
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @return true if no new state may be added, false otherwise
+ */
+bool is_database_full(MarkovChain *markov_chain);
+
+/**
+ * Bytes used by the chain's own structures.
+ *
+ * Counts the MarkovChain, the database list and its nodes, every MarkovNode,
+ * every frequency list, the count-min sketch and the decay window logs if
+ * any, and the successor tables of high fan-out states with the spare room
+ * of their lists. State data is owned by the user's copy_func and is not
+ * included.
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @return Number of bytes allocated for the chain structure
+ */
+size_t markov_chain_memory_usage(MarkovChain *markov_chain);
+
+/**
+ * Prune rare transitions and states from the markov chain.
+ *
+ * Applies, in order:
+ * 1. top_k - keeps only the k most frequent successors of every state
+ * 2. min_count - drops successors observed fewer than min_count times
+ * 3. memory_budget - while the chain is larger than the budget, drops the
+ *    globally lowest-count transitions, then evicts the lowest-count states
+ *
+ * Every state keeps at least its most frequent successor, so pruning never
+ * turns a walkable state into a dead end. The frequency of every removed
+ * transition is subtracted from its source's all_following, keeping
+ * sampling consistent. Frequency lists are left sorted by descending
+ * frequency, and node ids are renumbered densely if states were evicted.
+ *
+ * Any MarkovNode pointer held by the caller may be invalidated when states
+ * are evicted.
+ *
+ * @param markov_chain Pointer to the MarkovChain to prune
+ * @param config Pruning policy
+ * @param report Filled with what was removed (may be NULL)
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+int prune_markov_chain(MarkovChain *markov_chain, const PruneConfig *config,
+                       PruneReport *report);
+
+/**
+ * Print statistics about the markov chain.
+ *
+ * Always reports the vocabulary size, a power-of-two fan-out histogram and
+ * the bytes used by each structure. When compiled with -DMARKOV_STATS it
+ * also reports the hot-path counters (database probes per lookup,
+ * comp_func calls, frequency list reallocs, which_node scan lengths,
+ * get_first_random_node retries) and the CPU time of every phase marked
+ * with MARKOV_STATS_PHASE().
+ *
+ * @param markov_chain Pointer to the MarkovChain
+ * @param out Stream to print to
+ */
+void markov_chain_stats(MarkovChain *markov_chain, FILE *out);
+
+#ifdef MARKOV_STATS
+/**
+ * Start timing a phase (e.g. "train", "generate"), ending the previous one.
+ * Use through MARKOV_STATS_PHASE() so the call disappears when disabled.
+ *
+ * @param name Phase name; a string literal
+ */
+void markov_stats_phase(const char *name);
+#define MARKOV_STATS_PHASE(name) markov_stats_phase(name)
+#else
+#define MARKOV_STATS_PHASE(name) ((void)0)
+#endif
+
 /**
  * Free all memory associated with the markov chain.
  *
@@ -143,8 +626,9 @@ void generate_random_sequence(MarkovChain *markov_chain, MarkovNode *first_node,
  * 3. Frees all MarkovNode structures
  * 4. Frees all linked list nodes
  * 5. Frees the linked list itself
- * 6. Frees the MarkovChain structure
- * 7. Sets the pointer to NULL
+ * 6. Frees the approximate counting and decay state, if any
+ * 7. Frees the MarkovChain structure
+ * 8. Sets the pointer to NULL
  *
  * @param chain_ptr Pointer to pointer to the MarkovChain to free
  */
@@ -166,6 +650,23 @@ void free_markov_chain(MarkovChain **chain_ptr);
 int add_node_to_frequency_list(MarkovNode *first_node, MarkovNode *second_node,
                                MarkovChain *markov_chain);
 
+/**
+ * Add a transition observed weight times at once.
+ *
+ * Same as calling add_node_to_frequency_list() weight times on a plain
+ * exact chain; used to build chains from known probabilities, such as a
+ * weighted dice.
+ *
+ * @param first_node Pointer to the source MarkovNode
+ * @param second_node Pointer to the destination MarkovNode
+ * @param markov_chain Pointer to the MarkovChain
+ * @param weight Number of observations (positive)
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on a non-positive weight,
+ *         a frozen, approximate or decaying chain, or allocation error
+ */
+int add_weighted_transition(MarkovNode *first_node, MarkovNode *second_node,
+                            MarkovChain *markov_chain, int weight);
+
 /**
  * Check if data_ptr exists in the database.
  *
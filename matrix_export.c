@@ -0,0 +1,872 @@
+#define _POSIX_C_SOURCE 200809L // For mmap() and fstat()
+#include "matrix_export.h"
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/***************************/
+/*   CONSTANT DEFINITIONS  */
+/***************************/
+
+#define SECTION_BUFFER_BYTES (64 * 1024)  // Bytes buffered per section before a write
+#define INITIAL_LABEL_BYTES 64            // First size of the label scratch buffer
+
+/***************************/
+/*   STRUCTURE DEFINITIONS */
+/***************************/
+
+/**
+ * Enumeration of the sections of a matrix file, in file order.
+ */
+typedef enum Section {
+    SECTION_ROWS,
+    SECTION_COLUMNS,
+    SECTION_VALUES,
+    SECTION_ENDS,
+    SECTION_LABELS,
+    SECTION_TEXT,
+    SECTION_COUNT
+} Section;
+
+/**
+ * SectionWriter structure.
+ * Appends to one section of the file through a private buffer, so that all
+ * sections can be written in a single pass over the chain.
+ */
+typedef struct SectionWriter {
+    uint64_t offset;                             // File offset of the next flush
+    size_t used;                                 // Bytes waiting in buffer
+    unsigned char buffer[SECTION_BUFFER_BYTES];  // Pending bytes
+} SectionWriter;
+
+/**
+ * MatrixWriter structure.
+ * State of one export.
+ */
+typedef struct MatrixWriter {
+    FILE *file;               // Output file
+    SectionWriter *sections;  // One writer per Section
+    bool failed;              // A write has failed
+} MatrixWriter;
+
+/**
+ * RowEntry structure.
+ * One transition of the row being written, for sorting by column.
+ */
+typedef struct RowEntry {
+    uint32_t column;  // Successor id
+    uint32_t count;   // Transition count
+} RowEntry;
+
+/**
+ * LabelBuffer structure.
+ * Scratch space for formatting labels, grown as needed.
+ */
+typedef struct LabelBuffer {
+    char *text;       // Formatted label
+    size_t capacity;  // Bytes allocated for text
+} LabelBuffer;
+
+/***************************/
+/*   FUNCTION DEFINITIONS  */
+/***************************/
+
+/**
+ * Round an offset up to the next section boundary.
+ *
+ * @param offset File offset
+ * @return Smallest multiple of MATRIX_SECTION_ALIGN not below offset
+ */
+static uint64_t align_section(uint64_t offset)
+{
+    return (offset + MATRIX_SECTION_ALIGN - 1) /
+           MATRIX_SECTION_ALIGN * MATRIX_SECTION_ALIGN;
+}
+
+/**
+ * Compare two row entries by column.
+ *
+ * @param first Pointer to the first RowEntry
+ * @param second Pointer to the second RowEntry
+ * @return Negative, zero or positive like strcmp
+ */
+static int compare_row_entries(const void *first, const void *second)
+{
+    uint32_t a = ((const RowEntry *)first)->column;
+    uint32_t b = ((const RowEntry *)second)->column;
+    return (a > b) - (a < b);
+}
+
+/**
+ * Write the pending bytes of a section at its offset.
+ *
+ * @param writer Export state
+ * @param section Section to flush
+ */
+static void flush_section(MatrixWriter *writer, Section section)
+{
+    SectionWriter *target = &writer->sections[section];
+    if (target->used == 0 || writer->failed)
+    {
+        return;
+    }
+    if (fseeko(writer->file, (off_t)target->offset, SEEK_SET) != 0 ||
+        fwrite(target->buffer, 1, target->used, writer->file) != target->used)
+    {
+        writer->failed = true;
+        return;
+    }
+    target->offset += target->used;
+    target->used = 0;
+}
+
+/**
+ * Append bytes to a section.
+ *
+ * @param writer Export state
+ * @param section Section to append to
+ * @param bytes Bytes to append
+ * @param length Number of bytes
+ */
+static void append_section(MatrixWriter *writer, Section section,
+                           const void *bytes, size_t length)
+{
+    SectionWriter *target = &writer->sections[section];
+    const unsigned char *source = bytes;
+    while (length > 0)
+    {
+        if (target->used == SECTION_BUFFER_BYTES)
+        {
+            flush_section(writer, section);
+            if (writer->failed)
+            {
+                return;
+            }
+        }
+        size_t room = SECTION_BUFFER_BYTES - target->used;
+        size_t chunk = (length < room) ? length : room;
+        memcpy(target->buffer + target->used, source, chunk);
+        target->used += chunk;
+        source += chunk;
+        length -= chunk;
+    }
+}
+
+/**
+ * Format the label of a state into the scratch buffer.
+ *
+ * @param format_func snprintf-like formatter
+ * @param data State data
+ * @param label Scratch buffer, grown if the label does not fit
+ * @return Length of the label, or -1 on formatting or allocation error
+ */
+static long format_label(format_func_t format_func, void *data,
+                         LabelBuffer *label)
+{
+    int length = format_func(data, label->text, label->capacity);
+    if (length >= 0 && (size_t)length >= label->capacity)
+    {
+        char *grown = realloc(label->text, (size_t)length + 1);
+        if (grown == NULL)
+        {
+            return -1;
+        }
+        label->text = grown;
+        label->capacity = (size_t)length + 1;
+        length = format_func(data, label->text, label->capacity);
+    }
+    return length;
+}
+
+/**
+ * Append the label of a state to the text and label offset sections.
+ *
+ * @param writer Export state
+ * @param format_func snprintf-like formatter
+ * @param data State data
+ * @param label Scratch buffer for labels
+ * @param text_written Label bytes written so far, advanced past this label
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on formatting or
+ *         allocation error
+ */
+static int append_label(MatrixWriter *writer, format_func_t format_func,
+                        void *data, LabelBuffer *label, uint64_t *text_written)
+{
+    long length = format_label(format_func, data, label);
+    if (length < 0)
+    {
+        return EXIT_FAILURE;
+    }
+    append_section(writer, SECTION_TEXT, label->text, (size_t)length);
+    *text_written += (uint64_t)length;
+    append_section(writer, SECTION_LABELS, text_written, sizeof(uint64_t));
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Collect the nodes of a chain by id.
+ *
+ * A frozen chain already stores its nodes in id order; otherwise the
+ * database is walked once into a pointer array.
+ *
+ * @param markov_chain Chain to read
+ * @param by_id Receives an array of database size nodes (NULL when frozen)
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if ids are not dense or
+ *         allocation failed
+ */
+static int index_nodes(MarkovChain *markov_chain, MarkovNode ***by_id)
+{
+    *by_id = NULL;
+    if (markov_chain->layout != NULL)
+    {
+        return EXIT_SUCCESS;
+    }
+
+    int states = markov_chain->database->size;
+    MarkovNode **nodes = calloc(states > 0 ? states : 1, sizeof(MarkovNode *));
+    if (nodes == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+    for (Node *traveller = markov_chain->database->first; traveller;
+         traveller = traveller->next)
+    {
+        MarkovNode *node = traveller->data;
+        if (node->id < 0 || node->id >= states || nodes[node->id] != NULL)
+        {
+            free(nodes);
+            return EXIT_FAILURE;
+        }
+        nodes[node->id] = node;
+    }
+    *by_id = nodes;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Node with a given id.
+ *
+ * @param markov_chain Chain to read
+ * @param by_id Array from index_nodes()
+ * @param id Node id
+ * @return The node
+ */
+static MarkovNode *node_at(MarkovChain *markov_chain, MarkovNode **by_id, int id)
+{
+    return (by_id == NULL) ? &markov_chain->layout->nodes[id] : by_id[id];
+}
+
+/**
+ * Id of the successor of a frequency entry.
+ *
+ * In a frozen chain the id is the successor's index in the packed node
+ * array, found without touching the successor itself.
+ *
+ * @param markov_chain Chain the entry belongs to
+ * @param entry Frequency entry
+ * @return Successor id
+ */
+static uint32_t successor_id(MarkovChain *markov_chain,
+                             const MarkovNodeFrequency *entry)
+{
+    if (markov_chain->layout != NULL)
+    {
+        return (uint32_t)(entry->markov_node - markov_chain->layout->nodes);
+    }
+    return (uint32_t)entry->markov_node->id;
+}
+
+/**
+ * Size every section and place it in the file.
+ *
+ * @param markov_chain Chain to read
+ * @param by_id Array from index_nodes()
+ * @param format_func Label formatter, or NULL
+ * @param label Scratch buffer for labels
+ * @param header Header whose layout, values and has_labels are set; the
+ *        counts and offsets are filled in
+ * @param widest Receives the largest number of successors of a state
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on formatting or
+ *         allocation error
+ */
+static int plan_sections(MarkovChain *markov_chain, MarkovNode **by_id,
+                         format_func_t format_func, LabelBuffer *label,
+                         MatrixFileHeader *header, int *widest)
+{
+    int states = markov_chain->database->size;
+    uint64_t nonzeros = 0;
+    uint64_t text_bytes = 0;
+    *widest = 0;
+    for (int id = 0; id < states; id++)
+    {
+        MarkovNode *node = node_at(markov_chain, by_id, id);
+        for (int i = 0; i < node->following_count; i++)
+        {
+            nonzeros += (node->frequency_list[i].frequency > 0);
+        }
+        if (node->following_count > *widest)
+        {
+            *widest = node->following_count;
+        }
+        if (format_func != NULL)
+        {
+            long length = format_label(format_func, node->data, label);
+            if (length < 0)
+            {
+                return EXIT_FAILURE;
+            }
+            text_bytes += (uint64_t)length;
+        }
+    }
+
+    header->rows = (uint64_t)states;
+    header->nonzeros = nonzeros;
+    header->text_bytes = text_bytes;
+    uint64_t rows_bytes = (header->layout == MATRIX_LAYOUT_CSR)
+                          ? (header->rows + 1) * sizeof(uint64_t)
+                          : nonzeros * sizeof(uint32_t);
+    uint64_t labels_bytes = header->has_labels
+                            ? (header->rows + 1) * sizeof(uint64_t) : 0;
+
+    header->rows_offset = align_section(sizeof(MatrixFileHeader));
+    header->columns_offset = align_section(header->rows_offset + rows_bytes);
+    header->values_offset = align_section(header->columns_offset +
+                                          nonzeros * sizeof(uint32_t));
+    header->ends_offset = align_section(header->values_offset +
+                                        nonzeros * sizeof(uint32_t));
+    header->labels_offset = align_section(header->ends_offset + header->rows);
+    header->text_offset = align_section(header->labels_offset + labels_bytes);
+    header->file_bytes = header->has_labels
+                         ? header->text_offset + text_bytes
+                         : header->ends_offset + header->rows;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Stream one row to every section.
+ *
+ * @param writer Export state
+ * @param markov_chain Chain the node belongs to
+ * @param node State of the row
+ * @param row Row id
+ * @param header Header of the export
+ * @param scratch Room for the row's entries
+ * @param written Entries written so far, advanced past this row
+ */
+static void write_row(MatrixWriter *writer, MarkovChain *markov_chain,
+                      MarkovNode *node, uint32_t row,
+                      const MatrixFileHeader *header, RowEntry *scratch,
+                      uint64_t *written)
+{
+    int count = 0;
+    uint64_t total = 0;
+    for (int i = 0; i < node->following_count; i++)
+    {
+        const MarkovNodeFrequency *entry = &node->frequency_list[i];
+        if (entry->frequency > 0)
+        {
+            scratch[count++] = (RowEntry) {successor_id(markov_chain, entry),
+                                           (uint32_t)entry->frequency};
+            total += (uint64_t)entry->frequency;
+        }
+    }
+    qsort(scratch, count, sizeof(RowEntry), compare_row_entries);
+
+    for (int i = 0; i < count; i++)
+    {
+        if (header->layout == MATRIX_LAYOUT_COO)
+        {
+            append_section(writer, SECTION_ROWS, &row, sizeof(row));
+        }
+        append_section(writer, SECTION_COLUMNS, &scratch[i].column,
+                       sizeof(uint32_t));
+        if (header->values == MATRIX_VALUES_COUNTS)
+        {
+            append_section(writer, SECTION_VALUES, &scratch[i].count,
+                           sizeof(uint32_t));
+        }
+        else
+        {
+            float probability = (float)((double)scratch[i].count / total);
+            append_section(writer, SECTION_VALUES, &probability, sizeof(float));
+        }
+    }
+    *written += (uint64_t)count;
+    if (header->layout == MATRIX_LAYOUT_CSR)
+    {
+        append_section(writer, SECTION_ROWS, written, sizeof(uint64_t));
+    }
+
+    uint8_t end = markov_chain->is_last(node->data) ? 1 : 0;
+    append_section(writer, SECTION_ENDS, &end, sizeof(end));
+}
+
+/**
+ * Stream every row, label and the header to the file.
+ *
+ * @param writer Export state with its sections placed
+ * @param markov_chain Chain to read
+ * @param by_id Array from index_nodes()
+ * @param format_func Label formatter, or NULL
+ * @param label Scratch buffer for labels
+ * @param header Planned header
+ * @param scratch Room for the widest row
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on I/O or formatting error
+ */
+static int write_sections(MatrixWriter *writer, MarkovChain *markov_chain,
+                          MarkovNode **by_id, format_func_t format_func,
+                          LabelBuffer *label, const MatrixFileHeader *header,
+                          RowEntry *scratch)
+{
+    uint64_t written = 0;
+    uint64_t text_written = 0;
+    if (header->layout == MATRIX_LAYOUT_CSR)
+    {
+        append_section(writer, SECTION_ROWS, &written, sizeof(uint64_t));
+    }
+    if (header->has_labels)
+    {
+        append_section(writer, SECTION_LABELS, &text_written, sizeof(uint64_t));
+    }
+
+    for (uint64_t row = 0; row < header->rows && !writer->failed; row++)
+    {
+        MarkovNode *node = node_at(markov_chain, by_id, (int)row);
+        write_row(writer, markov_chain, node, (uint32_t)row, header, scratch,
+                  &written);
+        if (header->has_labels &&
+            append_label(writer, format_func, node->data, label,
+                         &text_written) == EXIT_FAILURE)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (int section = 0; section < SECTION_COUNT; section++)
+    {
+        flush_section(writer, (Section)section);
+    }
+    if (writer->failed || written != header->nonzeros ||
+        text_written != header->text_bytes)
+    {
+        return EXIT_FAILURE;
+    }
+
+    // Sections may end before their padding; make the file its full length
+    if (fflush(writer->file) != 0 ||
+        ftruncate(fileno(writer->file), (off_t)header->file_bytes) != 0 ||
+        fseeko(writer->file, 0, SEEK_SET) != 0 ||
+        fwrite(header, sizeof(MatrixFileHeader), 1, writer->file) != 1)
+    {
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int export_transition_matrix(MarkovChain *markov_chain, const char *path,
+                             MatrixLayout layout, MatrixValues values,
+                             format_func_t format_func)
+{
+    if (markov_chain == NULL || path == NULL ||
+        (uint64_t)markov_chain->database->size > UINT32_MAX)
+    {
+        return EXIT_FAILURE;
+    }
+
+    MatrixFileHeader header;
+    memset(&header, 0, sizeof(MatrixFileHeader));
+    memcpy(header.magic, MATRIX_FILE_MAGIC, MATRIX_MAGIC_LENGTH);
+    header.header_bytes = sizeof(MatrixFileHeader);
+    header.layout = layout;
+    header.values = values;
+    header.has_labels = (format_func != NULL);
+
+    MarkovNode **by_id;
+    if (index_nodes(markov_chain, &by_id) == EXIT_FAILURE)
+    {
+        return EXIT_FAILURE;
+    }
+
+    int result = EXIT_FAILURE;
+    int widest = 0;
+    LabelBuffer label = {malloc(INITIAL_LABEL_BYTES), INITIAL_LABEL_BYTES};
+    RowEntry *scratch = NULL;
+    MatrixWriter writer = {NULL, NULL, false};
+    if (label.text != NULL &&
+        plan_sections(markov_chain, by_id, format_func, &label, &header,
+                      &widest) == EXIT_SUCCESS &&
+        (scratch = malloc((widest > 0 ? widest : 1) * sizeof(RowEntry))) != NULL &&
+        (writer.sections = calloc(SECTION_COUNT, sizeof(SectionWriter))) != NULL &&
+        (writer.file = fopen(path, "wb")) != NULL)
+    {
+        const uint64_t starts[SECTION_COUNT] = {
+            header.rows_offset, header.columns_offset, header.values_offset,
+            header.ends_offset, header.labels_offset, header.text_offset};
+        for (int section = 0; section < SECTION_COUNT; section++)
+        {
+            writer.sections[section].offset = starts[section];
+        }
+        result = write_sections(&writer, markov_chain, by_id, format_func,
+                                &label, &header, scratch);
+    }
+
+    if (writer.file != NULL && fclose(writer.file) != 0)
+    {
+        result = EXIT_FAILURE;
+    }
+    free(writer.sections);
+    free(scratch);
+    free(label.text);
+    free(by_id);
+    return result;
+}
+
+/**
+ * MatrixStream structure.
+ * State of a matrix written entry by entry (see open_matrix_stream()).
+ */
+struct MatrixStream {
+    MatrixWriter writer;        // Output file and its section buffers
+    MarkovChain *markov_chain;  // Chain holding the states
+    MarkovNode **by_id;         // Array from index_nodes()
+    format_func_t format_func;  // Label formatter, or NULL
+    LabelBuffer label;          // Scratch buffer for labels
+    MatrixFileHeader header;    // Header, completed on close
+    FILE *values;               // Scratch file collecting the counts
+    char *scratch_path;         // Name of the scratch file
+    uint64_t row;               // Row entries are added to
+    uint64_t columns;           // Entries of that row so far
+    uint32_t last_column;       // Column of its last entry
+    uint64_t written;           // Entries so far
+    uint64_t text_written;      // Label bytes so far
+};
+
+/**
+ * Close the current row of a stream: its end offset, flag and label.
+ *
+ * @param stream Stream to advance to the next row
+ */
+static void end_stream_row(MatrixStream *stream)
+{
+    MatrixWriter *writer = &stream->writer;
+    MarkovNode *node = node_at(stream->markov_chain, stream->by_id,
+                               (int)stream->row);
+    append_section(writer, SECTION_ROWS, &stream->written, sizeof(uint64_t));
+    uint8_t end = stream->markov_chain->is_last(node->data) ? 1 : 0;
+    append_section(writer, SECTION_ENDS, &end, sizeof(end));
+    if (stream->header.has_labels &&
+        append_label(writer, stream->format_func, node->data, &stream->label,
+                     &stream->text_written) == EXIT_FAILURE)
+    {
+        writer->failed = true;
+    }
+    stream->row++;
+    stream->columns = 0;
+}
+
+/**
+ * Copy the counts from the scratch file to their section, in order.
+ *
+ * @param stream Stream whose values_offset is set
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on I/O or allocation error
+ */
+static int copy_stream_values(MatrixStream *stream)
+{
+    unsigned char *buffer = malloc(SECTION_BUFFER_BYTES);
+    FILE *file = stream->writer.file;
+    if (buffer == NULL || fflush(stream->values) != 0 ||
+        fseeko(stream->values, 0, SEEK_SET) != 0 ||
+        fseeko(file, (off_t)stream->header.values_offset, SEEK_SET) != 0)
+    {
+        free(buffer);
+        return EXIT_FAILURE;
+    }
+
+    uint64_t left = stream->written * sizeof(uint32_t);
+    while (left > 0)
+    {
+        size_t chunk = (left < SECTION_BUFFER_BYTES) ? (size_t)left :
+                       SECTION_BUFFER_BYTES;
+        if (fread(buffer, 1, chunk, stream->values) != chunk ||
+            fwrite(buffer, 1, chunk, file) != chunk)
+        {
+            free(buffer);
+            return EXIT_FAILURE;
+        }
+        left -= chunk;
+    }
+    free(buffer);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Free a stream and remove its scratch file.
+ *
+ * @param stream Stream to release
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if a file could not be closed
+ */
+static int free_matrix_stream(MatrixStream *stream)
+{
+    int result = EXIT_SUCCESS;
+    if (stream->writer.file != NULL && fclose(stream->writer.file) != 0)
+    {
+        result = EXIT_FAILURE;
+    }
+    if (stream->values != NULL)
+    {
+        fclose(stream->values);
+        remove(stream->scratch_path);
+    }
+    free(stream->scratch_path);
+    free(stream->writer.sections);
+    free(stream->label.text);
+    free(stream->by_id);
+    free(stream);
+    return result;
+}
+
+MatrixStream *open_matrix_stream(MarkovChain *markov_chain, FILE *file,
+                                 const char *scratch_path,
+                                 format_func_t format_func)
+{
+    MatrixStream *stream = NULL;
+    if (file == NULL || markov_chain == NULL || scratch_path == NULL ||
+        (uint64_t)markov_chain->database->size > UINT32_MAX ||
+        (stream = calloc(1, sizeof(MatrixStream))) == NULL)
+    {
+        if (file != NULL)
+        {
+            fclose(file);
+        }
+        return NULL;
+    }
+    stream->writer.file = file;
+    stream->markov_chain = markov_chain;
+    stream->format_func = format_func;
+    MatrixFileHeader *header = &stream->header;
+    memcpy(header->magic, MATRIX_FILE_MAGIC, MATRIX_MAGIC_LENGTH);
+    header->header_bytes = sizeof(MatrixFileHeader);
+    header->layout = MATRIX_LAYOUT_CSR;
+    header->values = MATRIX_VALUES_COUNTS;
+    header->has_labels = (format_func != NULL);
+
+    // Rows, flags and labels are sized by the states alone, so they go
+    // first; the columns follow and the counts are appended on close
+    int widest;
+    stream->label = (LabelBuffer) {malloc(INITIAL_LABEL_BYTES),
+                                   INITIAL_LABEL_BYTES};
+    if (index_nodes(markov_chain, &stream->by_id) == EXIT_FAILURE ||
+        stream->label.text == NULL ||
+        plan_sections(markov_chain, stream->by_id, format_func, &stream->label,
+                      header, &widest) == EXIT_FAILURE ||
+        (stream->scratch_path = malloc(strlen(scratch_path) + 1)) == NULL ||
+        (stream->writer.sections = calloc(SECTION_COUNT,
+                                          sizeof(SectionWriter))) == NULL)
+    {
+        free_matrix_stream(stream);
+        return NULL;
+    }
+    strcpy(stream->scratch_path, scratch_path);
+    uint64_t labels_bytes = header->has_labels
+                            ? (header->rows + 1) * sizeof(uint64_t) : 0;
+    header->nonzeros = 0;
+    header->rows_offset = align_section(sizeof(MatrixFileHeader));
+    header->ends_offset = align_section(header->rows_offset +
+                                        (header->rows + 1) * sizeof(uint64_t));
+    header->labels_offset = align_section(header->ends_offset + header->rows);
+    header->text_offset = align_section(header->labels_offset + labels_bytes);
+    header->columns_offset = align_section(header->text_offset +
+                                           header->text_bytes);
+
+    if ((stream->values = fopen(scratch_path, "w+b")) == NULL)
+    {
+        free_matrix_stream(stream);
+        return NULL;
+    }
+    const uint64_t starts[SECTION_COUNT] = {
+        header->rows_offset, header->columns_offset, 0, header->ends_offset,
+        header->labels_offset, header->text_offset};
+    for (int section = 0; section < SECTION_COUNT; section++)
+    {
+        stream->writer.sections[section].offset = starts[section];
+    }
+    append_section(&stream->writer, SECTION_ROWS, &stream->written,
+                   sizeof(uint64_t));
+    if (header->has_labels)
+    {
+        append_section(&stream->writer, SECTION_LABELS, &stream->text_written,
+                       sizeof(uint64_t));
+    }
+    return stream;
+}
+
+int matrix_stream_add(MatrixStream *stream, uint32_t row, uint32_t column,
+                      uint32_t count)
+{
+    if (row < stream->row || row >= stream->header.rows ||
+        column >= stream->header.rows ||
+        (row == stream->row && stream->columns > 0 &&
+         column <= stream->last_column))
+    {
+        stream->writer.failed = true;  // Out of order or out of range
+    }
+    while (!stream->writer.failed && stream->row < row)
+    {
+        end_stream_row(stream);
+    }
+    if (stream->writer.failed)
+    {
+        return EXIT_FAILURE;
+    }
+
+    append_section(&stream->writer, SECTION_COLUMNS, &column, sizeof(column));
+    if (fwrite(&count, sizeof(count), 1, stream->values) != 1)
+    {
+        stream->writer.failed = true;
+    }
+    stream->last_column = column;
+    stream->columns++;
+    stream->written++;
+    return stream->writer.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int close_matrix_stream(MatrixStream **stream_ptr)
+{
+    MatrixStream *stream = *stream_ptr;
+    *stream_ptr = NULL;
+    MatrixWriter *writer = &stream->writer;
+    MatrixFileHeader *header = &stream->header;
+    while (!writer->failed && stream->row < header->rows)
+    {
+        end_stream_row(stream);
+    }
+    for (int section = 0; section < SECTION_COUNT; section++)
+    {
+        flush_section(writer, (Section)section);
+    }
+
+    header->nonzeros = stream->written;
+    header->values_offset = align_section(header->columns_offset +
+                                          stream->written * sizeof(uint32_t));
+    header->file_bytes = header->values_offset +
+                         stream->written * sizeof(uint32_t);
+    int result = EXIT_FAILURE;
+    if (!writer->failed && stream->text_written == header->text_bytes &&
+        copy_stream_values(stream) == EXIT_SUCCESS &&
+        fflush(writer->file) == 0 &&
+        ftruncate(fileno(writer->file), (off_t)header->file_bytes) == 0 &&
+        fseeko(writer->file, 0, SEEK_SET) == 0 &&
+        fwrite(header, sizeof(MatrixFileHeader), 1, writer->file) == 1)
+    {
+        result = EXIT_SUCCESS;
+    }
+    if (free_matrix_stream(stream) == EXIT_FAILURE)
+    {
+        result = EXIT_FAILURE;
+    }
+    return result;
+}
+
+/**
+ * Check that a section lies inside the file and is aligned for its type.
+ *
+ * @param offset Section offset
+ * @param bytes Section length
+ * @param file_bytes File size
+ * @return true if the section is usable in place
+ */
+static bool section_fits(uint64_t offset, uint64_t bytes, uint64_t file_bytes)
+{
+    return offset % MATRIX_SECTION_ALIGN == 0 && offset <= file_bytes &&
+           bytes <= file_bytes - offset;
+}
+
+int open_matrix_file(const char *path, MatrixFile *matrix)
+{
+    memset(matrix, 0, sizeof(MatrixFile));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return EXIT_FAILURE;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 ||
+        (size_t)info.st_size < sizeof(MatrixFileHeader))
+    {
+        close(fd);
+        return EXIT_FAILURE;
+    }
+    void *mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED,
+                         fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return EXIT_FAILURE;
+    }
+    matrix->mapping = mapping;
+    matrix->mapping_bytes = (size_t)info.st_size;
+
+    const MatrixFileHeader *header = mapping;
+    const unsigned char *base = mapping;
+    uint64_t size = (uint64_t)info.st_size;
+    bool csr = (header->layout == MATRIX_LAYOUT_CSR);
+    if (memcmp(header->magic, MATRIX_FILE_MAGIC, MATRIX_MAGIC_LENGTH) != 0 ||
+        header->header_bytes != sizeof(MatrixFileHeader) ||
+        header->file_bytes != size || header->layout > MATRIX_LAYOUT_COO ||
+        header->values > MATRIX_VALUES_PROBABILITIES ||
+        header->rows > UINT32_MAX || header->nonzeros > size ||
+        !section_fits(header->rows_offset,
+                      csr ? (header->rows + 1) * sizeof(uint64_t)
+                          : header->nonzeros * sizeof(uint32_t), size) ||
+        !section_fits(header->columns_offset,
+                      header->nonzeros * sizeof(uint32_t), size) ||
+        !section_fits(header->values_offset,
+                      header->nonzeros * sizeof(uint32_t), size) ||
+        !section_fits(header->ends_offset, header->rows, size) ||
+        (header->has_labels &&
+         (!section_fits(header->labels_offset,
+                        (header->rows + 1) * sizeof(uint64_t), size) ||
+          header->text_offset > size ||
+          header->text_bytes > size - header->text_offset)))
+    {
+        close_matrix_file(matrix);
+        return EXIT_FAILURE;
+    }
+
+    matrix->header = header;
+    if (csr)
+    {
+        matrix->row_offsets = (const uint64_t *)(base + header->rows_offset);
+    }
+    else
+    {
+        matrix->row_ids = (const uint32_t *)(base + header->rows_offset);
+    }
+    matrix->columns = (const uint32_t *)(base + header->columns_offset);
+    if (header->values == MATRIX_VALUES_COUNTS)
+    {
+        matrix->counts = (const uint32_t *)(base + header->values_offset);
+    }
+    else
+    {
+        matrix->probabilities = (const float *)(base + header->values_offset);
+    }
+    matrix->ends = base + header->ends_offset;
+    if (header->has_labels)
+    {
+        matrix->label_offsets = (const uint64_t *)(base + header->labels_offset);
+        matrix->text = (const char *)(base + header->text_offset);
+    }
+    return EXIT_SUCCESS;
+}
+
+void close_matrix_file(MatrixFile *matrix)
+{
+    if (matrix->mapping != NULL)
+    {
+        munmap(matrix->mapping, matrix->mapping_bytes);
+    }
+    memset(matrix, 0, sizeof(MatrixFile));
+}
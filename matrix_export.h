@@ -0,0 +1,185 @@
+#ifndef _MATRIX_EXPORT_H_
+#define _MATRIX_EXPORT_H_
+
+#include "markov_chain.h"
+#include <stdint.h>
+
+/**
+ * File format written by export_transition_matrix().
+ *
+ * A MatrixFileHeader at offset 0, followed by sections that each start on a
+ * MATRIX_SECTION_ALIGN boundary, so a mapping of the file can be used as
+ * typed arrays in place. All integers are in the byte order of the machine
+ * that wrote the file (check magic and header_bytes before trusting it).
+ *
+ *   rows      CSR: rows + 1 uint64 offsets into columns/values
+ *             COO: nonzeros uint32 row ids
+ *   columns   nonzeros uint32 column ids, ascending within each row
+ *   values    nonzeros uint32 counts or float32 probabilities
+ *   ends      rows uint8 flags, 1 for last states (the walk ends there)
+ *   labels    rows + 1 uint64 offsets into label text (0 rows if no labels)
+ *   text      label bytes of every state, back to back, not terminated
+ *
+ * Row and column ids are node ids. States without successors have empty
+ * rows, and transitions whose count dropped to zero are not stored.
+ * export_transition_matrix() writes the sections in the order above; a
+ * MatrixStream puts the columns and values last. Readers go by the
+ * offsets in the header.
+ */
+#define MATRIX_FILE_MAGIC "MKVMTX01"
+#define MATRIX_MAGIC_LENGTH 8
+#define MATRIX_SECTION_ALIGN 64
+
+/**
+ * MatrixLayout enum.
+ * How the nonzero entries are addressed.
+ */
+typedef enum MatrixLayout {
+    MATRIX_LAYOUT_CSR,  // Row offsets: row i is entries rows[i] .. rows[i + 1]
+    MATRIX_LAYOUT_COO   // Row id stored next to every entry
+} MatrixLayout;
+
+/**
+ * MatrixValues enum.
+ * What the value of an entry holds.
+ */
+typedef enum MatrixValues {
+    MATRIX_VALUES_COUNTS,        // uint32 transition count
+    MATRIX_VALUES_PROBABILITIES  // float32 count / row total
+} MatrixValues;
+
+/**
+ * MatrixFileHeader structure.
+ * First bytes of an exported matrix; offsets are from the start of the file.
+ */
+typedef struct MatrixFileHeader {
+    char magic[MATRIX_MAGIC_LENGTH];  // MATRIX_FILE_MAGIC, not terminated
+    uint32_t header_bytes;            // sizeof(MatrixFileHeader)
+    uint32_t layout;                  // MatrixLayout
+    uint32_t values;                  // MatrixValues
+    uint32_t has_labels;              // 1 if the labels and text sections exist
+    uint64_t rows;                    // Number of states
+    uint64_t nonzeros;                // Number of stored transitions
+    uint64_t rows_offset;             // Row offsets (CSR) or row ids (COO)
+    uint64_t columns_offset;          // Column ids
+    uint64_t values_offset;           // Counts or probabilities
+    uint64_t ends_offset;             // Last-state flags
+    uint64_t labels_offset;           // Label offsets
+    uint64_t text_offset;             // Label text
+    uint64_t text_bytes;              // Length of the label text
+    uint64_t file_bytes;              // Total file size
+} MatrixFileHeader;
+
+/**
+ * MatrixFile structure.
+ * An exported matrix mapped into memory by open_matrix_file().
+ */
+typedef struct MatrixFile {
+    const MatrixFileHeader *header;  // Header at the start of the mapping
+    const uint64_t *row_offsets;     // CSR row offsets, or NULL for COO
+    const uint32_t *row_ids;         // COO row ids, or NULL for CSR
+    const uint32_t *columns;         // Column id of every entry
+    const uint32_t *counts;          // Counts, or NULL for probabilities
+    const float *probabilities;      // Probabilities, or NULL for counts
+    const uint8_t *ends;             // Last-state flag of every row
+    const uint64_t *label_offsets;   // Label offsets, or NULL without labels
+    const char *text;                // Label text, or NULL without labels
+    void *mapping;                   // Start of the mapping
+    size_t mapping_bytes;            // Length of the mapping
+} MatrixFile;
+
+/**
+ * Write the transition matrix of a chain to a binary file.
+ *
+ * Makes one pass over the chain to size the sections and a second that
+ * streams every row straight to its sections, so the only memory used
+ * besides stdio buffers is one row of scratch (and, for a chain that is not
+ * frozen, one pointer per state to visit them in id order). The file can
+ * therefore be larger than memory would allow for a copy of the matrix.
+ *
+ * Node ids must be dense (0 .. database size - 1), as they are after
+ * training, pruning and freezing.
+ *
+ * @param markov_chain Chain to export (not modified)
+ * @param path File to create or truncate
+ * @param layout CSR or COO
+ * @param values Counts or probabilities
+ * @param format_func Writes a state's label (snprintf-like), or NULL to
+ *        export without labels
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if ids are not dense, a
+ *         dimension does not fit the format, or on I/O or allocation error
+ */
+int export_transition_matrix(MarkovChain *markov_chain, const char *path,
+                             MatrixLayout layout, MatrixValues values,
+                             format_func_t format_func);
+
+/**
+ * A CSR count matrix written one entry at a time, for transitions that
+ * come from somewhere other than the chain's frequency lists (see
+ * external_builder.h). The states, their last-state flags and labels
+ * still come from the chain's database.
+ */
+typedef struct MatrixStream MatrixStream;
+
+/**
+ * Start writing a matrix file entry by entry.
+ *
+ * Rows, flags and labels are placed first, sized from the states; the
+ * columns are streamed after them and the counts go to a scratch file
+ * that is appended on close, so every section is written front to back.
+ * The chain's own frequency lists are not written.
+ *
+ * @param markov_chain Chain whose states are the rows (ids must be dense)
+ * @param file Writable, seekable file to write from its start; the stream
+ *        owns it from now on and closes it, also if opening fails
+ * @param scratch_path File to hold the counts until close (removed then)
+ * @param format_func Writes a state's label (snprintf-like), or NULL to
+ *        write without labels
+ * @return The stream, or NULL if ids are not dense or on I/O or
+ *         allocation error
+ */
+MatrixStream *open_matrix_stream(MarkovChain *markov_chain, FILE *file,
+                                 const char *scratch_path,
+                                 format_func_t format_func);
+
+/**
+ * Add one entry. Entries must come in ascending (row, column) order.
+ *
+ * @param stream Stream to add to
+ * @param row Row (state) id
+ * @param column Column (successor) id
+ * @param count Transition count
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on an entry out of order or
+ *         out of range, or I/O error (the stream then only accepts a close)
+ */
+int matrix_stream_add(MatrixStream *stream, uint32_t row, uint32_t column,
+                      uint32_t count);
+
+/**
+ * Finish the remaining rows, write the counts and header, and free the
+ * stream.
+ *
+ * @param stream_ptr Pointer to the stream pointer, set to NULL
+ * @return EXIT_SUCCESS if the whole file was written, EXIT_FAILURE otherwise
+ */
+int close_matrix_stream(MatrixStream **stream_ptr);
+
+/**
+ * Map an exported matrix read-only and locate its sections.
+ *
+ * @param path File written by export_transition_matrix()
+ * @param matrix Filled with pointers into the mapping; release with
+ *        close_matrix_file()
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the file cannot be mapped
+ *         or is not a matrix written on a machine like this one
+ */
+int open_matrix_file(const char *path, MatrixFile *matrix);
+
+/**
+ * Unmap a matrix opened with open_matrix_file().
+ *
+ * @param matrix Matrix to release
+ */
+void close_matrix_file(MatrixFile *matrix);
+
+#endif //_MATRIX_EXPORT_H_
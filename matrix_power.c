@@ -0,0 +1,247 @@
+#include "matrix_power.h"
+#include <string.h>
+
+/***************************/
+/*   CONSTANT DEFINITIONS  */
+/***************************/
+
+#define MATRIX_BLOCK 64  // Rows and columns of a tile (three tiles fit in L2)
+#define MATRIX_LANES 8   // Rows are padded to a multiple of this many doubles
+
+#define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))  // Returns minimum of two values
+
+/***************************/
+/*   STRUCTURE DEFINITIONS */
+/***************************/
+
+/**
+ * DenseMatrix structure.
+ * Square matrix stored row by row. Rows are padded with zeros to a whole
+ * number of cache lines so every row starts aligned like the first.
+ */
+typedef struct DenseMatrix {
+    int size;        // Number of rows and columns
+    int stride;      // Doubles from the start of one row to the next
+    double *values;  // size * stride entries
+} DenseMatrix;
+
+/***************************/
+/*   FUNCTION DEFINITIONS  */
+/***************************/
+
+/**
+ * Allocate a zero matrix.
+ *
+ * @param matrix Matrix to set up
+ * @param size Number of rows and columns
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int create_dense_matrix(DenseMatrix *matrix, int size)
+{
+    matrix->size = size;
+    matrix->stride = (size + MATRIX_LANES - 1) / MATRIX_LANES * MATRIX_LANES;
+    matrix->values = calloc((size_t)size * matrix->stride + 1, sizeof(double));
+    return (matrix->values == NULL) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * Free the entries of a matrix.
+ *
+ * @param matrix Matrix to empty
+ */
+static void free_dense_matrix(DenseMatrix *matrix)
+{
+    free(matrix->values);
+    matrix->values = NULL;
+}
+
+/**
+ * Fill a matrix with the transition probabilities of a chain.
+ *
+ * Rows of last states and states without successors keep the walk where
+ * it is.
+ *
+ * @param markov_chain Chain to read
+ * @param matrix Zero matrix of the chain's size
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if ids are not dense
+ */
+static int fill_transition_matrix(MarkovChain *markov_chain,
+                                  DenseMatrix *matrix)
+{
+    for (Node *traveller = markov_chain->database->first; traveller;
+         traveller = traveller->next)
+    {
+        MarkovNode *node = traveller->data;
+        if (node->id < 0 || node->id >= matrix->size)
+        {
+            return EXIT_FAILURE;
+        }
+        double *row = matrix->values + (size_t)node->id * matrix->stride;
+        if (markov_chain->is_last(node->data) || node->all_following <= 0)
+        {
+            row[node->id] = 1;
+            continue;
+        }
+        for (int i = 0; i < node->following_count; i++)
+        {
+            MarkovNodeFrequency *entry = &node->frequency_list[i];
+            if (entry->frequency > 0)
+            {
+                int id = entry->markov_node->id;
+                if (id < 0 || id >= matrix->size)
+                {
+                    return EXIT_FAILURE;
+                }
+                row[id] += (double)entry->frequency / node->all_following;
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Add a multiple of one row to another: target += factor * source.
+ *
+ * The innermost loop of both products, over contiguous doubles that
+ * cannot overlap, so it vectorizes.
+ *
+ * @param target Row to add to
+ * @param source Row to add
+ * @param factor Multiple of source to add
+ * @param count Number of entries
+ */
+static void add_scaled_row(double *restrict target,
+                           const double *restrict source, double factor,
+                           int count)
+{
+    for (int j = 0; j < count; j++)
+    {
+        target[j] += factor * source[j];
+    }
+}
+
+/**
+ * Matrix product product = left * right, tile by tile.
+ *
+ * Tiles of left, right and product are small enough to stay in cache
+ * while they are combined, and zero entries of left (common in the
+ * sparse early powers) skip their row of right entirely.
+ *
+ * @param left Left factor
+ * @param right Right factor of the same size
+ * @param product Matrix of the same size receiving the product; must be
+ *        neither factor
+ */
+static void multiply_dense(const DenseMatrix *left, const DenseMatrix *right,
+                           DenseMatrix *product)
+{
+    int size = left->size;
+    int stride = left->stride;
+    memset(product->values, 0, (size_t)size * stride * sizeof(double));
+
+    for (int row_block = 0; row_block < size; row_block += MATRIX_BLOCK)
+    {
+        int row_end = MIN(row_block + MATRIX_BLOCK, size);
+        for (int inner_block = 0; inner_block < size;
+             inner_block += MATRIX_BLOCK)
+        {
+            int inner_end = MIN(inner_block + MATRIX_BLOCK, size);
+            for (int column_block = 0; column_block < stride;
+                 column_block += MATRIX_BLOCK)
+            {
+                int columns = MIN(MATRIX_BLOCK, stride - column_block);
+                for (int i = row_block; i < row_end; i++)
+                {
+                    const double *left_row = left->values + (size_t)i * stride;
+                    double *target = product->values + (size_t)i * stride +
+                                     column_block;
+                    for (int k = inner_block; k < inner_end; k++)
+                    {
+                        if (left_row[k] != 0)
+                        {
+                            add_scaled_row(target, right->values +
+                                                   (size_t)k * stride +
+                                                   column_block,
+                                           left_row[k], columns);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Row vector times matrix: result = vector * matrix.
+ *
+ * @param vector Row vector with matrix->stride entries
+ * @param matrix Matrix to multiply by
+ * @param result Vector with matrix->stride entries; must not be vector
+ */
+static void multiply_vector(const double *vector, const DenseMatrix *matrix,
+                            double *result)
+{
+    memset(result, 0, matrix->stride * sizeof(double));
+    for (int i = 0; i < matrix->size; i++)
+    {
+        if (vector[i] != 0)
+        {
+            add_scaled_row(result, matrix->values + (size_t)i * matrix->stride,
+                           vector[i], matrix->stride);
+        }
+    }
+}
+
+int distribution_after_moves(MarkovChain *markov_chain, MarkovNode *first_node,
+                             long moves, double **distribution)
+{
+    *distribution = NULL;
+    int states = markov_chain->database->size;
+    if (moves < 0 || states > MAX_DENSE_STATES || first_node->id < 0 ||
+        first_node->id >= states)
+    {
+        return EXIT_FAILURE;
+    }
+
+    DenseMatrix power = {0, 0, NULL};
+    DenseMatrix squared = {0, 0, NULL};
+    double *vector = NULL;
+    double *next = NULL;
+    int result = EXIT_FAILURE;
+    if (create_dense_matrix(&power, states) == EXIT_SUCCESS &&
+        create_dense_matrix(&squared, states) == EXIT_SUCCESS &&
+        (vector = calloc(power.stride, sizeof(double))) != NULL &&
+        (next = calloc(power.stride, sizeof(double))) != NULL &&
+        fill_transition_matrix(markov_chain, &power) == EXIT_SUCCESS)
+    {
+        // power holds P^(2^bit) while moves is consumed bit by bit
+        vector[first_node->id] = 1;
+        while (moves > 0)
+        {
+            if (moves & 1)
+            {
+                multiply_vector(vector, &power, next);
+                double *swap = vector;
+                vector = next;
+                next = swap;
+            }
+            moves >>= 1;
+            if (moves > 0)
+            {
+                multiply_dense(&power, &power, &squared);
+                DenseMatrix swap = power;
+                power = squared;
+                squared = swap;
+            }
+        }
+        *distribution = vector;
+        vector = NULL;
+        result = EXIT_SUCCESS;
+    }
+
+    free(vector);
+    free(next);
+    free_dense_matrix(&power);
+    free_dense_matrix(&squared);
+    return result;
+}
@@ -0,0 +1,42 @@
+#ifndef _MATRIX_POWER_H_
+#define _MATRIX_POWER_H_
+
+#include "markov_chain.h"
+
+/**
+ * Largest chain distribution_after_moves() accepts. Every dense matrix
+ * takes states^2 doubles (32 MiB at the limit) and a squaring about
+ * 2 * states^3 operations.
+ */
+#define MAX_DENSE_STATES 2048
+
+/**
+ * Exact distribution of a walk after a number of moves.
+ *
+ * Models generate_sequence_r() without a length limit: a move goes to a
+ * successor with the probability given by the frequency lists, and a walk
+ * that reached a last state or a state without successors stays there.
+ * The transition matrix P is built densely and the start state's row of
+ * P^moves is found by repeated squaring: for every set bit of moves the
+ * distribution is multiplied by the current power, which is then squared,
+ * so about 2 * log2(moves) products are needed however large moves is.
+ *
+ * The products are cache-blocked, and their innermost loops run over
+ * contiguous rows so the compiler can vectorize them.
+ *
+ * Node ids must be dense (0 .. database size - 1), as they are after
+ * training, pruning and freezing.
+ *
+ * @param markov_chain Chain to read (not modified)
+ * @param first_node State the walk starts on
+ * @param moves Number of moves, at least 0
+ * @param distribution Receives the probability of every state, indexed by
+ *        node id; release with free()
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on negative moves, a chain
+ *         with more than MAX_DENSE_STATES states or ids that are not dense,
+ *         or allocation error
+ */
+int distribution_after_moves(MarkovChain *markov_chain, MarkovNode *first_node,
+                             long moves, double **distribution);
+
+#endif //_MATRIX_POWER_H_
@@ -0,0 +1,474 @@
+#include "pair_builder.h"
+#include <string.h> // For memset()
+
+/***************************/
+/*   CONSTANT DEFINITIONS  */
+/***************************/
+
+#define RADIX_BITS 11                     // Key bits sorted per pass
+#define RADIX_BUCKETS (1 << RADIX_BITS)   // Buckets of one pass (16 KiB of counts)
+#define RADIX_DIGITS 6                    // Passes covering all 64 key bits
+#define INITIAL_RUN_CAPACITY 16           // Runs allocated by a new builder
+#define RUN_MERGE_RATIO 2                 // Merge runs within this length ratio
+
+/***************************/
+/*   HELPER FUNCTIONS      */
+/***************************/
+
+/**
+ * Sort keys with a least significant digit radix sort.
+ *
+ * One pass over the keys counts every digit, then each digit that is not
+ * the same for all keys (the high bits of small ids never vary) scatters
+ * the keys into the other buffer, in order, bucket by bucket.
+ *
+ * @param keys Keys to sort
+ * @param scratch Buffer of the same length
+ * @param count Number of keys
+ * @param histograms RADIX_DIGITS * RADIX_BUCKETS counters
+ * @return keys or scratch, whichever holds the sorted keys
+ */
+static unsigned long long *radix_sort(unsigned long long *keys,
+                                      unsigned long long *scratch,
+                                      size_t count, size_t *histograms)
+{
+    memset(histograms, 0, RADIX_DIGITS * RADIX_BUCKETS * sizeof(size_t));
+    for (size_t i = 0; i < count; i++)
+    {
+        unsigned long long key = keys[i];
+        for (int digit = 0; digit < RADIX_DIGITS; digit++)
+        {
+            histograms[digit * RADIX_BUCKETS +
+                       ((key >> (digit * RADIX_BITS)) & (RADIX_BUCKETS - 1))]++;
+        }
+    }
+
+    for (int digit = 0; digit < RADIX_DIGITS; digit++)
+    {
+        size_t *offsets = histograms + digit * RADIX_BUCKETS;
+        int shift = digit * RADIX_BITS;
+        if (offsets[(keys[0] >> shift) & (RADIX_BUCKETS - 1)] == count)
+        {
+            continue;  // Every key has this digit - the order stays
+        }
+
+        size_t total = 0;
+        for (int bucket = 0; bucket < RADIX_BUCKETS; bucket++)
+        {
+            size_t size = offsets[bucket];
+            offsets[bucket] = total;
+            total += size;
+        }
+        for (size_t i = 0; i < count; i++)
+        {
+            unsigned long long key = keys[i];
+            scratch[offsets[(key >> shift) & (RADIX_BUCKETS - 1)]++] = key;
+        }
+        unsigned long long *swap = keys;
+        keys = scratch;
+        scratch = swap;
+    }
+    return keys;
+}
+
+/**
+ * Allocate the arrays of a run.
+ *
+ * @param run Run to set up
+ * @param length Number of transitions
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int create_run(PairRun *run, size_t length)
+{
+    run->length = length;
+    run->keys = malloc(length * sizeof(unsigned long long));
+    run->counts = malloc(length * sizeof(unsigned int));
+    if (run->keys == NULL || run->counts == NULL)
+    {
+        free(run->keys);
+        free(run->counts);
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Merge two runs into one, adding the counts of keys found in both.
+ *
+ * @param first Run to merge (freed)
+ * @param second Run to merge (freed)
+ * @param merged Receives the merged run
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error (the
+ *         inputs are then kept)
+ */
+static int merge_runs(PairRun *first, PairRun *second, PairRun *merged)
+{
+    if (create_run(merged, first->length + second->length) == EXIT_FAILURE)
+    {
+        return EXIT_FAILURE;
+    }
+
+    size_t i = 0;
+    size_t j = 0;
+    size_t length = 0;
+    while (i < first->length && j < second->length)
+    {
+        unsigned long long a = first->keys[i];
+        unsigned long long b = second->keys[j];
+        merged->keys[length] = (a < b) ? a : b;
+        merged->counts[length] = ((a <= b) ? first->counts[i] : 0) +
+                                 ((b <= a) ? second->counts[j] : 0);
+        i += (a <= b);
+        j += (b <= a);
+        length++;
+    }
+    for (; i < first->length; i++, length++)
+    {
+        merged->keys[length] = first->keys[i];
+        merged->counts[length] = first->counts[i];
+    }
+    for (; j < second->length; j++, length++)
+    {
+        merged->keys[length] = second->keys[j];
+        merged->counts[length] = second->counts[j];
+    }
+    merged->length = length;
+
+    // Keys seen in both runs leave the end unused; give it back
+    unsigned long long *keys = realloc(merged->keys,
+                                       length * sizeof(unsigned long long));
+    unsigned int *counts = realloc(merged->counts,
+                                   length * sizeof(unsigned int));
+    merged->keys = (keys != NULL) ? keys : merged->keys;
+    merged->counts = (counts != NULL) ? counts : merged->counts;
+
+    free_pair_run(first);
+    free_pair_run(second);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Merge the two shortest runs (the last two) into one.
+ *
+ * @param builder Builder with at least two runs
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int merge_last_runs(PairBuilder *builder)
+{
+    PairRun merged;
+    int last = builder->run_count - 1;
+    if (merge_runs(&builder->runs[last - 1], &builder->runs[last], &merged) ==
+        EXIT_FAILURE)
+    {
+        return EXIT_FAILURE;
+    }
+    builder->runs[last - 1] = merged;
+    builder->run_count--;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Sort the pending pairs into a new run of counts.
+ *
+ * The run is merged with the runs before it for as long as the previous
+ * one is less than RUN_MERGE_RATIO times as long, which keeps the runs
+ * ordered longest first with geometrically shrinking lengths.
+ *
+ * @param builder Builder with pending pairs
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int flush_pending(PairBuilder *builder)
+{
+    size_t count = builder->pending_count;
+    if (count == 0)
+    {
+        return EXIT_SUCCESS;
+    }
+    if (builder->run_count == builder->run_capacity)
+    {
+        int capacity = builder->run_capacity * 2;
+        PairRun *runs = realloc(builder->runs, capacity * sizeof(PairRun));
+        if (runs == NULL)
+        {
+            fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+            return EXIT_FAILURE;
+        }
+        builder->runs = runs;
+        builder->run_capacity = capacity;
+    }
+
+    unsigned long long *sorted = radix_sort(builder->pending, builder->scratch,
+                                            count, builder->histograms);
+    size_t distinct = 1;
+    for (size_t i = 1; i < count; i++)
+    {
+        distinct += (sorted[i] != sorted[i - 1]);
+    }
+
+    PairRun *run = &builder->runs[builder->run_count];
+    if (create_run(run, distinct) == EXIT_FAILURE)
+    {
+        return EXIT_FAILURE;
+    }
+    size_t length = 0;
+    run->keys[0] = sorted[0];
+    run->counts[0] = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (sorted[i] != run->keys[length])
+        {
+            length++;
+            run->keys[length] = sorted[i];
+            run->counts[length] = 0;
+        }
+        run->counts[length]++;
+    }
+    builder->run_count++;
+    builder->pending_count = 0;
+
+    while (builder->run_count > 1 &&
+           builder->runs[builder->run_count - 2].length <=
+           RUN_MERGE_RATIO * builder->runs[builder->run_count - 1].length)
+    {
+        if (merge_last_runs(builder) == EXIT_FAILURE)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Table from node id to node.
+ *
+ * @param markov_chain Chain to index
+ * @return Array of database size nodes, or NULL if ids are not dense or
+ *         on allocation error
+ */
+static MarkovNode **nodes_by_id(MarkovChain *markov_chain)
+{
+    int size = markov_chain->database->size;
+    MarkovNode **nodes = calloc(size + 1, sizeof(MarkovNode *));
+    if (nodes == NULL)
+    {
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        return NULL;
+    }
+    for (Node *traveller = markov_chain->database->first; traveller;
+         traveller = traveller->next)
+    {
+        MarkovNode *node = traveller->data;
+        if (node->id < 0 || node->id >= size || nodes[node->id] != NULL)
+        {
+            free(nodes);
+            return NULL;
+        }
+        nodes[node->id] = node;
+    }
+    return nodes;
+}
+
+/**
+ * Write the transitions of one state.
+ *
+ * @param markov_chain Chain being built
+ * @param nodes Table from node id to node
+ * @param node State the transitions leave
+ * @param run Run holding the state's transitions
+ * @param begin Index of the state's first transition in run
+ * @param end Index just past its last transition
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int build_frequency_list(MarkovChain *markov_chain, MarkovNode **nodes,
+                                MarkovNode *node, const PairRun *run,
+                                size_t begin, size_t end)
+{
+    if (node->frequency_list != NULL)
+    {
+        for (size_t i = begin; i < end; i++)
+        {
+            if (add_weighted_transition(node, nodes[run->keys[i] & PAIR_ID_MASK],
+                                        markov_chain, (int)run->counts[i]) ==
+                EXIT_FAILURE)
+            {
+                return EXIT_FAILURE;
+            }
+        }
+        return EXIT_SUCCESS;
+    }
+
+    int count = (int)(end - begin);
+    MarkovNodeFrequency *list = malloc(count * sizeof(MarkovNodeFrequency));
+    if (list == NULL)
+    {
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        return EXIT_FAILURE;
+    }
+    int total = 0;
+    for (int i = 0; i < count; i++)
+    {
+        list[i].markov_node = nodes[run->keys[begin + i] & PAIR_ID_MASK];
+        list[i].frequency = (int)run->counts[begin + i];
+        total += list[i].frequency;
+    }
+    list[0].num_of_nodes = count;
+    node->frequency_list = list;
+    node->following_count = count;
+    node->all_following = total;
+    return EXIT_SUCCESS;
+}
+
+/***************************/
+/*   FUNCTION DEFINITIONS  */
+/***************************/
+
+int create_pair_builder(PairBuilder *builder, size_t capacity)
+{
+    builder->pending = malloc(capacity * sizeof(unsigned long long));
+    builder->scratch = malloc(capacity * sizeof(unsigned long long));
+    builder->histograms = malloc(RADIX_DIGITS * RADIX_BUCKETS * sizeof(size_t));
+    builder->runs = malloc(INITIAL_RUN_CAPACITY * sizeof(PairRun));
+    builder->pending_count = 0;
+    builder->capacity = capacity;
+    builder->run_count = 0;
+    builder->run_capacity = INITIAL_RUN_CAPACITY;
+    builder->pairs = 0;
+    if (capacity == 0 || builder->pending == NULL ||
+        builder->scratch == NULL || builder->histograms == NULL ||
+        builder->runs == NULL)
+    {
+        free_pair_builder(builder);
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+int pair_builder_add(PairBuilder *builder, int from_id, int to_id)
+{
+    if (builder->pending_count == builder->capacity &&
+        flush_pending(builder) == EXIT_FAILURE)
+    {
+        return EXIT_FAILURE;
+    }
+    builder->pending[builder->pending_count++] =
+            ((unsigned long long)from_id << PAIR_ID_BITS) | (unsigned int)to_id;
+    builder->pairs++;
+    return EXIT_SUCCESS;
+}
+
+int pair_builder_take_run(PairBuilder *builder, PairRun *run)
+{
+    *run = (PairRun) {NULL, NULL, 0};
+    if (flush_pending(builder) == EXIT_FAILURE)
+    {
+        return EXIT_FAILURE;
+    }
+    while (builder->run_count > 1)
+    {
+        if (merge_last_runs(builder) == EXIT_FAILURE)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    if (builder->run_count == 1)
+    {
+        *run = builder->runs[0];
+        builder->run_count = 0;
+    }
+    return EXIT_SUCCESS;
+}
+
+void free_pair_run(PairRun *run)
+{
+    free(run->keys);
+    free(run->counts);
+    run->keys = NULL;
+    run->counts = NULL;
+    run->length = 0;
+}
+
+int build_chain_from_pairs(PairBuilder *builder, MarkovChain *markov_chain)
+{
+    PairRun merged;
+    if (markov_chain->approximate != NULL || markov_chain->decay != NULL ||
+        markov_chain->layout != NULL ||
+        pair_builder_take_run(builder, &merged) == EXIT_FAILURE)
+    {
+        return EXIT_FAILURE;
+    }
+    if (merged.length == 0)
+    {
+        return EXIT_SUCCESS;  // No transitions were seen
+    }
+
+    MarkovNode **nodes = nodes_by_id(markov_chain);
+    if (nodes == NULL)
+    {
+        free_pair_run(&merged);
+        return EXIT_FAILURE;
+    }
+
+    // The transitions of a state are adjacent: one list per group
+    PairRun *run = &merged;
+    int size = markov_chain->database->size;
+    int result = EXIT_SUCCESS;
+    size_t begin = 0;
+    while (result == EXIT_SUCCESS && begin < run->length)
+    {
+        unsigned long long from_id = run->keys[begin] >> PAIR_ID_BITS;
+        size_t end = begin + 1;
+        while (end < run->length && (run->keys[end] >> PAIR_ID_BITS) == from_id)
+        {
+            end++;
+        }
+        if (from_id >= (unsigned long long)size ||
+            (run->keys[end - 1] & PAIR_ID_MASK) >= (unsigned long long)size)
+        {
+            result = EXIT_FAILURE;  // A state or successor left the database
+        }
+        else
+        {
+            result = build_frequency_list(markov_chain, nodes, nodes[from_id],
+                                          run, begin, end);
+        }
+        begin = end;
+    }
+
+    free(nodes);
+    free_pair_run(run);
+    return result;
+}
+
+size_t pair_builder_memory_usage(const PairBuilder *builder)
+{
+    size_t bytes = 2 * builder->capacity * sizeof(unsigned long long) +
+                   RADIX_DIGITS * RADIX_BUCKETS * sizeof(size_t) +
+                   builder->run_capacity * sizeof(PairRun);
+    for (int i = 0; i < builder->run_count; i++)
+    {
+        bytes += builder->runs[i].length *
+                 (sizeof(unsigned long long) + sizeof(unsigned int));
+    }
+    return bytes;
+}
+
+void free_pair_builder(PairBuilder *builder)
+{
+    for (int i = 0; i < builder->run_count; i++)
+    {
+        free_pair_run(&builder->runs[i]);
+    }
+    free(builder->pending);
+    free(builder->scratch);
+    free(builder->histograms);
+    free(builder->runs);
+    builder->pending = NULL;
+    builder->scratch = NULL;
+    builder->histograms = NULL;
+    builder->runs = NULL;
+    builder->pending_count = 0;
+    builder->run_count = 0;
+    builder->run_capacity = 0;
+}
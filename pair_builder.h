@@ -0,0 +1,116 @@
+#ifndef _PAIR_BUILDER_H_
+#define _PAIR_BUILDER_H_
+#include "markov_chain.h"
+
+/**
+ * Pairs buffered before they are sorted. Each takes 16 bytes while
+ * pending (the pair and its radix sort copy), 64 MiB in all.
+ */
+#define DEFAULT_PAIR_CAPACITY (1 << 22)
+
+#define PAIR_ID_BITS 32           // Key bits holding the successor id
+#define PAIR_ID_MASK 0xffffffffULL  // Successor id part of a key
+
+/**
+ * PairRun structure.
+ * Distinct transitions in ascending key order, with how often each was
+ * seen. A key is (state id << 32) | successor id, so the transitions of
+ * one state are adjacent and ordered by successor id.
+ */
+typedef struct PairRun {
+    unsigned long long *keys;  // Transition keys, strictly ascending
+    unsigned int *counts;      // Observations of each key
+    size_t length;             // Number of distinct transitions
+} PairRun;
+
+/**
+ * PairBuilder structure.
+ * Two-phase construction of a chain's transitions. Training only appends
+ * (state id, successor id) pairs to a flat buffer; a full buffer is radix
+ * sorted and collapsed into a run of counts, and runs of similar length
+ * are merged as they pile up, so only O(log pairs) runs exist at a time
+ * and memory follows the distinct transitions rather than the corpus.
+ * build_chain_from_pairs() then gives every state its final frequency_list
+ * in a single allocation of the exact size.
+ */
+typedef struct PairBuilder {
+    unsigned long long *pending;  // Pairs not yet sorted
+    unsigned long long *scratch;  // Second buffer of the radix sort
+    size_t *histograms;           // Digit counts of the radix sort
+    size_t pending_count;         // Pairs in pending
+    size_t capacity;              // Pairs pending and scratch can hold
+    PairRun *runs;                // Sorted runs, longest first
+    int run_count;                // Runs in use
+    int run_capacity;             // Runs allocated
+    unsigned long long pairs;     // Pairs added in total
+} PairBuilder;
+
+/**
+ * Set up an empty builder.
+ *
+ * @param builder Builder to set up
+ * @param capacity Pairs buffered between sorts (at least 1)
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+int create_pair_builder(PairBuilder *builder, size_t capacity);
+
+/**
+ * Record one observed transition.
+ *
+ * @param builder Builder to add to
+ * @param from_id Id of the state the transition leaves
+ * @param to_id Id of the state it enters
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+int pair_builder_add(PairBuilder *builder, int from_id, int to_id);
+
+/**
+ * Merge everything recorded so far into one run and empty the builder.
+ *
+ * @param builder Builder to empty
+ * @param run Receives the merged run (length 0 and no arrays if nothing
+ *        was recorded); release with free_pair_run()
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+int pair_builder_take_run(PairBuilder *builder, PairRun *run);
+
+/**
+ * Free the arrays of a run.
+ *
+ * @param run Run to empty
+ */
+void free_pair_run(PairRun *run);
+
+/**
+ * Give the states of a chain every transition recorded in a builder.
+ *
+ * The transitions are merged with pair_builder_take_run(), and each state's
+ * successors are written into a frequency_list allocated once at its
+ * exact length, in successor id order. A state that already has a list
+ * gets the counts added through add_weighted_transition(). The chain's
+ * node ids must be dense, as add_to_database() leaves them, and the
+ * builder is empty afterwards.
+ *
+ * @param builder Builder holding the transitions
+ * @param markov_chain Chain whose database holds the states
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on an approximate, decaying
+ *         or frozen chain, ids that are not dense, or allocation error
+ */
+int build_chain_from_pairs(PairBuilder *builder, MarkovChain *markov_chain);
+
+/**
+ * Bytes held by a builder: its buffers and runs.
+ *
+ * @param builder Builder to measure
+ * @return Size in bytes
+ */
+size_t pair_builder_memory_usage(const PairBuilder *builder);
+
+/**
+ * Free the buffers and runs of a builder.
+ *
+ * @param builder Builder to empty
+ */
+void free_pair_builder(PairBuilder *builder);
+
+#endif //_PAIR_BUILDER_H_
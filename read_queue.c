@@ -0,0 +1,543 @@
+#define _GNU_SOURCE // For pread(), mmap() and syscall()
+#include "read_queue.h"
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+/***************************/
+/*   CONSTANT DEFINITIONS  */
+/***************************/
+
+#define MAX_POOL_THREADS 8   // pread threads per queue
+#define PROBE_OPS 256        // Opcode slots in an io_uring probe
+
+/***************************/
+/*   STRUCTURE DEFINITIONS */
+/***************************/
+
+/**
+ * ReadRequest structure.
+ * One read travelling through the pread pool.
+ */
+typedef struct ReadRequest {
+    int fd;          // File to read
+    char *buffer;    // Destination
+    size_t length;   // Bytes to read
+    off_t offset;    // File offset
+    int tag;         // Caller's identifier
+    ssize_t result;  // Bytes read or -1, once done
+} ReadRequest;
+
+/**
+ * PreadPool structure.
+ * Threads taking requests from a pending ring and putting them on a done
+ * ring. Both rings hold depth entries, enough for every outstanding read.
+ */
+typedef struct PreadPool {
+    ReadRequest *pending;       // Requests not yet taken by a thread
+    ReadRequest *done;          // Completed requests
+    int pending_head;           // Next request to take
+    int pending_count;          // Requests waiting
+    int done_head;              // Next completion to return
+    int done_count;             // Completions waiting
+    bool stop;                  // Threads should exit
+    pthread_t threads[MAX_POOL_THREADS];
+    int thread_count;           // Threads started
+    pthread_mutex_t lock;       // Guards both rings and stop
+    pthread_cond_t has_pending; // Signalled when a request is queued
+    pthread_cond_t has_done;    // Signalled when a request completes
+} PreadPool;
+
+#ifdef HAVE_IO_URING
+/**
+ * Uring structure.
+ * Submission and completion rings shared with the kernel.
+ */
+typedef struct Uring {
+    int fd;                       // io_uring instance
+    unsigned *sq_head;            // Kernel-owned submission head
+    unsigned *sq_tail;            // Our submission tail
+    unsigned *sq_mask;            // Submission ring mask
+    unsigned *sq_array;           // Submission index array
+    struct io_uring_sqe *sqes;    // Submission entries
+    unsigned *cq_head;            // Our completion head
+    unsigned *cq_tail;            // Kernel-owned completion tail
+    unsigned *cq_mask;            // Completion ring mask
+    struct io_uring_cqe *cqes;    // Completion entries
+    void *sq_ring;                // Mapping of the submission ring
+    size_t sq_ring_size;          // Its size
+    void *cq_ring;                // Mapping of the completion ring (may alias)
+    size_t cq_ring_size;          // Its size
+    size_t sqes_size;             // Size of the sqes mapping
+} Uring;
+#endif
+
+struct ReadQueue {
+    ReadBackend backend;   // Backend in use
+    int depth;             // Most reads in flight
+    PreadPool pool;        // pread backend state
+#ifdef HAVE_IO_URING
+    Uring ring;            // io_uring backend state
+#endif
+};
+
+/***************************/
+/*   PREAD POOL            */
+/***************************/
+
+/**
+ * pread thread: serve requests until the pool stops.
+ *
+ * @param arg ReadQueue
+ * @return NULL
+ */
+static void *pread_thread(void *arg)
+{
+    ReadQueue *queue = arg;
+    PreadPool *pool = &queue->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true)
+    {
+        while (!pool->stop && pool->pending_count == 0)
+        {
+            pthread_cond_wait(&pool->has_pending, &pool->lock);
+        }
+        if (pool->stop)
+        {
+            break;
+        }
+        ReadRequest request = pool->pending[pool->pending_head];
+        pool->pending_head = (pool->pending_head + 1) % queue->depth;
+        pool->pending_count--;
+        pthread_mutex_unlock(&pool->lock);
+
+        do
+        {
+            request.result = pread(request.fd, request.buffer, request.length,
+                                   request.offset);
+        } while (request.result < 0 && errno == EINTR);
+
+        pthread_mutex_lock(&pool->lock);
+        int slot = (pool->done_head + pool->done_count) % queue->depth;
+        pool->done[slot] = request;
+        pool->done_count++;
+        pthread_cond_signal(&pool->has_done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/**
+ * Stop and join the pool threads and free the rings.
+ *
+ * @param queue Queue whose pool to tear down
+ */
+static void stop_pread_pool(ReadQueue *queue)
+{
+    PreadPool *pool = &queue->pool;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = true;
+    pthread_cond_broadcast(&pool->has_pending);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->thread_count; i++)
+    {
+        pthread_join(pool->threads[i], NULL);
+    }
+    pthread_cond_destroy(&pool->has_done);
+    pthread_cond_destroy(&pool->has_pending);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->pending);
+    free(pool->done);
+}
+
+/**
+ * Start the pread pool of a queue.
+ *
+ * @param queue Queue to set up
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+static int start_pread_pool(ReadQueue *queue)
+{
+    PreadPool *pool = &queue->pool;
+    memset(pool, 0, sizeof(PreadPool));
+    pool->pending = malloc(queue->depth * sizeof(ReadRequest));
+    pool->done = malloc(queue->depth * sizeof(ReadRequest));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->has_pending, NULL);
+    pthread_cond_init(&pool->has_done, NULL);
+    if (pool->pending == NULL || pool->done == NULL)
+    {
+        stop_pread_pool(queue);
+        return EXIT_FAILURE;
+    }
+
+    int wanted = queue->depth < MAX_POOL_THREADS ? queue->depth
+                                                 : MAX_POOL_THREADS;
+    for (int i = 0; i < wanted; i++)
+    {
+        if (pthread_create(&pool->threads[i], NULL, pread_thread, queue) != 0)
+        {
+            break;
+        }
+        pool->thread_count++;
+    }
+    if (pool->thread_count == 0)
+    {
+        stop_pread_pool(queue);
+        return EXIT_FAILURE;
+    }
+    queue->backend = READ_BACKEND_PREAD;
+    return EXIT_SUCCESS;
+}
+
+/***************************/
+/*   IO_URING              */
+/***************************/
+
+#ifdef HAVE_IO_URING
+/**
+ * Check that the kernel supports IORING_OP_READ (Linux 5.6+).
+ *
+ * @param fd io_uring instance
+ * @return true if plain reads can be submitted
+ */
+static bool uring_supports_read(int fd)
+{
+    size_t size = sizeof(struct io_uring_probe)
+                  + PROBE_OPS * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, size);
+    if (probe == NULL)
+    {
+        return false;
+    }
+    bool supported = syscall(__NR_io_uring_register, fd,
+                             IORING_REGISTER_PROBE, probe, PROBE_OPS) == 0
+                     && probe->last_op >= IORING_OP_READ
+                     && (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    return supported;
+}
+
+/**
+ * Unmap the rings and close the io_uring instance.
+ *
+ * @param ring Ring to tear down
+ */
+static void stop_uring(Uring *ring)
+{
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+    {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring != NULL && ring->cq_ring != MAP_FAILED
+        && ring->cq_ring != ring->sq_ring)
+    {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring != NULL && ring->sq_ring != MAP_FAILED)
+    {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    close(ring->fd);
+}
+
+/**
+ * Set up an io_uring instance with depth entries.
+ *
+ * @param queue Queue to set up
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if io_uring is unusable
+ */
+static int start_uring(ReadQueue *queue)
+{
+    Uring *ring = &queue->ring;
+    struct io_uring_params params;
+    memset(ring, 0, sizeof(Uring));
+    memset(&params, 0, sizeof(params));
+
+    ring->fd = (int)syscall(__NR_io_uring_setup, (unsigned)queue->depth,
+                            &params);
+    if (ring->fd < 0)
+    {
+        return EXIT_FAILURE;  // ENOSYS, EPERM (disabled by sysctl/seccomp)...
+    }
+    if (!uring_supports_read(ring->fd))
+    {
+        close(ring->fd);
+        return EXIT_FAILURE;
+    }
+
+    ring->sq_ring_size = params.sq_off.array
+                         + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes
+                         + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && ring->cq_ring_size > ring->sq_ring_size)
+    {
+        ring->sq_ring_size = ring->cq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring->fd,
+                         IORING_OFF_SQ_RING);
+    ring->cq_ring = single_mmap
+                    ? ring->sq_ring
+                    : mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_POPULATE, ring->fd,
+                           IORING_OFF_CQ_RING);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sq_ring == MAP_FAILED || ring->cq_ring == MAP_FAILED
+        || ring->sqes == MAP_FAILED)
+    {
+        stop_uring(ring);
+        return EXIT_FAILURE;
+    }
+
+    char *sq = ring->sq_ring;
+    char *cq = ring->cq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    queue->backend = READ_BACKEND_IO_URING;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Queue one read on the submission ring and tell the kernel about it.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+static int uring_submit(Uring *ring, int fd, char *buffer, size_t length,
+                        off_t offset, int tag)
+{
+    unsigned tail = *ring->sq_tail;
+    unsigned index = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)buffer;
+    sqe->len = (unsigned)length;
+    sqe->off = (unsigned long long)offset;
+    sqe->user_data = (unsigned long long)tag;
+    ring->sq_array[index] = index;
+
+    // Publish the entry before the new tail
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    long submitted;
+    do
+    {
+        submitted = syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0);
+    } while (submitted < 0 && errno == EINTR);
+    return submitted == 1 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Take one completion, sleeping in the kernel while there is none.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+static int uring_wait(Uring *ring, int *tag, ssize_t *result)
+{
+    while (true)
+    {
+        unsigned head = *ring->cq_head;
+        if (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+        {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            *tag = (int)cqe->user_data;
+            *result = cqe->res < 0 ? -1 : cqe->res;
+            if (cqe->res < 0)
+            {
+                errno = -cqe->res;
+            }
+            __atomic_store_n(ring->cq_head, head + 1, __ATOMIC_RELEASE);
+            return EXIT_SUCCESS;
+        }
+
+        if (syscall(__NR_io_uring_enter, ring->fd, 0, 1,
+                    IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+        {
+            return EXIT_FAILURE;
+        }
+    }
+}
+#endif
+
+/***************************/
+/*   READ QUEUE            */
+/***************************/
+
+/**
+ * Create a read queue.
+ *
+ * @param depth Most reads in flight at once
+ * @param backend Backend wanted
+ * @return Pointer to the new queue, or NULL on failure
+ */
+ReadQueue *create_read_queue(int depth, ReadBackend backend)
+{
+    if (depth <= 0)
+    {
+        return NULL;
+    }
+    ReadQueue *queue = calloc(1, sizeof(ReadQueue));
+    if (queue == NULL)
+    {
+        return NULL;
+    }
+    queue->depth = depth;
+
+#ifdef HAVE_IO_URING
+    if (backend != READ_BACKEND_PREAD && start_uring(queue) == EXIT_SUCCESS)
+    {
+        return queue;
+    }
+#else
+    (void)backend;
+#endif
+
+    if (start_pread_pool(queue) == EXIT_FAILURE)
+    {
+        free(queue);
+        return NULL;
+    }
+    return queue;
+}
+
+/**
+ * Backend a queue actually uses.
+ *
+ * @param queue Queue to inspect
+ * @return READ_BACKEND_IO_URING or READ_BACKEND_PREAD
+ */
+ReadBackend read_queue_backend(const ReadQueue *queue)
+{
+    return queue->backend;
+}
+
+/**
+ * Human readable name of a backend.
+ *
+ * @param backend Backend
+ * @return Its name
+ */
+const char *read_backend_name(ReadBackend backend)
+{
+    switch (backend)
+    {
+        case READ_BACKEND_IO_URING:
+            return "io_uring";
+        case READ_BACKEND_PREAD:
+            return "pread";
+        default:
+            return "auto";
+    }
+}
+
+/**
+ * Start reading length bytes at offset of fd into buffer.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the read was not queued
+ */
+int read_queue_submit(ReadQueue *queue, int fd, char *buffer, size_t length,
+                      off_t offset, int tag)
+{
+#ifdef HAVE_IO_URING
+    if (queue->backend == READ_BACKEND_IO_URING)
+    {
+        return uring_submit(&queue->ring, fd, buffer, length, offset, tag);
+    }
+#endif
+
+    PreadPool *pool = &queue->pool;
+    pthread_mutex_lock(&pool->lock);
+    if (pool->pending_count == queue->depth)
+    {
+        pthread_mutex_unlock(&pool->lock);
+        return EXIT_FAILURE;
+    }
+    int slot = (pool->pending_head + pool->pending_count) % queue->depth;
+    pool->pending[slot] = (ReadRequest) {fd, buffer, length, offset, tag, 0};
+    pool->pending_count++;
+    pthread_cond_signal(&pool->has_pending);
+    pthread_mutex_unlock(&pool->lock);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Wait for any outstanding read to complete.
+ *
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if waiting failed
+ */
+int read_queue_wait(ReadQueue *queue, int *tag, ssize_t *result)
+{
+#ifdef HAVE_IO_URING
+    if (queue->backend == READ_BACKEND_IO_URING)
+    {
+        return uring_wait(&queue->ring, tag, result);
+    }
+#endif
+
+    PreadPool *pool = &queue->pool;
+    pthread_mutex_lock(&pool->lock);
+    while (pool->done_count == 0)
+    {
+        pthread_cond_wait(&pool->has_done, &pool->lock);
+    }
+    ReadRequest request = pool->done[pool->done_head];
+    pool->done_head = (pool->done_head + 1) % queue->depth;
+    pool->done_count--;
+    pthread_mutex_unlock(&pool->lock);
+
+    *tag = request.tag;
+    *result = request.result;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Free a read queue.
+ *
+ * @param queue_ptr Pointer to the queue pointer, set to NULL
+ */
+void free_read_queue(ReadQueue **queue_ptr)
+{
+    if (queue_ptr == NULL || *queue_ptr == NULL)
+    {
+        return;
+    }
+    ReadQueue *queue = *queue_ptr;
+#ifdef HAVE_IO_URING
+    if (queue->backend == READ_BACKEND_IO_URING)
+    {
+        stop_uring(&queue->ring);
+    }
+#endif
+    if (queue->backend == READ_BACKEND_PREAD)
+    {
+        stop_pread_pool(queue);
+    }
+    free(queue);
+    *queue_ptr = NULL;
+}
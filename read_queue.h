@@ -0,0 +1,83 @@
+#ifndef _READ_QUEUE_H_
+#define _READ_QUEUE_H_
+#include <stdlib.h>    // For size_t
+#include <sys/types.h> // For off_t, ssize_t
+
+/**
+ * How a ReadQueue performs its reads.
+ */
+typedef enum ReadBackend {
+    READ_BACKEND_AUTO,      // io_uring if the kernel allows it, else pread
+    READ_BACKEND_IO_URING,  // Linux io_uring (falls back to pread if missing)
+    READ_BACKEND_PREAD      // Pool of threads calling pread()
+} ReadBackend;
+
+/**
+ * ReadQueue structure (opaque).
+ * Keeps up to depth reads in flight and returns their completions in any
+ * order. Either an io_uring instance driven through raw system calls, or
+ * a small pool of threads doing blocking pread() calls, so callers can
+ * overlap I/O with their own work the same way on every kernel.
+ * A queue must be used by one thread at a time.
+ */
+typedef struct ReadQueue ReadQueue;
+
+/**
+ * Create a read queue.
+ *
+ * @param depth Most reads in flight at once (and tags 0..depth-1)
+ * @param backend Backend wanted
+ * @return Pointer to the new queue, or NULL on failure
+ */
+ReadQueue *create_read_queue(int depth, ReadBackend backend);
+
+/**
+ * Backend a queue actually uses (never READ_BACKEND_AUTO).
+ *
+ * @param queue Queue to inspect
+ * @return READ_BACKEND_IO_URING or READ_BACKEND_PREAD
+ */
+ReadBackend read_queue_backend(const ReadQueue *queue);
+
+/**
+ * Human readable name of a backend.
+ *
+ * @param backend Backend
+ * @return "io_uring", "pread" or "auto"
+ */
+const char *read_backend_name(ReadBackend backend);
+
+/**
+ * Start reading length bytes at offset of fd into buffer.
+ *
+ * The caller must not have more than depth reads outstanding.
+ *
+ * @param queue Queue to submit to
+ * @param fd File to read
+ * @param buffer Destination, untouched by the caller until completion
+ * @param length Bytes to read
+ * @param offset File offset to read at
+ * @param tag Caller's identifier for the read, in [0, depth)
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the read was not queued
+ */
+int read_queue_submit(ReadQueue *queue, int fd, char *buffer, size_t length,
+                      off_t offset, int tag);
+
+/**
+ * Wait for any outstanding read to complete.
+ *
+ * @param queue Queue to wait on
+ * @param tag Set to the tag of the completed read
+ * @param result Set to bytes read (0 at end of file) or -1 on error
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if waiting failed
+ */
+int read_queue_wait(ReadQueue *queue, int *tag, ssize_t *result);
+
+/**
+ * Free a read queue. All submitted reads must have completed.
+ *
+ * @param queue_ptr Pointer to the queue pointer, set to NULL
+ */
+void free_read_queue(ReadQueue **queue_ptr);
+
+#endif //_READ_QUEUE_H_
@@ -1,11 +1,17 @@
+#define _POSIX_C_SOURCE 200809L // For clock_gettime()
+#include <math.h>
 #include <string.h> // For strlen(), strcmp(), strcpy()
+#include <time.h>
 #include "markov_chain.h"
+#include "matrix_power.h"
+#include "snakes_board.h"
+#include "snakes_game.h"
 
 /***************************/
 /*   MACRO DEFINITIONS     */
 /***************************/
 
-#define MAX(X, Y) (((X) < (Y)) ? (Y) : (X))  // Returns maximum of two values
+#define MIN(X, Y) (((X) < (Y)) ? (X) : (Y))  // Returns minimum of two values
 
 #define EMPTY -1                    // Indicates no snake or ladder on a cell
 #define BOARD_SIZE 100              // Total number of cells on the game board
@@ -18,6 +24,67 @@
 #define NUM_OF_TRANSITIONS 20       // Total number of snakes and ladders
 #define NUM_ARGS 3                  // Expected number of command line arguments
 #define NUM_ARGS_ERROR "Usage: invalid number of arguments"  // Error message
+#define BOARDS_OPTION "--boards="   // Analyze the boards of a board file
+#define THREADS_OPTION "--threads=" // Threads for --boards (default one per CPU)
+#define PLAYERS_OPTION "--players=" // Play multi-player games on every board
+#define GAMES_OPTION "--games="     // Games to simulate per board
+#define SEED_OPTION "--seed="       // Seed of the game simulation
+#define DEFAULT_GAMES 1000000       // Default games per board
+#define DEFAULT_GAME_SEED 1         // Default simulation seed
+#define GAME_MAX_ROUNDS 10000       // Rounds after which a game is abandoned
+#define UNFINISHED_EPSILON 1e-9     // Smaller exact unfinished shares are rounding
+#define MOVES_OPTION "--moves="     // Distribution of the static board after moves
+#define WALKS_OPTION "--walks="     // Random walks checking the distribution
+#define DEFAULT_WALKS 100000        // Default walks for --moves
+#define WALK_CHUNK 1024             // Moves generated per generate_sequence_r() call
+#define PLAYERS_ERROR "Error: players must be between 2 and 6\n"
+#define MOVES_ERROR "Error: moves and walks must not be negative\n"
+#define NANOS_PER_SECOND 1e9
+
+/**
+ * The game's snakes and ladders, one X(cell, from, to) per jump.
+ * A ladder goes from x to y if x < y, a snake if x > y.
+ */
+#define BOARD_JUMPS(X, cell) \
+    X(cell, 13, 4)  X(cell, 85, 17) X(cell, 95, 67) X(cell, 97, 58) \
+    X(cell, 66, 89) X(cell, 87, 31) X(cell, 57, 83) X(cell, 91, 25) \
+    X(cell, 28, 50) X(cell, 35, 11) X(cell, 8, 30)  X(cell, 41, 62) \
+    X(cell, 81, 43) X(cell, 69, 32) X(cell, 20, 39) X(cell, 33, 70) \
+    X(cell, 79, 99) X(cell, 23, 76) X(cell, 15, 47) X(cell, 61, 14)
+
+/**
+ * Every cell number, one X(cell) per cell: BOARD_CELLS lists 1 to
+ * BOARD_SIZE - 1, then LAST_CELL follows, so tables can end differently.
+ */
+#define CELLS_OF_TEN(X, tens) \
+    X((tens) + 1) X((tens) + 2) X((tens) + 3) X((tens) + 4) X((tens) + 5) \
+    X((tens) + 6) X((tens) + 7) X((tens) + 8) X((tens) + 9) X((tens) + 10)
+#define BOARD_CELLS(X) \
+    CELLS_OF_TEN(X, 0)  CELLS_OF_TEN(X, 10) CELLS_OF_TEN(X, 20) \
+    CELLS_OF_TEN(X, 30) CELLS_OF_TEN(X, 40) CELLS_OF_TEN(X, 50) \
+    CELLS_OF_TEN(X, 60) CELLS_OF_TEN(X, 70) CELLS_OF_TEN(X, 80) \
+    X(91) X(92) X(93) X(94) X(95) X(96) X(97) X(98) X(99)
+#define LAST_CELL BOARD_SIZE
+
+// Every roll of the dice, one X(cell, roll) per face
+#define DICE_ROLLS(X, cell) \
+    X(cell, 1) X(cell, 2) X(cell, 3) X(cell, 4) X(cell, 5) X(cell, 6)
+
+/**
+ * Board arithmetic as integer constant expressions, so that the tables
+ * below are laid out entirely by the compiler.
+ *
+ * JUMP_OF(cell): destination of the cell's snake or ladder, or EMPTY.
+ * SUCCESSORS(cell): cells the chain may move to from cell; a jump is
+ *     taken with certainty, otherwise each roll that stays on the board.
+ * SUCCESSOR(cell, roll): cell number reached with the roll-th successor.
+ */
+#define JUMP_CASE(cell, from, to) ((cell) == (from)) ? (to) :
+#define JUMP_OF(cell) (BOARD_JUMPS(JUMP_CASE, cell) EMPTY)
+#define SUCCESSORS(cell) \
+    ((JUMP_OF(cell) != EMPTY) ? 1 : MIN(DICE_MAX, BOARD_SIZE - (cell)))
+#define SUCCESSOR(cell, roll) \
+    ((JUMP_OF(cell) != EMPTY) ? JUMP_OF(cell) : (cell) + (roll))
 
 /**
  * Array of game transitions (snakes and ladders).
@@ -25,39 +92,62 @@
  * - A ladder from x to y if x < y
  * - A snake from x to y if x > y
  */
-const int transitions[][2] = {{13, 4},
-                              {85, 17},
-                              {95, 67},
-                              {97, 58},
-                              {66, 89},
-                              {87, 31},
-                              {57, 83},
-                              {91, 25},
-                              {28, 50},
-                              {35, 11},
-                              {8,  30},
-                              {41, 62},
-                              {81, 43},
-                              {69, 32},
-                              {20, 39},
-                              {33, 70},
-                              {79, 99},
-                              {23, 76},
-                              {15, 47},
-                              {61, 14}};
+#define TRANSITION_ENTRY(cell, from, to) {from, to},
+const int transitions[][2] = {BOARD_JUMPS(TRANSITION_ENTRY, 0)};
 
 /***************************/
-/*   STRUCTURE DEFINITIONS */
+/*   STATIC BOARD CHAIN    */
 /***************************/
 
-/**
- * Cell structure representing a square on the game board.
+/*
+ * The frozen markov chain of the board, built by the compiler into
+ * read-only data: no allocation, no database lookups and no freeze before
+ * the first walk. It has the shape freeze_markov_chain() gives a chain,
+ * a NodeLayout whose node array is indexed by id (cell number - 1), so it
+ * must only be read and never passed to free_markov_chain(). Cells reached
+ * by a roll keep the order of the rolls, exactly like a chain built by
+ * adding the rolls one by one, so seeded walks are unchanged.
  */
-typedef struct Cell {
-    int number;      // Cell number (1-100)
-    int ladder_to;   // Destination of ladder (-1 if no ladder)
-    int snake_to;    // Destination of snake (-1 if no snake)
-} Cell;
+static const MarkovNode board_nodes[BOARD_SIZE];
+static const MarkovNodeFrequency board_frequencies[BOARD_SIZE][DICE_MAX];
+static const Node board_list[BOARD_SIZE];
+
+// The rows of board_frequencies list exactly the rolls of one dice
+typedef char dice_rolls_match_dice[(DICE_MAX == 6) ? 1 : -1];
+typedef char transitions_match_board[
+    (sizeof(transitions) / sizeof(transitions[0]) == NUM_OF_TRANSITIONS) ? 1 : -1];
+
+// Cell numbers, the data of the board's states
+#define CELL_NUMBER(cell) cell,
+static const int board_cells[BOARD_SIZE] = {BOARD_CELLS(CELL_NUMBER) LAST_CELL};
+
+// Unused slots of a row point at cell 1 with frequency 0
+#define FREQUENCY_SLOT(cell, roll) \
+    {(MarkovNode *)&board_nodes[((roll) <= SUCCESSORS(cell)) \
+                                ? SUCCESSOR(cell, roll) - 1 : 0], \
+     (roll) <= SUCCESSORS(cell), NULL, ((roll) == 1) ? SUCCESSORS(cell) : 0},
+#define FREQUENCY_ROW(cell) {DICE_ROLLS(FREQUENCY_SLOT, cell)},
+static const MarkovNodeFrequency board_frequencies[BOARD_SIZE][DICE_MAX] = {
+    BOARD_CELLS(FREQUENCY_ROW) FREQUENCY_ROW(LAST_CELL)};
+
+#define BOARD_NODE(cell) \
+    {(void *)&board_cells[(cell) - 1], \
+     (MarkovNodeFrequency *)board_frequencies[(cell) - 1], \
+     SUCCESSORS(cell), SUCCESSORS(cell), (cell) - 1},
+static const MarkovNode board_nodes[BOARD_SIZE] = {
+    BOARD_CELLS(BOARD_NODE) BOARD_NODE(LAST_CELL)};
+
+#define LIST_NODE(cell) \
+    {(MarkovNode *)&board_nodes[(cell) - 1], (Node *)&board_list[(cell)]},
+static const Node board_list[BOARD_SIZE] = {
+    BOARD_CELLS(LIST_NODE) {(MarkovNode *)&board_nodes[LAST_CELL - 1], NULL}};
+
+static const LinkedList board_database = {
+    (Node *)&board_list[0], (Node *)&board_list[BOARD_SIZE - 1], BOARD_SIZE};
+
+static const NodeLayout board_layout = {
+    (MarkovNode *)board_nodes, (MarkovNodeFrequency *)board_frequencies,
+    BOARD_SIZE, (long)BOARD_SIZE * DICE_MAX, NULL, 0, PAGE_BACKING_MALLOC};
 
 /***************************/
 /*   FUNCTION DEFINITIONS  */
@@ -79,153 +169,6 @@ int is_right_num_args(int args)
     return EXIT_SUCCESS;
 }
 
-/**
- * Handle errors and perform cleanup.
- *
- * Prints error message and frees the Markov chain if provided.
- *
- * @param error_msg Error message to display
- * @param database Pointer to MarkovChain to free (can be NULL)
- * @return EXIT_FAILURE
- */
-int handle_error_snakes(char *error_msg, MarkovChain **database)
-{
-    printf("%s", error_msg);
-    if (database != NULL)
-    {
-        free_markov_chain(database);
-    }
-    return EXIT_FAILURE;
-}
-
-/**
- * Create and initialize the game board.
- *
- * Allocates memory for all cells and initializes them with:
- * - Cell numbers (1-100)
- * - Snake and ladder destinations from the transitions array
- *
- * @param cells Array of pointers to Cell structures
- * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
- */
-int create_board(Cell *cells[BOARD_SIZE])
-{
-    // Allocate and initialize all cells
-    for (int i = 0; i < BOARD_SIZE; i++)
-    {
-        cells[i] = malloc(sizeof(Cell));
-        if (cells[i] == NULL)
-        {
-            // Free previously allocated cells on error
-            for (int j = 0; j < i; j++)
-            {
-                free(cells[j]);
-            }
-            handle_error_snakes(ALLOCATION_ERROR_MASSAGE, NULL);
-            return EXIT_FAILURE;
-        }
-        // Initialize cell with number and no snakes/ladders
-        *(cells[i]) = (Cell) {i + 1, EMPTY, EMPTY};
-    }
-
-    // Add snakes and ladders based on transitions array
-    for (int i = 0; i < NUM_OF_TRANSITIONS; i++)
-    {
-        int from = transitions[i][0];
-        int to = transitions[i][1];
-
-        if (from < to)
-        {
-            // This is a ladder (going up)
-            cells[from - 1]->ladder_to = to;
-        }
-        else
-        {
-            // This is a snake (going down)
-            cells[from - 1]->snake_to = to;
-        }
-    }
-    return EXIT_SUCCESS;
-}
-
-/**
- * Fill the Markov chain database with board transitions.
- *
- * Creates the Markov chain model for the Snakes and Ladders game:
- * 1. Creates the game board
- * 2. Adds all cells to the database
- * 3. For each cell, adds transitions to possible next cells
- *    - If cell has snake/ladder: adds single transition to destination
- *    - Otherwise: adds transitions for all possible dice rolls (1-6)
- *
- * @param markov_chain Pointer to the MarkovChain to populate
- * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
- */
-int fill_database_snakes(MarkovChain *markov_chain)
-{
-    Cell *cells[BOARD_SIZE];
-
-    // Create the game board
-    if (create_board(cells) == EXIT_FAILURE)
-    {
-        return EXIT_FAILURE;
-    }
-
-    MarkovNode *from_node = NULL, *to_node = NULL;
-    size_t index_to;
-
-    // Add all cells to the database
-    for (size_t i = 0; i < BOARD_SIZE; i++)
-    {
-        add_to_database(markov_chain, cells[i]);
-    }
-
-    // Build transition relationships
-    for (size_t i = 0; i < BOARD_SIZE; i++)
-    {
-        from_node = get_node_from_database(markov_chain, cells[i])->data;
-
-        // Check if this cell has a snake or ladder
-        if (cells[i]->snake_to != EMPTY || cells[i]->ladder_to != EMPTY)
-        {
-            // Cell has snake or ladder - single transition to destination
-            index_to = MAX(cells[i]->snake_to, cells[i]->ladder_to) - 1;
-            to_node = get_node_from_database(markov_chain, cells[index_to])->data;
-            add_node_to_frequency_list(from_node, to_node, markov_chain);
-        }
-        else
-        {
-            // Regular cell - add transitions for all possible dice rolls
-            for (int j = 1; j <= DICE_MAX; j++)
-            {
-                index_to = ((Cell*)(from_node->data))->number + j - 1;
-
-                // Don't add transitions beyond the board
-                if (index_to >= BOARD_SIZE)
-                {
-                    break;
-                }
-
-                to_node = get_node_from_database(markov_chain, cells[index_to])->data;
-                int res = add_node_to_frequency_list(from_node, to_node, markov_chain);
-
-                if (res == EXIT_FAILURE)
-                {
-                    return EXIT_FAILURE;
-                }
-            }
-        }
-    }
-
-    // Free temporary cell array
-    for (size_t i = 0; i < BOARD_SIZE; i++)
-    {
-        free(cells[i]);
-    }
-
-    return EXIT_SUCCESS;
-}
-
 /**
  * Comparison function for Cell data.
  *
@@ -329,65 +272,389 @@ bool is_last(void *data)
 }
 
 /**
- * Main function - Snakes and Ladders game simulator.
+ * Options of the --boards mode.
+ */
+typedef struct BatchOptions {
+    int threads;              // Threads (0 = one per CPU)
+    int players;              // Seats per simulated game (0 = length analysis)
+    long games;               // Games to simulate per board
+    unsigned long long seed;  // Simulation seed
+} BatchOptions;
+
+/**
+ * Parse the options that follow --boards=FILE.
  *
- * Generates random game paths using a Markov chain model.
+ * @param argc Number of command line arguments
+ * @param argv Array of argument strings
+ * @param options Receives the options
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on an unknown option
+ */
+int parse_batch_options(int argc, char *argv[], BatchOptions *options)
+{
+    *options = (BatchOptions) {0, 0, DEFAULT_GAMES, DEFAULT_GAME_SEED};
+    for (int i = 2; i < argc; i++)
+    {
+        char *arg = argv[i];
+        if (strncmp(arg, THREADS_OPTION, strlen(THREADS_OPTION)) == 0)
+        {
+            options->threads = (int)strtol(arg + strlen(THREADS_OPTION), NULL,
+                                           BASE_TEN);
+        }
+        else if (strncmp(arg, PLAYERS_OPTION, strlen(PLAYERS_OPTION)) == 0)
+        {
+            options->players = (int)strtol(arg + strlen(PLAYERS_OPTION), NULL,
+                                           BASE_TEN);
+            if (options->players < MIN_PLAYERS || options->players > MAX_PLAYERS)
+            {
+                fprintf(stdout, PLAYERS_ERROR);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (strncmp(arg, GAMES_OPTION, strlen(GAMES_OPTION)) == 0)
+        {
+            options->games = strtol(arg + strlen(GAMES_OPTION), NULL, BASE_TEN);
+        }
+        else if (strncmp(arg, SEED_OPTION, strlen(SEED_OPTION)) == 0)
+        {
+            options->seed = strtoull(arg + strlen(SEED_OPTION), NULL, BASE_TEN);
+        }
+        else
+        {
+            fprintf(stdout, NUM_ARGS_ERROR);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Print exact and simulated multi-player outcomes of every board.
  *
- * Usage: ./snakes_and_ladders <seed> <num_paths>
- *   seed: Random seed for reproducible results
- *   num_paths: Number of random game paths to generate
+ * @param boards Boards to play on
+ * @param count Number of boards
+ * @param options Players, games, seed and threads
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+int run_game_batch(const Board *boards, int count, const BatchOptions *options)
+{
+    SimulationConfig config = {options->players, options->games,
+                               options->threads, options->seed,
+                               GAME_MAX_ROUNDS};
+    for (int i = 0; i < count; i++)
+    {
+        MarkovChain *markov_chain = build_board_chain(&boards[i]);
+        if (markov_chain == NULL)
+        {
+            return EXIT_FAILURE;
+        }
+        freeze_markov_chain(markov_chain);
+
+        GameStats exact;
+        GameStats simulated;
+        if (exact_game_stats(markov_chain, options->players, GAME_MAX_ROUNDS,
+                             &exact) == EXIT_FAILURE ||
+            simulate_games(markov_chain, &config, &simulated) == EXIT_FAILURE)
+        {
+            fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+            free_markov_chain(&markov_chain);
+            return EXIT_FAILURE;
+        }
+        free_markov_chain(&markov_chain);
+
+        fprintf(stdout, "Board %s, %d players:\n", boards[i].name,
+                options->players);
+        for (int seat = 0; seat < options->players; seat++)
+        {
+            fprintf(stdout, "  Seat %d wins: %.4f exact, %.4f simulated\n",
+                    seat + 1, exact.win_probability[seat],
+                    simulated.win_probability[seat]);
+        }
+        fprintf(stdout, "  Rounds: %.4f exact, %.4f simulated\n",
+                exact.expected_rounds, simulated.expected_rounds);
+        fprintf(stdout, "  Turns: %.4f exact, %.4f simulated\n",
+                exact.expected_turns, simulated.expected_turns);
+        if (exact.unfinished > UNFINISHED_EPSILON || simulated.unfinished > 0)
+        {
+            fprintf(stdout, "  Unfinished after %d rounds: %.6f exact, "
+                            "%.6f simulated\n", GAME_MAX_ROUNDS,
+                    exact.unfinished, simulated.unfinished);
+        }
+        fprintf(stdout, "  Largest |z| over %ld games: %.2f\n", options->games,
+                compare_game_stats(&exact, &simulated));
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Analyze every board of a board file and print its game length statistics,
+ * or with --players its multi-player outcomes.
+ *
+ * Usage: ./snakes_and_ladders --boards=FILE [--threads=N]
+ *            [--players=P [--games=G] [--seed=S]]
  *
  * @param argc Number of command line arguments
  * @param argv Array of argument strings
  * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
  */
-int main(int argc, char *argv[])
+int run_board_batch(int argc, char *argv[])
 {
-    // Validate number of arguments
-    int check_args = is_right_num_args(argc);
-    if (check_args == EXIT_FAILURE)
+    BatchOptions options;
+    if (parse_batch_options(argc, argv, &options) == EXIT_FAILURE)
     {
         return EXIT_FAILURE;
     }
+    int threads = options.threads;
 
-    // Allocate and initialize LinkedList
-    LinkedList *list = (LinkedList *)malloc(sizeof(LinkedList));
-    if (list == NULL)
+    Board *boards;
+    int count;
+    if (load_boards(argv[1] + strlen(BOARDS_OPTION), &boards, &count) ==
+        EXIT_FAILURE)
+    {
+        return EXIT_FAILURE;
+    }
+    if (options.players > 0)
+    {
+        int played = run_game_batch(boards, count, &options);
+        free_boards(&boards, count);
+        return played;
+    }
+    BoardAnalysis *results = malloc(count * sizeof(BoardAnalysis));
+    if (results == NULL)
     {
         fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        free_boards(&boards, count);
+        return EXIT_FAILURE;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int result = analyze_boards(boards, count, threads, results);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (int i = 0; result == EXIT_SUCCESS && i < count; i++)
+    {
+        if (results[i].finishes)
+        {
+            fprintf(stdout, "Board %s: %.4f turns expected, variance %.4f\n",
+                    boards[i].name, results[i].expected_turns,
+                    results[i].variance);
+        }
+        else
+        {
+            fprintf(stdout, "Board %s: never finishes\n", boards[i].name);
+        }
+    }
+    if (result == EXIT_FAILURE)
+    {
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+    }
+    fprintf(stderr, "Analyzed %d boards in %.3f s\n", count,
+            (end.tv_sec - start.tv_sec) +
+            (end.tv_nsec - start.tv_nsec) / NANOS_PER_SECOND);
+
+    free(results);
+    free_boards(&boards, count);
+    return result;
+}
+
+/**
+ * Cell a random walk is on after a number of moves.
+ *
+ * The walk is generated with generate_sequence_r() WALK_CHUNK moves at a
+ * time, so any number of moves needs only a small path buffer. A walk that
+ * reaches the last cell stays there.
+ *
+ * @param markov_chain Board chain
+ * @param first_node Cell the walk starts on
+ * @param moves Number of moves
+ * @param path Buffer of WALK_CHUNK + 1 node pointers
+ * @param state Generator state
+ * @return Node of the cell the walk is on
+ */
+MarkovNode *walk_moves(MarkovChain *markov_chain, MarkovNode *first_node,
+                       long moves, MarkovNode **path, random_state_t *state)
+{
+    while (moves > 0)
+    {
+        int chunk = (int)MIN(moves, (long)WALK_CHUNK);
+        int length = generate_sequence_r(markov_chain, first_node, chunk + 1,
+                                          path, state);
+        first_node = path[length - 1];
+        if (length <= chunk)
+        {
+            break;  // The walk ended before its moves ran out
+        }
+        moves -= chunk;
+    }
+    return first_node;
+}
+
+/**
+ * Largest z-score of walk counts against the exact distribution.
+ *
+ * @param exact Exact probability of every cell, by node id
+ * @param counts Walks that ended on every cell, by node id
+ * @param cells Number of cells
+ * @param walks Number of walks
+ * @return Largest absolute z-score (HUGE_VAL if a walk reached a cell the
+ *         exact distribution rules out)
+ */
+double largest_cell_z(const double *exact, const long *counts, int cells,
+                      long walks)
+{
+    double largest = 0;
+    for (int id = 0; id < cells; id++)
+    {
+        double simulated = (double)counts[id] / walks;
+        double variance = exact[id] * (1 - exact[id]) / walks;
+        double z = (variance > 0) ? fabs(simulated - exact[id]) / sqrt(variance)
+                                  : ((simulated == exact[id]) ? 0 : HUGE_VAL);
+        if (z > largest)
+        {
+            largest = z;
+        }
+    }
+    return largest;
+}
+
+/**
+ * Print where a walk on the static board is after a number of moves,
+ * exactly by matrix exponentiation and from random walks.
+ *
+ * Usage: ./snakes_and_ladders --moves=T [--walks=W] [--seed=S]
+ *
+ * @param markov_chain The static board chain
+ * @param argc Number of command line arguments
+ * @param argv Array of argument strings
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+int run_move_distribution(MarkovChain *markov_chain, int argc, char *argv[])
+{
+    long moves = strtol(argv[1] + strlen(MOVES_OPTION), NULL, BASE_TEN);
+    long walks = DEFAULT_WALKS;
+    unsigned long long seed = DEFAULT_GAME_SEED;
+    for (int i = 2; i < argc; i++)
+    {
+        if (strncmp(argv[i], WALKS_OPTION, strlen(WALKS_OPTION)) == 0)
+        {
+            walks = strtol(argv[i] + strlen(WALKS_OPTION), NULL, BASE_TEN);
+        }
+        else if (strncmp(argv[i], SEED_OPTION, strlen(SEED_OPTION)) == 0)
+        {
+            seed = strtoull(argv[i] + strlen(SEED_OPTION), NULL, BASE_TEN);
+        }
+        else
+        {
+            fprintf(stdout, NUM_ARGS_ERROR);
+            return EXIT_FAILURE;
+        }
+    }
+    if (moves < 0 || walks < 0)
+    {
+        fprintf(stdout, MOVES_ERROR);
         return EXIT_FAILURE;
     }
-    list->first = NULL;
-    list->last = NULL;
-    list->size = 0;
 
-    // Allocate and initialize MarkovChain
-    MarkovChain *markov_chain = (MarkovChain *)malloc(sizeof(MarkovChain));
-    if (markov_chain == NULL)
+    MarkovNode *first_node = markov_chain->database->first->data;
+    double *exact;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (distribution_after_moves(markov_chain, first_node, moves, &exact) ==
+        EXIT_FAILURE)
     {
         fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
         return EXIT_FAILURE;
     }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    fprintf(stderr, "Exact distribution after %ld moves in %.6f s\n", moves,
+            (end.tv_sec - start.tv_sec) +
+            (end.tv_nsec - start.tv_nsec) / NANOS_PER_SECOND);
+
+    long counts[BOARD_SIZE] = {0};
+    MarkovNode *path[WALK_CHUNK + 1];
+    random_state_t state;
+    seed_random_state(&state, seed);
+    for (long walk = 0; walk < walks; walk++)
+    {
+        counts[walk_moves(markov_chain, first_node, moves, path, &state)->id]++;
+    }
 
-    // Set up MarkovChain with appropriate functions for Cell data
-    markov_chain->database = list;
-    markov_chain->copy_func = copy_func;
-    markov_chain->comp_func = comp_fun;
-    markov_chain->is_last = is_last;
-    markov_chain->print_func = ptint_func;
-    markov_chain->free_data = free_data;
+    for (Node *traveller = markov_chain->database->first; traveller;
+         traveller = traveller->next)
+    {
+        MarkovNode *node = traveller->data;
+        if (exact[node->id] > 0 || counts[node->id] > 0)
+        {
+            fprintf(stdout, "Cell %d: %.6f exact, %.6f simulated\n",
+                    *(int *)node->data, exact[node->id],
+                    (walks > 0) ? (double)counts[node->id] / walks : 0);
+        }
+    }
+    if (walks > 0)
+    {
+        fprintf(stdout, "Largest |z| over %ld walks: %.2f\n", walks,
+                largest_cell_z(exact, counts, BOARD_SIZE, walks));
+    }
+    free(exact);
+    return EXIT_SUCCESS;
+}
 
-    // Set random seed from command line argument
-    long seed = strtol(argv[1], NULL, BASE_TEN);
-    srand(seed);
+/**
+ * Main function - Snakes and Ladders game simulator.
+ *
+ * Generates random game paths using a Markov chain model.
+ *
+ * Usage: ./snakes_and_ladders <seed> <num_paths>
+ *   seed: Random seed for reproducible results
+ *   num_paths: Number of random game paths to generate
+ *
+ * or:    ./snakes_and_ladders --boards=FILE [--threads=N]
+ *   Prints the expected number of turns and its variance for every board
+ *   of FILE (see snakes_board.h), analyzing boards on N threads
+ *
+ * or:    ./snakes_and_ladders --boards=FILE --players=P [--games=G]
+ *                             [--seed=S] [--threads=N]
+ *   Prints the chance of winning of every seat and the game length of P
+ *   players on every board, exact and simulated over G games (see
+ *   snakes_game.h)
+ *
+ * or:    ./snakes_and_ladders --moves=T [--walks=W] [--seed=S]
+ *   Prints the probability of every cell after T moves from cell 1 by
+ *   matrix exponentiation, next to the share of W random walks (default
+ *   100000) on it (see matrix_power.h)
+ *
+ * @param argc Number of command line arguments
+ * @param argv Array of argument strings
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && strncmp(argv[1], BOARDS_OPTION, strlen(BOARDS_OPTION)) == 0)
+    {
+        return run_board_batch(argc, argv);
+    }
 
-    // Build the Markov chain database
-    int make_the_chain = fill_database_snakes(markov_chain);
-    if (make_the_chain == EXIT_FAILURE)
+    // The board's chain is a constant; only the function pointers are set
+    MarkovChain board_chain = {(LinkedList *)&board_database, ptint_func,
+                               comp_fun, free_data, copy_func, is_last,
+                               NULL, NULL, (NodeLayout *)&board_layout, NULL};
+    MarkovChain *markov_chain = &board_chain;
+    if (argc > 1 && strncmp(argv[1], MOVES_OPTION, strlen(MOVES_OPTION)) == 0)
+    {
+        return run_move_distribution(markov_chain, argc, argv);
+    }
+
+    // Validate number of arguments
+    int check_args = is_right_num_args(argc);
+    if (check_args == EXIT_FAILURE)
     {
         return EXIT_FAILURE;
     }
 
+    // Set random seed from command line argument
+    long seed = strtol(argv[1], NULL, BASE_TEN);
+    srand(seed);
+
     // Get number of paths to generate from command line
     long max_paths = strtol(argv[2], NULL, BASE_TEN);
     int curr_walk = CURR_WALK;
@@ -407,8 +674,5 @@ int main(int argc, char *argv[])
         fprintf(stdout, "\n");
     }
 
-    // Clean up and free all allocated memory
-    free_markov_chain(&markov_chain);
-
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,963 @@
+#define _GNU_SOURCE // For sysconf(_SC_NPROCESSORS_ONLN)
+#include "snakes_board.h"
+#include <limits.h> // For INT_MIN, INT_MAX
+#include <math.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/***************************/
+/*   CONSTANT DEFINITIONS  */
+/***************************/
+
+#define MAX_LINE_LENGTH 1024       // Longest line of a board file
+#define MAX_BOARD_SIZE 2000        // Keeps the dense analysis within memory
+#define BASE_TEN 10
+#define COMMENT_CHAR '#'
+#define TOKEN_SEPARATORS " \t\r\n"
+#define BOARD_ERROR "Error: %s:%d: %s\n"  // File, line, reason
+#define FIRST_CELL 1
+#define FLAG 1  // Constant true value for infinite loops
+
+/***************************/
+/*   STRUCTURE DEFINITIONS */
+/***************************/
+
+/**
+ * BoardDraft structure.
+ * A board being read; its jumps are checked once its size is final.
+ */
+typedef struct BoardDraft {
+    Board board;         // Settings read so far
+    int (*jumps)[2];     // (from, to) of every jump line
+    int jump_count;      // Jumps read
+    int jump_capacity;   // Jumps allocated
+    int line;            // Line of the "board" directive
+} BoardDraft;
+
+/**
+ * BoardBatch structure.
+ * Work shared by the threads of analyze_boards().
+ */
+typedef struct BoardBatch {
+    const Board *boards;     // Boards to analyze
+    int count;               // Number of boards
+    BoardAnalysis *results;  // One result per board
+    int next;                // Next board to hand out
+    bool failed;             // Some board could not be analyzed
+    pthread_mutex_t lock;    // Guards next and failed
+} BoardBatch;
+
+/***************************/
+/*   CELL FUNCTIONS        */
+/***************************/
+
+/**
+ * Copy a board cell to the heap.
+ *
+ * @param data Pointer to the BoardCell
+ * @return Newly allocated copy, or NULL on allocation failure
+ */
+static void *copy_board_cell(void *data)
+{
+    BoardCell *copy = malloc(sizeof(BoardCell));
+    if (copy != NULL)
+    {
+        *copy = *(BoardCell *)data;
+    }
+    return copy;
+}
+
+/**
+ * Compare two board cells by number.
+ *
+ * @param first_data Pointer to the first BoardCell
+ * @param second_data Pointer to the second BoardCell
+ * @return Difference between the first and second cell numbers
+ */
+static int compare_board_cells(void *first_data, void *second_data)
+{
+    return ((BoardCell *)first_data)->number - ((BoardCell *)second_data)->number;
+}
+
+/**
+ * Check whether the game ends on a board cell.
+ *
+ * @param data Pointer to the BoardCell
+ * @return true for the last cell
+ */
+static bool is_last_board_cell(void *data)
+{
+    return ((BoardCell *)data)->last;
+}
+
+/**
+ * Print a board cell the way snakes_and_ladders prints a walk.
+ *
+ * @param data Pointer to the BoardCell
+ */
+static void print_board_cell(void *data)
+{
+    BoardCell *cell = data;
+    if (cell->jump_to != NO_JUMP)
+    {
+        fprintf(stdout, " [%d] -%s to->", cell->number,
+                (cell->jump_to < cell->number) ? "snake" : "ladder");
+    }
+    else if (cell->last)
+    {
+        fprintf(stdout, " [%d]", cell->number);
+    }
+    else
+    {
+        fprintf(stdout, " [%d] ->", cell->number);
+    }
+}
+
+/***************************/
+/*   BOARD FILE READING    */
+/***************************/
+
+/**
+ * Parse a whole token as a number.
+ *
+ * @param token Token to parse, or NULL
+ * @param value Receives the number
+ * @return true if token is a decimal number that fits in an int
+ */
+static bool parse_number(const char *token, int *value)
+{
+    if (token == NULL)
+    {
+        return false;
+    }
+    char *end;
+    long number = strtol(token, &end, BASE_TEN);
+    if (end == token || *end != '\0' || number < INT_MIN || number > INT_MAX)
+    {
+        return false;
+    }
+    *value = (int)number;
+    return true;
+}
+
+/**
+ * Start a draft with the default settings.
+ *
+ * @param draft Draft to reset
+ * @param name Board name
+ * @param line Line of the "board" directive
+ * @return true if the name fits
+ */
+static bool start_draft(BoardDraft *draft, const char *name, int line)
+{
+    if (strlen(name) >= BOARD_NAME_LENGTH)
+    {
+        return false;
+    }
+    memset(&draft->board, 0, sizeof(Board));
+    strcpy(draft->board.name, name);
+    draft->board.size = DEFAULT_BOARD_SIZE;
+    draft->board.faces = DEFAULT_DICE_FACES;
+    for (int face = 0; face < DEFAULT_DICE_FACES; face++)
+    {
+        draft->board.weights[face] = 1;
+    }
+    draft->board.finish = FINISH_REROLL;
+    draft->jump_count = 0;
+    draft->line = line;
+    return true;
+}
+
+/**
+ * Check a finished draft and give it its jump table.
+ *
+ * @param draft Draft to finish
+ * @param board Receives the board
+ * @return NULL on success, otherwise the reason the board is invalid
+ */
+static const char *finish_draft(BoardDraft *draft, Board *board)
+{
+    Board *drafted = &draft->board;
+    long total_weight = 0;
+    for (int face = 0; face < drafted->faces; face++)
+    {
+        total_weight += drafted->weights[face];
+    }
+    if (drafted->size < 2 || drafted->size > MAX_BOARD_SIZE)
+    {
+        return "board size must be between 2 and 2000";
+    }
+    if (total_weight <= 0 || total_weight > INT_MAX)
+    {
+        return "dice weights must have a positive sum";
+    }
+    if (drafted->finish == FINISH_BOUNCE && drafted->faces >= drafted->size)
+    {
+        return "bounce needs fewer dice faces than cells";
+    }
+
+    int *jump_to = calloc(drafted->size, sizeof(int));
+    if (jump_to == NULL)
+    {
+        return "out of memory";
+    }
+    for (int i = 0; i < draft->jump_count; i++)
+    {
+        int from = draft->jumps[i][0];
+        int to = draft->jumps[i][1];
+        const char *problem = NULL;
+        if (from <= FIRST_CELL || from >= drafted->size)
+        {
+            problem = "a jump must start between the first and last cell";
+        }
+        else if (to < FIRST_CELL || to > drafted->size || to == from)
+        {
+            problem = "a jump must end on another cell of the board";
+        }
+        else if (jump_to[from - 1] != NO_JUMP)
+        {
+            problem = "a cell has two jumps";
+        }
+        if (problem != NULL)
+        {
+            free(jump_to);
+            return problem;
+        }
+        jump_to[from - 1] = to;
+    }
+
+    // A chain of jumps longer than the board goes round in a circle
+    for (int cell = FIRST_CELL; cell <= drafted->size; cell++)
+    {
+        int at = cell;
+        for (int step = 0; step <= drafted->size && jump_to[at - 1] != NO_JUMP;
+             step++)
+        {
+            at = jump_to[at - 1];
+        }
+        if (jump_to[at - 1] != NO_JUMP)
+        {
+            free(jump_to);
+            return "jumps form a cycle";
+        }
+    }
+
+    *board = *drafted;
+    board->jump_to = jump_to;
+    return NULL;
+}
+
+/**
+ * Apply one directive line to the current draft.
+ *
+ * @param draft Current draft
+ * @param directive First token of the line
+ * @return NULL on success, otherwise the reason the line is invalid
+ */
+static const char *apply_directive(BoardDraft *draft, const char *directive)
+{
+    Board *board = &draft->board;
+    if (strcmp(directive, "size") == 0)
+    {
+        if (!parse_number(strtok(NULL, TOKEN_SEPARATORS), &board->size))
+        {
+            return "size needs a number of cells";
+        }
+    }
+    else if (strcmp(directive, "dice") == 0)
+    {
+        int faces = 0;
+        char *token;
+        while ((token = strtok(NULL, TOKEN_SEPARATORS)) != NULL)
+        {
+            if (faces == MAX_DICE_FACES)
+            {
+                return "dice has more than 64 faces";
+            }
+            if (!parse_number(token, &board->weights[faces]) ||
+                board->weights[faces] < 0)
+            {
+                return "dice weights must be non-negative numbers";
+            }
+            faces++;
+        }
+        if (faces == 0)
+        {
+            return "dice needs the weight of every face";
+        }
+        board->faces = faces;
+    }
+    else if (strcmp(directive, "jump") == 0)
+    {
+        int from;
+        int to;
+        if (!parse_number(strtok(NULL, TOKEN_SEPARATORS), &from) ||
+            !parse_number(strtok(NULL, TOKEN_SEPARATORS), &to))
+        {
+            return "jump needs a start and an end cell";
+        }
+        if (draft->jump_count == draft->jump_capacity)
+        {
+            int capacity = (draft->jump_capacity > 0) ? 2 * draft->jump_capacity
+                                                      : DEFAULT_BOARD_SIZE;
+            int (*grown)[2] = realloc(draft->jumps, capacity * sizeof(int[2]));
+            if (grown == NULL)
+            {
+                return "out of memory";
+            }
+            draft->jumps = grown;
+            draft->jump_capacity = capacity;
+        }
+        draft->jumps[draft->jump_count][0] = from;
+        draft->jumps[draft->jump_count][1] = to;
+        draft->jump_count++;
+    }
+    else if (strcmp(directive, "finish") == 0)
+    {
+        const char *rule = strtok(NULL, TOKEN_SEPARATORS);
+        static const char *const RULES[] = {"reroll", "stay", "bounce", "pass"};
+        int found = -1;
+        for (int i = 0; rule != NULL && i < (int)(sizeof(RULES) / sizeof(RULES[0]));
+             i++)
+        {
+            found = (strcmp(rule, RULES[i]) == 0) ? i : found;
+        }
+        if (found < 0)
+        {
+            return "finish must be reroll, stay, bounce or pass";
+        }
+        board->finish = (FinishRule)found;
+    }
+    else
+    {
+        return "unknown directive";
+    }
+    return (strtok(NULL, TOKEN_SEPARATORS) == NULL) ? NULL
+                                                    : "unexpected text after directive";
+}
+
+/**
+ * Append a finished draft to the array of boards.
+ *
+ * @param draft Draft to finish
+ * @param boards Array of boards, grown as needed
+ * @param count Number of boards, incremented
+ * @param capacity Boards allocated
+ * @return NULL on success, otherwise the reason the board is invalid
+ */
+static const char *store_draft(BoardDraft *draft, Board **boards, int *count,
+                               int *capacity)
+{
+    if (*count == *capacity)
+    {
+        int grown_capacity = (*capacity > 0) ? 2 * *capacity : 1;
+        Board *grown = realloc(*boards, grown_capacity * sizeof(Board));
+        if (grown == NULL)
+        {
+            return "out of memory";
+        }
+        *boards = grown;
+        *capacity = grown_capacity;
+    }
+    const char *problem = finish_draft(draft, &(*boards)[*count]);
+    if (problem == NULL)
+    {
+        (*count)++;
+    }
+    return problem;
+}
+
+int load_boards(const char *path, Board **boards, int *count)
+{
+    *boards = NULL;
+    *count = 0;
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+    {
+        fprintf(stdout, BOARD_ERROR, path, 0, "cannot open file");
+        return EXIT_FAILURE;
+    }
+
+    BoardDraft draft;
+    memset(&draft, 0, sizeof(BoardDraft));
+    bool drafting = false;
+    int capacity = 0;
+    int line_number = 0;
+    int problem_line = 0;
+    const char *problem = NULL;
+    char line[MAX_LINE_LENGTH];
+
+    while (problem == NULL && fgets(line, sizeof(line), file) != NULL)
+    {
+        line_number++;
+        problem_line = line_number;
+        // Checked before comments are cut, or the rest of a long commented
+        // line would be read as the next line
+        if (strchr(line, '\n') == NULL && !feof(file))
+        {
+            problem = "line too long";
+            break;
+        }
+        char *comment = strchr(line, COMMENT_CHAR);
+        if (comment != NULL)
+        {
+            *comment = '\0';
+        }
+
+        char *directive = strtok(line, TOKEN_SEPARATORS);
+        if (directive == NULL)
+        {
+            continue;
+        }
+        if (strcmp(directive, "board") == 0)
+        {
+            if (drafting &&
+                (problem = store_draft(&draft, boards, count, &capacity)) != NULL)
+            {
+                problem_line = draft.line;  // The finished board is invalid
+                break;
+            }
+            char *name = strtok(NULL, TOKEN_SEPARATORS);
+            if ((name == NULL || strtok(NULL, TOKEN_SEPARATORS) != NULL ||
+                 !start_draft(&draft, name, line_number)))
+            {
+                problem = "board needs a name of at most 63 characters";
+            }
+            drafting = true;
+        }
+        else if (!drafting)
+        {
+            problem = "directive before the first board";
+        }
+        else
+        {
+            problem = apply_directive(&draft, directive);
+        }
+    }
+
+    if (problem == NULL && drafting)
+    {
+        problem_line = draft.line;
+        problem = store_draft(&draft, boards, count, &capacity);
+    }
+    if (problem == NULL && *count == 0)
+    {
+        problem = "no board";
+    }
+    fclose(file);
+    free(draft.jumps);
+
+    if (problem != NULL)
+    {
+        fprintf(stdout, BOARD_ERROR, path, problem_line, problem);
+        free_boards(boards, *count);
+        *count = 0;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+void free_boards(Board **boards, int count)
+{
+    if (boards == NULL || *boards == NULL)
+    {
+        return;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        free((*boards)[i].jump_to);
+    }
+    free(*boards);
+    *boards = NULL;
+}
+
+/***************************/
+/*   CHAIN CONSTRUCTION    */
+/***************************/
+
+/**
+ * Cell reached by a roll from a cell without a jump.
+ *
+ * @param board Board
+ * @param cell Cell the roll is made from
+ * @param face Rolled face
+ * @return Cell the token moves to, or NO_JUMP if the roll is repeated
+ */
+static int roll_target(const Board *board, int cell, int face)
+{
+    int target = cell + face;
+    if (target <= board->size)
+    {
+        return target;
+    }
+    switch (board->finish)
+    {
+        case FINISH_STAY:
+            return cell;
+        case FINISH_BOUNCE:
+            return 2 * board->size - target;
+        case FINISH_PASS:
+            return board->size;
+        default:
+            return NO_JUMP;
+    }
+}
+
+MarkovChain *build_board_chain(const Board *board)
+{
+    MarkovChain *markov_chain = calloc(1, sizeof(MarkovChain));
+    MarkovNode **cells = malloc(board->size * sizeof(MarkovNode *));
+    if (markov_chain == NULL || cells == NULL ||
+        (markov_chain->database = calloc(1, sizeof(LinkedList))) == NULL)
+    {
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        free(cells);
+        free_markov_chain(&markov_chain);
+        return NULL;
+    }
+    markov_chain->copy_func = copy_board_cell;
+    markov_chain->comp_func = compare_board_cells;
+    markov_chain->free_data = free;
+    markov_chain->is_last = is_last_board_cell;
+    markov_chain->print_func = print_board_cell;
+
+    // Cells are added in order, so the id of cell n is n - 1
+    for (int cell = FIRST_CELL; cell <= board->size; cell++)
+    {
+        BoardCell data = {cell, board->jump_to[cell - 1], cell == board->size};
+        Node *node = add_to_database(markov_chain, &data);
+        if (node == NULL)
+        {
+            free(cells);
+            free_markov_chain(&markov_chain);
+            return NULL;
+        }
+        cells[cell - 1] = node->data;
+    }
+
+    for (int cell = FIRST_CELL; cell < board->size; cell++)
+    {
+        int jump = board->jump_to[cell - 1];
+        for (int face = 1; face <= board->faces; face++)
+        {
+            int target = (jump != NO_JUMP) ? jump : roll_target(board, cell, face);
+            int weight = (jump != NO_JUMP) ? 1 : board->weights[face - 1];
+            if (target != NO_JUMP && weight > 0 &&
+                add_weighted_transition(cells[cell - 1], cells[target - 1],
+                                        markov_chain, weight) == EXIT_FAILURE)
+            {
+                free(cells);
+                free_markov_chain(&markov_chain);
+                return NULL;
+            }
+            if (jump != NO_JUMP)
+            {
+                break;  // A jump is taken with certainty
+            }
+        }
+    }
+
+    free(cells);
+    return markov_chain;
+}
+
+/***************************/
+/*   ANALYSIS              */
+/***************************/
+
+/**
+ * Factorize a dense square matrix in place with partial pivoting.
+ *
+ * @param matrix Row-major n x n matrix, replaced by its LU factors
+ * @param n Dimension
+ * @param pivots Receives the row swapped into each position
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if the matrix is singular
+ */
+static int factorize_dense(double *matrix, int n, int *pivots)
+{
+    for (int k = 0; k < n; k++)
+    {
+        int best = k;
+        for (int row = k + 1; row < n; row++)
+        {
+            if (fabs(matrix[(long)row * n + k]) > fabs(matrix[(long)best * n + k]))
+            {
+                best = row;
+            }
+        }
+        pivots[k] = best;
+        if (matrix[(long)best * n + k] == 0)
+        {
+            return EXIT_FAILURE;
+        }
+        if (best != k)
+        {
+            for (int col = 0; col < n; col++)
+            {
+                double swap = matrix[(long)k * n + col];
+                matrix[(long)k * n + col] = matrix[(long)best * n + col];
+                matrix[(long)best * n + col] = swap;
+            }
+        }
+
+        double *pivot_row = &matrix[(long)k * n];
+        for (int row = k + 1; row < n; row++)
+        {
+            double *target = &matrix[(long)row * n];
+            double factor = target[k] / pivot_row[k];
+            target[k] = factor;
+            if (factor != 0)
+            {
+                for (int col = k + 1; col < n; col++)
+                {
+                    target[col] -= factor * pivot_row[col];
+                }
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Solve a system factorized by factorize_dense().
+ *
+ * @param factors LU factors
+ * @param n Dimension
+ * @param pivots Row swaps from factorize_dense()
+ * @param vector Right-hand side, replaced by the solution
+ */
+static void solve_dense(const double *factors, int n, const int *pivots,
+                        double *vector)
+{
+    for (int k = 0; k < n; k++)
+    {
+        double swap = vector[k];
+        vector[k] = vector[pivots[k]];
+        vector[pivots[k]] = swap;
+    }
+    for (int row = 0; row < n; row++)
+    {
+        for (int col = 0; col < row; col++)
+        {
+            vector[row] -= factors[(long)row * n + col] * vector[col];
+        }
+    }
+    for (int row = n - 1; row >= 0; row--)
+    {
+        for (int col = row + 1; col < n; col++)
+        {
+            vector[row] -= factors[(long)row * n + col] * vector[col];
+        }
+        vector[row] /= factors[(long)row * n + row];
+    }
+}
+
+/**
+ * Mark the states reachable from the first state of the database, and
+ * those from which a last state is reachable.
+ *
+ * @param by_id States indexed by id
+ * @param n Number of states
+ * @param reached Receives 1 for states reachable from the first state
+ * @param finishing Receives 1 for states that can reach a last state
+ * @param markov_chain Chain the states belong to
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int mark_states(MarkovNode **by_id, int n, char *reached,
+                       char *finishing, MarkovChain *markov_chain)
+{
+    int *stack = malloc(n * sizeof(int));
+    long *in_start = calloc(n + 1, sizeof(long));
+    if (stack == NULL || in_start == NULL)
+    {
+        free(stack);
+        free(in_start);
+        return EXIT_FAILURE;
+    }
+
+    // Forward search from the first cell
+    int depth = 0;
+    int start = markov_chain->database->first->data->id;
+    stack[depth++] = start;
+    reached[start] = 1;
+    while (depth > 0)
+    {
+        MarkovNode *node = by_id[stack[--depth]];
+        for (int i = 0; i < node->following_count; i++)
+        {
+            int next = node->frequency_list[i].markov_node->id;
+            if (!reached[next])
+            {
+                reached[next] = 1;
+                stack[depth++] = next;
+            }
+        }
+    }
+
+    // Backward search from the last cells over the predecessor lists
+    for (int id = 0; id < n; id++)
+    {
+        for (int i = 0; i < by_id[id]->following_count; i++)
+        {
+            in_start[by_id[id]->frequency_list[i].markov_node->id + 1]++;
+        }
+    }
+    for (int id = 0; id < n; id++)
+    {
+        in_start[id + 1] += in_start[id];
+    }
+    int *sources = malloc((in_start[n] > 0 ? in_start[n] : 1) * sizeof(int));
+    long *fill = malloc((n > 0 ? n : 1) * sizeof(long));
+    if (sources == NULL || fill == NULL)
+    {
+        free(sources);
+        free(fill);
+        free(stack);
+        free(in_start);
+        return EXIT_FAILURE;
+    }
+    memcpy(fill, in_start, n * sizeof(long));
+    for (int id = 0; id < n; id++)
+    {
+        for (int i = 0; i < by_id[id]->following_count; i++)
+        {
+            sources[fill[by_id[id]->frequency_list[i].markov_node->id]++] = id;
+        }
+    }
+
+    for (int id = 0; id < n; id++)
+    {
+        if (markov_chain->is_last(by_id[id]->data))
+        {
+            finishing[id] = 1;
+            stack[depth++] = id;
+        }
+    }
+    while (depth > 0)
+    {
+        int id = stack[--depth];
+        for (long k = in_start[id]; k < in_start[id + 1]; k++)
+        {
+            if (!finishing[sources[k]])
+            {
+                finishing[sources[k]] = 1;
+                stack[depth++] = sources[k];
+            }
+        }
+    }
+
+    free(sources);
+    free(fill);
+    free(stack);
+    free(in_start);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Turn cost of leaving a state: 1 for a roll, 0 for a jump.
+ *
+ * @param node State of a board chain
+ * @return Turns used when leaving the state
+ */
+static double turn_cost(const MarkovNode *node)
+{
+    return (((BoardCell *)node->data)->jump_to == NO_JUMP) ? 1 : 0;
+}
+
+/**
+ * Solve for the mean and second moment of the turns from a state.
+ *
+ * @param by_id States indexed by id
+ * @param n Number of states
+ * @param start Id of the state the game starts on
+ * @param index Unknown of every state, -1 for states that are not one
+ * @param m Number of unknowns
+ * @param analysis Receives the statistics of the first state
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int solve_turn_moments(MarkovNode **by_id, int n, int start,
+                              const int *index, int m, BoardAnalysis *analysis)
+{
+    double *matrix = calloc((size_t)m * m, sizeof(double));
+    double *mean = malloc(m * sizeof(double));
+    double *moment = malloc(m * sizeof(double));
+    int *pivots = calloc(m, sizeof(int));
+    if (matrix == NULL || mean == NULL || moment == NULL || pivots == NULL)
+    {
+        free(matrix);
+        free(mean);
+        free(moment);
+        free(pivots);
+        return EXIT_FAILURE;
+    }
+
+    // (I - Q) and the cost of leaving every state
+    for (int id = 0; id < n; id++)
+    {
+        int row = index[id];
+        if (row < 0)
+        {
+            continue;
+        }
+        MarkovNode *node = by_id[id];
+        matrix[(long)row * m + row] += 1;
+        for (int i = 0; i < node->following_count; i++)
+        {
+            int col = index[node->frequency_list[i].markov_node->id];
+            if (col >= 0)
+            {
+                matrix[(long)row * m + col] -=
+                        (double)node->frequency_list[i].frequency /
+                        node->all_following;
+            }
+        }
+        mean[row] = turn_cost(node);
+    }
+
+    analysis->finishes = (factorize_dense(matrix, m, pivots) == EXIT_SUCCESS);
+    if (analysis->finishes)
+    {
+        solve_dense(matrix, m, pivots, mean);
+
+        // Second moment: c^2 + 2 c (Q t), where Q t = t - c
+        for (int id = 0; id < n; id++)
+        {
+            int row = index[id];
+            if (row >= 0)
+            {
+                double cost = turn_cost(by_id[id]);
+                moment[row] = cost * cost + 2 * cost * (mean[row] - cost);
+            }
+        }
+        solve_dense(matrix, m, pivots, moment);
+
+        analysis->expected_turns = mean[index[start]];
+        analysis->variance = moment[index[start]] -
+                             mean[index[start]] * mean[index[start]];
+    }
+
+    free(matrix);
+    free(mean);
+    free(moment);
+    free(pivots);
+    return EXIT_SUCCESS;
+}
+
+int analyze_board_chain(MarkovChain *markov_chain, BoardAnalysis *analysis)
+{
+    int n = markov_chain->database->size;
+    memset(analysis, 0, sizeof(BoardAnalysis));
+    if (n == 0)
+    {
+        return EXIT_SUCCESS;
+    }
+
+    MarkovNode **by_id = malloc(n * sizeof(MarkovNode *));
+    char *reached = calloc(n, sizeof(char));
+    char *finishing = calloc(n, sizeof(char));
+    int *index = malloc(n * sizeof(int));
+    int result = EXIT_FAILURE;
+    if (by_id != NULL && reached != NULL && finishing != NULL && index != NULL)
+    {
+        for (Node *traveller = markov_chain->database->first; traveller;
+             traveller = traveller->next)
+        {
+            by_id[traveller->data->id] = traveller->data;
+        }
+        result = mark_states(by_id, n, reached, finishing, markov_chain);
+    }
+
+    // Unknowns: reachable states the game has not ended on. The game can
+    // get stuck if some reachable state cannot reach a last one.
+    bool stuck = false;
+    int m = 0;
+    for (int id = 0; result == EXIT_SUCCESS && id < n; id++)
+    {
+        stuck = stuck || (reached[id] && !finishing[id]);
+        bool unknown = reached[id] && !markov_chain->is_last(by_id[id]->data);
+        index[id] = unknown ? m++ : -1;
+    }
+    if (result == EXIT_SUCCESS && !stuck)
+    {
+        analysis->finishes = true;
+        int start = markov_chain->database->first->data->id;
+        if (index[start] >= 0)
+        {
+            result = solve_turn_moments(by_id, n, start, index, m, analysis);
+        }
+    }
+
+    free(by_id);
+    free(reached);
+    free(finishing);
+    free(index);
+    return result;
+}
+
+/**
+ * Analyze boards until none is left.
+ *
+ * @param arg The BoardBatch
+ * @return NULL
+ */
+static void *analyze_board_worker(void *arg)
+{
+    BoardBatch *batch = arg;
+    while (FLAG)
+    {
+        pthread_mutex_lock(&batch->lock);
+        int i = batch->next++;
+        pthread_mutex_unlock(&batch->lock);
+        if (i >= batch->count)
+        {
+            return NULL;
+        }
+
+        MarkovChain *markov_chain = build_board_chain(&batch->boards[i]);
+        if (markov_chain == NULL ||
+            analyze_board_chain(markov_chain, &batch->results[i]) == EXIT_FAILURE)
+        {
+            pthread_mutex_lock(&batch->lock);
+            batch->failed = true;
+            pthread_mutex_unlock(&batch->lock);
+        }
+        free_markov_chain(&markov_chain);
+    }
+}
+
+int analyze_boards(const Board *boards, int count, int threads,
+                   BoardAnalysis *results)
+{
+    if (threads <= 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (online > 0) ? (int)online : 1;
+    }
+    if (threads > count)
+    {
+        threads = (count > 0) ? count : 1;
+    }
+
+    BoardBatch batch = {boards, count, results, 0, false,
+                        PTHREAD_MUTEX_INITIALIZER};
+    pthread_t *helpers = malloc(threads * sizeof(pthread_t));
+    int started = 0;
+
+    // The calling thread works too; helpers that fail to start are skipped
+    while (helpers != NULL && started < threads - 1 &&
+           pthread_create(&helpers[started], NULL, analyze_board_worker,
+                          &batch) == 0)
+    {
+        started++;
+    }
+    analyze_board_worker(&batch);
+    for (int i = 0; i < started; i++)
+    {
+        pthread_join(helpers[i], NULL);
+    }
+
+    free(helpers);
+    pthread_mutex_destroy(&batch.lock);
+    return batch.failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
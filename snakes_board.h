@@ -0,0 +1,145 @@
+#ifndef _SNAKES_BOARD_H_
+#define _SNAKES_BOARD_H_
+
+#include "markov_chain.h"
+
+/**
+ * Board file format read by load_boards().
+ *
+ * One directive per line; '#' starts a comment. "board" starts a new board
+ * and every other directive applies to the board above it:
+ *
+ *     board <name>           Start a board (name without spaces)
+ *     size <cells>           Cells 1 .. cells; the game ends on the last
+ *                            (default 100)
+ *     dice <w1> <w2> ...     Weight of each face 1, 2, ... (default six
+ *                            faces of weight 1)
+ *     jump <from> <to>       Snake (to < from) or ladder (to > from)
+ *     finish <rule>          What a roll past the last cell does:
+ *                              reroll   it is not a move; roll again
+ *                                       (default, as the classic board)
+ *                              stay     the token stays, the turn is used
+ *                              bounce   the token moves back the excess
+ *                              pass     the token finishes anyway
+ *
+ * A token starts on cell 1 and a turn is one roll. Landing on a jump moves
+ * the token on within the same turn.
+ */
+#define BOARD_NAME_LENGTH 64   // Longest board name, with the terminator
+#define MAX_DICE_FACES 64      // Most faces of a dice
+#define DEFAULT_BOARD_SIZE 100
+#define DEFAULT_DICE_FACES 6
+#define NO_JUMP 0              // jump_to of a cell without snake or ladder
+
+/**
+ * FinishRule enum.
+ * What a roll that would pass the last cell does.
+ */
+typedef enum FinishRule {
+    FINISH_REROLL,  // Not a move; the roll is repeated
+    FINISH_STAY,    // The token stays and the turn is used
+    FINISH_BOUNCE,  // The token moves back by the excess
+    FINISH_PASS     // The token reaches the last cell
+} FinishRule;
+
+/**
+ * Board structure.
+ * One board design.
+ */
+typedef struct Board {
+    char name[BOARD_NAME_LENGTH];  // Name from the board file
+    int size;                      // Number of cells
+    int faces;                     // Number of dice faces
+    int weights[MAX_DICE_FACES];   // Relative weight of faces 1 .. faces
+    int *jump_to;                  // Destination per cell (index cell - 1), or NO_JUMP
+    FinishRule finish;             // Rule for rolls past the last cell
+} Board;
+
+/**
+ * BoardCell structure.
+ * Data of one state of a board's chain.
+ */
+typedef struct BoardCell {
+    int number;   // Cell number, 1 .. size
+    int jump_to;  // Destination of the cell's snake or ladder, or NO_JUMP
+    bool last;    // The game ends on this cell
+} BoardCell;
+
+/**
+ * BoardAnalysis structure.
+ * Exact statistics of the number of turns of a one-player game.
+ */
+typedef struct BoardAnalysis {
+    bool finishes;          // The game ends with probability 1
+    double expected_turns;  // Mean number of turns (if finishes)
+    double variance;        // Variance of the number of turns (if finishes)
+} BoardAnalysis;
+
+/**
+ * Read every board of a board file.
+ *
+ * Errors are reported with their line number.
+ *
+ * @param path Board file
+ * @param boards Receives the array of boards; release with free_boards()
+ * @param count Receives the number of boards
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on I/O, syntax, invalid
+ *         board or allocation error
+ */
+int load_boards(const char *path, Board **boards, int *count);
+
+/**
+ * Free boards read by load_boards().
+ *
+ * @param boards Pointer to the array of boards, set to NULL
+ * @param count Number of boards
+ */
+void free_boards(Board **boards, int count);
+
+/**
+ * Build the markov chain of a board.
+ *
+ * States are BoardCells with ids cell - 1. A jump cell has a single
+ * transition to its destination; any other cell but the last has one
+ * transition per reachable cell, weighted by the dice faces landing there
+ * under the board's finish rule.
+ *
+ * @param board Board to model
+ * @return The chain (release with free_markov_chain()), or NULL on
+ *         allocation error
+ */
+MarkovChain *build_board_chain(const Board *board);
+
+/**
+ * Mean and variance of the number of turns of a board chain's game.
+ *
+ * Solves the absorbing-chain equations exactly over the states reachable
+ * from the first state of the database (cell 1, also once frozen):
+ * t = c + Q t for the mean and m = c^2 + 2 c (Q t) + Q m for the second
+ * moment, where Q holds the transition probabilities between cells that
+ * are not last and c is 1 for a turn and 0 for a jump. A game
+ * that can reach a cell from which the last one is unreachable never
+ * finishes with probability 1 and is reported as such.
+ *
+ * @param markov_chain Chain from build_board_chain()
+ * @param analysis Receives the statistics
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+int analyze_board_chain(MarkovChain *markov_chain, BoardAnalysis *analysis);
+
+/**
+ * Build and analyze many boards in parallel.
+ *
+ * Boards are handed out one at a time to the threads, so boards of very
+ * different sizes still keep every thread busy.
+ *
+ * @param boards Boards to analyze
+ * @param count Number of boards
+ * @param threads Threads to use (0 = one per CPU)
+ * @param results Receives one analysis per board, in board order
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+int analyze_boards(const Board *boards, int count, int threads,
+                   BoardAnalysis *results);
+
+#endif //_SNAKES_BOARD_H_
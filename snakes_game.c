@@ -0,0 +1,511 @@
+#define _GNU_SOURCE // For sysconf(_SC_NPROCESSORS_ONLN)
+#include "snakes_game.h"
+#include <math.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/***************************/
+/*   CONSTANT DEFINITIONS  */
+/***************************/
+
+#define SIMULATION_SLOTS 64   // Games a thread keeps in flight
+#define EXACT_TAIL 1e-15      // Single-player mass left on the board that ends the sum
+
+/***************************/
+/*   STRUCTURE DEFINITIONS */
+/***************************/
+
+/**
+ * SimulationTally structure.
+ * Outcome counts of the games played by one thread.
+ */
+typedef struct SimulationTally {
+    long wins[MAX_PLAYERS];  // Games won by each seat
+    long finished;           // Games won by some seat
+    long unfinished;         // Games stuck or stopped at the round cap
+    double rounds;           // Sum of the rounds of finished games
+    double rounds_squared;   // Sum of their squares
+    double turns;            // Sum of the turns of finished games
+} SimulationTally;
+
+/**
+ * SimulationThread structure.
+ * One thread's share of simulate_games().
+ */
+typedef struct SimulationThread {
+    MarkovChain *markov_chain;       // Board chain
+    const SimulationConfig *config;  // Shared settings
+    const char *finishing;           // 1 for cells that can reach the last one
+    long games;                      // Games this thread plays
+    unsigned long long seed;         // Seed of this thread's random state
+    SimulationTally tally;           // Results
+    int status;                      // EXIT_SUCCESS or EXIT_FAILURE
+    pthread_t thread;                // Thread running the share
+} SimulationThread;
+
+/***************************/
+/*   FUNCTION DEFINITIONS  */
+/***************************/
+
+/**
+ * Follow the snakes and ladders a token landed on.
+ *
+ * @param node Cell the token landed on
+ * @return Cell the token comes to rest on
+ */
+static MarkovNode *resolve_jumps(MarkovNode *node)
+{
+    while (((BoardCell *)node->data)->jump_to != NO_JUMP)
+    {
+        node = node->frequency_list[0].markov_node;
+    }
+    return node;
+}
+
+int single_player_turns(MarkovChain *markov_chain, double tail, int max_turns,
+                        double **pmf, double **survival, int *turns)
+{
+    int n = markov_chain->database->size;
+    MarkovNode **by_id = malloc(n * sizeof(MarkovNode *));
+    int *rest = malloc(n * sizeof(int));
+    double *mass = calloc(n, sizeof(double));
+    double *next = calloc(n, sizeof(double));
+    *pmf = calloc(max_turns + 1, sizeof(double));
+    *survival = calloc(max_turns + 1, sizeof(double));
+    if (by_id == NULL || rest == NULL || mass == NULL || next == NULL ||
+        *pmf == NULL || *survival == NULL)
+    {
+        free(by_id);
+        free(rest);
+        free(mass);
+        free(next);
+        free(*pmf);
+        free(*survival);
+        *pmf = NULL;
+        *survival = NULL;
+        return EXIT_FAILURE;
+    }
+
+    // Where a token landing on each cell comes to rest
+    for (Node *traveller = markov_chain->database->first; traveller;
+         traveller = traveller->next)
+    {
+        by_id[traveller->data->id] = traveller->data;
+    }
+    for (int id = 0; id < n; id++)
+    {
+        rest[id] = resolve_jumps(by_id[id])->id;
+    }
+
+    mass[markov_chain->database->first->data->id] = 1;
+    (*survival)[0] = 1;
+    int turn = 0;
+    while (turn < max_turns && (*survival)[turn] > tail)
+    {
+        turn++;
+        memset(next, 0, n * sizeof(double));
+        for (int id = 0; id < n; id++)
+        {
+            MarkovNode *node = by_id[id];
+            if (mass[id] == 0)
+            {
+                continue;
+            }
+            if (node->all_following == 0)
+            {
+                next[id] += mass[id];  // Stuck: the token cannot move
+                continue;
+            }
+            double share = mass[id] / node->all_following;
+            for (int i = 0; i < node->following_count; i++)
+            {
+                MarkovNodeFrequency *entry = &node->frequency_list[i];
+                next[rest[entry->markov_node->id]] += share * entry->frequency;
+            }
+        }
+
+        double finished = 0;
+        double remaining = 0;
+        for (int id = 0; id < n; id++)
+        {
+            if (markov_chain->is_last(by_id[id]->data))
+            {
+                finished += next[id];
+                next[id] = 0;
+            }
+            remaining += next[id];
+        }
+        (*pmf)[turn] = finished;
+        (*survival)[turn] = remaining;
+
+        double *swap = mass;
+        mass = next;
+        next = swap;
+    }
+
+    *turns = turn;
+    free(by_id);
+    free(rest);
+    free(mass);
+    free(next);
+    return EXIT_SUCCESS;
+}
+
+int exact_game_stats(MarkovChain *markov_chain, int players, int max_rounds,
+                     GameStats *stats)
+{
+    memset(stats, 0, sizeof(GameStats));
+    if (players < MIN_PLAYERS || players > MAX_PLAYERS || max_rounds <= 0)
+    {
+        return EXIT_FAILURE;
+    }
+    double *pmf;
+    double *survival;
+    int turns;
+    if (single_player_turns(markov_chain, EXACT_TAIL, max_rounds, &pmf,
+                            &survival, &turns) == EXIT_FAILURE)
+    {
+        return EXIT_FAILURE;
+    }
+
+    // Seat i wins on round t: it finishes, earlier seats need more than t
+    // turns and later seats at least t
+    double finished = 0;
+    double rounds = 0;
+    double rounds_squared = 0;
+    for (int t = 1; t <= turns; t++)
+    {
+        for (int seat = 0; seat < players; seat++)
+        {
+            double win = pmf[t] * pow(survival[t], seat) *
+                         pow(survival[t - 1], players - 1 - seat);
+            stats->win_probability[seat] += win;
+            stats->expected_turns += win * ((double)(t - 1) * players + seat + 1);
+            finished += win;
+            rounds += win * t;
+            rounds_squared += win * t * (double)t;
+        }
+    }
+
+    // Everything is reported over the games that finish within the cap
+    stats->players = players;
+    stats->unfinished = 1 - finished;
+    if (finished > 0)
+    {
+        for (int seat = 0; seat < players; seat++)
+        {
+            stats->win_probability[seat] /= finished;
+        }
+        stats->expected_turns /= finished;
+        stats->expected_rounds = rounds / finished;
+        stats->rounds_variance = rounds_squared / finished -
+                                 stats->expected_rounds * stats->expected_rounds;
+    }
+    free(pmf);
+    free(survival);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Mark the cells from which the last cell can still be reached.
+ *
+ * @param markov_chain Board chain
+ * @return Array indexed by id (release with free()), or NULL on
+ *         allocation error
+ */
+static char *mark_finishing_cells(MarkovChain *markov_chain)
+{
+    int n = markov_chain->database->size;
+    char *finishing = calloc(n, sizeof(char));
+    if (finishing == NULL)
+    {
+        return NULL;
+    }
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (Node *traveller = markov_chain->database->first; traveller;
+             traveller = traveller->next)
+        {
+            MarkovNode *node = traveller->data;
+            bool reaches = markov_chain->is_last(node->data);
+            for (int i = 0; !reaches && i < node->following_count; i++)
+            {
+                reaches = finishing[node->frequency_list[i].markov_node->id];
+            }
+            if (reaches && !finishing[node->id])
+            {
+                finishing[node->id] = 1;
+                changed = true;
+            }
+        }
+    }
+    return finishing;
+}
+
+/**
+ * Check whether no seat of a game can win any more.
+ *
+ * @param positions Token of every seat, seat by seat over the slots
+ * @param players Number of seats
+ * @param slot Slot of the game
+ * @param finishing Cells from which the last is reachable
+ * @return true if every token is stuck away from the last cell
+ */
+static bool game_is_stuck(MarkovNode **positions, int players, int slot,
+                          const char *finishing)
+{
+    for (int seat = 0; seat < players; seat++)
+    {
+        if (finishing[positions[seat * SIMULATION_SLOTS + slot]->id])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Put every seat of a game slot back on the first cell.
+ *
+ * @param positions Token of every seat, seat by seat over the slots
+ * @param players Number of seats
+ * @param slot Slot to reset
+ * @param start First cell
+ */
+static void start_game(MarkovNode **positions, int players, int slot,
+                       MarkovNode *start)
+{
+    for (int seat = 0; seat < players; seat++)
+    {
+        positions[seat * SIMULATION_SLOTS + slot] = start;
+    }
+}
+
+/**
+ * Play one thread's share of the games.
+ *
+ * @param arg The SimulationThread
+ * @return NULL
+ */
+static void *simulate_share(void *arg)
+{
+    SimulationThread *share = arg;
+    MarkovChain *markov_chain = share->markov_chain;
+    int players = share->config->players;
+    int max_rounds = share->config->max_rounds;
+    MarkovNode *start = markov_chain->database->first->data;
+    MarkovNode **positions = malloc(players * SIMULATION_SLOTS *
+                                    sizeof(MarkovNode *));
+    if (positions == NULL)
+    {
+        share->status = EXIT_FAILURE;
+        return NULL;
+    }
+
+    int seat[SIMULATION_SLOTS];
+    int round[SIMULATION_SLOTS];
+    bool playing[SIMULATION_SLOTS];
+    long started = 0;
+    int in_flight = 0;
+    for (int slot = 0; slot < SIMULATION_SLOTS; slot++)
+    {
+        playing[slot] = (started < share->games);
+        if (playing[slot])
+        {
+            start_game(positions, players, slot, start);
+            seat[slot] = 0;
+            round[slot] = 1;
+            started++;
+            in_flight++;
+        }
+    }
+
+    random_state_t state;
+    seed_random_state(&state, share->seed);
+    SimulationTally *tally = &share->tally;
+    while (in_flight > 0)
+    {
+        for (int slot = 0; slot < SIMULATION_SLOTS; slot++)
+        {
+            if (!playing[slot])
+            {
+                continue;
+            }
+
+            // The seat to move takes one turn
+            MarkovNode **token = &positions[seat[slot] * SIMULATION_SLOTS + slot];
+            if ((*token)->all_following > 0)
+            {
+                *token = resolve_jumps(get_next_random_node_r(*token, &state));
+            }
+
+            bool over = true;
+            if (!share->finishing[(*token)->id] &&
+                game_is_stuck(positions, players, slot, share->finishing))
+            {
+                tally->unfinished++;  // Would only run into the round cap
+            }
+            else if (markov_chain->is_last((*token)->data))
+            {
+                tally->wins[seat[slot]]++;
+                tally->finished++;
+                tally->rounds += round[slot];
+                tally->rounds_squared += (double)round[slot] * round[slot];
+                tally->turns += (double)(round[slot] - 1) * players +
+                                seat[slot] + 1;
+            }
+            else if (++seat[slot] < players)
+            {
+                over = false;
+            }
+            else if (round[slot] < max_rounds)
+            {
+                seat[slot] = 0;
+                round[slot]++;
+                over = false;
+            }
+            else
+            {
+                tally->unfinished++;
+            }
+
+            if (over && started < share->games)
+            {
+                start_game(positions, players, slot, start);
+                seat[slot] = 0;
+                round[slot] = 1;
+                started++;
+            }
+            else if (over)
+            {
+                playing[slot] = false;
+                in_flight--;
+            }
+        }
+    }
+
+    free(positions);
+    share->status = EXIT_SUCCESS;
+    return NULL;
+}
+
+int simulate_games(MarkovChain *markov_chain, const SimulationConfig *config,
+                   GameStats *stats)
+{
+    memset(stats, 0, sizeof(GameStats));
+    if (config->players < MIN_PLAYERS || config->players > MAX_PLAYERS ||
+        config->games <= 0 || config->max_rounds <= 0)
+    {
+        return EXIT_FAILURE;
+    }
+    int threads = config->threads;
+    if (threads <= 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (online > 0) ? (int)online : 1;
+    }
+    if (threads > config->games)
+    {
+        threads = (int)config->games;
+    }
+
+    SimulationThread *shares = calloc(threads, sizeof(SimulationThread));
+    char *finishing = mark_finishing_cells(markov_chain);
+    if (shares == NULL || finishing == NULL)
+    {
+        free(shares);
+        free(finishing);
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        shares[i].markov_chain = markov_chain;
+        shares[i].config = config;
+        shares[i].finishing = finishing;
+        shares[i].games = config->games / threads + (i < config->games % threads);
+        shares[i].seed = config->seed + (unsigned long long)i;
+    }
+
+    // Share 0 runs on the calling thread, as does any share whose thread
+    // could not be started
+    bool *spawned = calloc(threads, sizeof(bool));
+    for (int i = 1; spawned != NULL && i < threads; i++)
+    {
+        spawned[i] = (pthread_create(&shares[i].thread, NULL, simulate_share,
+                                     &shares[i]) == 0);
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        if (spawned == NULL || !spawned[i])
+        {
+            simulate_share(&shares[i]);
+        }
+    }
+
+    int result = EXIT_SUCCESS;
+    SimulationTally total;
+    memset(&total, 0, sizeof(SimulationTally));
+    for (int i = 0; i < threads; i++)
+    {
+        if (spawned != NULL && spawned[i])
+        {
+            pthread_join(shares[i].thread, NULL);
+        }
+        SimulationTally *tally = &shares[i].tally;
+        for (int seat = 0; seat < config->players; seat++)
+        {
+            total.wins[seat] += tally->wins[seat];
+        }
+        total.finished += tally->finished;
+        total.unfinished += tally->unfinished;
+        total.rounds += tally->rounds;
+        total.rounds_squared += tally->rounds_squared;
+        total.turns += tally->turns;
+        result = (shares[i].status == EXIT_SUCCESS) ? result : EXIT_FAILURE;
+    }
+    free(spawned);
+    free(shares);
+    free(finishing);
+
+    stats->players = config->players;
+    stats->games = config->games;
+    stats->unfinished = (double)total.unfinished / config->games;
+    if (total.finished > 0)
+    {
+        for (int seat = 0; seat < config->players; seat++)
+        {
+            stats->win_probability[seat] = (double)total.wins[seat] / total.finished;
+        }
+        stats->expected_rounds = total.rounds / total.finished;
+        stats->rounds_variance = total.rounds_squared / total.finished -
+                                 stats->expected_rounds * stats->expected_rounds;
+        stats->expected_turns = total.turns / total.finished;
+    }
+    return result;
+}
+
+double compare_game_stats(const GameStats *exact, const GameStats *simulated)
+{
+    double finished = simulated->games * (1 - simulated->unfinished);
+    if (finished <= 0)
+    {
+        return 0;
+    }
+
+    double worst = 0;
+    for (int seat = 0; seat < exact->players; seat++)
+    {
+        double p = exact->win_probability[seat];
+        double error = sqrt(p * (1 - p) / finished);
+        double gap = fabs(simulated->win_probability[seat] - p);
+        double z = (error > 0) ? gap / error : (gap > 0 ? INFINITY : 0);
+        worst = (z > worst) ? z : worst;
+    }
+    double error = sqrt(exact->rounds_variance / finished);
+    double gap = fabs(simulated->expected_rounds - exact->expected_rounds);
+    double z = (error > 0) ? gap / error : (gap > 0 ? INFINITY : 0);
+    return (z > worst) ? z : worst;
+}
@@ -0,0 +1,109 @@
+#ifndef _SNAKES_GAME_H_
+#define _SNAKES_GAME_H_
+
+#include "snakes_board.h"
+
+/**
+ * Multi-player games on a board chain from build_board_chain().
+ *
+ * Players take turns in seat order, all starting on cell 1, and the first
+ * to reach the last cell wins. A round is one turn of every seat.
+ */
+#define MIN_PLAYERS 2
+#define MAX_PLAYERS 6
+
+/**
+ * GameStats structure.
+ * Outcome of multi-player games, exact or simulated.
+ */
+typedef struct GameStats {
+    int players;                          // Number of seats
+    double win_probability[MAX_PLAYERS];  // Chance that each seat wins
+    double expected_rounds;               // Mean rounds until a seat wins
+    double rounds_variance;               // Variance of the rounds
+    double expected_turns;                // Mean turns of all seats until a win
+    double unfinished;                    // Chance a game cannot finish within the round cap
+    long games;                           // Games simulated (0 when exact)
+} GameStats;
+
+/**
+ * SimulationConfig structure.
+ * Parameters of simulate_games().
+ */
+typedef struct SimulationConfig {
+    int players;              // Seats per game
+    long games;               // Games to play in total
+    int threads;              // Threads to spread the games over (0 = one per CPU)
+    unsigned long long seed;  // Seed of the per-thread random states
+    int max_rounds;           // Rounds after which a game counts as unfinished
+} SimulationConfig;
+
+/**
+ * Distribution of the number of turns one player needs to finish.
+ *
+ * Propagates the probability of every cell one turn at a time (a roll,
+ * then any jumps it lands on) until the mass still on the board falls
+ * below tail or max_turns is reached.
+ *
+ * @param markov_chain Board chain
+ * @param tail Mass on the board at which to stop
+ * @param max_turns Most turns to compute
+ * @param pmf Receives P(finish on turn t) at index t (index 0 is 0);
+ *        release with free()
+ * @param survival Receives P(not finished after turn t) at index t; release
+ *        with free()
+ * @param turns Receives the last turn computed
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+int single_player_turns(MarkovChain *markov_chain, double tail, int max_turns,
+                        double **pmf, double **survival, int *turns);
+
+/**
+ * Exact outcome of a multi-player game.
+ *
+ * Players move independently, so seat i wins on round t exactly when it
+ * finishes on its t-th turn, every earlier seat needs more than t turns
+ * and every later seat at least t. With the single-player distribution p
+ * and survival S: P(seat i wins) = sum over t of p(t) S(t)^i S(t-1)^(n-1-i),
+ * and the rounds are the minimum of n independent lengths.
+ *
+ * @param markov_chain Board chain
+ * @param players Number of seats
+ * @param max_rounds Rounds after which a game counts as unfinished
+ * @param stats Receives the outcome
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on an invalid player count
+ *         or allocation error
+ */
+int exact_game_stats(MarkovChain *markov_chain, int players, int max_rounds,
+                     GameStats *stats);
+
+/**
+ * Simulate many multi-player games.
+ *
+ * Every thread keeps a batch of games in flight with the token positions of
+ * each seat stored seat by seat, and advances all of its games one turn per
+ * sweep, starting a new game in a slot as soon as its game ends. Each
+ * thread has its own random state derived from the seed, so equal seeds and
+ * thread counts give equal results. A game in which no token can reach the
+ * last cell any more is counted as unfinished at once.
+ *
+ * @param markov_chain Board chain (only read)
+ * @param config Players, games, threads, seed and round cap
+ * @param stats Receives the outcome of the finished games
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on an invalid config or
+ *         allocation error
+ */
+int simulate_games(MarkovChain *markov_chain, const SimulationConfig *config,
+                   GameStats *stats);
+
+/**
+ * Largest disagreement between a simulation and the exact outcome.
+ *
+ * @param exact Result of exact_game_stats()
+ * @param simulated Result of simulate_games()
+ * @return Largest absolute z-score over the seat win probabilities and
+ *         the mean rounds; below 4 the two agree
+ */
+double compare_game_stats(const GameStats *exact, const GameStats *simulated);
+
+#endif //_SNAKES_GAME_H_
@@ -0,0 +1,495 @@
+#define _GNU_SOURCE // For pthread barriers and sysconf(_SC_NPROCESSORS_ONLN)
+#include "stationary.h"
+#include <math.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/***************************/
+/*   CONSTANT DEFINITIONS  */
+/***************************/
+
+#define FLAG 1  // Constant true value for infinite loops
+
+/***************************/
+/*   STRUCTURE DEFINITIONS */
+/***************************/
+
+/**
+ * TransposedMatrix structure.
+ * Transition probabilities stored by target: row j lists every state i
+ * with a transition to j and its probability P[i][j]. States whose walk
+ * ends (last states and states without successors) have no entries; their
+ * mass restarts instead.
+ */
+typedef struct TransposedMatrix {
+    int states;        // Number of states (rows and columns)
+    long *row_start;   // Offsets of each row in sources/weights, states + 1 entries
+    int *sources;      // Predecessor id of every entry
+    double *weights;   // Transition probability of every entry
+    char *ends;        // 1 for states whose walk restarts
+    int start_count;   // States a restart lands on (those with ends == 0)
+} TransposedMatrix;
+
+/**
+ * PowerIteration structure.
+ * State shared by the threads of one power iteration.
+ */
+typedef struct PowerIteration {
+    const TransposedMatrix *matrix;  // Matrix to multiply by
+    const StationaryConfig *config;  // Tolerance, cap and teleport probability
+    double *current;                 // Distribution of the previous iteration
+    double *next;                    // Distribution being computed
+    int threads;                     // Number of threads
+    int *block_start;                // First row of each thread, threads + 1 entries
+    double *end_mass;                // Per-thread mass sitting on end states
+    double *change;                  // Per-thread L1 change of the iteration
+    pthread_barrier_t barrier;       // Separates the phases of an iteration
+    pthread_mutex_t lock;            // Guards released
+    pthread_cond_t release;          // Signalled once threads and blocks are final
+    bool released;                   // Helper threads may start iterating
+    int iterations;                  // Iterations completed
+    double residual;                 // L1 change of the last iteration
+    double rate;                     // Last ratio of successive residuals
+    bool done;                       // Converged or out of iterations
+} PowerIteration;
+
+/**
+ * IterationThread structure.
+ * One thread's view of a power iteration.
+ */
+typedef struct IterationThread {
+    PowerIteration *shared;  // Shared state
+    int index;               // Block handled by this thread
+    pthread_t thread;        // Thread running the block (unused for index 0)
+} IterationThread;
+
+/***************************/
+/*   FUNCTION DEFINITIONS  */
+/***************************/
+
+/**
+ * Free the arrays of a transposed matrix.
+ *
+ * @param matrix Matrix to empty
+ */
+static void free_transposed_matrix(TransposedMatrix *matrix)
+{
+    free(matrix->row_start);
+    free(matrix->sources);
+    free(matrix->weights);
+    free(matrix->ends);
+    memset(matrix, 0, sizeof(TransposedMatrix));
+}
+
+/**
+ * Id of the successor of a frequency entry.
+ *
+ * In a frozen chain the id is the successor's index in the packed node
+ * array, found without touching the (randomly placed) successor itself.
+ *
+ * @param markov_chain Chain the entry belongs to
+ * @param entry Frequency entry
+ * @return Successor id
+ */
+static int successor_id(MarkovChain *markov_chain,
+                        const MarkovNodeFrequency *entry)
+{
+    if (markov_chain->layout != NULL)
+    {
+        return (int)(entry->markov_node - markov_chain->layout->nodes);
+    }
+    return entry->markov_node->id;
+}
+
+/**
+ * Build the transposed transition matrix of a chain.
+ *
+ * @param markov_chain Chain to read
+ * @param matrix Matrix to fill
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if ids are not dense or
+ *         allocation failed
+ */
+static int build_transposed_matrix(MarkovChain *markov_chain,
+                                   TransposedMatrix *matrix)
+{
+    int states = markov_chain->database->size;
+    memset(matrix, 0, sizeof(TransposedMatrix));
+    matrix->states = states;
+    matrix->row_start = (long *)calloc(states + 1, sizeof(long));
+    matrix->ends = (char *)calloc(states, sizeof(char));
+    char *seen = (char *)calloc(states, sizeof(char));
+    if (matrix->row_start == NULL || matrix->ends == NULL || seen == NULL)
+    {
+        free(seen);
+        free_transposed_matrix(matrix);
+        return EXIT_FAILURE;
+    }
+
+    // Count the entries of every row (in-degree from walking states)
+    Node *traveller;
+    for (traveller = markov_chain->database->first; traveller;
+         traveller = traveller->next)
+    {
+        MarkovNode *node = traveller->data;
+        if (node->id < 0 || node->id >= states || seen[node->id])
+        {
+            free(seen);
+            free_transposed_matrix(matrix);
+            return EXIT_FAILURE;
+        }
+        seen[node->id] = 1;
+
+        if (markov_chain->is_last(node->data) || node->all_following <= 0)
+        {
+            matrix->ends[node->id] = 1;
+            continue;
+        }
+        matrix->start_count++;
+        for (int i = 0; i < node->following_count; i++)
+        {
+            if (node->frequency_list[i].frequency > 0)
+            {
+                matrix->row_start[successor_id(markov_chain,
+                                               &node->frequency_list[i]) + 1]++;
+            }
+        }
+    }
+    free(seen);
+
+    for (int row = 0; row < states; row++)
+    {
+        matrix->row_start[row + 1] += matrix->row_start[row];
+    }
+
+    long entries = matrix->row_start[states];
+    long *fill = (long *)malloc(states * sizeof(long));
+    matrix->sources = (int *)malloc((entries + 1) * sizeof(int));
+    matrix->weights = (double *)malloc((entries + 1) * sizeof(double));
+    if (fill == NULL || matrix->sources == NULL || matrix->weights == NULL)
+    {
+        free(fill);
+        free_transposed_matrix(matrix);
+        return EXIT_FAILURE;
+    }
+    memcpy(fill, matrix->row_start, states * sizeof(long));
+
+    for (traveller = markov_chain->database->first; traveller;
+         traveller = traveller->next)
+    {
+        MarkovNode *node = traveller->data;
+        if (matrix->ends[node->id])
+        {
+            continue;
+        }
+        for (int i = 0; i < node->following_count; i++)
+        {
+            MarkovNodeFrequency *entry = &node->frequency_list[i];
+            if (entry->frequency > 0)
+            {
+                long slot = fill[successor_id(markov_chain, entry)]++;
+                matrix->sources[slot] = node->id;
+                matrix->weights[slot] =
+                        (double)entry->frequency / node->all_following;
+            }
+        }
+    }
+
+    free(fill);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Split the rows into one block per thread with similar work.
+ *
+ * Work of a row is its entry count plus one, so blocks of empty rows are
+ * not free either.
+ *
+ * @param matrix Matrix to split
+ * @param threads Number of blocks
+ * @param block_start Receives threads + 1 row boundaries
+ */
+static void balance_blocks(const TransposedMatrix *matrix, int threads,
+                           int *block_start)
+{
+    double total = (double)matrix->row_start[matrix->states] + matrix->states;
+    int row = 0;
+
+    block_start[0] = 0;
+    for (int block = 1; block < threads; block++)
+    {
+        double target = total * block / threads;
+        while (row < matrix->states &&
+               matrix->row_start[row] + row < target)
+        {
+            row++;
+        }
+        block_start[block] = row;
+    }
+    block_start[threads] = matrix->states;
+}
+
+/**
+ * Run power iterations on one block of rows until the shared state is done.
+ *
+ * Waits until the thread count is final, then runs iterations of three
+ * phases separated by barriers: sum the mass on end states, compute the
+ * block's new probabilities (pulling from the predecessors), then one
+ * thread checks convergence and swaps the vectors.
+ *
+ * @param arg The IterationThread
+ * @return NULL
+ */
+static void *iterate_block(void *arg)
+{
+    IterationThread *self = arg;
+    PowerIteration *shared = self->shared;
+    pthread_mutex_lock(&shared->lock);
+    while (!shared->released)
+    {
+        pthread_cond_wait(&shared->release, &shared->lock);
+    }
+    pthread_mutex_unlock(&shared->lock);
+
+    const TransposedMatrix *matrix = shared->matrix;
+    double teleport = shared->config->teleport;
+    int first = shared->block_start[self->index];
+    int last = shared->block_start[self->index + 1];
+
+    while (FLAG)
+    {
+        const double *current = shared->current;
+        double *next = shared->next;
+
+        double end_mass = 0;
+        for (int row = first; row < last; row++)
+        {
+            if (matrix->ends[row])
+            {
+                end_mass += current[row];
+            }
+        }
+        shared->end_mass[self->index] = end_mass;
+        pthread_barrier_wait(&shared->barrier);
+
+        // Mass leaving end states, plus teleports, restarts uniformly
+        end_mass = 0;
+        for (int t = 0; t < shared->threads; t++)
+        {
+            end_mass += shared->end_mass[t];
+        }
+        double restart = ((1 - teleport) * end_mass + teleport) /
+                         matrix->start_count;
+
+        double change = 0;
+        for (int row = first; row < last; row++)
+        {
+            double sum = 0;
+            for (long k = matrix->row_start[row]; k < matrix->row_start[row + 1];
+                 k++)
+            {
+                sum += matrix->weights[k] * current[matrix->sources[k]];
+            }
+            double value = (1 - teleport) * sum +
+                           (matrix->ends[row] ? 0 : restart);
+            change += fabs(value - current[row]);
+            next[row] = value;
+        }
+        shared->change[self->index] = change;
+
+        if (pthread_barrier_wait(&shared->barrier) ==
+            PTHREAD_BARRIER_SERIAL_THREAD)
+        {
+            double residual = 0;
+            for (int t = 0; t < shared->threads; t++)
+            {
+                residual += shared->change[t];
+            }
+            if (shared->iterations > 0 && shared->residual > 0)
+            {
+                shared->rate = residual / shared->residual;
+            }
+            shared->residual = residual;
+            shared->iterations++;
+            shared->current = next;
+            shared->next = (double *)current;
+            shared->done = residual < shared->config->tolerance ||
+                           shared->iterations >= shared->config->max_iterations;
+        }
+        pthread_barrier_wait(&shared->barrier);
+
+        if (shared->done)
+        {
+            return NULL;
+        }
+    }
+}
+
+/**
+ * Start the helper threads, iterate on the calling thread, then join.
+ *
+ * If fewer threads than requested can be started, the rows are split
+ * among those that did before anyone begins.
+ *
+ * @param shared Prepared power iteration
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int run_power_iteration(PowerIteration *shared)
+{
+    IterationThread *workers = (IterationThread *)malloc(
+            shared->threads * sizeof(IterationThread));
+    if (workers == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+
+    int started = 1;
+    for (int t = 1; t < shared->threads; t++)
+    {
+        workers[t].shared = shared;
+        workers[t].index = t;
+        if (pthread_create(&workers[t].thread, NULL, iterate_block,
+                           &workers[t]) != 0)
+        {
+            break;
+        }
+        started++;
+    }
+
+    pthread_mutex_lock(&shared->lock);
+    shared->threads = started;
+    balance_blocks(shared->matrix, started, shared->block_start);
+    pthread_barrier_init(&shared->barrier, NULL, started);
+    shared->released = true;
+    pthread_cond_broadcast(&shared->release);
+    pthread_mutex_unlock(&shared->lock);
+
+    workers[0].shared = shared;
+    workers[0].index = 0;
+    iterate_block(&workers[0]);
+
+    for (int t = 1; t < started; t++)
+    {
+        pthread_join(workers[t].thread, NULL);
+    }
+    pthread_barrier_destroy(&shared->barrier);
+    free(workers);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Compute the stationary distribution of a markov chain.
+ *
+ * @param markov_chain Chain to analyse
+ * @param config Iteration parameters
+ * @param result Result to fill
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+int compute_stationary_distribution(MarkovChain *markov_chain,
+                                    const StationaryConfig *config,
+                                    StationaryResult *result)
+{
+    memset(result, 0, sizeof(StationaryResult));
+    if (config->tolerance <= 0 || config->max_iterations <= 0 ||
+        config->teleport < 0 || config->teleport >= 1 || config->threads < 0)
+    {
+        return EXIT_FAILURE;
+    }
+
+    TransposedMatrix matrix;
+    if (build_transposed_matrix(markov_chain, &matrix) == EXIT_FAILURE)
+    {
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        return EXIT_FAILURE;
+    }
+    if (matrix.start_count == 0)
+    {
+        free_transposed_matrix(&matrix);
+        return EXIT_FAILURE;
+    }
+
+    int threads = config->threads;
+    if (threads == 0)
+    {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = (online > 0) ? (int)online : 1;
+    }
+    if (threads > matrix.states)
+    {
+        threads = matrix.states;
+    }
+
+    PowerIteration shared;
+    memset(&shared, 0, sizeof(shared));
+    shared.matrix = &matrix;
+    shared.config = config;
+    shared.threads = threads;
+    shared.current = (double *)malloc(matrix.states * sizeof(double));
+    shared.next = (double *)malloc(matrix.states * sizeof(double));
+    shared.block_start = (int *)malloc((threads + 1) * sizeof(int));
+    shared.end_mass = (double *)malloc(threads * sizeof(double));
+    shared.change = (double *)malloc(threads * sizeof(double));
+    int status = EXIT_FAILURE;
+
+    if (shared.current != NULL && shared.next != NULL &&
+        shared.block_start != NULL && shared.end_mass != NULL &&
+        shared.change != NULL)
+    {
+        // Start from the restart distribution
+        for (int row = 0; row < matrix.states; row++)
+        {
+            shared.current[row] = matrix.ends[row] ? 0 :
+                                  1.0 / matrix.start_count;
+        }
+        pthread_mutex_init(&shared.lock, NULL);
+        pthread_cond_init(&shared.release, NULL);
+        status = run_power_iteration(&shared);
+        pthread_mutex_destroy(&shared.lock);
+        pthread_cond_destroy(&shared.release);
+    }
+
+    if (status == EXIT_SUCCESS)
+    {
+        // Undo rounding drift so the probabilities sum to exactly 1
+        double total = 0;
+        for (int row = 0; row < matrix.states; row++)
+        {
+            total += shared.current[row];
+        }
+        for (int row = 0; row < matrix.states; row++)
+        {
+            shared.current[row] /= total;
+        }
+
+        result->probabilities = shared.current;
+        result->states = matrix.states;
+        result->iterations = shared.iterations;
+        result->residual = shared.residual;
+        result->convergence_rate = shared.rate;
+        result->converged = shared.residual < config->tolerance;
+        shared.current = NULL;
+    }
+    else
+    {
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+    }
+
+    free(shared.current);
+    free(shared.next);
+    free(shared.block_start);
+    free(shared.end_mass);
+    free(shared.change);
+    free_transposed_matrix(&matrix);
+    return status;
+}
+
+/**
+ * Free the probabilities of a stationary result.
+ *
+ * @param result Result to empty
+ */
+void free_stationary_result(StationaryResult *result)
+{
+    free(result->probabilities);
+    memset(result, 0, sizeof(StationaryResult));
+}
@@ -0,0 +1,70 @@
+#ifndef _STATIONARY_H_
+#define _STATIONARY_H_
+
+#include "markov_chain.h"
+
+/**
+ * StationaryConfig structure.
+ * Parameters of compute_stationary_distribution().
+ */
+typedef struct StationaryConfig {
+    double tolerance;    // Stop once the L1 change of an iteration is below this
+    int max_iterations;  // Stop after this many iterations regardless
+    double teleport;     // Probability of restarting at every step (0 = only at ends)
+    int threads;         // Threads for the matrix-vector products (0 = one per CPU)
+} StationaryConfig;
+
+/**
+ * StationaryResult structure.
+ * Long-run probability of every state, indexed by node id.
+ */
+typedef struct StationaryResult {
+    double *probabilities;    // Probability of each state, summing to 1
+    int states;               // Number of entries in probabilities
+    int iterations;           // Iterations performed
+    double residual;          // L1 change of the last iteration
+    double convergence_rate;  // Estimate of |lambda_2|, the second largest eigenvalue
+    bool converged;           // residual fell below the tolerance
+} StationaryResult;
+
+/**
+ * Compute the stationary distribution of a markov chain.
+ *
+ * Models generation run forever: a walk moves to a successor with the
+ * probability given by the frequency lists, and whenever it reaches a last
+ * state or a state without successors it restarts at a state drawn like
+ * get_first_random_node() (uniformly among non-terminal states with
+ * successors). With teleport > 0 the walk additionally restarts with that
+ * probability at every step, which guarantees convergence on periodic or
+ * disconnected chains (PageRank-style damping).
+ *
+ * The transition matrix is transposed into compressed sparse rows (one row
+ * per target state listing its predecessors), so every thread pulls the
+ * new probabilities of its own block of states without synchronization.
+ * Blocks are balanced by the number of entries, and power iteration runs
+ * until the L1 change drops below tolerance. The ratio of successive
+ * changes estimates the second largest eigenvalue modulus, which governs
+ * how fast walks forget their start.
+ *
+ * Node ids must be dense (0 .. database size - 1), as they are after
+ * training, pruning and freezing.
+ *
+ * @param markov_chain Chain to analyse (not modified)
+ * @param config Tolerance, iteration cap, teleport probability and threads
+ * @param result Filled with the distribution; release with
+ *        free_stationary_result()
+ * @return EXIT_SUCCESS on success (even if not converged), EXIT_FAILURE on
+ *         invalid config, a chain with no start state or allocation error
+ */
+int compute_stationary_distribution(MarkovChain *markov_chain,
+                                    const StationaryConfig *config,
+                                    StationaryResult *result);
+
+/**
+ * Free the probabilities of a stationary result.
+ *
+ * @param result Result to empty
+ */
+void free_stationary_result(StationaryResult *result);
+
+#endif //_STATIONARY_H_
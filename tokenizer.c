@@ -0,0 +1,415 @@
+#include "tokenizer.h"
+#include <string.h> // For memcpy(), memmove()
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_WIDTH 32
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define SIMD_WIDTH 16
+#endif
+
+/***************************/
+/*   CONSTANT DEFINITIONS  */
+/***************************/
+
+#define HASH_SEED 0x9E3779B97F4A7C15ULL  // Initial hash state
+#define HASH_MULTIPLIER 0xFF51AFD7ED558CCDULL  // Mixing constant
+#define HASH_CHUNK 8                     // Bytes consumed per hash step
+#define HASH_ROTATE 29                   // Rotation between hash steps
+
+/***************************/
+/*   HELPER FUNCTIONS      */
+/***************************/
+
+/**
+ * Check whether a byte separates tokens (one of TOKEN_DELIMITERS).
+ *
+ * @param c Byte to check
+ * @return Non-zero for a delimiter
+ */
+static int is_delimiter(char c)
+{
+    return c == ' ' || c == '\n' || c == '\t' || c == '\r';
+}
+
+#ifdef SIMD_WIDTH
+/**
+ * Delimiter mask of one block: bit i is set when block[i] is a delimiter.
+ *
+ * @param block SIMD_WIDTH bytes to classify
+ * @return Bit mask of delimiter positions
+ */
+static unsigned int delimiter_mask(const char *block)
+{
+#if SIMD_WIDTH == 32
+    __m256i bytes = _mm256_loadu_si256((const __m256i *)block);
+    __m256i hits = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')),
+                            _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n'))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\t')),
+                            _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\r'))));
+    return (unsigned int)_mm256_movemask_epi8(hits);
+#else
+    __m128i bytes = _mm_loadu_si128((const __m128i *)block);
+    __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')),
+                         _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'))),
+            _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8('\t')),
+                         _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\r'))));
+    return (unsigned int)_mm_movemask_epi8(hits);
+#endif
+}
+
+/**
+ * Index of the lowest set bit.
+ *
+ * @param mask Non-zero mask
+ * @return Position of its lowest set bit
+ */
+static int lowest_bit(unsigned int mask)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    int bit = 0;
+    while ((mask & 1U) == 0)
+    {
+        mask >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+#endif
+
+/**
+ * Hash a token's bytes.
+ *
+ * @param bytes Token bytes
+ * @param length Number of bytes
+ * @return 64-bit hash
+ */
+unsigned long hash_token(const char *bytes, size_t length)
+{
+    unsigned long long hash = HASH_SEED ^ (unsigned long long)length;
+    unsigned long long chunk;
+
+    for (; length >= HASH_CHUNK; bytes += HASH_CHUNK, length -= HASH_CHUNK)
+    {
+        memcpy(&chunk, bytes, HASH_CHUNK);
+        hash = (hash ^ chunk) * HASH_MULTIPLIER;
+        hash = (hash << HASH_ROTATE) | (hash >> (64 - HASH_ROTATE));
+    }
+    if (length > 0)
+    {
+        chunk = 0;
+        memcpy(&chunk, bytes, length);
+        hash = (hash ^ chunk) * HASH_MULTIPLIER;
+    }
+
+    // Final avalanche so low bits depend on every input byte
+    hash ^= hash >> 33;
+    hash *= HASH_MULTIPLIER;
+    hash ^= hash >> 33;
+    return (unsigned long)hash;
+}
+
+/**
+ * Record one token: position, hash and terminal flag.
+ *
+ * @param span Span to fill
+ * @param buffer Scanned buffer
+ * @param start Index of the token's first byte
+ * @param end Index just past the token's last byte
+ */
+static void emit_span(TokenSpan *span, const char *buffer, size_t start,
+                      size_t end)
+{
+    span->offset = start;
+    span->length = end - start;
+    span->hash = hash_token(buffer + start, end - start);
+    span->terminal = (buffer[end - 1] == TOKEN_TERMINATOR);
+}
+
+/***************************/
+/*   TOKENIZER             */
+/***************************/
+
+/**
+ * Find the whitespace-separated tokens of a buffer.
+ *
+ * Both paths walk the buffer with the same state: whether a token is open
+ * and where it started. The SIMD path turns each block into a delimiter
+ * mask and jumps straight to the next token start (first clear bit) or
+ * token end (first set bit), so runs of word or space bytes cost one mask
+ * test per block instead of one branch per byte.
+ *
+ * @param buffer Bytes to scan
+ * @param length Number of bytes in buffer
+ * @param spans Array receiving the spans
+ * @param max_spans Capacity of spans
+ * @param resume Set to the number of bytes fully scanned
+ * @return Number of spans written
+ */
+size_t find_token_spans(const char *buffer, size_t length, TokenSpan *spans,
+                        size_t max_spans, size_t *resume)
+{
+    size_t count = 0;
+    size_t position = 0;
+    size_t token_start = 0;
+    int in_token = 0;
+
+    if (max_spans == 0)
+    {
+        *resume = 0;
+        return 0;
+    }
+
+#ifdef SIMD_WIDTH
+    const unsigned int full = (SIMD_WIDTH == 32) ? 0xFFFFFFFFU : 0xFFFFU;
+
+    for (; position + SIMD_WIDTH <= length; position += SIMD_WIDTH)
+    {
+        unsigned int delimiters = delimiter_mask(buffer + position);
+        int bit = 0;
+
+        while (bit < SIMD_WIDTH)
+        {
+            unsigned int remaining = full & (full << bit);
+            unsigned int next = in_token ? (delimiters & remaining)
+                                         : (~delimiters & remaining);
+            if (next == 0)
+            {
+                break;  // Current state lasts to the end of the block
+            }
+            bit = lowest_bit(next);
+
+            if (!in_token)
+            {
+                token_start = position + (size_t)bit;
+                in_token = 1;
+                continue;
+            }
+
+            emit_span(&spans[count], buffer, token_start,
+                      position + (size_t)bit);
+            in_token = 0;
+            if (++count == max_spans)
+            {
+                *resume = position + (size_t)bit;
+                return count;
+            }
+        }
+    }
+#endif
+
+    // Tail (or the whole buffer without SIMD), one byte at a time
+    for (; position < length; position++)
+    {
+        if (!is_delimiter(buffer[position]))
+        {
+            if (!in_token)
+            {
+                token_start = position;
+                in_token = 1;
+            }
+            continue;
+        }
+        if (in_token)
+        {
+            emit_span(&spans[count], buffer, token_start, position);
+            in_token = 0;
+            if (++count == max_spans)
+            {
+                *resume = position;
+                return count;
+            }
+        }
+    }
+
+    if (in_token)
+    {
+        emit_span(&spans[count], buffer, token_start, length);
+        count++;
+    }
+    *resume = length;
+    return count;
+}
+
+/***************************/
+/*   TOKEN STREAM          */
+/***************************/
+
+/**
+ * Size the span array for the current buffer capacity.
+ *
+ * A buffer of n bytes holds at most n / 2 + 1 tokens, so one
+ * find_token_spans() call always covers the whole block.
+ *
+ * @param stream Stream to update
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int fit_spans(TokenStream *stream)
+{
+    size_t needed = stream->capacity / 2 + 1;
+    if (needed <= stream->span_capacity)
+    {
+        return EXIT_SUCCESS;
+    }
+    TokenSpan *spans = realloc(stream->spans, needed * sizeof(TokenSpan));
+    if (spans == NULL)
+    {
+        return EXIT_FAILURE;
+    }
+    stream->spans = spans;
+    stream->span_capacity = needed;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Prepare a token stream over an open file.
+ *
+ * @param stream Stream to set up
+ * @param fp File to read
+ * @param buffer_size Bytes read per block
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+int open_token_stream(TokenStream *stream, FILE *fp, size_t buffer_size)
+{
+    stream->fp = fp;
+    stream->capacity = buffer_size > 0 ? buffer_size : 1;
+    stream->buffer = malloc(stream->capacity);
+    stream->length = 0;
+    stream->offset = 0;
+    stream->carry_start = 0;
+    stream->spans = NULL;
+    stream->span_capacity = 0;
+    stream->eof = false;
+    stream->failed = false;
+    if (stream->buffer == NULL || fit_spans(stream) == EXIT_FAILURE)
+    {
+        close_token_stream(stream);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Read the next block and return its complete tokens.
+ *
+ * @param stream Stream to read from
+ * @param text Set to the block's bytes
+ * @param spans Set to the block's tokens
+ * @return Number of tokens, 0 at end of file, -1 on error
+ */
+long token_stream_next(TokenStream *stream, const char **text,
+                       const TokenSpan **spans)
+{
+    if (stream->failed)
+    {
+        return -1;
+    }
+
+    // Keep only the unfinished token of the previous block
+    size_t carried = stream->length - stream->carry_start;
+    memmove(stream->buffer, stream->buffer + stream->carry_start, carried);
+    stream->offset += stream->carry_start;
+    stream->length = carried;
+    stream->carry_start = carried;
+
+    while (true)
+    {
+        if (stream->eof && stream->length == 0)
+        {
+            return 0;
+        }
+
+        if (!stream->eof)
+        {
+            if (stream->length == stream->capacity)
+            {
+                // One token fills the whole buffer - make room for the rest
+                char *grown = realloc(stream->buffer, stream->capacity * 2);
+                if (grown == NULL)
+                {
+                    stream->failed = true;
+                    return -1;
+                }
+                stream->buffer = grown;
+                stream->capacity *= 2;
+                if (fit_spans(stream) == EXIT_FAILURE)
+                {
+                    stream->failed = true;
+                    return -1;
+                }
+            }
+
+            size_t wanted = stream->capacity - stream->length;
+            size_t received = fread(stream->buffer + stream->length, 1, wanted,
+                                    stream->fp);
+            stream->length += received;
+            if (received < wanted)
+            {
+                if (ferror(stream->fp))
+                {
+                    stream->failed = true;
+                    return -1;
+                }
+                stream->eof = true;
+            }
+        }
+
+        size_t resume = 0;
+        size_t count = find_token_spans(stream->buffer, stream->length,
+                                        stream->spans, stream->span_capacity,
+                                        &resume);
+        stream->carry_start = stream->length;
+
+        // A token touching the end may continue in the next block
+        if (!stream->eof && count > 0
+            && stream->spans[count - 1].offset + stream->spans[count - 1].length
+               == stream->length)
+        {
+            count--;
+            stream->carry_start = stream->spans[count].offset;
+        }
+
+        if (count > 0 || stream->eof)
+        {
+            *text = stream->buffer;
+            *spans = stream->spans;
+            if (count == 0)
+            {
+                stream->offset += stream->length;  // Only delimiters were left
+                stream->length = 0;
+                stream->carry_start = 0;
+            }
+            return (long)count;
+        }
+
+        // Nothing complete yet: drop leading delimiters and read on
+        size_t kept = stream->length - stream->carry_start;
+        memmove(stream->buffer, stream->buffer + stream->carry_start, kept);
+        stream->offset += stream->carry_start;
+        stream->length = kept;
+        stream->carry_start = kept;
+    }
+}
+
+/**
+ * Free a token stream's buffers.
+ *
+ * @param stream Stream to close
+ */
+void close_token_stream(TokenStream *stream)
+{
+    free(stream->buffer);
+    free(stream->spans);
+    stream->buffer = NULL;
+    stream->spans = NULL;
+    stream->capacity = 0;
+    stream->span_capacity = 0;
+    stream->length = 0;
+    stream->carry_start = 0;
+}
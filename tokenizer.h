@@ -0,0 +1,112 @@
+#ifndef _TOKENIZER_H_
+#define _TOKENIZER_H_
+#include <stdio.h>  // For FILE
+#include <stdlib.h> // For size_t
+#include <stdbool.h> // For bool
+
+/**
+ * Bytes that separate tokens: space, newline, tab and carriage return.
+ */
+#define TOKEN_DELIMITERS " \n\t\r"
+#define TOKEN_TERMINATOR '.'  // Last byte of a sentence-ending token
+
+/**
+ * TokenSpan structure.
+ * Position of one token inside the scanned buffer, with the values every
+ * later stage needs so none of them rescans the bytes. The buffer itself
+ * is never modified, so tokens are not NUL-terminated.
+ */
+typedef struct TokenSpan {
+    size_t offset;        // Index of the token's first byte
+    size_t length;        // Number of bytes in the token
+    unsigned long hash;   // hash_token() of the token's bytes
+    bool terminal;        // Token ends with TOKEN_TERMINATOR
+} TokenSpan;
+
+/**
+ * Hash a token's bytes.
+ *
+ * Consumes eight bytes per step, so short words cost one or two
+ * multiplies. Equal byte strings always get equal hashes.
+ *
+ * @param bytes Token bytes (need not be NUL-terminated)
+ * @param length Number of bytes
+ * @return 64-bit hash
+ */
+unsigned long hash_token(const char *bytes, size_t length);
+
+/**
+ * Find the whitespace-separated tokens of a buffer.
+ *
+ * Classifies 16 bytes at a time with SSE2 compare masks (32 with AVX2) and
+ * falls back to a byte loop on other targets or for the tail. The end of
+ * the buffer counts as a delimiter, so a token touching it is reported
+ * whole. Each token is hashed and checked for TOKEN_TERMINATOR as soon as
+ * its end is found, while its bytes are still in cache.
+ *
+ * Scanning stops early when max_spans tokens have been found; *resume is
+ * then the offset to pass as buffer + *resume in the next call. Otherwise
+ * *resume is length.
+ *
+ * @param buffer Bytes to scan (need not be NUL-terminated)
+ * @param length Number of bytes in buffer
+ * @param spans Array receiving the spans, in order
+ * @param max_spans Capacity of spans
+ * @param resume Set to the number of bytes fully scanned
+ * @return Number of spans written
+ */
+size_t find_token_spans(const char *buffer, size_t length, TokenSpan *spans,
+                        size_t max_spans, size_t *resume);
+
+/**
+ * TokenStream structure.
+ * Reads a file in large blocks and hands out the complete tokens of each
+ * block in place. A token cut by the end of a block is moved to the front
+ * of the buffer and completed by the next read, so lines and tokens of
+ * any length come out whole and only those few carried bytes are copied.
+ */
+typedef struct TokenStream {
+    FILE *fp;               // File being read
+    char *buffer;           // Current block (plus carried bytes at the front)
+    size_t capacity;        // Size of buffer, doubled for giant tokens
+    size_t length;          // Valid bytes in buffer
+    size_t offset;          // Position of buffer[0] in the file
+    size_t carry_start;     // Offset of the incomplete last token, or length
+    TokenSpan *spans;       // Complete tokens of the current block
+    size_t span_capacity;   // Size of spans
+    bool eof;               // No more bytes to read
+    bool failed;            // A read or allocation failed
+} TokenStream;
+
+/**
+ * Prepare a token stream over an open file.
+ *
+ * @param stream Stream to set up
+ * @param fp File to read (left open by close_token_stream())
+ * @param buffer_size Bytes read per block
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+int open_token_stream(TokenStream *stream, FILE *fp, size_t buffer_size);
+
+/**
+ * Read the next block and return its complete tokens.
+ *
+ * The text and spans stay valid until the next call. Span offsets are
+ * relative to *text, which starts at byte stream->offset of the file.
+ *
+ * @param stream Stream to read from
+ * @param text Set to the block's bytes
+ * @param spans Set to the block's tokens
+ * @return Number of tokens, 0 at end of file, -1 on error
+ */
+long token_stream_next(TokenStream *stream, const char **text,
+                       const TokenSpan **spans);
+
+/**
+ * Free a token stream's buffers.
+ *
+ * @param stream Stream to close
+ */
+void close_token_stream(TokenStream *stream);
+
+#endif //_TOKENIZER_H_
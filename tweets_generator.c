@@ -1,8 +1,18 @@
+#define _POSIX_C_SOURCE 200809L // For clock_gettime()
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "markov_chain.h"
 #include "linked_list.h"
+#include "generation_server.h"
+#include "tokenizer.h"
+#include "intern_table.h"
+#include "corpus_pipeline.h"
+#include "stationary.h"
+#include "matrix_export.h"
+#include "pair_builder.h"
+#include "external_builder.h"
 
 /***************************/
 /*   MACRO DEFINITIONS     */
@@ -10,30 +20,159 @@
 
 #define FILE_PATH_ERROR "Error: incorrect file path"  // Error for invalid file path
 #define NUM_ARGS_ERROR "Usage: invalid number of arguments"  // Error for wrong arg count
-#define DELIMITERS " \n\t\r"       // Word delimiters for tokenization
-#define MAX_LEN_ROW 1000           // Maximum length of a line in input file
-#define START_CHAIN 0              // Initial word counter value
+#define READ_BUFFER_SIZE (1 << 20) // Bytes read from the corpus at a time
 #define BASE_TEN 10                // Base for string to integer conversion
 #define LEN_OF_TWEETS 1            // Initial tweet counter value
 #define MAX_LEN_OF_TWEET 20        // Maximum words per generated tweet
 #define MIN_NUM_ARGS 4             // Minimum command line arguments
 #define MAX_NUM_ARGS 5             // Maximum command line arguments
+#define OPTION_PREFIX "--"         // Prefix of optional command line flags
+#define OPTION_ERROR "Usage: unknown option "  // Error for unrecognized flag
+#define MIN_COUNT_OPTION "--min-count="        // Prune rarer transitions
+#define TOP_K_OPTION "--top-k="                // Keep k successors per word
+#define MEMORY_BUDGET_OPTION "--memory-budget=" // Cap chain size in bytes
+#define PRUNE_CHECK_INTERVAL 65536 // Words between memory budget checks
+#define HEAVY_HITTERS_OPTION "--heavy-hitters=" // Approximate mode candidates
+#define EPSILON_OPTION "--epsilon="            // Sketch error bound
+#define DELTA_OPTION "--delta="                // Sketch failure probability
+#define MAX_STATES_OPTION "--max-states="      // Cap on distinct words
+#define DEFAULT_EPSILON 0.0001     // Default sketch error bound
+#define DEFAULT_DELTA 0.01         // Default sketch failure probability
+#define HALF_LIFE_OPTION "--half-life="        // Decay half-life in epochs
+#define WINDOW_OPTION "--window="              // Sliding window in epochs
+#define EPOCH_WORDS_OPTION "--epoch-words="    // Words per epoch
+#define DEFAULT_EPOCH_WORDS 10000  // Default number of words per epoch
+#define STATS_OPTION "--stats"     // Dump chain statistics to stderr
+#define SERVE_OPTION "--serve="    // Serve generations on a Unix socket
+#define WORKERS_OPTION "--workers=" // Generation threads in server mode
+#define DEFAULT_WORKERS 4          // Default number of server workers
+#define SERVER_BATCH 16            // Requests a server worker takes at once
+#define SERVER_MAX_COUNT 10000     // Most sequences per server request
+#define SERVER_MAX_LENGTH 1000     // Longest sequence per server request
+#define READERS_OPTION "--readers="        // File reading threads
+#define TOKENIZERS_OPTION "--tokenizers="  // Tokenizing threads
+#define DEFAULT_READERS 2          // Default number of reader threads
+#define DEFAULT_TOKENIZERS 2       // Default number of tokenizer threads
+#define NO_WORD_LIMIT (-1)         // Word limit when reading everything
+#define IO_OPTION "--io="          // Read backend: auto, uring or pread
+#define IO_DEPTH_OPTION "--io-depth=" // Reads in flight per reader thread
+#define BYTES_PER_MIB (1024.0 * 1024.0)
+#define MAX_BYTES_OPTION "--max-bytes="     // Stop after this many input bytes
+#define MAX_SECONDS_OPTION "--max-seconds=" // Stop training after this long
+#define BOUNDARY_OPTION "--boundary="       // Where word runs end
+#define BATCH_OPTION "--batch"     // Generate tweets in lockstep groups
+#define RANK_OPTION "--rank="      // Print the words with most long-run visits
+#define TELEPORT_OPTION "--teleport=" // Restart probability for --rank
+#define RANK_TOLERANCE 1e-12       // L1 change at which --rank stops iterating
+#define RANK_MAX_ITERATIONS 10000  // Iteration cap of --rank
+#define RANK_ERROR "Error: could not compute the stationary distribution\n"
+#define EXPORT_OPTION "--export="  // Write the transition matrix to a file
+#define EXPORT_FORMAT_OPTION "--export-format="  // csr or coo
+#define EXPORT_VALUES_OPTION "--export-values="  // counts or probabilities
+#define EXPORT_ERROR "Error: could not export the transition matrix\n"
+#define APPROX_BUDGET_ERROR "Usage: --heavy-hitters cannot be combined with " \
+                            "--memory-budget; cap --max-states instead\n"
+#define TWO_PHASE_OPTION "--two-phase" // Count pairs first, build lists after
+#define TWO_PHASE_ERROR "Usage: --two-phase needs exact counts without decay " \
+                        "or a memory budget\n"
+#define SPILL_OPTION "--spill="    // Train out of core, run files in this directory
+#define SPILL_BUDGET_OPTION "--spill-budget=" // Memory for out-of-core training
+#define DEFAULT_SPILL_BUDGET (256UL * 1024 * 1024) // Default out-of-core memory
+#define SPILL_ERROR "Usage: --spill needs --export (csr counts) and exact, " \
+                    "unpruned counts, and cannot be combined with --rank, " \
+                    "--serve, --batch or --two-phase\n"
+#define SPILL_BUDGET_ERROR "Usage: --spill-budget must be at least %d bytes\n"
+#define SNAPSHOT_ERROR "Error: could not write the chain snapshot\n"
+#define SPILL_PATH_ERROR "Error: %s is not a writable directory or %s " \
+                         "cannot be created\n"
+#define TIME_CHECK_INTERVAL 1024   // Words between clock reads
+#define EMPTY_CORPUS_ERROR "Error: corpus has no word to start a tweet from\n"
+#define NANOS_PER_SECOND 1e9
+
+/***************************/
+/*   STRUCTURE DEFINITIONS */
+/***************************/
+
+// Function pointer type deciding whether no transition follows a word
+typedef bool (*boundary_func_t)(const char *text, const TokenSpan *span);
+
+/**
+ * Limits of one training run. Reading stops at whichever comes first.
+ */
+typedef struct IngestLimits {
+    long words;      // Most words to read, NO_WORD_LIMIT for none
+    size_t bytes;    // Most input bytes to read, 0 for none
+    double seconds;  // Wall-clock budget for reading, 0 for none
+} IngestLimits;
+
+/**
+ * Training options collected from the optional command line flags.
+ */
+typedef struct TrainOptions {
+    PruneConfig prune;         // Pruning policy
+    ApproximateConfig approx;  // Approximate counting (heavy_hitters 0 = exact)
+    DecayConfig decay;         // Time decay / sliding window (zeros = off)
+    long epoch_words;          // Words read per decay epoch
+    bool stats;                // Print markov_chain_stats() when done
+    const char *serve_path;    // Socket to serve on instead of printing tweets
+    int workers;               // Server worker threads
+    PipelineConfig pipeline;   // Threads for multi-file corpora
+    IngestLimits limits;       // When to stop reading
+    boundary_func_t boundary;  // Which words end a run of linked words
+    bool batch;                // Generate with generate_sequences_batch()
+    int rank;                  // Words to print by stationary probability (0 = off)
+    double teleport;           // Restart probability per step for --rank
+    const char *export_path;   // Matrix file to write, or NULL
+    MatrixLayout export_layout;  // CSR or COO
+    MatrixValues export_values;  // Counts or probabilities
+    bool two_phase;            // Build the frequency lists after reading
+    const char *spill_dir;     // Train out of core with run files here, or NULL
+    size_t spill_budget;       // Memory for out-of-core training
+} TrainOptions;
+
+/**
+ * A word and its stationary probability, for sorting.
+ */
+typedef struct RankedWord {
+    double probability;  // Long-run share of visits
+    MarkovNode *node;    // The word's state
+} RankedWord;
+
+/**
+ * Progress of one ingest, carried across blocks and files.
+ */
+typedef struct IngestState {
+    MarkovChain *markov_chain;    // Chain being trained
+    InternTable *words;           // Index of the chain's words
+    const TrainOptions *options;  // Training options
+    long words_read;              // Words consumed so far
+    size_t bytes_base;            // Input position of the current text
+    double deadline;              // Monotonic time to stop at, 0 for none
+    MarkovNode *save_last_one;    // Previous word, NULL at a boundary
+    bool last_boundary;           // No transition may follow previous word
+    char *word;                   // Buffer for copying out new words
+    size_t word_capacity;         // Size of word
+    PairBuilder *pairs;           // Transitions to build later, or NULL
+    ExternalBuilder *spill;       // Transitions to write to disk, or NULL
+} IngestState;
 
 /***************************/
 /*   FUNCTION DEFINITIONS  */
 /***************************/
 
 /**
- * Validate command line arguments and file path.
+ * Validate command line arguments and corpus path.
  *
- * Checks if the correct number of arguments was provided and if the
- * specified file path can be opened.
+ * Checks if the correct number of arguments was provided and expands the
+ * corpus path (a file, a directory or a comma-separated list of them)
+ * into the files to read.
  *
- * @param path File path to validate
+ * @param path Corpus path to validate
  * @param args Number of command line arguments
+ * @param files Receives the corpus files on success
  * @return EXIT_SUCCESS if valid, EXIT_FAILURE otherwise
  */
-int is_right_path(char *path, int args)
+int is_right_path(char *path, int args, CorpusFiles *files)
 {
     // Check argument count
     if (args != MIN_NUM_ARGS && args != MAX_NUM_ARGS)
@@ -42,9 +181,8 @@ int is_right_path(char *path, int args)
         return EXIT_FAILURE;
     }
 
-    // Attempt to open file
-    FILE *input_file = fopen(path, "r");
-    if (input_file == NULL)
+    // Every listed file must exist and every directory must be readable
+    if (list_corpus_files(path, files) == EXIT_FAILURE)
     {
         fprintf(stdout, FILE_PATH_ERROR);
         return EXIT_FAILURE;
@@ -54,164 +192,757 @@ int is_right_path(char *path, int args)
 }
 
 /**
- * Fill database without word limit.
+ * Boundary policy: a word ending with a period ends its sentence.
  *
- * Reads the entire input file and builds a Markov chain from all words.
- * Words are tokenized and added to the database, with transitions recorded
- * between consecutive words (except after sentence-ending periods).
+ * @param text Text the span points into (unused)
+ * @param span Word to check
+ * @return true if no transition may follow the word
+ */
+bool sentence_boundary(const char *text, const TokenSpan *span)
+{
+    (void)text;
+    return span->terminal;
+}
+
+/**
+ * Boundary policy: every word is linked to the next one.
  *
- * @param fp File pointer to read from
- * @param markov_chain Pointer to MarkovChain to populate
- * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ * @param text Text the span points into (unused)
+ * @param span Word to check (unused)
+ * @return false
  */
-int fill_without_limit(FILE *fp, MarkovChain *markov_chain)
+bool no_boundary(const char *text, const TokenSpan *span)
 {
-    int start_chain = START_CHAIN;
+    (void)text;
+    (void)span;
+    return false;
+}
 
-    // Allocate buffer for reading lines
-    char *row = malloc(sizeof(char) * MAX_LEN_ROW);
-    if (row == NULL)
+/**
+ * Print tweets generated in lockstep groups of LOCKSTEP_WALKS.
+ *
+ * Start words come from a start index and the walks of a group advance
+ * together (see generate_sequences_batch()), so memory latency overlaps
+ * across tweets. Uses its own random state seeded from seed rather than
+ * rand(), so the tweets differ from those of the one-by-one loop.
+ *
+ * @param markov_chain Trained chain
+ * @param max_tweets Number of tweets to print
+ * @param seed Seed of the random state
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+int print_tweets_batched(MarkovChain *markov_chain, long max_tweets,
+                         unsigned long long seed)
+{
+    StartIndex starts;
+    if (build_start_index(markov_chain, &starts) == EXIT_FAILURE)
     {
         fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
         return EXIT_FAILURE;
     }
 
-    MarkovNode *save_last_one = NULL;  // Track previous word
+    MarkovNode *firsts[LOCKSTEP_WALKS];
+    MarkovNode *tweets[LOCKSTEP_WALKS * MAX_LEN_OF_TWEET];
+    int lengths[LOCKSTEP_WALKS];
+    random_state_t state;
+    seed_random_state(&state, seed);
 
-    // Read file line by line
-    while (fgets(row, MAX_LEN_ROW, fp) != NULL)
+    for (long done = 0; done < max_tweets; done += LOCKSTEP_WALKS)
     {
-        // Tokenize line into words
-        void *token = strtok(row, DELIMITERS);
+        int group = (max_tweets - done < LOCKSTEP_WALKS) ?
+                    (int)(max_tweets - done) : LOCKSTEP_WALKS;
+        sample_start_nodes(&starts, group, firsts, &state);
+        generate_sequences_batch(markov_chain, firsts, group, MAX_LEN_OF_TWEET,
+                                 tweets, lengths, &state);
 
-        while (token)
+        for (int i = 0; i < group; i++)
         {
-            // Check if word already exists in database
-            Node *has_node = get_node_from_database(markov_chain, (char *)token);
-
-            if (has_node == NULL)
+            fprintf(stdout, "Tweet %ld: ", done + i + LEN_OF_TWEETS);
+            for (int j = 0; j < lengths[i]; j++)
             {
-                // Word doesn't exist - add it to database
-                has_node = add_to_database(markov_chain, (char *)token);
-                if (has_node == NULL)
-                {
-                    return EXIT_FAILURE;
-                }
+                markov_chain->print_func(tweets[i * MAX_LEN_OF_TWEET + j]->data);
             }
+            fprintf(stdout, "\n");
+        }
+    }
 
-            // Add transition from previous word to current word
-            if (save_last_one != NULL)
-            {
-                char *s = (char *)save_last_one->data;
-                unsigned long len_s = strlen(s);
-
-                // Only add transition if previous word doesn't end with period
-                if (s[len_s - 1] != '.')
-                {
-                    int add_to_frequency_list = add_node_to_frequency_list(
-                            save_last_one, has_node->data, markov_chain);
-
-                    if (add_to_frequency_list == EXIT_FAILURE)
-                    {
-                        return EXIT_FAILURE;
-                    }
-                }
-            }
+    free_start_index(&starts);
+    return EXIT_SUCCESS;
+}
 
-            // Update previous word tracker
-            save_last_one = has_node->data;
+/**
+ * qsort comparator ordering RankedWords by descending probability.
+ *
+ * @param first Pointer to the first RankedWord
+ * @param second Pointer to the second RankedWord
+ * @return Negative if first is more probable, positive if less, 0 if equal
+ */
+int compare_ranked_desc(const void *first, const void *second)
+{
+    const RankedWord *a = (const RankedWord *)first;
+    const RankedWord *b = (const RankedWord *)second;
+    return (b->probability > a->probability) - (b->probability < a->probability);
+}
 
-            // Get next token
-            token = strtok(NULL, DELIMITERS);
-            start_chain++;
+/**
+ * Print the words that endless tweet generation visits most often.
+ *
+ * Ranks words by the stationary distribution of the chain, restarting at a
+ * random first word after every tweet end. Convergence details go to
+ * stderr.
+ *
+ * @param markov_chain Trained chain
+ * @param count Number of words to print
+ * @param teleport Extra restart probability per step
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+int print_top_words(MarkovChain *markov_chain, int count, double teleport)
+{
+    StationaryConfig config = {RANK_TOLERANCE, RANK_MAX_ITERATIONS, teleport, 0};
+    StationaryResult result;
+    if (compute_stationary_distribution(markov_chain, &config, &result) ==
+        EXIT_FAILURE)
+    {
+        fprintf(stdout, RANK_ERROR);
+        return EXIT_FAILURE;
+    }
+
+    RankedWord *ranked = malloc(result.states * sizeof(RankedWord));
+    if (ranked == NULL)
+    {
+        free_stationary_result(&result);
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        return EXIT_FAILURE;
+    }
+    for (Node *traveller = markov_chain->database->first; traveller;
+         traveller = traveller->next)
+    {
+        MarkovNode *node = traveller->data;
+        ranked[node->id] = (RankedWord) {result.probabilities[node->id], node};
+    }
+    qsort(ranked, result.states, sizeof(RankedWord), compare_ranked_desc);
+
+    fprintf(stderr, "Stationary distribution: %d iterations, residual %.3g%s, "
+                    "convergence rate %.4f\n",
+            result.iterations, result.residual,
+            result.converged ? "" : " (not converged)",
+            result.convergence_rate);
+    for (int i = 0; i < count && i < result.states; i++)
+    {
+        fprintf(stdout, "Rank %d: %s %.6f\n", i + 1, (char *)ranked[i].node->data,
+                ranked[i].probability);
+    }
+
+    free(ranked);
+    free_stationary_result(&result);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Remove optional "--name=value" flags from the command line.
+ *
+ * Recognized flags are parsed into options and removed from argv, so the
+ * remaining positional arguments keep their usual indices.
+ *
+ * @param args Pointer to the argument count, updated in place
+ * @param argv Argument vector, compacted in place
+ * @param options Training options to fill (reset to defaults first)
+ * @return EXIT_SUCCESS if all flags were recognized, EXIT_FAILURE otherwise
+ */
+int parse_options(int *args, char *argv[], TrainOptions *options)
+{
+    PruneConfig *prune = &options->prune;
+    ApproximateConfig *approx = &options->approx;
+    *prune = (PruneConfig) {0, 0, 0};
+    *approx = (ApproximateConfig) {DEFAULT_EPSILON, DEFAULT_DELTA, 0, 0};
+    options->decay = (DecayConfig) {0, 0};
+    options->epoch_words = DEFAULT_EPOCH_WORDS;
+    options->stats = false;
+    options->serve_path = NULL;
+    options->workers = DEFAULT_WORKERS;
+    options->pipeline = (PipelineConfig) {DEFAULT_READERS, DEFAULT_TOKENIZERS,
+                                          0, READ_BACKEND_AUTO, 0};
+    options->limits = (IngestLimits) {NO_WORD_LIMIT, 0, 0};
+    options->boundary = sentence_boundary;
+    options->batch = false;
+    options->rank = 0;
+    options->teleport = 0;
+    options->export_path = NULL;
+    options->export_layout = MATRIX_LAYOUT_CSR;
+    options->export_values = MATRIX_VALUES_COUNTS;
+    options->two_phase = false;
+    options->spill_dir = NULL;
+    options->spill_budget = DEFAULT_SPILL_BUDGET;
+    int kept = 0;
+
+    for (int i = 0; i < *args; i++)
+    {
+        char *arg = argv[i];
+
+        if (i == 0 || strncmp(arg, OPTION_PREFIX, strlen(OPTION_PREFIX)) != 0)
+        {
+            argv[kept++] = arg;  // Positional argument
+        }
+        else if (strncmp(arg, MIN_COUNT_OPTION, strlen(MIN_COUNT_OPTION)) == 0)
+        {
+            prune->min_count = (int)strtol(arg + strlen(MIN_COUNT_OPTION),
+                                           NULL, BASE_TEN);
+        }
+        else if (strncmp(arg, TOP_K_OPTION, strlen(TOP_K_OPTION)) == 0)
+        {
+            prune->top_k = (int)strtol(arg + strlen(TOP_K_OPTION),
+                                       NULL, BASE_TEN);
+        }
+        else if (strncmp(arg, MEMORY_BUDGET_OPTION,
+                         strlen(MEMORY_BUDGET_OPTION)) == 0)
+        {
+            prune->memory_budget = strtoul(arg + strlen(MEMORY_BUDGET_OPTION),
+                                           NULL, BASE_TEN);
+        }
+        else if (strncmp(arg, HEAVY_HITTERS_OPTION,
+                         strlen(HEAVY_HITTERS_OPTION)) == 0)
+        {
+            approx->heavy_hitters = (int)strtol(
+                    arg + strlen(HEAVY_HITTERS_OPTION), NULL, BASE_TEN);
+        }
+        else if (strncmp(arg, EPSILON_OPTION, strlen(EPSILON_OPTION)) == 0)
+        {
+            approx->epsilon = strtod(arg + strlen(EPSILON_OPTION), NULL);
+        }
+        else if (strncmp(arg, DELTA_OPTION, strlen(DELTA_OPTION)) == 0)
+        {
+            approx->delta = strtod(arg + strlen(DELTA_OPTION), NULL);
+        }
+        else if (strncmp(arg, MAX_STATES_OPTION, strlen(MAX_STATES_OPTION)) == 0)
+        {
+            approx->max_states = (int)strtol(arg + strlen(MAX_STATES_OPTION),
+                                             NULL, BASE_TEN);
+        }
+        else if (strncmp(arg, HALF_LIFE_OPTION, strlen(HALF_LIFE_OPTION)) == 0)
+        {
+            options->decay.half_life = (int)strtol(
+                    arg + strlen(HALF_LIFE_OPTION), NULL, BASE_TEN);
+        }
+        else if (strncmp(arg, WINDOW_OPTION, strlen(WINDOW_OPTION)) == 0)
+        {
+            options->decay.window = (int)strtol(arg + strlen(WINDOW_OPTION),
+                                                NULL, BASE_TEN);
+        }
+        else if (strcmp(arg, STATS_OPTION) == 0)
+        {
+            options->stats = true;
+        }
+        else if (strcmp(arg, BATCH_OPTION) == 0)
+        {
+            options->batch = true;
+        }
+        else if (strncmp(arg, SERVE_OPTION, strlen(SERVE_OPTION)) == 0)
+        {
+            options->serve_path = arg + strlen(SERVE_OPTION);
         }
+        else if (strncmp(arg, WORKERS_OPTION, strlen(WORKERS_OPTION)) == 0)
+        {
+            options->workers = (int)strtol(arg + strlen(WORKERS_OPTION),
+                                           NULL, BASE_TEN);
+        }
+        else if (strncmp(arg, READERS_OPTION, strlen(READERS_OPTION)) == 0)
+        {
+            options->pipeline.readers = (int)strtol(
+                    arg + strlen(READERS_OPTION), NULL, BASE_TEN);
+        }
+        else if (strncmp(arg, TOKENIZERS_OPTION, strlen(TOKENIZERS_OPTION)) == 0)
+        {
+            options->pipeline.tokenizers = (int)strtol(
+                    arg + strlen(TOKENIZERS_OPTION), NULL, BASE_TEN);
+        }
+        else if (strcmp(arg, IO_OPTION "auto") == 0)
+        {
+            options->pipeline.backend = READ_BACKEND_AUTO;
+        }
+        else if (strcmp(arg, IO_OPTION "uring") == 0)
+        {
+            options->pipeline.backend = READ_BACKEND_IO_URING;
+        }
+        else if (strcmp(arg, IO_OPTION "pread") == 0)
+        {
+            options->pipeline.backend = READ_BACKEND_PREAD;
+        }
+        else if (strncmp(arg, IO_DEPTH_OPTION, strlen(IO_DEPTH_OPTION)) == 0)
+        {
+            options->pipeline.io_depth = (int)strtol(
+                    arg + strlen(IO_DEPTH_OPTION), NULL, BASE_TEN);
+        }
+        else if (strncmp(arg, MAX_BYTES_OPTION, strlen(MAX_BYTES_OPTION)) == 0)
+        {
+            options->limits.bytes = strtoul(arg + strlen(MAX_BYTES_OPTION),
+                                            NULL, BASE_TEN);
+        }
+        else if (strncmp(arg, MAX_SECONDS_OPTION,
+                         strlen(MAX_SECONDS_OPTION)) == 0)
+        {
+            options->limits.seconds = strtod(arg + strlen(MAX_SECONDS_OPTION),
+                                             NULL);
+        }
+        else if (strcmp(arg, BOUNDARY_OPTION "sentence") == 0)
+        {
+            options->boundary = sentence_boundary;
+        }
+        else if (strcmp(arg, BOUNDARY_OPTION "none") == 0)
+        {
+            options->boundary = no_boundary;
+        }
+        else if (strncmp(arg, RANK_OPTION, strlen(RANK_OPTION)) == 0)
+        {
+            options->rank = (int)strtol(arg + strlen(RANK_OPTION), NULL,
+                                        BASE_TEN);
+        }
+        else if (strncmp(arg, TELEPORT_OPTION, strlen(TELEPORT_OPTION)) == 0)
+        {
+            options->teleport = strtod(arg + strlen(TELEPORT_OPTION), NULL);
+        }
+        else if (strncmp(arg, EXPORT_OPTION, strlen(EXPORT_OPTION)) == 0)
+        {
+            options->export_path = arg + strlen(EXPORT_OPTION);
+        }
+        else if (strcmp(arg, EXPORT_FORMAT_OPTION "csr") == 0)
+        {
+            options->export_layout = MATRIX_LAYOUT_CSR;
+        }
+        else if (strcmp(arg, EXPORT_FORMAT_OPTION "coo") == 0)
+        {
+            options->export_layout = MATRIX_LAYOUT_COO;
+        }
+        else if (strcmp(arg, EXPORT_VALUES_OPTION "counts") == 0)
+        {
+            options->export_values = MATRIX_VALUES_COUNTS;
+        }
+        else if (strcmp(arg, EXPORT_VALUES_OPTION "probabilities") == 0)
+        {
+            options->export_values = MATRIX_VALUES_PROBABILITIES;
+        }
+        else if (strncmp(arg, EPOCH_WORDS_OPTION,
+                         strlen(EPOCH_WORDS_OPTION)) == 0)
+        {
+            options->epoch_words = strtol(arg + strlen(EPOCH_WORDS_OPTION),
+                                          NULL, BASE_TEN);
+        }
+        else if (strcmp(arg, TWO_PHASE_OPTION) == 0)
+        {
+            options->two_phase = true;
+        }
+        else if (strncmp(arg, SPILL_OPTION, strlen(SPILL_OPTION)) == 0)
+        {
+            options->spill_dir = arg + strlen(SPILL_OPTION);
+        }
+        else if (strncmp(arg, SPILL_BUDGET_OPTION,
+                         strlen(SPILL_BUDGET_OPTION)) == 0)
+        {
+            options->spill_budget = strtoul(arg + strlen(SPILL_BUDGET_OPTION),
+                                            NULL, BASE_TEN);
+        }
+        else
+        {
+            fprintf(stdout, "%s%s", OPTION_ERROR, arg);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Sketch keys are node ids, which evicting states renumbers
+    if (approx->heavy_hitters > 0 && prune->memory_budget > 0)
+    {
+        fprintf(stdout, APPROX_BUDGET_ERROR);
+        return EXIT_FAILURE;
+    }
+
+    // Pairs are only counted exactly and turned into lists at the end
+    if (options->two_phase &&
+        (approx->heavy_hitters > 0 || options->decay.half_life > 0 ||
+         options->decay.window > 0 || prune->memory_budget > 0))
+    {
+        fprintf(stdout, TWO_PHASE_ERROR);
+        return EXIT_FAILURE;
     }
 
-    // Free buffer
-    free(row);
-    row = NULL;
+    // Out of core, the chain only ever exists as the exported snapshot
+    if (options->spill_dir != NULL &&
+        (options->export_path == NULL ||
+         options->export_layout != MATRIX_LAYOUT_CSR ||
+         options->export_values != MATRIX_VALUES_COUNTS ||
+         approx->heavy_hitters > 0 || options->decay.half_life > 0 ||
+         options->decay.window > 0 || prune->min_count > 0 ||
+         prune->top_k > 0 || prune->memory_budget > 0 || options->rank > 0 ||
+         options->serve_path != NULL || options->batch || options->two_phase))
+    {
+        fprintf(stdout, SPILL_ERROR);
+        return EXIT_FAILURE;
+    }
+    if (options->spill_dir != NULL &&
+        options->spill_budget < MIN_EXTERNAL_BUDGET)
+    {
+        fprintf(stdout, SPILL_BUDGET_ERROR, MIN_EXTERNAL_BUDGET);
+        return EXIT_FAILURE;
+    }
 
+    *args = kept;
     return EXIT_SUCCESS;
 }
 
 /**
- * Fill database with a limited number of words.
+ * Copy a token span into a NUL-terminated word buffer.
  *
- * Reads up to words_to_read words from the input file and builds a
- * Markov chain. Words are tokenized and added to the database, with
- * transitions recorded between consecutive words.
+ * The text itself is never written to; only this per-word copy is
+ * NUL-terminated for add_to_database().
  *
- * @param fp File pointer to read from
- * @param words_to_read Maximum number of words to read
- * @param markov_chain Pointer to MarkovChain to populate
+ * @param text Text the span points into
+ * @param span Position of the word inside text
+ * @param word Pointer to the word buffer (grown as needed)
+ * @param capacity Pointer to the size of the word buffer
+ * @return The word, or NULL on allocation failure
+ */
+char *span_to_word(const char *text, const TokenSpan *span, char **word,
+                   size_t *capacity)
+{
+    if (span->length + 1 > *capacity)
+    {
+        char *grown = realloc(*word, span->length + 1);
+        if (grown == NULL)
+        {
+            fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+            return NULL;
+        }
+        *word = grown;
+        *capacity = span->length + 1;
+    }
+    memcpy(*word, text + span->offset, span->length);
+    (*word)[span->length] = '\0';
+    return *word;
+}
+
+/**
+ * Periodic maintenance while the chain is still being trained.
+ *
+ * Ends a decay epoch every epoch_words words, and enforces the memory
+ * budget every PRUNE_CHECK_INTERVAL words. Only the budget passes run
+ * here: min_count and top_k would judge partial counts, and what they drop
+ * is never recovered, so main() applies them once to the final counts.
+ * Pruning may evict the previous word's node and any interned node, so the
+ * transition tracker is reset and the intern table rebuilt afterwards.
+ *
+ * @param markov_chain Pointer to MarkovChain being populated
+ * @param options Training options
+ * @param words_read Number of words read so far
+ * @param words Intern table to rebuild after pruning
+ * @param save_last_one Previous-word tracker to reset after pruning
  * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
  */
-int fill_database(FILE *fp, long words_to_read, MarkovChain *markov_chain)
+int maintain_during_training(MarkovChain *markov_chain,
+                             const TrainOptions *options, long words_read,
+                             InternTable *words, MarkovNode **save_last_one)
 {
-    int start_chain = START_CHAIN;
+    const PruneConfig *prune = &options->prune;
 
-    // Allocate buffer for reading lines
-    char *row = malloc(MAX_LEN_ROW * sizeof(char));
-    if (row == NULL)
+    if (options->epoch_words > 0 && words_read % options->epoch_words == 0)
+    {
+        advance_epoch(markov_chain);
+    }
+
+    if (prune->memory_budget == 0 || words_read % PRUNE_CHECK_INTERVAL != 0 ||
+        markov_chain_memory_usage(markov_chain) <= prune->memory_budget)
+    {
+        return EXIT_SUCCESS;
+    }
+
+    PruneConfig budget_only = {0, 0, prune->memory_budget};
+    if (prune_markov_chain(markov_chain, &budget_only, NULL) == EXIT_FAILURE)
     {
-        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
         return EXIT_FAILURE;
     }
+    *save_last_one = NULL;
+    return intern_table_rebuild(words, markov_chain);
+}
+
+/**
+ * Current monotonic time in seconds.
+ *
+ * @return Seconds since an arbitrary fixed point
+ */
+double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / NANOS_PER_SECOND;
+}
 
-    MarkovNode *save_last_one = NULL;  // Track previous word
+/**
+ * Check whether the next word would exceed a training limit.
+ *
+ * The clock is read only every TIME_CHECK_INTERVAL words.
+ *
+ * @param state Ingest state
+ * @param end Input position just past the next word
+ * @return true if reading must stop before the word
+ */
+bool limit_reached(const IngestState *state, size_t end)
+{
+    const IngestLimits *limits = &state->options->limits;
 
-    // Read file line by line until word limit reached
-    while (fgets(row, MAX_LEN_ROW, fp) != NULL && start_chain < words_to_read)
+    if (limits->words != NO_WORD_LIMIT && state->words_read >= limits->words)
+    {
+        return true;
+    }
+    if (limits->bytes > 0 && end > limits->bytes)
     {
-        // Tokenize line into words
-        void *token = strtok(row, DELIMITERS);
+        return true;
+    }
+    return state->deadline > 0 && state->words_read % TIME_CHECK_INTERVAL == 0
+           && now_seconds() >= state->deadline;
+}
 
-        while (token && start_chain < words_to_read)
+/**
+ * Record a transition the way the training mode asks for.
+ *
+ * @param state Ingest state
+ * @param from Previous word
+ * @param to Current word
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+int record_transition(IngestState *state, MarkovNode *from, MarkovNode *to)
+{
+    if (state->spill != NULL)
+    {
+        return external_builder_add(state->spill, from->id, to->id);
+    }
+    if (state->pairs != NULL)
+    {
+        return pair_builder_add(state->pairs, from->id, to->id);
+    }
+    return add_node_to_frequency_list(from, to, state->markov_chain);
+}
+
+/**
+ * Add a run of words to the chain.
+ *
+ * The one place where words become states and transitions, whatever the
+ * input came from: each word is interned by its precomputed hash, a
+ * transition from the previous word is recorded (see record_transition())
+ * unless the boundary policy ended the run there, and periodic maintenance
+ * runs as words go by.
+ *
+ * @param state Ingest state
+ * @param text Text the spans point into
+ * @param spans Words of text, in order
+ * @param count Number of words
+ * @return EXIT_SUCCESS, PIPELINE_STOP at a limit, or EXIT_FAILURE
+ */
+int ingest_spans(IngestState *state, const char *text, const TokenSpan *spans,
+                 size_t count)
+{
+    MarkovChain *markov_chain = state->markov_chain;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const TokenSpan *span = &spans[i];
+        if (limit_reached(state, state->bytes_base + span->offset + span->length))
         {
-            // Check if word already exists in database
-            Node *has_node = get_node_from_database(markov_chain, (char *)token);
+            return PIPELINE_STOP;
+        }
 
-            if (has_node == NULL)
-            {
-                // Word doesn't exist - add it to database
-                has_node = add_to_database(markov_chain, token);
-            }
+        // Look the word up by its hash and length, without rescanning it
+        MarkovNode *current = intern_table_find(
+                state->words, text + span->offset, span->length, span->hash);
+
+        if (current == NULL && is_database_full(markov_chain))
+        {
+            // State cap reached - drop the word and break the transition
+            state->save_last_one = NULL;
+            state->words_read++;
+            continue;
+        }
 
-            // Add transition from previous word to current word
-            if (save_last_one != NULL)
+        if (current == NULL)
+        {
+            // Word doesn't exist - add it to database
+            char *word = span_to_word(text, span, &state->word,
+                                      &state->word_capacity);
+            Node *added = word ? add_to_database(markov_chain, word) : NULL;
+            if (added == NULL || intern_table_insert(
+                    state->words, added->data, span->length,
+                    span->hash) == EXIT_FAILURE)
             {
-                char *s = (char *)save_last_one->data;
-                unsigned long len_s = strlen(s);
-
-                // Only add transition if previous word doesn't end with period
-                if (s[len_s - 1] != '.')
-                {
-                    int add_to_frequency_list = add_node_to_frequency_list(
-                            save_last_one, has_node->data, markov_chain);
-
-                    if (add_to_frequency_list == EXIT_FAILURE)
-                    {
-                        return EXIT_FAILURE;
-                    }
-                }
+                return EXIT_FAILURE;
             }
+            current = added->data;
+        }
+
+        // Add transition unless the previous word ended a run
+        if (state->save_last_one != NULL && !state->last_boundary &&
+            record_transition(state, state->save_last_one, current) ==
+            EXIT_FAILURE)
+        {
+            return EXIT_FAILURE;
+        }
 
-            // Update previous word tracker
-            save_last_one = has_node->data;
+        // Update previous word tracker
+        state->save_last_one = current;
+        state->last_boundary = state->options->boundary(text, span);
+        state->words_read++;
 
-            // Get next token
-            token = strtok(NULL, DELIMITERS);
-            start_chain++;
+        if (maintain_during_training(markov_chain, state->options,
+                                     state->words_read, state->words,
+                                     &state->save_last_one) == EXIT_FAILURE)
+        {
+            return EXIT_FAILURE;
         }
     }
 
-    // Free buffer
-    free(row);
-    row = NULL;
-
     return EXIT_SUCCESS;
 }
 
+/**
+ * Ingest one file as a stream of large blocks.
+ *
+ * @param fp File to read
+ * @param state Ingest state
+ * @return EXIT_SUCCESS, PIPELINE_STOP at a limit, or EXIT_FAILURE
+ */
+int ingest_stream(FILE *fp, IngestState *state)
+{
+    // Read the file in large blocks, words cut by a block end carried over
+    TokenStream stream;
+    if (open_token_stream(&stream, fp, READ_BUFFER_SIZE) == EXIT_FAILURE)
+    {
+        fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        return EXIT_FAILURE;
+    }
+
+    const char *text = NULL;        // Current block
+    const TokenSpan *spans = NULL;  // Complete words of the block
+    long count = 0;
+    int result = EXIT_SUCCESS;
+
+    while (result == EXIT_SUCCESS &&
+           (count = token_stream_next(&stream, &text, &spans)) > 0)
+    {
+        state->bytes_base = stream.offset;
+        result = ingest_spans(state, text, spans, (size_t)count);
+    }
+
+    close_token_stream(&stream);
+    return count < 0 ? EXIT_FAILURE : result;
+}
+
+/**
+ * Pipeline consumer: ingest one whole file, without linking it to the last.
+ *
+ * @param context IngestState
+ * @param text File contents
+ * @param length Bytes in text
+ * @param spans Words of text
+ * @param count Number of words
+ * @return As ingest_spans()
+ */
+int consume_file(void *context, const char *text, size_t length,
+                 const TokenSpan *spans, size_t count)
+{
+    IngestState *state = context;
+    state->save_last_one = NULL;  // Files are independent documents
+    int result = ingest_spans(state, text, spans, count);
+    state->bytes_base += length;
+    return result;
+}
+
+/**
+ * Fill database from the corpus.
+ *
+ * A single file is streamed on this thread. Several files are read and
+ * tokenized in parallel by run_corpus_pipeline() and added to the chain in
+ * list order here, so the chain is the same as reading the files one after
+ * another (with no transition from the last word of a file to the first
+ * word of the next). Either way every word goes through ingest_spans(),
+ * and reading stops at the first of options->limits to be reached.
+ *
+ * With options->two_phase the transitions are collected in a PairBuilder
+ * while reading and the frequency lists are built from it at the end. With
+ * a spill builder the chain only gets its states, and the transitions are
+ * left in the builder.
+ *
+ * @param files Corpus files
+ * @param markov_chain Pointer to MarkovChain to populate
+ * @param words Intern table indexing the chain's words
+ * @param options Training options applied while reading
+ * @param spill Builder taking the transitions out of core, or NULL
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+int fill_database(const CorpusFiles *files, MarkovChain *markov_chain,
+                  InternTable *words, const TrainOptions *options,
+                  ExternalBuilder *spill)
+{
+    IngestState state = {markov_chain, words, options, 0, 0, 0, NULL, false,
+                         NULL, 0, NULL, spill};
+    if (options->limits.seconds > 0)
+    {
+        state.deadline = now_seconds() + options->limits.seconds;
+    }
+    PairBuilder pairs;
+    if (options->two_phase)
+    {
+        if (create_pair_builder(&pairs, DEFAULT_PAIR_CAPACITY) == EXIT_FAILURE)
+        {
+            return EXIT_FAILURE;
+        }
+        state.pairs = &pairs;
+    }
+
+    int result = EXIT_FAILURE;
+    if (files->count > 1)
+    {
+        PipelineStats stats;
+        result = run_corpus_pipeline(files, &options->pipeline, consume_file,
+                                     &state, &stats);
+
+        if (options->stats && stats.read_seconds > 0 && stats.wall_seconds > 0)
+        {
+            // Per reader: how fast one reader's I/O went while it was reading
+            fprintf(stderr, "Read %zu bytes from %d files with %s: "
+                            "%.1f MiB/s per reader, %.1f MiB/s overall\n",
+                    stats.bytes_read, stats.files_read,
+                    read_backend_name(stats.backend),
+                    stats.bytes_read / BYTES_PER_MIB / stats.read_seconds,
+                    stats.bytes_read / BYTES_PER_MIB / stats.wall_seconds);
+        }
+    }
+    else
+    {
+        FILE *input_file = fopen(files->paths[0], "r");
+        if (input_file == NULL)
+        {
+            fprintf(stdout, FILE_PATH_ERROR);
+        }
+        else
+        {
+            result = ingest_stream(input_file, &state);
+            result = (result == PIPELINE_STOP) ? EXIT_SUCCESS : result;
+            fclose(input_file);
+        }
+    }
+
+    if (state.pairs != NULL)
+    {
+        if (options->stats)
+        {
+            fprintf(stderr, "Two-phase build: %llu pairs, %zu bytes buffered\n",
+                    pairs.pairs, pair_builder_memory_usage(&pairs));
+        }
+        if (result == EXIT_SUCCESS)
+        {
+            result = build_chain_from_pairs(&pairs, markov_chain);
+        }
+        free_pair_builder(&pairs);
+    }
+    free(state.word);
+    return result;
+}
+
 /**
  * Print function for string data.
  *
@@ -270,6 +1001,19 @@ void check_free_data(void *data)
     free((char *)data);
 }
 
+/**
+ * Format function for string data, used by the generation server.
+ *
+ * @param data Pointer to string to format
+ * @param buffer Destination buffer
+ * @param size Size of buffer
+ * @return Length of the string (as snprintf)
+ */
+int check_format_func(void *data, char *buffer, size_t size)
+{
+    return snprintf(buffer, size, "%s", (char *)data);
+}
+
 /**
  * Check if a word is a sentence ending (ends with period).
  *
@@ -282,6 +1026,163 @@ bool check_is_last(void *data)
     return (s[strlen(s) - 1] == '.');
 }
 
+/**
+ * Train without holding the transitions in memory.
+ *
+ * The words become states of the chain as usual, but every transition goes
+ * to an ExternalBuilder that spills sorted runs to options->spill_dir, and
+ * the merged runs are written straight to the snapshot at
+ * options->export_path.
+ *
+ * @param files Corpus files
+ * @param markov_chain Chain receiving the states
+ * @param words Intern table indexing the chain's words
+ * @param options Training options
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+int train_out_of_core(const CorpusFiles *files, MarkovChain *markov_chain,
+                      InternTable *words, const TrainOptions *options)
+{
+    ExternalBuilder spill;
+    if (create_external_builder(&spill, options->spill_dir,
+                                options->export_path,
+                                options->spill_budget) == EXIT_FAILURE)
+    {
+        fprintf(stdout, SPILL_PATH_ERROR, options->spill_dir,
+                options->export_path);
+        return EXIT_FAILURE;
+    }
+
+    int result = fill_database(files, markov_chain, words, options, &spill);
+    if (result == EXIT_SUCCESS &&
+        write_external_snapshot(&spill, markov_chain,
+                                check_format_func) == EXIT_FAILURE)
+    {
+        fprintf(stdout, SNAPSHOT_ERROR);
+        result = EXIT_FAILURE;
+    }
+    if (options->stats)
+    {
+        fprintf(stderr, "Out-of-core build: %d run files, %llu records "
+                        "spilled\n", spill.run_count, spill.spilled);
+    }
+    free_external_builder(&spill);
+    return result;
+}
+
+/**
+ * Whether a walk may continue from a row of a mapped snapshot.
+ *
+ * @param matrix Mapped snapshot
+ * @param row Row id
+ * @return true if the row is not a last state and has successors
+ */
+bool snapshot_row_continues(const MatrixFile *matrix, uint32_t row)
+{
+    return !matrix->ends[row] &&
+           matrix->row_offsets[row] < matrix->row_offsets[row + 1];
+}
+
+/**
+ * Print the word of a row of a mapped snapshot, followed by a space.
+ *
+ * @param matrix Mapped snapshot
+ * @param row Row id
+ */
+void print_snapshot_word(const MatrixFile *matrix, uint32_t row)
+{
+    uint64_t start = matrix->label_offsets[row];
+    fprintf(stdout, "%.*s ", (int)(matrix->label_offsets[row + 1] - start),
+            matrix->text + start);
+}
+
+/**
+ * Pick the successor of a row of a mapped snapshot by its counts.
+ *
+ * @param matrix Mapped snapshot
+ * @param row Row id, with successors
+ * @return Row id of the successor
+ */
+uint32_t next_snapshot_row(const MatrixFile *matrix, uint32_t row)
+{
+    uint64_t begin = matrix->row_offsets[row];
+    uint64_t end = matrix->row_offsets[row + 1];
+    uint64_t total = 0;
+    for (uint64_t i = begin; i < end; i++)
+    {
+        total += matrix->counts[i];
+    }
+    uint64_t pick = (uint64_t)rand() % total;
+    uint64_t i = begin;
+    while (pick >= matrix->counts[i])
+    {
+        pick -= matrix->counts[i];
+        i++;
+    }
+    return matrix->columns[i];
+}
+
+/**
+ * Print tweets walking a snapshot mapped with open_matrix_file().
+ *
+ * Follows the rules of the in-memory loop: a random start word that can
+ * continue, then successors by count until a last word, a dead end or
+ * MAX_LEN_OF_TWEET words.
+ *
+ * @param path Snapshot written by out-of-core training
+ * @param max_tweets Number of tweets to print
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE if the snapshot cannot be
+ *         mapped or has no word to start from
+ */
+int print_snapshot_tweets(const char *path, long max_tweets)
+{
+    MatrixFile matrix;
+    if (open_matrix_file(path, &matrix) == EXIT_FAILURE ||
+        matrix.row_offsets == NULL || matrix.counts == NULL ||
+        matrix.text == NULL)
+    {
+        close_matrix_file(&matrix);
+        fprintf(stdout, SNAPSHOT_ERROR);
+        return EXIT_FAILURE;
+    }
+
+    uint32_t rows = (uint32_t)matrix.header->rows;
+    bool can_start = false;
+    for (uint32_t row = 0; row < rows && !can_start; row++)
+    {
+        can_start = snapshot_row_continues(&matrix, row);
+    }
+    if (!can_start)
+    {
+        close_matrix_file(&matrix);
+        fprintf(stdout, EMPTY_CORPUS_ERROR);
+        return EXIT_FAILURE;
+    }
+
+    for (long tweet = LEN_OF_TWEETS; tweet <= max_tweets; tweet++)
+    {
+        fprintf(stdout, "Tweet %ld: ", tweet);
+        uint32_t row;
+        do
+        {
+            row = (uint32_t)(rand() % rows);
+        } while (!snapshot_row_continues(&matrix, row));
+        print_snapshot_word(&matrix, row);
+
+        for (int length = LEN_OF_TWEETS;
+             snapshot_row_continues(&matrix, row) && length < MAX_LEN_OF_TWEET;
+             length++)
+        {
+            row = next_snapshot_row(&matrix, row);
+            print_snapshot_word(&matrix, row);
+        }
+        fprintf(stdout, "\n");
+    }
+
+    close_matrix_file(&matrix);
+    return EXIT_SUCCESS;
+}
+
 /**
  * Main function - Tweet generator using Markov chains.
  *
@@ -289,11 +1190,50 @@ bool check_is_last(void *data)
  * The program learns word patterns from an input file and generates
  * new sentences that follow similar patterns.
  *
- * Usage: ./tweets_generator <seed> <num_tweets> <file_path> [words_to_read]
+ * Usage: ./tweets_generator [options] <seed> <num_tweets> <file_path> [words_to_read]
  *   seed: Random seed for reproducible results
  *   num_tweets: Number of tweets to generate
- *   file_path: Path to input text file
+ *   file_path: Input text file, directory of files, or comma-separated
+ *              list of files and directories
  *   words_to_read: (Optional) Maximum words to read from file
+ *   --min-count=N: (Optional) Drop transitions seen fewer than N times
+ *   --top-k=K: (Optional) Keep only the K most frequent successors per word
+ *   --memory-budget=BYTES: (Optional) Cap the chain structure size
+ *   --heavy-hitters=K: (Optional) Approximate counting, K candidates per word
+ *   --epsilon=E, --delta=D: (Optional) Sketch error bounds
+ *   --max-states=N: (Optional) Cap on distinct words in approximate mode
+ *   --half-life=E: (Optional) Halve the weight of observations every E epochs
+ *   --window=W: (Optional) Count only the last W epochs
+ *   --epoch-words=N: (Optional) Words per epoch (default 10000)
+ *   --stats: (Optional) Print chain statistics to stderr
+ *   --serve=SOCKET: (Optional) Serve generations on a Unix socket instead of
+ *                   printing num_tweets tweets (see generation_server.h)
+ *   --workers=N: (Optional) Generation threads in server mode (default 4)
+ *   --readers=N, --tokenizers=N: (Optional) Threads reading and tokenizing
+ *                   multi-file corpora (default 2 each)
+ *   --io=auto|uring|pread: (Optional) How multi-file corpora are read
+ *   --io-depth=N: (Optional) Reads in flight per reader thread (default 4)
+ *   --max-bytes=N: (Optional) Read at most the first N bytes of the corpus
+ *   --max-seconds=S: (Optional) Stop reading after S seconds
+ *   --boundary=sentence|none: (Optional) Whether a word ending with '.'
+ *                   breaks the chain of transitions (default sentence)
+ *   --batch: (Optional) Generate LOCKSTEP_WALKS tweets at a time; faster on
+ *                   large chains, but gives different tweets for a seed
+ *   --rank=K: (Optional) Before the tweets, print the K words with the
+ *                   highest stationary probability
+ *   --teleport=P: (Optional) Restart probability per step for --rank
+ *   --export=PATH: (Optional) Write the transition matrix to PATH (see
+ *                   matrix_export.h) before generating
+ *   --export-format=csr|coo: (Optional) Matrix layout (default csr)
+ *   --export-values=counts|probabilities: (Optional) Matrix values
+ *                   (default counts)
+ *   --two-phase: (Optional) Buffer word pairs while reading and build every
+ *                   frequency list at its final size afterwards; faster on
+ *                   large corpora, but gives different tweets for a seed
+ *   --spill=DIR: (Optional) Train out of core: spill sorted transition
+ *                   runs to DIR, merge them straight into the --export
+ *                   snapshot and print the tweets from its mapping
+ *   --spill-budget=BYTES: (Optional) Memory for --spill (default 256 MiB)
  *
  * @param args Number of command line arguments
  * @param argv Array of argument strings
@@ -301,8 +1241,11 @@ bool check_is_last(void *data)
  */
 int main(int args, char *argv[])
 {
-    // Validate arguments and file path
-    if (is_right_path(argv[3], args) == EXIT_FAILURE)
+    // Strip optional flags, then validate arguments and file path
+    TrainOptions options;
+    CorpusFiles files;
+    if (parse_options(&args, argv, &options) == EXIT_FAILURE ||
+        is_right_path(argv[3], args, &files) == EXIT_FAILURE)
     {
         return EXIT_FAILURE;
     }
@@ -312,6 +1255,7 @@ int main(int args, char *argv[])
     if (list == NULL)
     {
         fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        free_corpus_files(&files);
         return EXIT_FAILURE;
     }
     list->first = NULL;
@@ -323,6 +1267,8 @@ int main(int args, char *argv[])
     if (markov_chain == NULL)
     {
         fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+        free(list);
+        free_corpus_files(&files);
         return EXIT_FAILURE;
     }
 
@@ -333,39 +1279,142 @@ int main(int args, char *argv[])
     markov_chain->is_last = check_is_last;
     markov_chain->comp_func = check_comp_fun;
     markov_chain->copy_func = check_copy_func;
+    markov_chain->approximate = NULL;
+    markov_chain->decay = NULL;
+    markov_chain->layout = NULL;
+    markov_chain->successors = NULL;
+
+    // Count transitions in a fixed-size sketch and/or decay them if requested
+    if ((options.approx.heavy_hitters > 0 &&
+         enable_approximate_counts(markov_chain, &options.approx) == EXIT_FAILURE) ||
+        ((options.decay.half_life > 0 || options.decay.window > 0) &&
+         enable_decay(markov_chain, &options.decay) == EXIT_FAILURE))
+    {
+        free_markov_chain(&markov_chain);
+        free_corpus_files(&files);
+        return EXIT_FAILURE;
+    }
 
     // Set random seed from command line argument
     long seed = strtol(argv[1], NULL, BASE_TEN);
     srand(seed);
 
-    // Open input file
-    FILE *input_file = fopen(argv[3], "r");
-    int make_the_chain = EXIT_FAILURE;
+    // Index of the chain's words, used only while reading the corpus
+    InternTable *words = create_intern_table();
+    if (words == NULL)
+    {
+        free_markov_chain(&markov_chain);
+        free_corpus_files(&files);
+        return EXIT_FAILURE;
+    }
 
-    // Build database - with or without word limit
     if (args == MAX_NUM_ARGS)
     {
         // Word limit specified
-        long long_value = strtol(argv[4], NULL, BASE_TEN);
-        make_the_chain = fill_database(input_file, long_value, markov_chain);
+        options.limits.words = strtol(argv[4], NULL, BASE_TEN);
     }
-    else
+
+    // Build database
+    MARKOV_STATS_PHASE("train");
+    if (options.spill_dir != NULL)
     {
-        // No word limit - read entire file
-        make_the_chain = fill_without_limit(input_file, markov_chain);
+        // Out-of-core training writes the snapshot, tweets come from its map
+        int trained = train_out_of_core(&files, markov_chain, words, &options);
+        free_intern_table(&words);
+        free_markov_chain(&markov_chain);
+        free_corpus_files(&files);
+        return (trained == EXIT_FAILURE) ? EXIT_FAILURE :
+               print_snapshot_tweets(options.export_path,
+                                     strtol(argv[2], NULL, BASE_TEN));
     }
+    int make_the_chain = fill_database(&files, markov_chain, words, &options,
+                                       NULL);
+    free_intern_table(&words);
 
     if (make_the_chain == EXIT_FAILURE)
     {
+        free_markov_chain(&markov_chain);
+        free_corpus_files(&files);
+        return EXIT_FAILURE;
+    }
+    if (!has_start_node(markov_chain))
+    {
+        // A byte or time limit (or a tiny corpus) left nothing to sample
+        fprintf(stdout, EMPTY_CORPUS_ERROR);
+        free_markov_chain(&markov_chain);
+        free_corpus_files(&files);
         return EXIT_FAILURE;
     }
 
+    // Apply the pruning policy to the final chain and report the savings
+    MARKOV_STATS_PHASE("prune");
+    PruneConfig *prune = &options.prune;
+    if (prune->min_count > 0 || prune->top_k > 0 || prune->memory_budget > 0)
+    {
+        PruneReport report;
+        if (prune_markov_chain(markov_chain, prune, &report) == EXIT_FAILURE)
+        {
+            free_markov_chain(&markov_chain);
+            free_corpus_files(&files);
+            return EXIT_FAILURE;
+        }
+        fprintf(stderr, "Pruned %ld transitions (mass %ld) and %ld states, "
+                        "saved %zu bytes\n",
+                report.transitions_removed, report.mass_removed,
+                report.states_removed, report.bytes_before - report.bytes_after);
+    }
+
+    // Training is done - order successors by frequency for faster sampling
+    MARKOV_STATS_PHASE("freeze");
+    freeze_markov_chain(markov_chain);
+
     // Get number of tweets to generate from command line
     long max_tweets = strtol(argv[2], NULL, BASE_TEN);
     int num_tweets = LEN_OF_TWEETS;
+    int result = EXIT_SUCCESS;
+
+    // Rank words by long-run visits before generating
+    MARKOV_STATS_PHASE("rank");
+    if (options.rank > 0 &&
+        print_top_words(markov_chain, options.rank, options.teleport) ==
+        EXIT_FAILURE)
+    {
+        free_markov_chain(&markov_chain);
+        free_corpus_files(&files);
+        return EXIT_FAILURE;
+    }
+
+    // Hand the learned transitions to external tools
+    MARKOV_STATS_PHASE("export");
+    if (options.export_path != NULL &&
+        export_transition_matrix(markov_chain, options.export_path,
+                                 options.export_layout, options.export_values,
+                                 check_format_func) == EXIT_FAILURE)
+    {
+        fprintf(stdout, EXPORT_ERROR);
+        free_markov_chain(&markov_chain);
+        free_corpus_files(&files);
+        return EXIT_FAILURE;
+    }
+
+    MARKOV_STATS_PHASE("generate");
+    if (options.serve_path != NULL)
+    {
+        // Keep the trained chain in memory and answer socket requests
+        ServerConfig server_config = {options.serve_path, options.workers,
+                                      SERVER_BATCH, SERVER_MAX_COUNT,
+                                      SERVER_MAX_LENGTH, check_format_func};
+        result = run_generation_server(markov_chain, &server_config);
+    }
+    else if (options.batch)
+    {
+        result = print_tweets_batched(markov_chain, max_tweets,
+                                      (unsigned long long)seed);
+    }
 
     // Generate and print tweets
-    while (num_tweets <= max_tweets)
+    while (options.serve_path == NULL && !options.batch &&
+           num_tweets <= max_tweets)
     {
         fprintf(stdout, "Tweet %d: ", num_tweets);
 
@@ -380,9 +1429,14 @@ int main(int args, char *argv[])
         fprintf(stdout, "\n");
     }
 
+    if (options.stats)
+    {
+        markov_chain_stats(markov_chain, stderr);
+    }
+
     // Clean up and free all allocated memory
     free_markov_chain(&markov_chain);
-    fclose(input_file);
+    free_corpus_files(&files);
 
-    return EXIT_SUCCESS;
+    return result;
 }
\ No newline at end of file
@@ -0,0 +1,318 @@
+#define _POSIX_C_SOURCE 200809L // For clock_gettime()
+#include "markov_chain.h"
+#include <string.h>
+#include <time.h>
+
+/***************************/
+/*   CONSTANT DEFINITIONS  */
+/***************************/
+
+#define MIN_ARGS 3                 // Program, states, walks
+#define MAX_ARGS 4                 // Optional successors per state
+#define DEFAULT_SUCCESSORS 8       // Transitions drawn per state
+#define TERMINAL_EVERY 20          // Every 20th state ends a walk
+#define MAX_WALK_LENGTH 20         // Same cap as a tweet
+#define SKEW_POWER 4               // Successor ids follow u^4: a few hot states
+#define SCATTER_MULTIPLIER 2654435761UL  // Spreads hot ids over the id range
+#define BUILD_SEED 5
+#define WALK_SEED 1
+#define NANOS_PER_SECOND 1e9
+#define STATES_PER_MILLION 1e6
+#define BASE 10
+#define USAGE_ERROR "Usage: walk_bench <states> <walks> [successors]\n"
+
+/***************************/
+/*   STRUCTURE DEFINITIONS */
+/***************************/
+
+/**
+ * Layout structure.
+ * One storage configuration to measure.
+ */
+typedef struct Layout {
+    const char *name;     // Row label
+    bool freeze;          // Pack the chain before walking
+    PageBacking backing;  // Memory for the packed arrays
+} Layout;
+
+static const Layout LAYOUTS[] = {
+    {"unpacked", false, PAGE_BACKING_MALLOC},
+    {"packed", true, PAGE_BACKING_MALLOC},
+    {"packed", true, PAGE_BACKING_TRANSPARENT},
+    {"packed", true, PAGE_BACKING_HUGETLB},
+};
+
+/***************************/
+/*   HELPER FUNCTIONS      */
+/***************************/
+
+/**
+ * Current monotonic time.
+ *
+ * @return Seconds since an arbitrary fixed point
+ */
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / NANOS_PER_SECOND;
+}
+
+/**
+ * Compare two state ids.
+ *
+ * @param first Pointer to the first id
+ * @param second Pointer to the second id
+ * @return Negative, zero or positive like strcmp
+ */
+static int compare_ids(void *first, void *second)
+{
+    int a = *(int *)first;
+    int b = *(int *)second;
+    return (a > b) - (a < b);
+}
+
+/**
+ * Copy a state id to the heap.
+ *
+ * @param data Pointer to the id
+ * @return Newly allocated copy, or NULL on allocation failure
+ */
+static void *copy_id(void *data)
+{
+    int *copy = malloc(sizeof(int));
+    if (copy != NULL)
+    {
+        *copy = *(int *)data;
+    }
+    return copy;
+}
+
+/**
+ * Check whether a state ends a walk.
+ *
+ * @param data Pointer to the id
+ * @return true for every TERMINAL_EVERY-th state
+ */
+static bool is_terminal(void *data)
+{
+    return *(int *)data % TERMINAL_EVERY == 0;
+}
+
+/**
+ * Print a state id (unused by the benchmark, required by MarkovChain).
+ *
+ * @param data Pointer to the id
+ */
+static void print_id(void *data)
+{
+    printf("%d ", *(int *)data);
+}
+
+/**
+ * Free and unlink everything built so far, reporting an allocation error.
+ *
+ * @param markov_chain Partly built chain
+ * @param nodes Scratch array of node pointers
+ * @return NULL
+ */
+static MarkovChain *abandon_chain(MarkovChain *markov_chain, MarkovNode **nodes)
+{
+    fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+    free(nodes);
+    free_markov_chain(&markov_chain);
+    return NULL;
+}
+
+/**
+ * Build a synthetic chain whose transitions favour a few hot states.
+ *
+ * Successor ids are drawn as states * u^SKEW_POWER for uniform u and then
+ * scattered with a multiplicative hash, so the hot states are spread over
+ * the insertion order the way frequent words are in a real corpus.
+ *
+ * @param states Number of states
+ * @param successors Transitions drawn per state
+ * @return The chain, or NULL on allocation failure
+ */
+static MarkovChain *build_chain(int states, int successors)
+{
+    MarkovChain *markov_chain = calloc(1, sizeof(MarkovChain));
+    MarkovNode **nodes = malloc(states * sizeof(MarkovNode *));
+    if (markov_chain == NULL || nodes == NULL ||
+        (markov_chain->database = calloc(1, sizeof(LinkedList))) == NULL)
+    {
+        return abandon_chain(markov_chain, nodes);
+    }
+    markov_chain->copy_func = copy_id;
+    markov_chain->comp_func = compare_ids;
+    markov_chain->free_data = free;
+    markov_chain->is_last = is_terminal;
+    markov_chain->print_func = print_id;
+
+    for (int id = 0; id < states; id++)
+    {
+        Node *node = add_to_database(markov_chain, &id);
+        if (node == NULL)
+        {
+            return abandon_chain(markov_chain, nodes);
+        }
+        nodes[id] = node->data;
+    }
+
+    random_state_t state;
+    seed_random_state(&state, BUILD_SEED);
+    for (int id = 0; id < states; id++)
+    {
+        for (int k = 0; k < successors; k++)
+        {
+            double u = get_random_number_r(states, &state) / (double)states;
+            double skewed = u;
+            for (int power = 1; power < SKEW_POWER; power++)
+            {
+                skewed *= u;
+            }
+            unsigned long next = (unsigned long)(skewed * states) *
+                                 SCATTER_MULTIPLIER % (unsigned long)states;
+            if (add_node_to_frequency_list(nodes[id], nodes[next],
+                                           markov_chain) != EXIT_SUCCESS)
+            {
+                return abandon_chain(markov_chain, nodes);
+            }
+        }
+    }
+
+    free(nodes);
+    return markov_chain;
+}
+
+/**
+ * Walk the chain one sequence at a time and in lockstep batches.
+ *
+ * @param markov_chain Chain to walk
+ * @param walks Number of walks per mode
+ * @param single Receives single-walk throughput (M states/s)
+ * @param batched Receives lockstep throughput (M states/s)
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on allocation error
+ */
+static int measure_walks(MarkovChain *markov_chain, long walks, double *single,
+                         double *batched)
+{
+    StartIndex starts;
+    if (build_start_index(markov_chain, &starts) == EXIT_FAILURE ||
+        starts.count == 0)
+    {
+        free_start_index(&starts);
+        return EXIT_FAILURE;
+    }
+
+    MarkovNode *firsts[LOCKSTEP_WALKS];
+    MarkovNode *out[LOCKSTEP_WALKS * MAX_WALK_LENGTH];
+    int lengths[LOCKSTEP_WALKS];
+    random_state_t state;
+    long visited = 0;
+
+    seed_random_state(&state, WALK_SEED);
+    double start = now_seconds();
+    for (long walk = 0; walk < walks; walk++)
+    {
+        sample_start_nodes(&starts, 1, firsts, &state);
+        visited += generate_sequence_r(markov_chain, firsts[0], MAX_WALK_LENGTH,
+                                       out, &state);
+    }
+    *single = visited / (now_seconds() - start) / STATES_PER_MILLION;
+
+    visited = 0;
+    seed_random_state(&state, WALK_SEED);
+    start = now_seconds();
+    for (long walk = 0; walk < walks; walk += LOCKSTEP_WALKS)
+    {
+        sample_start_nodes(&starts, LOCKSTEP_WALKS, firsts, &state);
+        generate_sequences_batch(markov_chain, firsts, LOCKSTEP_WALKS,
+                                 MAX_WALK_LENGTH, out, lengths, &state);
+        for (int i = 0; i < LOCKSTEP_WALKS; i++)
+        {
+            visited += lengths[i];
+        }
+    }
+    *batched = visited / (now_seconds() - start) / STATES_PER_MILLION;
+
+    free_start_index(&starts);
+    return EXIT_SUCCESS;
+}
+
+/***************************/
+/*   MAIN FUNCTION         */
+/***************************/
+
+/**
+ * Measure random walk throughput for each storage layout of a chain.
+ *
+ * Builds the same synthetic chain once per layout: left as trained
+ * (separately allocated nodes), or frozen into packed arrays on ordinary,
+ * transparent huge or explicit huge pages. A layout whose pages are not
+ * available reports the backing it fell back to. Use a state count whose
+ * chain (see the bytes column) exceeds the last-level cache.
+ *
+ * Usage: walk_bench <states> <walks> [successors]
+ *
+ * @param argc Number of command line arguments
+ * @param argv Array of argument strings
+ * @return EXIT_SUCCESS on success, EXIT_FAILURE on error
+ */
+int main(int argc, char *argv[])
+{
+    if (argc < MIN_ARGS || argc > MAX_ARGS)
+    {
+        fprintf(stdout, USAGE_ERROR);
+        return EXIT_FAILURE;
+    }
+
+    int states = (int)strtol(argv[1], NULL, BASE);
+    long walks = strtol(argv[2], NULL, BASE);
+    int successors = (argc == MAX_ARGS) ? (int)strtol(argv[3], NULL, BASE)
+                                        : DEFAULT_SUCCESSORS;
+    if (states <= TERMINAL_EVERY || walks <= 0 || successors <= 0)
+    {
+        fprintf(stdout, USAGE_ERROR);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(stdout, "%-9s %-17s %14s %16s %16s\n", "layout", "pages",
+            "bytes", "single(Mst/s)", "lockstep(Mst/s)");
+    for (size_t i = 0; i < sizeof(LAYOUTS) / sizeof(LAYOUTS[0]); i++)
+    {
+        const Layout *layout = &LAYOUTS[i];
+        MarkovChain *markov_chain = build_chain(states, successors);
+        if (markov_chain == NULL)
+        {
+            return EXIT_FAILURE;
+        }
+
+        const char *pages = "heap";
+        if (layout->freeze)
+        {
+            freeze_markov_chain_backed(markov_chain, layout->backing);
+            if (markov_chain->layout != NULL)
+            {
+                pages = page_backing_name(markov_chain->layout->backing);
+            }
+        }
+
+        double single;
+        double batched;
+        if (measure_walks(markov_chain, walks, &single, &batched) ==
+            EXIT_FAILURE)
+        {
+            fprintf(stdout, ALLOCATION_ERROR_MASSAGE);
+            free_markov_chain(&markov_chain);
+            return EXIT_FAILURE;
+        }
+        fprintf(stdout, "%-9s %-17s %14zu %16.2f %16.2f\n", layout->name,
+                pages, markov_chain_memory_usage(markov_chain), single,
+                batched);
+        fflush(stdout);
+        free_markov_chain(&markov_chain);
+    }
+    return EXIT_SUCCESS;
+}